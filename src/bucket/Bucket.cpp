@@ -6,6 +6,7 @@
 #include "bucket/BucketManager.h"
 #include "bucket/BucketOutputIterator.h"
 #include "bucket/LedgerCmp.h"
+#include "bucket/MergeCheckpoint.h"
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
 #include "crypto/SHA.h"
@@ -17,8 +18,12 @@
 #include "util/Logging.h"
 #include "util/TmpDir.h"
 #include "util/XDRStream.h"
+#include "xdrpp/marshal.h"
 #include "xdrpp/message.h"
+#include <algorithm>
 #include <cassert>
+#include <exception>
+#include <fstream>
 #include <future>
 
 namespace viichain
@@ -32,7 +37,8 @@ Bucket::Bucket(std::string const& filename, Hash const& hash)
     {
         CLOG(TRACE, "Bucket")
             << "Bucket::Bucket() created, file exists : " << mFilename;
-        mSize = fs::size(filename);
+        mCompressed = BlockCompressedReader::isCompressed(filename);
+        mSize = BlockCompressedReader::contentSize(filename);
     }
 }
 
@@ -58,9 +64,151 @@ Bucket::getSize() const
     return mSize;
 }
 
+bool
+Bucket::isCompressed() const
+{
+    return mCompressed;
+}
+
+void
+Bucket::setIndex(std::unique_ptr<BucketIndex const>&& index)
+{
+    assert(!mIndex);
+    mIndex = std::move(index);
+}
+
+bool
+Bucket::isIndexed() const
+{
+    return static_cast<bool>(mIndex);
+}
+
+BucketIndex const&
+Bucket::getIndex() const
+{
+    assert(mIndex);
+    return *mIndex;
+}
+
+void
+Bucket::setBloomFilter(std::unique_ptr<BucketBloomFilter const>&& filter)
+{
+    assert(!mBloomFilter);
+    mBloomFilter = std::move(filter);
+}
+
+bool
+Bucket::hasBloomFilter() const
+{
+    return static_cast<bool>(mBloomFilter);
+}
+
+BucketBloomFilter const&
+Bucket::getBloomFilter() const
+{
+    assert(mBloomFilter);
+    return *mBloomFilter;
+}
+
+void
+Bucket::setStats(std::unique_ptr<BucketStats const>&& stats)
+{
+    assert(!mStats);
+    mStats = std::move(stats);
+}
+
+bool
+Bucket::hasStats() const
+{
+    return static_cast<bool>(mStats);
+}
+
+BucketStats const&
+Bucket::getStats() const
+{
+    assert(mStats);
+    return *mStats;
+}
+
+void
+Bucket::setMapping(std::shared_ptr<MappedFile const> mapping)
+{
+    mMapping = mapping;
+}
+
+std::shared_ptr<MappedFile const>
+Bucket::getMapping() const
+{
+    return mMapping;
+}
+
+template <typename Stream>
+static optional<BucketEntry>
+scanForEntry(Stream& in, LedgerKey const& key)
+{
+    LedgerEntryIdCmp cmp;
+    BucketEntry be;
+    while (in.readOne(be))
+    {
+        if (be.type() == METAENTRY)
+        {
+            continue;
+        }
+        auto entryKey = BucketIndex::getBucketLedgerKey(be);
+        if (cmp(key, entryKey))
+        {
+            break;
+        }
+        if (!cmp(entryKey, key))
+        {
+            return make_optional<BucketEntry>(be);
+        }
+    }
+    return nullopt<BucketEntry>();
+}
+
+optional<BucketEntry>
+Bucket::getBucketEntry(LedgerKey const& key) const
+{
+    if (mFilename.empty() || (mBloomFilter && !mBloomFilter->mayContain(key)))
+    {
+        return nullopt<BucketEntry>();
+    }
+
+    uint64_t pos = 0;
+    if (mIndex && !mIndex->lookup(key, pos))
+    {
+        return nullopt<BucketEntry>();
+    }
+
+    if (mMapping)
+    {
+        XDRBufferedInputFileStream in;
+        in.open(mMapping);
+        in.seek(pos);
+        return scanForEntry(in, key);
+    }
+
+    std::lock_guard<std::mutex> lock(mIndexStreamMutex);
+    if (!mIndexStream)
+    {
+        mIndexStream = std::make_unique<XDRBufferedInputFileStream>(
+            0, XDRBufferedInputFileStream::kBlockAlignment);
+        mIndexStream->open(mFilename);
+    }
+    mIndexStream->seek(pos);
+    return scanForEntry(*mIndexStream, key);
+}
+
 bool
 Bucket::containsBucketIdentity(BucketEntry const& id) const
 {
+    if (mBloomFilter && id.type() != METAENTRY &&
+        !mBloomFilter->mayContain(BucketIndex::getBucketLedgerKey(id)))
+    {
+        return false;
+    }
+
     BucketEntryIdCmp cmp;
     BucketInputIterator iter(shared_from_this());
     while (iter)
@@ -141,7 +289,10 @@ Bucket::fresh(BucketManager& bucketManager, uint32_t protocolVersion,
         convertToBucketEntry(useInit, initEntries, liveEntries, deadEntries);
 
     MergeCounters mc;
-    BucketOutputIterator out(bucketManager.getTmpDir(), true, meta, mc);
+    BucketOutputIterator out(bucketManager.getTmpDir(), true, meta, mc,
+                             bucketManager.makeBucketIndexBuilder(),
+                             bucketManager.makeBucketBloomFilterBuilder(),
+                             bucketManager.compressBucketFiles());
     for (auto const& e : entries)
     {
         out.put(e);
@@ -384,6 +535,325 @@ mergeCasesWithEqualKeys(MergeCounters& mc, BucketInputIterator& oi,
     ++ni;
 }
 
+static void
+checkpointMerge(MergeCheckpointer& checkpointer, BucketInputIterator const& oi,
+                BucketInputIterator const& ni,
+                std::vector<BucketInputIterator> const& shadowIterators,
+                BucketOutputIterator& out)
+{
+    MergeCheckpoint cp;
+    cp.mInputOffsets.emplace_back(oi.getEntryOffset());
+    cp.mInputOffsets.emplace_back(ni.getEntryOffset());
+    for (auto const& si : shadowIterators)
+    {
+        cp.mInputOffsets.emplace_back(si.getEntryOffset());
+    }
+    out.checkpoint(cp);
+    checkpointer.save(cp);
+}
+
+static void
+mergeInputs(MergeCounters& mc, BucketInputIterator& oi,
+            BucketInputIterator& ni, BucketOutputIterator& out,
+            std::vector<BucketInputIterator>& shadowIterators,
+            uint32_t protocolVersion, bool keepShadowedLifecycleEntries,
+            MergeCheckpointer* checkpointer = nullptr)
+{
+    BucketEntryIdCmp cmp;
+    while (oi || ni)
+    {
+        if (checkpointer && checkpointer->isDue(out.getBytesPut()))
+        {
+            checkpointMerge(*checkpointer, oi, ni, shadowIterators, out);
+        }
+        if (!mergeCasesWithDefaultAcceptance(cmp, mc, oi, ni, out,
+                                             shadowIterators, protocolVersion,
+                                             keepShadowedLifecycleEntries))
+        {
+            mergeCasesWithEqualKeys(mc, oi, ni, out, shadowIterators,
+                                    protocolVersion,
+                                    keepShadowedLifecycleEntries);
+        }
+    }
+}
+
+namespace
+{
+size_t const kMergeCopyBufferSize = 1024 * 1024;
+
+struct MergePartition
+{
+    std::string mFilename;
+    size_t mObjects{0};
+    size_t mBytes{0};
+    MergeCounters mCounters;
+    std::unique_ptr<BucketStats> mStats;
+    std::unique_ptr<BucketIndex::Builder> mIndexBuilder;
+    std::unique_ptr<BucketBloomFilter::Builder> mBloomFilterBuilder;
+};
+
+// Bound that BucketEntryIdCmp orders with the entries for key.
+BucketEntry
+keyBound(LedgerKey const& key)
+{
+    BucketEntry e;
+    e.type(DEADENTRY);
+    e.deadEntry() = key;
+    return e;
+}
+
+// Offset from which a scan finds every entry at or after bound, or 0 if it
+// has to start at the beginning of the bucket.
+size_t
+seekOffset(std::shared_ptr<Bucket> const& b, BucketEntry const& bound)
+{
+    if (!b->isIndexed())
+    {
+        return 0;
+    }
+    return b->getIndex().seekOffset(BucketIndex::getBucketLedgerKey(bound));
+}
+
+MergePartition
+mergePartition(std::string const& tmpDir,
+               std::vector<std::shared_ptr<Bucket>> const& inputs,
+               std::vector<size_t> const& offsets,
+               optional<BucketEntry> lowerBound,
+               optional<BucketEntry> upperBound, BucketMetadata const& meta,
+               bool keepDeadEntries, bool keepShadowedLifecycleEntries,
+               std::unique_ptr<BucketIndex::Builder> indexBuilder,
+               std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder)
+{
+    MergePartition res;
+    BucketInputIterator oi(inputs[0]);
+    BucketInputIterator ni(inputs[1]);
+    std::vector<BucketInputIterator> shadowIterators(inputs.begin() + 2,
+                                                     inputs.end());
+    oi.seekToRange(offsets[0], lowerBound, upperBound);
+    ni.seekToRange(offsets[1], lowerBound, upperBound);
+    for (size_t i = 0; i < shadowIterators.size(); ++i)
+    {
+        shadowIterators[i].seekToRange(offsets[i + 2], lowerBound,
+                                       upperBound);
+    }
+
+    auto out = BucketOutputIterator::forMergePartition(
+        tmpDir, keepDeadEntries, meta, res.mCounters, !lowerBound,
+        std::move(indexBuilder), std::move(bloomFilterBuilder));
+    try
+    {
+        mergeInputs(res.mCounters, oi, ni, *out, shadowIterators,
+                    meta.ledgerVersion, keepShadowedLifecycleEntries);
+        res.mFilename = out->finishPartition();
+    }
+    catch (std::exception const&)
+    {
+        out->discard();
+        throw;
+    }
+    res.mObjects = out->getObjectsPut();
+    res.mBytes = out->getBytesPut();
+    res.mStats = out->releaseStats();
+    res.mIndexBuilder = out->releaseIndexBuilder();
+    res.mBloomFilterBuilder = out->releaseBloomFilterBuilder();
+    return res;
+}
+
+// Appends the partitions to the first one, hashing the result in order, and
+// adopts it as the merged bucket. The partitions' index and bloom filter
+// builders are combined into indexBuilder and bloomFilterBuilder, if set, so
+// the merged bucket is not scanned again.
+std::shared_ptr<Bucket>
+adoptMergePartitions(
+    BucketManager& bucketManager, std::vector<MergePartition>& parts,
+    std::unique_ptr<BucketIndex::Builder> indexBuilder,
+    std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder)
+{
+    size_t nObjects = 0;
+    size_t nBytes = 0;
+    for (auto const& part : parts)
+    {
+        nObjects += part.mObjects;
+        nBytes += part.mBytes;
+    }
+    if (nObjects == 0 || nBytes == 0)
+    {
+        for (auto const& part : parts)
+        {
+            std::remove(part.mFilename.c_str());
+        }
+        return std::make_shared<Bucket>();
+    }
+
+    auto stats = std::make_unique<BucketStats>();
+    size_t offset = 0;
+    for (auto& part : parts)
+    {
+        stats->append(*part.mStats);
+        if (indexBuilder)
+        {
+            indexBuilder->append(*part.mIndexBuilder->finish(), offset);
+        }
+        if (bloomFilterBuilder)
+        {
+            bloomFilterBuilder->append(*part.mBloomFilterBuilder);
+        }
+        offset += part.mBytes;
+    }
+
+    auto hasher = SHA256::create();
+    std::vector<char> buf(kMergeCopyBufferSize);
+    auto hashFile = [&](std::string const& filename, std::ofstream* out) {
+        std::ifstream in(filename, std::ifstream::binary);
+        if (!in)
+        {
+            throw std::runtime_error(
+                fmt::format("failed to open merge output {}", filename));
+        }
+        while (in.read(buf.data(), buf.size()) || in.gcount() > 0)
+        {
+            auto n = static_cast<size_t>(in.gcount());
+            hasher->add(ByteSlice(buf.data(), n));
+            if (out)
+            {
+                out->write(buf.data(), n);
+            }
+        }
+    };
+
+    auto const& filename = parts.front().mFilename;
+    hashFile(filename, nullptr);
+    {
+        std::ofstream out;
+        out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        out.open(filename, std::ofstream::binary | std::ofstream::app);
+        for (size_t i = 1; i < parts.size(); ++i)
+        {
+            hashFile(parts[i].mFilename, &out);
+            std::remove(parts[i].mFilename.c_str());
+        }
+        out.close();
+    }
+    return bucketManager.adoptFileAsBucket(
+        filename, hasher->finish(), nObjects, nBytes,
+        indexBuilder ? indexBuilder->finish() : nullptr,
+        bloomFilterBuilder ? bloomFilterBuilder->finish() : nullptr,
+        std::move(stats));
+}
+}
+
+// Splits the key space at keys taken from the index of the largest input and
+// merges each range on its own thread, seeking every input to the start of
+// its range through its index. The ranges are concatenated in key order, so
+// the result is byte-for-byte the bucket a sequential merge would produce.
+// Returns nullptr if the inputs are not indexed or don't yield enough
+// distinct split keys.
+static std::shared_ptr<Bucket>
+parallelMerge(BucketManager& bucketManager, uint32_t nPartitions,
+              std::vector<std::shared_ptr<Bucket>> const& inputs,
+              BucketMetadata const& meta, bool keepDeadEntries,
+              bool keepShadowedLifecycleEntries, MergeCounters& mc)
+{
+    if (!inputs[0]->isIndexed() || !inputs[1]->isIndexed())
+    {
+        return nullptr;
+    }
+    size_t largest = inputs[0]->getSize() >= inputs[1]->getSize() ? 0 : 1;
+    auto const& index = inputs[largest]->getIndex();
+    if (index.size() == 0)
+    {
+        return nullptr;
+    }
+
+    BucketEntryIdCmp cmp;
+    std::vector<BucketEntry> splits;
+    for (size_t i = 1; i < nPartitions; ++i)
+    {
+        auto e = keyBound(index.getKey(i * index.size() / nPartitions));
+        if (splits.empty() || cmp(splits.back(), e))
+        {
+            splits.emplace_back(std::move(e));
+        }
+    }
+    if (splits.empty())
+    {
+        return nullptr;
+    }
+
+    CLOG(DEBUG, "Bucket") << "Merging in " << (splits.size() + 1)
+                          << " partitions";
+    auto const& tmpDir = bucketManager.getTmpDir();
+    auto indexBuilder = bucketManager.makeBucketIndexBuilder();
+    auto bloomFilterBuilder = bucketManager.makeBucketBloomFilterBuilder();
+    std::vector<std::future<MergePartition>> futures;
+    for (size_t p = 0; p <= splits.size(); ++p)
+    {
+        optional<BucketEntry> lower = nullopt<BucketEntry>();
+        optional<BucketEntry> upper = nullopt<BucketEntry>();
+        std::vector<size_t> offsets(inputs.size(), 0);
+        if (p > 0)
+        {
+            lower = make_optional<BucketEntry>(splits[p - 1]);
+            for (size_t i = 0; i < inputs.size(); ++i)
+            {
+                offsets[i] = seekOffset(inputs[i], *lower);
+            }
+        }
+        if (p < splits.size())
+        {
+            upper = make_optional<BucketEntry>(splits[p]);
+        }
+        std::unique_ptr<BucketBloomFilter::Builder> partFilterBuilder;
+        if (bloomFilterBuilder)
+        {
+            partFilterBuilder = bloomFilterBuilder->makePartBuilder();
+        }
+        futures.emplace_back(std::async(
+            std::launch::async, mergePartition, tmpDir, inputs, offsets,
+            lower, upper, meta, keepDeadEntries, keepShadowedLifecycleEntries,
+            bucketManager.makeBucketIndexBuilder(),
+            std::move(partFilterBuilder)));
+    }
+
+    // Every partition is waited for, even after one fails, so that the
+    // outputs of all the others are known and can be removed.
+    std::vector<MergePartition> parts;
+    std::exception_ptr failure;
+    for (auto& f : futures)
+    {
+        try
+        {
+            parts.emplace_back(f.get());
+            mc += parts.back().mCounters;
+        }
+        catch (std::exception const&)
+        {
+            if (!failure)
+            {
+                failure = std::current_exception();
+            }
+        }
+    }
+    try
+    {
+        if (failure)
+        {
+            std::rethrow_exception(failure);
+        }
+        return adoptMergePartitions(bucketManager, parts,
+                                    std::move(indexBuilder),
+                                    std::move(bloomFilterBuilder));
+    }
+    catch (std::exception const&)
+    {
+        for (auto const& part : parts)
+        {
+            std::remove(part.mFilename.c_str());
+        }
+        throw;
+    }
+}
+
 std::shared_ptr<Bucket>
 Bucket::merge(BucketManager& bucketManager, uint32_t maxProtocolVersion,
               std::shared_ptr<Bucket> const& oldBucket,
@@ -410,25 +880,98 @@ Bucket::merge(BucketManager& bucketManager, uint32_t maxProtocolVersion,
     auto timer = bucketManager.getMergeTimer().TimeScope();
     BucketMetadata meta;
     meta.ledgerVersion = protocolVersion;
-    BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries, meta,
-                             mc);
 
-    BucketEntryIdCmp cmp;
-    while (oi || ni)
+    auto nPartitions = bucketManager.getMergePartitionCount(
+        oldBucket->getSize() + newBucket->getSize());
+    if (nPartitions > 1)
     {
-        if (!mergeCasesWithDefaultAcceptance(cmp, mc, oi, ni, out,
-                                             shadowIterators, protocolVersion,
-                                             keepShadowedLifecycleEntries))
+        std::vector<std::shared_ptr<Bucket>> inputs{oldBucket, newBucket};
+        inputs.insert(inputs.end(), shadows.begin(), shadows.end());
+        auto b = parallelMerge(bucketManager, nPartitions, inputs, meta,
+                               keepDeadEntries, keepShadowedLifecycleEntries,
+                               mc);
+        if (b)
         {
-            mergeCasesWithEqualKeys(mc, oi, ni, out, shadowIterators,
-                                    protocolVersion,
-                                    keepShadowedLifecycleEntries);
+            if (countMergeEvents)
+            {
+                bucketManager.incrMergeCounters(mc);
+            }
+            return b;
+        }
+    }
+
+    // Long merges are checkpointed so that they resume after a restart. Their
+    // output is written to the merge dir and indexed once it is adopted.
+    std::vector<Hash> inputHashes{oldBucket->getHash(), newBucket->getHash()};
+    for (auto const& s : shadows)
+    {
+        inputHashes.emplace_back(s->getHash());
+    }
+    auto checkpointer = bucketManager.makeMergeCheckpointer(
+        mergeKey(maxProtocolVersion, oldBucket, newBucket, shadows,
+                 keepDeadEntries),
+        oldBucket->getSize() + newBucket->getSize());
+
+    std::unique_ptr<BucketOutputIterator> out;
+    if (checkpointer)
+    {
+        auto cp = checkpointer->resume(inputHashes);
+        if (cp)
+        {
+            ++mc.mResumedMerges;
+            oi.seekToRange(cp->mInputOffsets[0], nullptr, nullptr);
+            ni.seekToRange(cp->mInputOffsets[1], nullptr, nullptr);
+            for (size_t i = 0; i < shadowIterators.size(); ++i)
+            {
+                shadowIterators[i].seekToRange(cp->mInputOffsets[i + 2],
+                                               nullptr, nullptr);
+            }
         }
+        out = BucketOutputIterator::forCheckpointedMerge(
+            checkpointer->getOutputFilename(), keepDeadEntries, meta, mc,
+            cp.get());
     }
+    else
+    {
+        out = std::make_unique<BucketOutputIterator>(
+            bucketManager.getTmpDir(), keepDeadEntries, meta, mc,
+            bucketManager.makeBucketIndexBuilder(),
+            bucketManager.makeBucketBloomFilterBuilder(),
+            bucketManager.compressBucketFiles());
+    }
+
+    mergeInputs(mc, oi, ni, *out, shadowIterators, protocolVersion,
+                keepShadowedLifecycleEntries, checkpointer.get());
     if (countMergeEvents)
     {
         bucketManager.incrMergeCounters(mc);
     }
-    return out.getBucket(bucketManager);
+    auto b = out->getBucket(bucketManager);
+    if (checkpointer)
+    {
+        checkpointer->finish();
+    }
+    return b;
+}
+
+Hash
+Bucket::mergeKey(uint32_t maxProtocolVersion,
+                 std::shared_ptr<Bucket> const& oldBucket,
+                 std::shared_ptr<Bucket> const& newBucket,
+                 std::vector<std::shared_ptr<Bucket>> const& shadows,
+                 bool keepDeadEntries)
+{
+    auto hasher = SHA256::create();
+    hasher->add(oldBucket->getHash());
+    hasher->add(newBucket->getHash());
+    for (auto const& s : shadows)
+    {
+        hasher->add(s->getHash());
+    }
+    xdr::xvector<uint32_t> params{maxProtocolVersion,
+                                  static_cast<uint32_t>(keepDeadEntries),
+                                  static_cast<uint32_t>(shadows.size())};
+    hasher->add(xdr::xdr_to_opaque(params));
+    return hasher->finish();
 }
 }
@@ -1,11 +1,17 @@
 #pragma once
 
 
+#include "bucket/BucketBloomFilter.h"
+#include "bucket/BucketIndex.h"
+#include "bucket/BucketStats.h"
 #include "bucket/LedgerCmp.h"
 #include "crypto/Hex.h"
 #include "overlay/VIIXDR.h"
+#include "util/MappedFile.h"
 #include "util/NonCopyable.h"
 #include "util/XDRStream.h"
+#include "util/optional.h"
+#include <mutex>
 #include <string>
 
 namespace viichain
@@ -23,6 +29,14 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     std::string const mFilename;
     Hash const mHash;
     size_t mSize{0};
+    bool mCompressed{false};
+
+    std::unique_ptr<BucketIndex const> mIndex;
+    std::unique_ptr<BucketBloomFilter const> mBloomFilter;
+    std::unique_ptr<BucketStats const> mStats;
+    std::shared_ptr<MappedFile const> mMapping;
+    mutable std::mutex mIndexStreamMutex;
+    mutable std::unique_ptr<XDRBufferedInputFileStream> mIndexStream;
 
   public:
             Bucket();
@@ -31,8 +45,36 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
 
     Hash const& getHash() const;
     std::string const& getFilename() const;
+
+    // Size of the uncompressed XDR stream, which is what the hash covers.
     size_t getSize() const;
 
+    // Whether the file is in the block-compressed format, which only the
+    // XDRBufferedInputFileStream readers understand.
+    bool isCompressed() const;
+
+    void setIndex(std::unique_ptr<BucketIndex const>&& index);
+    bool isIndexed() const;
+    BucketIndex const& getIndex() const;
+
+    void setBloomFilter(std::unique_ptr<BucketBloomFilter const>&& filter);
+    bool hasBloomFilter() const;
+    BucketBloomFilter const& getBloomFilter() const;
+
+    void setStats(std::unique_ptr<BucketStats const>&& stats);
+    bool hasStats() const;
+    BucketStats const& getStats() const;
+
+    // When a mapping is set, iterators and lookups decode entries directly
+    // from the mapped file.
+    void setMapping(std::shared_ptr<MappedFile const> mapping);
+    std::shared_ptr<MappedFile const> getMapping() const;
+
+    // Returns the entry for key stored in this bucket, if any. Consults the
+    // bloom filter and index when attached and scans the whole file
+    // otherwise.
+    optional<BucketEntry> getBucketEntry(LedgerKey const& key) const;
+
             bool containsBucketIdentity(BucketEntry const& id) const;
 
             static constexpr uint32_t
@@ -61,5 +103,13 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
           std::shared_ptr<Bucket> const& newBucket,
           std::vector<std::shared_ptr<Bucket>> const& shadows,
           bool keepDeadEntries, bool countMergeEvents);
+
+    // Identifies a merge by its inputs and parameters: merges with equal keys
+    // produce the same output.
+    static Hash mergeKey(uint32_t maxProtocolVersion,
+                         std::shared_ptr<Bucket> const& oldBucket,
+                         std::shared_ptr<Bucket> const& newBucket,
+                         std::vector<std::shared_ptr<Bucket>> const& shadows,
+                         bool keepDeadEntries);
 };
 }
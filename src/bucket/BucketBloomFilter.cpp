@@ -0,0 +1,218 @@
+
+#include "bucket/BucketBloomFilter.h"
+#include "bucket/BucketIndex.h"
+#include "lib/util/format.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sodium.h>
+
+namespace viichain
+{
+
+BucketBloomFilter::BucketBloomFilter()
+{
+    static_assert(sizeof(mHashKey) == crypto_shorthash_KEYBYTES,
+                  "unexpected key size");
+    randombytes_buf(mHashKey.data(), mHashKey.size());
+}
+
+uint64_t
+BucketBloomFilter::hashKey(LedgerKey const& key) const
+{
+    auto bytes = xdr::xdr_to_opaque(key);
+    uint64_t res;
+    static_assert(sizeof(res) == crypto_shorthash_BYTES, "unexpected size");
+    crypto_shorthash(reinterpret_cast<unsigned char*>(&res), bytes.data(),
+                     bytes.size(), mHashKey.data());
+    return res;
+}
+
+void
+BucketBloomFilter::addHash(uint64_t h)
+{
+    uint64_t numBlocks = mBits.size() / kWordsPerBlock;
+    assert(numBlocks > 0);
+    size_t block = ((h >> 32) * numBlocks) >> 32;
+    uint32_t g = static_cast<uint32_t>(h);
+    uint32_t delta = (g >> 17) | (g << 15);
+    for (uint64_t i = 0; i < mNumProbes; ++i)
+    {
+        uint32_t bit = g % kBitsPerBlock;
+        mBits[block * kWordsPerBlock + bit / 64] |= (1ULL << (bit % 64));
+        g += delta;
+    }
+}
+
+bool
+BucketBloomFilter::mayContainHash(uint64_t h) const
+{
+    uint64_t numBlocks = mBits.size() / kWordsPerBlock;
+    if (numBlocks == 0)
+    {
+        return false;
+    }
+    size_t block = ((h >> 32) * numBlocks) >> 32;
+    uint32_t g = static_cast<uint32_t>(h);
+    uint32_t delta = (g >> 17) | (g << 15);
+    for (uint64_t i = 0; i < mNumProbes; ++i)
+    {
+        uint32_t bit = g % kBitsPerBlock;
+        if (!(mBits[block * kWordsPerBlock + bit / 64] & (1ULL << (bit % 64))))
+        {
+            return false;
+        }
+        g += delta;
+    }
+    return true;
+}
+
+BucketBloomFilter::Builder::Builder(uint32_t bitsPerKey)
+    : mFilter(std::make_unique<BucketBloomFilter>()), mBitsPerKey(bitsPerKey)
+{
+    assert(bitsPerKey > 0);
+}
+
+void
+BucketBloomFilter::Builder::add(BucketEntry const& entry)
+{
+    assert(mFilter);
+    if (entry.type() == METAENTRY)
+    {
+        return;
+    }
+    mHashes.emplace_back(
+        mFilter->hashKey(BucketIndex::getBucketLedgerKey(entry)));
+}
+
+std::unique_ptr<BucketBloomFilter::Builder>
+BucketBloomFilter::Builder::makePartBuilder() const
+{
+    assert(mFilter);
+    auto part = std::make_unique<Builder>(mBitsPerKey);
+    part->mFilter->mHashKey = mFilter->mHashKey;
+    return part;
+}
+
+void
+BucketBloomFilter::Builder::append(Builder& part)
+{
+    assert(mFilter && part.mFilter);
+    assert(part.mFilter->mHashKey == mFilter->mHashKey);
+    mHashes.insert(mHashes.end(), part.mHashes.begin(), part.mHashes.end());
+    part.mHashes.clear();
+}
+
+std::unique_ptr<BucketBloomFilter const>
+BucketBloomFilter::Builder::finish()
+{
+    assert(mFilter);
+    if (!mHashes.empty())
+    {
+        uint64_t totalBits = mHashes.size() * uint64_t{mBitsPerKey};
+        uint64_t numBlocks = (totalBits + kBitsPerBlock - 1) / kBitsPerBlock;
+        mFilter->mBits.resize(numBlocks * kWordsPerBlock, 0);
+        mFilter->mNumProbes =
+            std::min<uint64_t>(std::max<uint64_t>(mBitsPerKey * 69 / 100, 1),
+                               30);
+        for (auto h : mHashes)
+        {
+            mFilter->addHash(h);
+        }
+        mHashes.clear();
+    }
+    return std::move(mFilter);
+}
+
+std::unique_ptr<BucketBloomFilter const>
+BucketBloomFilter::createFilter(std::string const& filename,
+                                uint32_t bitsPerKey)
+{
+    CLOG(DEBUG, "Bucket") << "Building bloom filter for bucket file "
+                          << filename;
+    Builder builder(bitsPerKey);
+    XDRBufferedInputFileStream in;
+    in.open(filename, true);
+    BucketEntry be;
+    while (in.readOne(be))
+    {
+        builder.add(be);
+    }
+    return builder.finish();
+}
+
+std::unique_ptr<BucketBloomFilter const>
+BucketBloomFilter::load(std::string const& filename)
+{
+    auto filter = std::make_unique<BucketBloomFilter>();
+    XDRInputFileStream in;
+    in.open(filename);
+
+    xdr::xvector<uint64_t> header;
+    if (!in.readOne(header) || header.size() != 4 ||
+        header[0] != kFilterFormatVersion)
+    {
+        throw std::runtime_error(
+            fmt::format("unsupported bucket bloom filter {}", filename));
+    }
+    filter->mNumProbes = header[1];
+    std::memcpy(filter->mHashKey.data(), &header[2], 8);
+    std::memcpy(filter->mHashKey.data() + 8, &header[3], 8);
+
+    if (!in.readOne(filter->mBits) ||
+        filter->mBits.size() % kWordsPerBlock != 0)
+    {
+        throw std::runtime_error(
+            fmt::format("malformed bucket bloom filter {}", filename));
+    }
+    return std::move(filter);
+}
+
+std::string
+BucketBloomFilter::filterFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".bloom";
+}
+
+void
+BucketBloomFilter::save(std::string const& filename) const
+{
+    auto tmpFilename = filename + ".tmp";
+    {
+        xdr::xvector<uint64_t> header(4);
+        header[0] = kFilterFormatVersion;
+        header[1] = mNumProbes;
+        std::memcpy(&header[2], mHashKey.data(), 8);
+        std::memcpy(&header[3], mHashKey.data() + 8, 8);
+
+        XDROutputFileStream out;
+        out.open(tmpFilename);
+        out.writeOne(header);
+        out.writeOne(mBits);
+        out.close();
+    }
+    if (rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error(
+            fmt::format("Failed to rename bucket bloom filter {}: {}",
+                        filename, strerror(errno)));
+    }
+}
+
+bool
+BucketBloomFilter::mayContain(LedgerKey const& key) const
+{
+    return mayContainHash(hashKey(key));
+}
+
+size_t
+BucketBloomFilter::getNumBits() const
+{
+    return mBits.size() * 64;
+}
+}
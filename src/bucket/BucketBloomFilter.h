@@ -0,0 +1,71 @@
+#pragma once
+
+
+#include "overlay/VIIXDR.h"
+#include "util/NonCopyable.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace viichain
+{
+
+// Blocked Bloom filter over the keys stored in a bucket. Every key maps to a
+// single 512-bit block, so a negative lookup costs one SipHash of the key and
+// one cache line of filter memory. The SipHash key is chosen at random per
+// filter and persisted along with the bits.
+class BucketBloomFilter : public NonMovableOrCopyable
+{
+    static constexpr uint64_t kFilterFormatVersion = 1;
+    static constexpr size_t kBitsPerBlock = 512;
+    static constexpr size_t kWordsPerBlock = kBitsPerBlock / 64;
+
+    std::array<unsigned char, 16> mHashKey;
+    uint64_t mNumProbes{0};
+    xdr::xvector<uint64_t> mBits;
+
+    uint64_t hashKey(LedgerKey const& key) const;
+    void addHash(uint64_t h);
+    bool mayContainHash(uint64_t h) const;
+
+  public:
+    BucketBloomFilter();
+
+    class Builder
+    {
+        std::unique_ptr<BucketBloomFilter> mFilter;
+        uint32_t mBitsPerKey;
+        std::vector<uint64_t> mHashes;
+
+      public:
+        explicit Builder(uint32_t bitsPerKey);
+
+        void add(BucketEntry const& entry);
+
+        // Returns a builder for another range of the same bucket, sharing
+        // this builder's hash key so that its keys can be appended here.
+        std::unique_ptr<Builder> makePartBuilder() const;
+        void append(Builder& part);
+
+        std::unique_ptr<BucketBloomFilter const> finish();
+    };
+
+    // Scans a bucket file that was written without a filter.
+    static std::unique_ptr<BucketBloomFilter const>
+    createFilter(std::string const& filename, uint32_t bitsPerKey);
+
+    static std::unique_ptr<BucketBloomFilter const>
+    load(std::string const& filename);
+
+    static std::string filterFilename(std::string const& bucketFilename);
+
+    void save(std::string const& filename) const;
+
+    // False means key is definitely not in the bucket.
+    bool mayContain(LedgerKey const& key) const;
+
+    size_t getNumBits() const;
+};
+}
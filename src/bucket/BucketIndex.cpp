@@ -0,0 +1,280 @@
+
+#include "bucket/BucketIndex.h"
+#include "lib/util/format.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "util/types.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace viichain
+{
+
+BucketIndex::Builder::Builder(uint64_t pageSize, uint64_t cutoff)
+    : mIndex(std::make_unique<BucketIndex>()), mCutoff(cutoff)
+{
+    assert(pageSize > 0);
+    mIndex->mPageSize = pageSize;
+}
+
+void
+BucketIndex::Builder::addPaged(LedgerKey const& key, uint64_t offset)
+{
+    auto& idx = *mIndex;
+    if (idx.mOffsets.empty() || offset >= mPageLimit)
+    {
+        idx.mKeys.emplace_back(key);
+        idx.mUpperBounds.emplace_back(key);
+        idx.mOffsets.emplace_back(offset);
+        mPageLimit = (offset / idx.mPageSize + 1) * idx.mPageSize;
+    }
+    else
+    {
+        idx.mUpperBounds.back() = key;
+    }
+}
+
+void
+BucketIndex::Builder::convertToPaged()
+{
+    auto& idx = *mIndex;
+    xdr::xvector<LedgerKey> keys;
+    xdr::xvector<uint64_t> offsets;
+    keys.swap(idx.mKeys);
+    offsets.swap(idx.mOffsets);
+    idx.mPaged = true;
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        addPaged(keys[i], offsets[i]);
+    }
+}
+
+void
+BucketIndex::Builder::addKey(LedgerKey const& key, uint64_t offset)
+{
+    if (!mIndex->mPaged && offset >= mCutoff)
+    {
+        convertToPaged();
+    }
+
+    if (mIndex->mPaged)
+    {
+        addPaged(key, offset);
+    }
+    else
+    {
+        mIndex->mKeys.emplace_back(key);
+        mIndex->mOffsets.emplace_back(offset);
+    }
+}
+
+void
+BucketIndex::Builder::add(BucketEntry const& entry, uint64_t offset)
+{
+    assert(mIndex);
+    if (entry.type() == METAENTRY)
+    {
+        return;
+    }
+    addKey(getBucketLedgerKey(entry), offset);
+}
+
+void
+BucketIndex::Builder::append(BucketIndex const& part, uint64_t offset)
+{
+    assert(mIndex);
+    if (!part.mPaged)
+    {
+        for (size_t i = 0; i < part.mKeys.size(); ++i)
+        {
+            addKey(part.mKeys[i], part.mOffsets[i] + offset);
+        }
+        return;
+    }
+
+    // The keys within a page of part are not known, so its pages are kept
+    // whole, possibly merged into the last page added here.
+    if (!mIndex->mPaged)
+    {
+        convertToPaged();
+    }
+    for (size_t i = 0; i < part.mKeys.size(); ++i)
+    {
+        addPaged(part.mKeys[i], part.mOffsets[i] + offset);
+        mIndex->mUpperBounds.back() = part.mUpperBounds[i];
+    }
+}
+
+std::unique_ptr<BucketIndex const>
+BucketIndex::Builder::finish()
+{
+    assert(mIndex);
+    return std::move(mIndex);
+}
+
+LedgerKey
+BucketIndex::getBucketLedgerKey(BucketEntry const& entry)
+{
+    switch (entry.type())
+    {
+    case LIVEENTRY:
+    case INITENTRY:
+        return LedgerEntryKey(entry.liveEntry());
+    case DEADENTRY:
+        return entry.deadEntry();
+    default:
+        throw std::runtime_error("Malformed bucket: META entry has no key.");
+    }
+}
+
+std::unique_ptr<BucketIndex const>
+BucketIndex::createIndex(std::string const& filename, uint64_t pageSize,
+                         uint64_t cutoff)
+{
+    CLOG(DEBUG, "Bucket") << "Indexing bucket file " << filename;
+    Builder builder(pageSize, cutoff);
+    XDRBufferedInputFileStream in;
+    in.open(filename, true);
+    BucketEntry be;
+    uint64_t pos = in.pos();
+    while (in.readOne(be))
+    {
+        builder.add(be, pos);
+        pos = in.pos();
+    }
+    return builder.finish();
+}
+
+std::unique_ptr<BucketIndex const>
+BucketIndex::load(std::string const& filename)
+{
+    auto index = std::make_unique<BucketIndex>();
+    XDRInputFileStream in;
+    in.open(filename);
+
+    xdr::xvector<uint64_t> header;
+    if (!in.readOne(header) || header.size() != 3 ||
+        header[0] != kIndexFormatVersion)
+    {
+        throw std::runtime_error(
+            fmt::format("unsupported bucket index file {}", filename));
+    }
+    index->mPaged = header[1] != 0;
+    index->mPageSize = header[2];
+
+    if (!in.readOne(index->mKeys) || !in.readOne(index->mUpperBounds) ||
+        !in.readOne(index->mOffsets) ||
+        index->mKeys.size() != index->mOffsets.size() ||
+        (index->mPaged && index->mUpperBounds.size() != index->mKeys.size()))
+    {
+        throw std::runtime_error(
+            fmt::format("malformed bucket index file {}", filename));
+    }
+    return std::move(index);
+}
+
+std::string
+BucketIndex::indexFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".index";
+}
+
+void
+BucketIndex::save(std::string const& filename) const
+{
+    auto tmpFilename = filename + ".tmp";
+    {
+        XDROutputFileStream out;
+        out.open(tmpFilename);
+        xdr::xvector<uint64_t> header{kIndexFormatVersion,
+                                      static_cast<uint64_t>(mPaged ? 1 : 0),
+                                      mPageSize};
+        out.writeOne(header);
+        out.writeOne(mKeys);
+        out.writeOne(mUpperBounds);
+        out.writeOne(mOffsets);
+        out.close();
+    }
+    if (rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error(fmt::format(
+            "Failed to rename bucket index {}: {}", filename, strerror(errno)));
+    }
+}
+
+bool
+BucketIndex::lookup(LedgerKey const& key, uint64_t& offset) const
+{
+    LedgerEntryIdCmp cmp;
+    if (mPaged)
+    {
+        auto it = std::lower_bound(mUpperBounds.begin(), mUpperBounds.end(),
+                                   key, cmp);
+        if (it == mUpperBounds.end())
+        {
+            return false;
+        }
+        auto i = std::distance(mUpperBounds.begin(), it);
+        if (cmp(key, mKeys[i]))
+        {
+            return false;
+        }
+        offset = mOffsets[i];
+        return true;
+    }
+
+    auto it = std::lower_bound(mKeys.begin(), mKeys.end(), key, cmp);
+    if (it == mKeys.end() || cmp(key, *it))
+    {
+        return false;
+    }
+    offset = mOffsets[std::distance(mKeys.begin(), it)];
+    return true;
+}
+
+uint64_t
+BucketIndex::seekOffset(LedgerKey const& key) const
+{
+    if (mOffsets.empty())
+    {
+        return 0;
+    }
+    LedgerEntryIdCmp cmp;
+    auto const& bounds = mPaged ? mUpperBounds : mKeys;
+    auto it = std::lower_bound(bounds.begin(), bounds.end(), key, cmp);
+    if (it == bounds.end())
+    {
+        return mOffsets.back();
+    }
+    return mOffsets[std::distance(bounds.begin(), it)];
+}
+
+LedgerKey const&
+BucketIndex::getKey(size_t i) const
+{
+    assert(i < mKeys.size());
+    return mKeys[i];
+}
+
+bool
+BucketIndex::isPaged() const
+{
+    return mPaged;
+}
+
+uint64_t
+BucketIndex::getPageSize() const
+{
+    return mPageSize;
+}
+
+size_t
+BucketIndex::size() const
+{
+    return mKeys.size();
+}
+}
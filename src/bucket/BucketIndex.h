@@ -0,0 +1,85 @@
+#pragma once
+
+
+#include "bucket/LedgerCmp.h"
+#include "overlay/VIIXDR.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <string>
+
+namespace viichain
+{
+
+// Maps LedgerKeys to byte offsets in a bucket file. Small buckets get one
+// index entry per key; once a bucket grows past the configured cutoff the
+// index switches to one entry per page, recording the first and last key
+// stored in each page of the file.
+class BucketIndex : public NonMovableOrCopyable
+{
+    static constexpr uint64_t kIndexFormatVersion = 1;
+
+    bool mPaged{false};
+    uint64_t mPageSize{0};
+
+    // For individual indexes mKeys holds every key in the bucket; for paged
+    // indexes it holds the lower bound of each page and mUpperBounds the
+    // matching upper bound.
+    xdr::xvector<LedgerKey> mKeys;
+    xdr::xvector<LedgerKey> mUpperBounds;
+    xdr::xvector<uint64_t> mOffsets;
+
+  public:
+    class Builder
+    {
+        std::unique_ptr<BucketIndex> mIndex;
+        uint64_t mCutoff;
+        uint64_t mPageLimit{0};
+
+        void addKey(LedgerKey const& key, uint64_t offset);
+        void addPaged(LedgerKey const& key, uint64_t offset);
+        void convertToPaged();
+
+      public:
+        Builder(uint64_t pageSize, uint64_t cutoff);
+
+        void add(BucketEntry const& entry, uint64_t offset);
+
+        // Adds the index of a bucket range whose keys all follow those added
+        // so far and which starts at offset, as when concatenating the
+        // partitions of a merge.
+        void append(BucketIndex const& part, uint64_t offset);
+
+        std::unique_ptr<BucketIndex const> finish();
+    };
+
+    static LedgerKey getBucketLedgerKey(BucketEntry const& entry);
+
+    // Scans a bucket file that was written without an index.
+    static std::unique_ptr<BucketIndex const>
+    createIndex(std::string const& filename, uint64_t pageSize,
+                uint64_t cutoff);
+
+    static std::unique_ptr<BucketIndex const>
+    load(std::string const& filename);
+
+    static std::string indexFilename(std::string const& bucketFilename);
+
+    void save(std::string const& filename) const;
+
+    // Returns true and sets offset to the position at which a scan for key
+    // should start. A false return means key is not in the bucket.
+    bool lookup(LedgerKey const& key, uint64_t& offset) const;
+
+    // Offset from which a scan of the bucket finds every key at or after key.
+    uint64_t seekOffset(LedgerKey const& key) const;
+
+    // The i-th key of the bucket, or for paged indexes the first key of the
+    // i-th page, for i < size().
+    LedgerKey const& getKey(size_t i) const;
+
+    bool isPaged() const;
+    uint64_t getPageSize() const;
+    size_t size() const;
+};
+}
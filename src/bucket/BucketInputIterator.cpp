@@ -7,6 +7,7 @@ namespace viichain
 void
 BucketInputIterator::loadEntry()
 {
+    mEntryOffset = mIn.pos();
     if (mIn.readOne(mEntry))
     {
         mEntryPtr = &mEntry;
@@ -33,6 +34,10 @@ BucketInputIterator::loadEntry()
             {
                 Bucket::checkProtocolLegality(mEntry, mMetadata.ledgerVersion);
             }
+            if (mUpperBound && !mCmp(mEntry, *mUpperBound))
+            {
+                mEntryPtr = nullptr;
+            }
         }
     }
     else
@@ -41,6 +46,12 @@ BucketInputIterator::loadEntry()
     }
 }
 
+size_t
+BucketInputIterator::getEntryOffset() const
+{
+    return mEntryOffset;
+}
+
 size_t
 BucketInputIterator::pos()
 {
@@ -83,7 +94,14 @@ BucketInputIterator::BucketInputIterator(std::shared_ptr<Bucket const> bucket)
     {
         CLOG(TRACE, "Bucket") << "BucketInputIterator opening file to read: "
                               << mBucket->getFilename();
-        mIn.open(mBucket->getFilename());
+        if (auto mapping = mBucket->getMapping())
+        {
+            mIn.open(mapping);
+        }
+        else
+        {
+            mIn.open(mBucket->getFilename(), true);
+        }
         loadEntry();
     }
 }
@@ -105,4 +123,29 @@ BucketInputIterator& BucketInputIterator::operator++()
     }
     return *this;
 }
+
+void
+BucketInputIterator::seekToRange(size_t offset,
+                                 optional<BucketEntry> lowerBound,
+                                 optional<BucketEntry> upperBound)
+{
+    mUpperBound = upperBound;
+    if (mBucket->getFilename().empty())
+    {
+        return;
+    }
+    if (offset != 0)
+    {
+        mIn.seek(offset);
+        loadEntry();
+    }
+    else if (mEntryPtr && mUpperBound && !mCmp(*mEntryPtr, *mUpperBound))
+    {
+        mEntryPtr = nullptr;
+    }
+    while (mEntryPtr && lowerBound && mCmp(*mEntryPtr, *lowerBound))
+    {
+        loadEntry();
+    }
+}
 }
@@ -3,6 +3,7 @@
 
 #include "bucket/LedgerCmp.h"
 #include "util/XDRStream.h"
+#include "util/optional.h"
 #include "xdr/vii-ledger.h"
 
 #include <memory>
@@ -17,11 +18,14 @@ class BucketInputIterator
     std::shared_ptr<Bucket const> mBucket;
 
                 BucketEntry const* mEntryPtr{nullptr};
-    XDRInputFileStream mIn;
+    XDRBufferedInputFileStream mIn;
     BucketEntry mEntry;
+    size_t mEntryOffset{0};
     bool mSeenMetadata{false};
     bool mSeenOtherEntries{false};
     BucketMetadata mMetadata;
+    optional<BucketEntry> mUpperBound;
+    BucketEntryIdCmp mCmp;
     void loadEntry();
 
   public:
@@ -38,6 +42,17 @@ class BucketInputIterator
 
     BucketInputIterator& operator++();
 
+    // Restricts iteration to entries with keys in [lowerBound, upperBound);
+    // either bound may be null. Reading restarts at offset, which must be a
+    // record boundary at or before the first entry of the range, or 0 to
+    // continue from the current entry.
+    void seekToRange(size_t offset, optional<BucketEntry> lowerBound,
+                     optional<BucketEntry> upperBound);
+
+    // Offset of the current entry, or of the end of the file once the bucket
+    // is exhausted; usable as the offset argument of seekToRange.
+    size_t getEntryOffset() const;
+
     size_t pos();
     size_t size() const;
 };
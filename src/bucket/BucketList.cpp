@@ -276,6 +276,27 @@ BucketList::getHash() const
     return hsh->finish();
 }
 
+std::shared_ptr<LedgerEntry const>
+BucketList::getLedgerEntry(LedgerKey const& key) const
+{
+    for (auto const& lev : mLevels)
+    {
+        for (auto const& b : {lev.getCurr(), lev.getSnap()})
+        {
+            auto be = b->getBucketEntry(key);
+            if (be)
+            {
+                if (be->type() == DEADENTRY)
+                {
+                    return nullptr;
+                }
+                return std::make_shared<LedgerEntry const>(be->liveEntry());
+            }
+        }
+    }
+    return nullptr;
+}
+
 
 bool
 BucketList::levelShouldSpill(uint32_t ledger, uint32_t level)
@@ -88,6 +88,11 @@ class BucketList
 
                 Hash getHash() const;
 
+    // Walks the levels newest-to-oldest and returns the live entry for key,
+    // or nullptr if the key is absent or its newest version is a tombstone.
+    std::shared_ptr<LedgerEntry const>
+    getLedgerEntry(LedgerKey const& key) const;
+
                     void restartMerges(Application& app, uint32_t maxProtocolVersion);
 
                                 void addBatch(Application& app, uint32_t currLedger,
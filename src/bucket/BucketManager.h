@@ -4,6 +4,7 @@
 #include "bucket/Bucket.h"
 #include "overlay/VIIXDR.h"
 #include "util/NonCopyable.h"
+#include <future>
 #include <memory>
 
 #include "medida/timer_context.h"
@@ -13,6 +14,7 @@ namespace viichain
 
 class Application;
 class BucketList;
+class MergeCheckpointer;
 class TmpDirManager;
 struct LedgerHeader;
 struct HistoryArchiveState;
@@ -21,6 +23,10 @@ struct MergeCounters
 {
     uint64_t mPreInitEntryProtocolMerges{0};
     uint64_t mPostInitEntryProtocolMerges{0};
+    uint64_t mResumedMerges{0};
+    uint64_t mRunningMergeReattachments{0};
+    uint64_t mFinishedMergeReattachments{0};
+    uint64_t mMergeReattachmentMisses{0};
 
     uint64_t mNewMetaEntries{0};
     uint64_t mNewInitEntries{0};
@@ -73,10 +79,51 @@ class BucketManager : NonMovableOrCopyable
 
                                                 virtual std::shared_ptr<Bucket>
     adoptFileAsBucket(std::string const& filename, uint256 const& hash,
-                      size_t nObjects, size_t nBytes) = 0;
+                      size_t nObjects, size_t nBytes,
+                      std::unique_ptr<BucketIndex const> index,
+                      std::unique_ptr<BucketBloomFilter const> filter,
+                      std::unique_ptr<BucketStats const> stats) = 0;
+
+    // Returns a builder for BucketOutputIterator to index the bucket it
+    // writes, or nullptr when bucket indexing is disabled.
+    virtual std::unique_ptr<BucketIndex::Builder> makeBucketIndexBuilder() = 0;
+
+    // Likewise for the bucket's bloom filter.
+    virtual std::unique_ptr<BucketBloomFilter::Builder>
+    makeBucketBloomFilterBuilder() = 0;
+
+    // Whether new buckets are written in the block-compressed format.
+    virtual bool compressBucketFiles() = 0;
+
+    // Number of key ranges a merge of inputBytes of buckets is split into.
+    virtual uint32_t getMergePartitionCount(size_t inputBytes) = 0;
+
+    // Directory holding the partial outputs and checkpoints of merges.
+    virtual std::string const& getMergeDir() = 0;
+
+    // Returns a checkpointer for a merge of inputBytes identified by key, or
+    // nullptr if such a merge is not checkpointed or one with the same key is
+    // already running.
+    virtual std::unique_ptr<MergeCheckpointer>
+    makeMergeCheckpointer(Hash const& key, size_t inputBytes) = 0;
+
+    // Merges are registered under their Bucket::mergeKey so that FutureBuckets
+    // asking for the same merge share it. getMergeFuture returns the future of
+    // a running merge with that key, a ready future holding the output of a
+    // finished one that is still around, or an invalid future otherwise.
+    virtual std::shared_future<std::shared_ptr<Bucket>>
+    getMergeFuture(Hash const& key) = 0;
+    virtual void
+    putMergeFuture(Hash const& key,
+                   std::shared_future<std::shared_ptr<Bucket>> future) = 0;
 
         virtual std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) = 0;
 
+    // Attaches the stats of b if it has none yet, reading its stats file or,
+    // failing that, scanning the bucket. Returns false when bucket stats are
+    // disabled or b has no file. Called on the main thread only.
+    virtual bool loadBucketStats(std::shared_ptr<Bucket> const& b) = 0;
+
                     virtual void forgetUnreferencedBuckets() = 0;
 
                     virtual void addBatch(Application& app, uint32_t currLedger,
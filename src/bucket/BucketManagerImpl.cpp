@@ -1,18 +1,26 @@
 
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketBloomFilter.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
+#include "bucket/BucketStats.h"
+#include "bucket/MergeCheckpoint.h"
 #include "crypto/Hex.h"
 #include "history/HistoryManager.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/VIIXDR.h"
+#include "util/FileSystemException.h"
 #include "util/Fs.h"
 #include "util/LogSlowExecution.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
 #include "util/TmpDir.h"
 #include "util/types.h"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <map>
 #include <regex>
@@ -53,6 +61,13 @@ BucketManagerImpl::initialize()
 
     mLockedBucketDir = std::make_unique<std::string>(d);
     mTmpDirManager = std::make_unique<TmpDirManager>(d + "/tmp");
+
+    mMergeDir = d + "/merges";
+    if (!fs::exists(mMergeDir) && !fs::mkpath(mMergeDir))
+    {
+        throw std::runtime_error("Unable to create merge directory: " +
+                                 mMergeDir);
+    }
 }
 
 void
@@ -87,6 +102,7 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
     , mBucketSnapMerge(app.getMetrics().NewTimer({"bucket", "snap", "merge"}))
     , mSharedBucketsSize(
           app.getMetrics().NewCounter({"bucket", "memory", "shared"}))
+    , mBucketFileSync(app.getMetrics().NewTimer({"bucket", "file", "fsync"}))
 
 {
 }
@@ -104,15 +120,36 @@ bucketBasename(std::string const& bucketHexHash)
 bool
 isBucketFile(std::string const& name)
 {
-    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz)?$");
+    static std::regex re(
+        "^bucket-[a-z0-9]{64}\\.xdr(\\.gz|\\.index|\\.bloom|\\.stats)?$");
     return std::regex_match(name, re);
 };
 
+bool
+isMergeCheckpointFile(std::string const& name)
+{
+    static std::regex re(
+        "^merge-[a-z0-9]{64}\\.(xdr|checkpoint(\\.tmp)?)$");
+    return std::regex_match(name, re);
+}
+
 uint256
 extractFromFilename(std::string const& name)
 {
     return hexToBin256(name.substr(7, 64));
 };
+
+uint64_t
+bucketIndexPageSize(Config const& cfg)
+{
+    return 1ULL << cfg.BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT;
+}
+
+uint64_t
+bucketIndexCutoff(Config const& cfg)
+{
+    return uint64_t{cfg.BUCKETLIST_DB_INDEX_CUTOFF} * 1024 * 1024;
+}
 }
 
 std::string
@@ -190,6 +227,10 @@ MergeCounters::operator+=(MergeCounters const& delta)
 {
     mPreInitEntryProtocolMerges += delta.mPreInitEntryProtocolMerges;
     mPostInitEntryProtocolMerges += delta.mPostInitEntryProtocolMerges;
+    mResumedMerges += delta.mResumedMerges;
+    mRunningMergeReattachments += delta.mRunningMergeReattachments;
+    mFinishedMergeReattachments += delta.mFinishedMergeReattachments;
+    mMergeReattachmentMisses += delta.mMergeReattachmentMisses;
 
     mNewMetaEntries += delta.mNewMetaEntries;
     mNewInitEntries += delta.mNewInitEntries;
@@ -227,13 +268,271 @@ BucketManagerImpl::incrMergeCounters(MergeCounters const& delta)
     mMergeCounters += delta;
 }
 
-std::shared_ptr<Bucket>
-BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
-                                     uint256 const& hash, size_t nObjects,
-                                     size_t nBytes)
+std::unique_ptr<BucketIndex::Builder>
+BucketManagerImpl::makeBucketIndexBuilder()
+{
+    auto const& cfg = mApp.getConfig();
+    if (!cfg.EXPERIMENTAL_BUCKETLIST_DB)
+    {
+        return nullptr;
+    }
+    return std::make_unique<BucketIndex::Builder>(bucketIndexPageSize(cfg),
+                                                  bucketIndexCutoff(cfg));
+}
+
+void
+BucketManagerImpl::maybeMapBucket(std::shared_ptr<Bucket> const& b)
+{
+    if (!mApp.getConfig().MMAP_BUCKET_FILES || b->getFilename().empty() ||
+        b->isCompressed())
+    {
+        return;
+    }
+    try
+    {
+        b->setMapping(std::make_shared<MappedFile>(b->getFilename()));
+    }
+    catch (FileSystemException const& e)
+    {
+        CLOG(WARNING, "Bucket") << "Reading bucket " << b->getFilename()
+                                << " without mmap: " << e.what();
+    }
+}
+
+void
+BucketManagerImpl::maybeIndexBucket(std::shared_ptr<Bucket> const& b)
+{
+    auto const& cfg = mApp.getConfig();
+    if (!cfg.EXPERIMENTAL_BUCKETLIST_DB || b->getFilename().empty() ||
+        b->isIndexed())
+    {
+        return;
+    }
+
+    auto indexFilename = BucketIndex::indexFilename(b->getFilename());
+    std::unique_ptr<BucketIndex const> index;
+    if (fs::exists(indexFilename))
+    {
+        try
+        {
+            index = BucketIndex::load(indexFilename);
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(WARNING, "Bucket") << "Rebuilding bucket index "
+                                    << indexFilename << ": " << e.what();
+        }
+    }
+    if (!index)
+    {
+        index = BucketIndex::createIndex(b->getFilename(),
+                                         bucketIndexPageSize(cfg),
+                                         bucketIndexCutoff(cfg));
+        index->save(indexFilename);
+    }
+    b->setIndex(std::move(index));
+}
+
+std::unique_ptr<BucketBloomFilter::Builder>
+BucketManagerImpl::makeBucketBloomFilterBuilder()
+{
+    auto bitsPerKey = mApp.getConfig().BUCKET_BLOOM_FILTER_BITS_PER_KEY;
+    if (bitsPerKey == 0)
+    {
+        return nullptr;
+    }
+    return std::make_unique<BucketBloomFilter::Builder>(bitsPerKey);
+}
+
+bool
+BucketManagerImpl::compressBucketFiles()
+{
+    return mApp.getConfig().COMPRESS_BUCKET_FILES;
+}
+
+uint32_t
+BucketManagerImpl::getMergePartitionCount(size_t inputBytes)
+{
+    auto const& cfg = mApp.getConfig();
+    auto n = inputBytes / cfg.BUCKET_MERGE_MIN_PARTITION_SIZE;
+    return static_cast<uint32_t>(
+        std::max<size_t>(1, std::min<size_t>(cfg.BUCKET_MERGE_THREADS, n)));
+}
+
+std::string const&
+BucketManagerImpl::getMergeDir()
+{
+    return mMergeDir;
+}
+
+std::unique_ptr<MergeCheckpointer>
+BucketManagerImpl::makeMergeCheckpointer(Hash const& key, size_t inputBytes)
+{
+    auto const& cfg = mApp.getConfig();
+    uint64_t interval = cfg.BUCKET_MERGE_CHECKPOINT_INTERVAL;
+    if (interval == 0 || inputBytes < interval)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    if (!mCheckpointedMerges.insert(key).second)
+    {
+        return nullptr;
+    }
+    return std::make_unique<MergeCheckpointer>(
+        mMergeDir, key, interval,
+        cfg.ARTIFICIALLY_INTERRUPT_MERGES_FOR_TESTING, [this, key]() {
+            std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+            mCheckpointedMerges.erase(key);
+        });
+}
+
+void
+BucketManagerImpl::reapFinishedMerges()
 {
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
-        std::shared_ptr<Bucket> b = getBucketByHash(hash);
+    for (auto i = mRunningMerges.begin(); i != mRunningMerges.end();)
+    {
+        if (i->second.wait_for(std::chrono::nanoseconds(0)) !=
+            std::future_status::ready)
+        {
+            ++i;
+            continue;
+        }
+        try
+        {
+            mFinishedMerges[i->first] = i->second.get()->getHash();
+        }
+        catch (std::exception&)
+        {
+            // A failed merge is forgotten so that it can be retried.
+        }
+        i = mRunningMerges.erase(i);
+    }
+}
+
+std::shared_future<std::shared_ptr<Bucket>>
+BucketManagerImpl::getMergeFuture(Hash const& key)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    reapFinishedMerges();
+
+    auto running = mRunningMerges.find(key);
+    if (running != mRunningMerges.end())
+    {
+        CLOG(TRACE, "Bucket") << "Reattaching to running merge "
+                              << hexAbbrev(key);
+        ++mMergeCounters.mRunningMergeReattachments;
+        return running->second;
+    }
+
+    auto finished = mFinishedMerges.find(key);
+    if (finished != mFinishedMerges.end())
+    {
+        // Only buckets still shared are reused: loading one from its file
+        // cannot be done while holding the bucket lock.
+        auto shared = mSharedBuckets.find(finished->second);
+        if (shared != mSharedBuckets.end())
+        {
+            CLOG(TRACE, "Bucket") << "Reattaching to finished merge "
+                                  << hexAbbrev(key);
+            ++mMergeCounters.mFinishedMergeReattachments;
+            std::promise<std::shared_ptr<Bucket>> promise;
+            promise.set_value(shared->second);
+            return promise.get_future().share();
+        }
+        mFinishedMerges.erase(finished);
+    }
+
+    ++mMergeCounters.mMergeReattachmentMisses;
+    return std::shared_future<std::shared_ptr<Bucket>>();
+}
+
+void
+BucketManagerImpl::putMergeFuture(
+    Hash const& key, std::shared_future<std::shared_ptr<Bucket>> future)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    mRunningMerges[key] = future;
+}
+
+void
+BucketManagerImpl::maybeAttachBloomFilter(std::shared_ptr<Bucket> const& b)
+{
+    auto bitsPerKey = mApp.getConfig().BUCKET_BLOOM_FILTER_BITS_PER_KEY;
+    if (bitsPerKey == 0 || b->getFilename().empty() || b->hasBloomFilter())
+    {
+        return;
+    }
+
+    auto filterFilename = BucketBloomFilter::filterFilename(b->getFilename());
+    std::unique_ptr<BucketBloomFilter const> filter;
+    if (fs::exists(filterFilename))
+    {
+        try
+        {
+            filter = BucketBloomFilter::load(filterFilename);
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(WARNING, "Bucket") << "Rebuilding bucket bloom filter "
+                                    << filterFilename << ": " << e.what();
+        }
+    }
+    if (!filter)
+    {
+        filter = BucketBloomFilter::createFilter(b->getFilename(), bitsPerKey);
+        filter->save(filterFilename);
+    }
+    b->setBloomFilter(std::move(filter));
+}
+
+bool
+BucketManagerImpl::loadBucketStats(std::shared_ptr<Bucket> const& b)
+{
+    if (!mApp.getConfig().BUCKET_STATS || b->getFilename().empty())
+    {
+        return false;
+    }
+    if (b->hasStats())
+    {
+        return true;
+    }
+
+    // No bucket lock is taken: b is already shared, and its stats are only
+    // set here and, before it is shared, by adoptFileAsBucket.
+    auto statsFilename = BucketStats::statsFilename(b->getFilename());
+    std::unique_ptr<BucketStats const> stats;
+    if (fs::exists(statsFilename))
+    {
+        try
+        {
+            stats = BucketStats::load(statsFilename);
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(WARNING, "Bucket") << "Rebuilding bucket stats "
+                                    << statsFilename << ": " << e.what();
+        }
+    }
+    if (!stats)
+    {
+        stats = BucketStats::createStats(b->getFilename());
+        stats->save(statsFilename);
+    }
+    b->setStats(std::move(stats));
+    return true;
+}
+
+std::shared_ptr<Bucket>
+BucketManagerImpl::adoptFileAsBucket(
+    std::string const& filename, uint256 const& hash, size_t nObjects,
+    size_t nBytes, std::unique_ptr<BucketIndex const> index,
+    std::unique_ptr<BucketBloomFilter const> filter,
+    std::unique_ptr<BucketStats const> stats)
+{
+    std::shared_ptr<Bucket> b = getBucketByHash(hash);
     if (b)
     {
         CLOG(DEBUG, "Bucket") << "Deleting bucket file " << filename
@@ -242,10 +541,55 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
             auto timer = LogSlowExecution("Delete redundant bucket");
             std::remove(filename.c_str());
         }
+        return b;
+    }
+
+    // The syncs and any sidecars the writer did not build, which need a
+    // scan of the file, are done without the bucket lock. It only covers the
+    // rename and publishing the bucket.
+    auto const& cfg = mApp.getConfig();
+    bool durable = cfg.DURABLE_BUCKET_WRITES;
+    if (durable)
+    {
+        auto timer = mBucketFileSync.TimeScope();
+        fs::syncFile(filename);
+    }
+    if (!cfg.EXPERIMENTAL_BUCKETLIST_DB)
+    {
+        index.reset();
     }
-    else
+    else if (!index)
     {
-        std::string canonicalName = bucketFilename(hash);
+        index = BucketIndex::createIndex(filename, bucketIndexPageSize(cfg),
+                                         bucketIndexCutoff(cfg));
+    }
+    if (cfg.BUCKET_BLOOM_FILTER_BITS_PER_KEY == 0)
+    {
+        filter.reset();
+    }
+    else if (!filter)
+    {
+        filter = BucketBloomFilter::createFilter(
+            filename, cfg.BUCKET_BLOOM_FILTER_BITS_PER_KEY);
+    }
+    // Stats gathered while writing are kept; any others are only built when
+    // the bucketstats command asks for them.
+    if (!cfg.BUCKET_STATS)
+    {
+        stats.reset();
+    }
+
+    std::string canonicalName = bucketFilename(hash);
+    {
+        std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+        auto i = mSharedBuckets.find(hash);
+        if (i != mSharedBuckets.end())
+        {
+            // Another merge adopted the same bucket since the check above.
+            std::remove(filename.c_str());
+            return i->second;
+        }
+
         CLOG(DEBUG, "Bucket")
             << "Adopting bucket file " << filename << " as " << canonicalName;
         if (rename(filename.c_str(), canonicalName.c_str()) != 0)
@@ -260,10 +604,43 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
         }
 
         b = std::make_shared<Bucket>(canonicalName, hash);
+        maybeMapBucket(b);
+        if (index)
+        {
+            b->setIndex(std::move(index));
+        }
+        if (filter)
+        {
+            b->setBloomFilter(std::move(filter));
+        }
+        if (stats)
         {
-            mSharedBuckets.insert(std::make_pair(hash, b));
-            mSharedBucketsSize.set_count(mSharedBuckets.size());
+            b->setStats(std::move(stats));
         }
+        mSharedBuckets.insert(std::make_pair(hash, b));
+        mSharedBucketsSize.set_count(mSharedBuckets.size());
+    }
+
+    // Once the bucket is shared, nothing reads its sidecar files until the
+    // next start, so they are saved after releasing the lock.
+    if (b->isIndexed())
+    {
+        b->getIndex().save(BucketIndex::indexFilename(canonicalName));
+    }
+    if (b->hasBloomFilter())
+    {
+        b->getBloomFilter().save(
+            BucketBloomFilter::filterFilename(canonicalName));
+    }
+    if (b->hasStats())
+    {
+        b->getStats().save(BucketStats::statsFilename(canonicalName));
+    }
+
+    if (durable)
+    {
+        auto timer = mBucketFileSync.TimeScope();
+        fs::syncDirectory(getBucketDir());
     }
     assert(b);
     return b;
@@ -272,31 +649,74 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
 std::shared_ptr<Bucket>
 BucketManagerImpl::getBucketByHash(uint256 const& hash)
 {
-    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
     if (isZero(hash))
     {
         return std::make_shared<Bucket>();
     }
-    auto i = mSharedBuckets.find(hash);
-    if (i != mSharedBuckets.end())
+
+    std::string canonicalName = bucketFilename(hash);
+    std::shared_future<std::shared_ptr<Bucket>> loading;
+    std::promise<std::shared_ptr<Bucket>> loaded;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+        auto i = mSharedBuckets.find(hash);
+        if (i != mSharedBuckets.end())
+        {
+            CLOG(TRACE, "Bucket")
+                << "BucketManager::getBucketByHash(" << binToHex(hash)
+                << ") found bucket " << i->second->getFilename();
+            return i->second;
+        }
+        auto j = mLoadingBuckets.find(hash);
+        if (j != mLoadingBuckets.end())
+        {
+            loading = j->second;
+        }
+        else if (!fs::exists(canonicalName))
+        {
+            return std::shared_ptr<Bucket>();
+        }
+        else
+        {
+            mLoadingBuckets[hash] = loaded.get_future().share();
+        }
+    }
+    if (loading.valid())
     {
-        CLOG(TRACE, "Bucket")
-            << "BucketManager::getBucketByHash(" << binToHex(hash)
-            << ") found bucket " << i->second->getFilename();
-        return i->second;
+        return loading.get();
     }
-    std::string canonicalName = bucketFilename(hash);
-    if (fs::exists(canonicalName))
+
+    // Loading or building the sidecars may read the whole bucket, so the
+    // bucket is only published under the lock once they are attached.
+    CLOG(TRACE, "Bucket") << "BucketManager::getBucketByHash("
+                          << binToHex(hash)
+                          << ") found no bucket, making new one";
+    std::shared_ptr<Bucket> p;
+    try
     {
-        CLOG(TRACE, "Bucket")
-            << "BucketManager::getBucketByHash(" << binToHex(hash)
-            << ") found no bucket, making new one";
-        auto p = std::make_shared<Bucket>(canonicalName, hash);
+        p = std::make_shared<Bucket>(canonicalName, hash);
+        maybeMapBucket(p);
+        maybeIndexBucket(p);
+        maybeAttachBloomFilter(p);
+    }
+    catch (std::exception const&)
+    {
+        {
+            std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+            mLoadingBuckets.erase(hash);
+        }
+        loaded.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
         mSharedBuckets.insert(std::make_pair(hash, p));
         mSharedBucketsSize.set_count(mSharedBuckets.size());
-        return p;
+        mLoadingBuckets.erase(hash);
     }
-    return std::shared_ptr<Bucket>();
+    loaded.set_value(p);
+    return p;
 }
 
 std::set<Hash>
@@ -384,6 +804,8 @@ void
 BucketManagerImpl::forgetUnreferencedBuckets()
 {
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    // Finished merges must not keep their outputs alive.
+    reapFinishedMerges();
     auto referenced = getReferencedBuckets();
 
     for (auto i = mSharedBuckets.begin(); i != mSharedBuckets.end();)
@@ -405,11 +827,90 @@ BucketManagerImpl::forgetUnreferencedBuckets()
                 std::remove(filename.c_str());
                 auto gzfilename = filename + ".gz";
                 std::remove(gzfilename.c_str());
+                auto indexFilename = BucketIndex::indexFilename(filename);
+                std::remove(indexFilename.c_str());
+                auto filterFilename =
+                    BucketBloomFilter::filterFilename(filename);
+                std::remove(filterFilename.c_str());
+                auto statsFilename = BucketStats::statsFilename(filename);
+                std::remove(statsFilename.c_str());
             }
             mSharedBuckets.erase(j);
         }
     }
     mSharedBucketsSize.set_count(mSharedBuckets.size());
+
+    for (auto i = mFinishedMerges.begin(); i != mFinishedMerges.end();)
+    {
+        if (mSharedBuckets.find(i->second) == mSharedBuckets.end())
+        {
+            i = mFinishedMerges.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (!mApp.getConfig().DISABLE_BUCKET_GC)
+    {
+        for (auto const& kv : mSharedBuckets)
+        {
+            referenced.insert(kv.first);
+        }
+        cleanupMergeCheckpoints(referenced);
+    }
+}
+
+void
+BucketManagerImpl::cleanupMergeCheckpoints(std::set<Hash> const& liveBuckets)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    for (auto const& f : fs::findfiles(mMergeDir, isMergeCheckpointFile))
+    {
+        auto key = hexToBin256(f.substr(6, 64));
+        if (mCheckpointedMerges.find(key) != mCheckpointedMerges.end())
+        {
+            continue;
+        }
+
+        auto fullName = mMergeDir + "/" + f;
+        auto suffix = f.substr(70);
+        auto checkpoint = MergeCheckpointer::checkpointFilename(mMergeDir, key);
+        bool stale = true;
+        if (suffix == ".checkpoint")
+        {
+            // Keep the checkpoint while every input of the merge is live.
+            try
+            {
+                auto cp = MergeCheckpoint::load(checkpoint);
+                stale = std::any_of(
+                    cp->mInputs.begin(), cp->mInputs.end(),
+                    [&](Hash const& h) {
+                        return !isZero(h) &&
+                               liveBuckets.find(h) == liveBuckets.end();
+                    });
+            }
+            catch (std::exception&)
+            {
+            }
+        }
+        else if (suffix == ".xdr")
+        {
+            stale = !fs::exists(checkpoint);
+        }
+
+        if (stale)
+        {
+            CLOG(DEBUG, "Bucket") << "Removing stale merge file " << f;
+            std::remove(fullName.c_str());
+            if (suffix == ".checkpoint")
+            {
+                auto output = MergeCheckpointer::outputFilename(mMergeDir, key);
+                std::remove(output.c_str());
+            }
+        }
+    }
 }
 
 void
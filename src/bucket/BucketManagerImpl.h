@@ -36,17 +36,35 @@ class BucketManagerImpl : public BucketManager
     std::unique_ptr<TmpDirManager> mTmpDirManager;
     std::unique_ptr<TmpDir> mWorkDir;
     std::map<Hash, std::shared_ptr<Bucket>> mSharedBuckets;
+    // Buckets that getBucketByHash is reading from the bucket directory,
+    // outside mBucketMutex. Other callers wait for the same load, so
+    // getBucketByHash is never called with mBucketMutex held.
+    std::map<Hash, std::shared_future<std::shared_ptr<Bucket>>>
+        mLoadingBuckets;
     mutable std::recursive_mutex mBucketMutex;
     std::unique_ptr<std::string> mLockedBucketDir;
+    std::string mMergeDir;
+    std::set<Hash> mCheckpointedMerges;
+    std::map<Hash, std::shared_future<std::shared_ptr<Bucket>>> mRunningMerges;
+    std::map<Hash, Hash> mFinishedMerges;
     medida::Meter& mBucketObjectInsertBatch;
     medida::Timer& mBucketAddBatch;
     medida::Timer& mBucketSnapMerge;
     medida::Counter& mSharedBucketsSize;
+    medida::Timer& mBucketFileSync;
     MergeCounters mMergeCounters;
 
     std::set<Hash> getReferencedBuckets() const;
     void cleanupStaleFiles();
+    void cleanupMergeCheckpoints(std::set<Hash> const& liveBuckets);
+    void reapFinishedMerges();
     void cleanDir();
+    void maybeMapBucket(std::shared_ptr<Bucket> const& b);
+    // Load the index or bloom filter of a bucket that is not shared yet from
+    // its file, or build and save it. Building reads the whole bucket, so
+    // these are never called with mBucketMutex held.
+    void maybeIndexBucket(std::shared_ptr<Bucket> const& b);
+    void maybeAttachBloomFilter(std::shared_ptr<Bucket> const& b);
 
   protected:
     void calculateSkipValues(LedgerHeader& currentHeader);
@@ -65,11 +83,27 @@ class BucketManagerImpl : public BucketManager
     MergeCounters readMergeCounters() override;
     void incrMergeCounters(MergeCounters const&) override;
     TmpDirManager& getTmpDirManager() override;
-    std::shared_ptr<Bucket> adoptFileAsBucket(std::string const& filename,
-                                              uint256 const& hash,
-                                              size_t nObjects,
-                                              size_t nBytes) override;
+    std::shared_ptr<Bucket>
+    adoptFileAsBucket(std::string const& filename, uint256 const& hash,
+                      size_t nObjects, size_t nBytes,
+                      std::unique_ptr<BucketIndex const> index,
+                      std::unique_ptr<BucketBloomFilter const> filter,
+                      std::unique_ptr<BucketStats const> stats) override;
+    std::unique_ptr<BucketIndex::Builder> makeBucketIndexBuilder() override;
+    std::unique_ptr<BucketBloomFilter::Builder>
+    makeBucketBloomFilterBuilder() override;
+    bool compressBucketFiles() override;
+    uint32_t getMergePartitionCount(size_t inputBytes) override;
+    std::string const& getMergeDir() override;
+    std::unique_ptr<MergeCheckpointer>
+    makeMergeCheckpointer(Hash const& key, size_t inputBytes) override;
+    std::shared_future<std::shared_ptr<Bucket>>
+    getMergeFuture(Hash const& key) override;
+    void
+    putMergeFuture(Hash const& key,
+                   std::shared_future<std::shared_ptr<Bucket>> future) override;
     std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) override;
+    bool loadBucketStats(std::shared_ptr<Bucket> const& b) override;
 
     void forgetUnreferencedBuckets() override;
     void addBatch(Application& app, uint32_t currLedger,
@@ -25,32 +25,113 @@ randomBucketName(std::string const& tmpDir)
 }
 }
 
-BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
-                                           bool keepDeadEntries,
-                                           BucketMetadata const& meta,
-                                           MergeCounters& mc)
-    : mFilename(randomBucketName(tmpDir))
+BucketOutputIterator::BucketOutputIterator(
+    std::string const& tmpDir, bool keepDeadEntries, BucketMetadata const& meta,
+    MergeCounters& mc, std::unique_ptr<BucketIndex::Builder> indexBuilder,
+    std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder,
+    bool compress)
+    : BucketOutputIterator(randomBucketName(tmpDir), keepDeadEntries, meta, mc,
+                           std::move(indexBuilder),
+                           std::move(bloomFilterBuilder), true, true, compress,
+                           nullptr)
+{
+}
+
+BucketOutputIterator::BucketOutputIterator(
+    std::string const& filename, bool keepDeadEntries,
+    BucketMetadata const& meta, MergeCounters& mc,
+    std::unique_ptr<BucketIndex::Builder> indexBuilder,
+    std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder,
+    bool hashOutput, bool putMeta, bool compress,
+    MergeCheckpoint const* resumeFrom)
+    : mFilename(filename)
     , mBuf(nullptr)
-    , mHasher(SHA256::create())
+    , mHasher(hashOutput ? SHA256::create() : nullptr)
     , mKeepDeadEntries(keepDeadEntries)
     , mMeta(meta)
     , mMergeCounters(mc)
+    , mIndexBuilder(std::move(indexBuilder))
+    , mBloomFilterBuilder(std::move(bloomFilterBuilder))
+    , mStats(resumeFrom ? nullptr : std::make_unique<BucketStats>())
 {
     CLOG(TRACE, "Bucket") << "BucketOutputIterator opening file to write: "
                           << mFilename;
-        mOut.open(mFilename);
+    if (resumeFrom)
+    {
+        assert(mHasher);
+        mOut.openAt(mFilename, resumeFrom->mBytesPut);
+        mHasher->restoreState(resumeFrom->mHashState);
+        mBytesPut = resumeFrom->mBytesPut;
+        mObjectsPut = resumeFrom->mObjectsPut;
+        if (resumeFrom->mBuffered)
+        {
+            mBuf = std::make_unique<BucketEntry>(*resumeFrom->mBuffered);
+        }
+    }
+    else
+    {
+        mOut.open(mFilename, compress);
+    }
 
     if (meta.ledgerVersion >=
         Bucket::FIRST_PROTOCOL_SUPPORTING_INITENTRY_AND_METAENTRY)
     {
-        BucketEntry bme;
-        bme.type(METAENTRY);
-        bme.metaEntry() = mMeta;
-        put(bme);
+        if (putMeta && !resumeFrom)
+        {
+            BucketEntry bme;
+            bme.type(METAENTRY);
+            bme.metaEntry() = mMeta;
+            put(bme);
+        }
         mPutMeta = true;
     }
 }
 
+std::unique_ptr<BucketOutputIterator>
+BucketOutputIterator::forMergePartition(
+    std::string const& tmpDir, bool keepDeadEntries,
+    BucketMetadata const& meta, MergeCounters& mc, bool firstPartition,
+    std::unique_ptr<BucketIndex::Builder> indexBuilder,
+    std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder)
+{
+    return std::unique_ptr<BucketOutputIterator>(new BucketOutputIterator(
+        randomBucketName(tmpDir), keepDeadEntries, meta, mc,
+        std::move(indexBuilder), std::move(bloomFilterBuilder), false,
+        firstPartition, false, nullptr));
+}
+
+std::unique_ptr<BucketOutputIterator>
+BucketOutputIterator::forCheckpointedMerge(std::string const& filename,
+                                           bool keepDeadEntries,
+                                           BucketMetadata const& meta,
+                                           MergeCounters& mc,
+                                           MergeCheckpoint const* resumeFrom)
+{
+    return std::unique_ptr<BucketOutputIterator>(
+        new BucketOutputIterator(filename, keepDeadEntries, meta, mc, nullptr,
+                                 nullptr, true, true, false, resumeFrom));
+}
+
+void
+BucketOutputIterator::writeBuffered()
+{
+    if (mIndexBuilder)
+    {
+        mIndexBuilder->add(*mBuf, mBytesPut);
+    }
+    if (mBloomFilterBuilder)
+    {
+        mBloomFilterBuilder->add(*mBuf);
+    }
+    auto bytesBefore = mBytesPut;
+    mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
+    mObjectsPut++;
+    if (mStats)
+    {
+        mStats->add(*mBuf, mBytesPut - bytesBefore);
+    }
+}
+
 void
 BucketOutputIterator::put(BucketEntry const& e)
 {
@@ -77,8 +158,7 @@ BucketOutputIterator::put(BucketEntry const& e)
                         if (mCmp(*mBuf, e))
         {
             ++mMergeCounters.mOutputIteratorActualWrites;
-            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-            mObjectsPut++;
+            writeBuffered();
         }
     }
     else
@@ -95,8 +175,7 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager)
 {
     if (mBuf)
     {
-        mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-        mObjectsPut++;
+        writeBuffered();
         mBuf.reset();
     }
 
@@ -109,7 +188,81 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager)
         std::remove(mFilename.c_str());
         return std::make_shared<Bucket>();
     }
-    return bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
-                                           mObjectsPut, mBytesPut);
+    assert(mHasher);
+    return bucketManager.adoptFileAsBucket(
+        mFilename, mHasher->finish(), mObjectsPut, mBytesPut,
+        mIndexBuilder ? mIndexBuilder->finish() : nullptr,
+        mBloomFilterBuilder ? mBloomFilterBuilder->finish() : nullptr,
+        std::move(mStats));
+}
+
+std::string
+BucketOutputIterator::finishPartition()
+{
+    if (mBuf)
+    {
+        writeBuffered();
+        mBuf.reset();
+    }
+    mOut.close();
+    return mFilename;
+}
+
+void
+BucketOutputIterator::discard()
+{
+    mBuf.reset();
+    if (mOut)
+    {
+        try
+        {
+            mOut.close();
+        }
+        catch (FileSystemException const&)
+        {
+        }
+    }
+    std::remove(mFilename.c_str());
+}
+
+std::unique_ptr<BucketStats>
+BucketOutputIterator::releaseStats()
+{
+    return std::move(mStats);
+}
+
+std::unique_ptr<BucketIndex::Builder>
+BucketOutputIterator::releaseIndexBuilder()
+{
+    return std::move(mIndexBuilder);
+}
+
+std::unique_ptr<BucketBloomFilter::Builder>
+BucketOutputIterator::releaseBloomFilterBuilder()
+{
+    return std::move(mBloomFilterBuilder);
+}
+
+void
+BucketOutputIterator::checkpoint(MergeCheckpoint& cp)
+{
+    assert(mHasher);
+    mOut.flush();
+    cp.mBytesPut = mBytesPut;
+    cp.mObjectsPut = mObjectsPut;
+    cp.mHashState = mHasher->saveState();
+    cp.mBuffered = mBuf ? make_optional<BucketEntry>(*mBuf) : nullptr;
+}
+
+size_t
+BucketOutputIterator::getObjectsPut() const
+{
+    return mObjectsPut;
+}
+
+size_t
+BucketOutputIterator::getBytesPut() const
+{
+    return mBytesPut;
 }
 }
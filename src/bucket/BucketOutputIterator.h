@@ -3,6 +3,7 @@
 
 #include "bucket/BucketManager.h"
 #include "bucket/LedgerCmp.h"
+#include "bucket/MergeCheckpoint.h"
 #include "util/XDRStream.h"
 #include "xdr/vii-ledger.h"
 
@@ -19,7 +20,7 @@ class BucketOutputIterator
 {
   protected:
     std::string mFilename;
-    XDROutputFileStream mOut;
+    XDRBufferedOutputFileStream mOut;
     BucketEntryIdCmp mCmp;
     std::unique_ptr<BucketEntry> mBuf;
     std::unique_ptr<SHA256> mHasher;
@@ -29,13 +30,69 @@ class BucketOutputIterator
     BucketMetadata mMeta;
     bool mPutMeta{false};
     MergeCounters& mMergeCounters;
+    std::unique_ptr<BucketIndex::Builder> mIndexBuilder;
+    std::unique_ptr<BucketBloomFilter::Builder> mBloomFilterBuilder;
+    std::unique_ptr<BucketStats> mStats;
+
+    void writeBuffered();
+
+    BucketOutputIterator(
+        std::string const& filename, bool keepDeadEntries,
+        BucketMetadata const& meta, MergeCounters& mc,
+        std::unique_ptr<BucketIndex::Builder> indexBuilder,
+        std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder,
+        bool hashOutput, bool putMeta, bool compress,
+        MergeCheckpoint const* resumeFrom);
 
   public:
-                                BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries,
-                         BucketMetadata const& meta, MergeCounters& mc);
+                                BucketOutputIterator(
+        std::string const& tmpDir, bool keepDeadEntries,
+        BucketMetadata const& meta, MergeCounters& mc,
+        std::unique_ptr<BucketIndex::Builder> indexBuilder = nullptr,
+        std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder =
+            nullptr,
+        bool compress = false);
+
+    // Output for one key range of a parallel merge. It is not hashed, only
+    // the first range carries the META entry, and it is finished with
+    // finishPartition rather than adopted as a bucket.
+    static std::unique_ptr<BucketOutputIterator>
+    forMergePartition(
+        std::string const& tmpDir, bool keepDeadEntries,
+        BucketMetadata const& meta, MergeCounters& mc, bool firstPartition,
+        std::unique_ptr<BucketIndex::Builder> indexBuilder,
+        std::unique_ptr<BucketBloomFilter::Builder> bloomFilterBuilder);
+
+    // Output of a merge that may be checkpointed, written to filename rather
+    // than the tmp dir. If resumeFrom is set, the output continues from it.
+    static std::unique_ptr<BucketOutputIterator>
+    forCheckpointedMerge(std::string const& filename, bool keepDeadEntries,
+                         BucketMetadata const& meta, MergeCounters& mc,
+                         MergeCheckpoint const* resumeFrom);
 
     void put(BucketEntry const& e);
 
     std::shared_ptr<Bucket> getBucket(BucketManager& bucketManager);
+
+    // Flushes and closes the output, returning its filename.
+    std::string finishPartition();
+
+    // Closes the output and deletes its file, for a merge that failed.
+    void discard();
+
+    // Stats of the entries written so far, or nullptr for a resumed merge,
+    // whose earlier entries were not seen.
+    std::unique_ptr<BucketStats> releaseStats();
+
+    // The builders passed in, fed with the entries written so far, so that
+    // the partitions of a merge can be combined.
+    std::unique_ptr<BucketIndex::Builder> releaseIndexBuilder();
+    std::unique_ptr<BucketBloomFilter::Builder> releaseBloomFilterBuilder();
+
+    // Flushes the output and records its progress in cp.
+    void checkpoint(MergeCheckpoint& cp);
+
+    size_t getObjectsPut() const;
+    size_t getBytesPut() const;
 };
 }
@@ -0,0 +1,170 @@
+
+#include "bucket/BucketStats.h"
+#include "bucket/BucketIndex.h"
+#include "lib/util/format.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace viichain
+{
+
+void
+BucketStats::add(BucketEntry const& entry, uint64_t bytes)
+{
+    mBytes += bytes;
+    switch (entry.type())
+    {
+    case METAENTRY:
+        ++mMetaEntries;
+        return;
+    case INITENTRY:
+        ++mInitEntries;
+        break;
+    case LIVEENTRY:
+        ++mLiveEntries;
+        break;
+    case DEADENTRY:
+        ++mDeadEntries;
+        break;
+    }
+
+    auto key = BucketIndex::getBucketLedgerKey(entry);
+    auto& ts = mByType[key.type()];
+    ++ts.mEntries;
+    ts.mBytes += bytes;
+    if (!mMinKey)
+    {
+        mMinKey = make_optional<LedgerKey>(key);
+    }
+    mMaxKey = make_optional<LedgerKey>(key);
+}
+
+void
+BucketStats::append(BucketStats const& other)
+{
+    for (auto const& kv : other.mByType)
+    {
+        auto& ts = mByType[kv.first];
+        ts.mEntries += kv.second.mEntries;
+        ts.mBytes += kv.second.mBytes;
+    }
+    mInitEntries += other.mInitEntries;
+    mLiveEntries += other.mLiveEntries;
+    mDeadEntries += other.mDeadEntries;
+    mMetaEntries += other.mMetaEntries;
+    mBytes += other.mBytes;
+    if (!mMinKey)
+    {
+        mMinKey = other.mMinKey;
+    }
+    if (other.mMaxKey)
+    {
+        mMaxKey = other.mMaxKey;
+    }
+}
+
+std::unique_ptr<BucketStats const>
+BucketStats::createStats(std::string const& filename)
+{
+    CLOG(DEBUG, "Bucket") << "Gathering stats for bucket file " << filename;
+    auto stats = std::make_unique<BucketStats>();
+    XDRBufferedInputFileStream in;
+    in.open(filename, true);
+    BucketEntry be;
+    uint64_t pos = in.pos();
+    while (in.readOne(be))
+    {
+        stats->add(be, in.pos() - pos);
+        pos = in.pos();
+    }
+    return std::move(stats);
+}
+
+std::unique_ptr<BucketStats const>
+BucketStats::load(std::string const& filename)
+{
+    auto stats = std::make_unique<BucketStats>();
+    XDRInputFileStream in;
+    in.open(filename);
+
+    xdr::xvector<uint64_t> header;
+    if (!in.readOne(header) || header.size() != 6 ||
+        header[0] != kStatsFormatVersion)
+    {
+        throw std::runtime_error(
+            fmt::format("unsupported bucket stats file {}", filename));
+    }
+    stats->mInitEntries = header[1];
+    stats->mLiveEntries = header[2];
+    stats->mDeadEntries = header[3];
+    stats->mMetaEntries = header[4];
+    stats->mBytes = header[5];
+
+    xdr::xvector<uint64_t> byType;
+    xdr::xvector<LedgerKey> bounds;
+    if (!in.readOne(byType) || !in.readOne(bounds) || byType.size() % 3 != 0 ||
+        (!bounds.empty() && bounds.size() != 2))
+    {
+        throw std::runtime_error(
+            fmt::format("malformed bucket stats file {}", filename));
+    }
+    for (size_t i = 0; i < byType.size(); i += 3)
+    {
+        auto& ts = stats->mByType[static_cast<LedgerEntryType>(byType[i])];
+        ts.mEntries = byType[i + 1];
+        ts.mBytes = byType[i + 2];
+    }
+    if (!bounds.empty())
+    {
+        stats->mMinKey = make_optional<LedgerKey>(bounds[0]);
+        stats->mMaxKey = make_optional<LedgerKey>(bounds[1]);
+    }
+    return std::move(stats);
+}
+
+std::string
+BucketStats::statsFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".stats";
+}
+
+void
+BucketStats::save(std::string const& filename) const
+{
+    auto tmpFilename = filename + ".tmp";
+    {
+        xdr::xvector<uint64_t> header{kStatsFormatVersion, mInitEntries,
+                                      mLiveEntries,        mDeadEntries,
+                                      mMetaEntries,        mBytes};
+        xdr::xvector<uint64_t> byType;
+        for (auto const& kv : mByType)
+        {
+            byType.emplace_back(static_cast<uint64_t>(kv.first));
+            byType.emplace_back(kv.second.mEntries);
+            byType.emplace_back(kv.second.mBytes);
+        }
+        xdr::xvector<LedgerKey> bounds;
+        if (mMinKey && mMaxKey)
+        {
+            bounds.emplace_back(*mMinKey);
+            bounds.emplace_back(*mMaxKey);
+        }
+
+        XDROutputFileStream out;
+        out.open(tmpFilename);
+        out.writeOne(header);
+        out.writeOne(byType);
+        out.writeOne(bounds);
+        out.close();
+    }
+    if (rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error(fmt::format(
+            "Failed to rename bucket stats {}: {}", filename, strerror(errno)));
+    }
+}
+}
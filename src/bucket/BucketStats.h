@@ -0,0 +1,56 @@
+#pragma once
+
+
+#include "overlay/VIIXDR.h"
+#include "util/optional.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace viichain
+{
+
+// Entry counts and record sizes of a bucket, gathered by BucketOutputIterator
+// as it writes the bucket and kept next to it in bucket-<hash>.xdr.stats, so
+// that they can be reported without reading the bucket. Sizes are those of
+// the uncompressed XDR records, including their 4-byte headers.
+struct BucketStats
+{
+    static constexpr uint64_t kStatsFormatVersion = 1;
+
+    struct TypeStats
+    {
+        uint64_t mEntries{0};
+        uint64_t mBytes{0};
+    };
+
+    // Keyed by the type of the entry, or of the key for DEAD entries.
+    std::map<LedgerEntryType, TypeStats> mByType;
+    uint64_t mInitEntries{0};
+    uint64_t mLiveEntries{0};
+    uint64_t mDeadEntries{0};
+    uint64_t mMetaEntries{0};
+    uint64_t mBytes{0};
+    optional<LedgerKey> mMinKey;
+    optional<LedgerKey> mMaxKey;
+
+    // Entries must be added in bucket order.
+    void add(BucketEntry const& entry, uint64_t bytes);
+
+    // Adds the stats of a bucket range whose keys all follow those added so
+    // far, as when concatenating the partitions of a merge.
+    void append(BucketStats const& other);
+
+    // Scans a bucket file that was written without stats.
+    static std::unique_ptr<BucketStats const>
+    createStats(std::string const& filename);
+
+    static std::unique_ptr<BucketStats const>
+    load(std::string const& filename);
+
+    static std::string statsFilename(std::string const& bucketFilename);
+
+    void save(std::string const& filename) const;
+};
+}
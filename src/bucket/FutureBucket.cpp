@@ -255,6 +255,19 @@ FutureBucket::startMerge(Application& app, uint32_t maxProtocolVersion,
 
     BucketManager& bm = app.getBucketManager();
 
+    auto key = Bucket::mergeKey(maxProtocolVersion, curr, snap, shadows,
+                                keepDeadEntries);
+    auto existing = bm.getMergeFuture(key);
+    if (existing.valid())
+    {
+        CLOG(TRACE, "Bucket") << "Sharing merge of curr="
+                              << hexAbbrev(curr->getHash())
+                              << " with snap=" << hexAbbrev(snap->getHash());
+        mOutputBucket = existing;
+        checkState();
+        return;
+    }
+
     using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
     std::shared_ptr<task_t> task =
         std::make_shared<task_t>([curr, snap, &bm, shadows, maxProtocolVersion,
@@ -287,6 +300,7 @@ FutureBucket::startMerge(Application& app, uint32_t maxProtocolVersion,
         });
 
     mOutputBucket = task->get_future().share();
+    bm.putMergeFuture(key, mOutputBucket);
     app.postOnBackgroundThread(bind(&task_t::operator(), task),
                                "FutureBucket: merge");
     checkState();
@@ -0,0 +1,196 @@
+
+#include "bucket/MergeCheckpoint.h"
+#include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "lib/util/format.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace viichain
+{
+
+std::unique_ptr<MergeCheckpoint>
+MergeCheckpoint::load(std::string const& filename)
+{
+    auto cp = std::make_unique<MergeCheckpoint>();
+    XDRInputFileStream in;
+    in.open(filename);
+
+    xdr::xvector<uint64_t> header;
+    if (!in.readOne(header) || header.size() != 4 ||
+        header[0] != kCheckpointFormatVersion)
+    {
+        throw std::runtime_error(
+            fmt::format("unsupported merge checkpoint {}", filename));
+    }
+    cp->mBytesPut = header[1];
+    cp->mObjectsPut = header[2];
+
+    xdr::xvector<Hash> inputs;
+    xdr::xvector<uint64_t> offsets;
+    xdr::opaque_vec<> hashState;
+    if (!in.readOne(inputs) || !in.readOne(offsets) ||
+        !in.readOne(hashState) || inputs.size() != offsets.size())
+    {
+        throw std::runtime_error(
+            fmt::format("malformed merge checkpoint {}", filename));
+    }
+    cp->mInputs.assign(inputs.begin(), inputs.end());
+    cp->mInputOffsets.assign(offsets.begin(), offsets.end());
+    cp->mHashState.assign(hashState.begin(), hashState.end());
+
+    if (header[3] != 0)
+    {
+        cp->mBuffered = make_optional<BucketEntry>();
+        if (!in.readOne(*cp->mBuffered))
+        {
+            throw std::runtime_error(
+                fmt::format("malformed merge checkpoint {}", filename));
+        }
+    }
+    return cp;
+}
+
+void
+MergeCheckpoint::save(std::string const& filename) const
+{
+    auto tmpFilename = filename + ".tmp";
+    {
+        xdr::xvector<uint64_t> header{
+            kCheckpointFormatVersion, mBytesPut, mObjectsPut,
+            static_cast<uint64_t>(mBuffered ? 1 : 0)};
+        xdr::xvector<Hash> inputs(mInputs.begin(), mInputs.end());
+        xdr::xvector<uint64_t> offsets(mInputOffsets.begin(),
+                                       mInputOffsets.end());
+        xdr::opaque_vec<> hashState(mHashState.begin(), mHashState.end());
+
+        XDROutputFileStream out;
+        out.open(tmpFilename);
+        out.writeOne(header);
+        out.writeOne(inputs);
+        out.writeOne(offsets);
+        out.writeOne(hashState);
+        if (mBuffered)
+        {
+            out.writeOne(*mBuffered);
+        }
+        out.close();
+    }
+    if (rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error(
+            fmt::format("Failed to rename merge checkpoint {}: {}", filename,
+                        strerror(errno)));
+    }
+}
+
+std::string
+MergeCheckpointer::outputFilename(std::string const& mergeDir,
+                                  Hash const& key)
+{
+    return mergeDir + "/merge-" + binToHex(key) + ".xdr";
+}
+
+std::string
+MergeCheckpointer::checkpointFilename(std::string const& mergeDir,
+                                      Hash const& key)
+{
+    return mergeDir + "/merge-" + binToHex(key) + ".checkpoint";
+}
+
+MergeCheckpointer::MergeCheckpointer(std::string const& mergeDir,
+                                     Hash const& key, uint64_t interval,
+                                     uint32_t checkpointsBeforeInterrupt,
+                                     std::function<void()> release)
+    : mOutputFilename(outputFilename(mergeDir, key))
+    , mCheckpointFilename(checkpointFilename(mergeDir, key))
+    , mInterval(interval)
+    , mNextCheckpoint(interval)
+    , mCheckpointsBeforeInterrupt(checkpointsBeforeInterrupt)
+    , mRelease(release)
+{
+    assert(interval > 0);
+}
+
+MergeCheckpointer::~MergeCheckpointer()
+{
+    mRelease();
+}
+
+std::string const&
+MergeCheckpointer::getOutputFilename() const
+{
+    return mOutputFilename;
+}
+
+std::unique_ptr<MergeCheckpoint>
+MergeCheckpointer::resume(std::vector<Hash> const& inputs)
+{
+    mInputs = inputs;
+    std::unique_ptr<MergeCheckpoint> cp;
+    if (fs::exists(mCheckpointFilename) && fs::exists(mOutputFilename))
+    {
+        try
+        {
+            cp = MergeCheckpoint::load(mCheckpointFilename);
+            SHA256::create()->restoreState(cp->mHashState);
+            if (cp->mInputs != inputs ||
+                fs::size(mOutputFilename) < cp->mBytesPut)
+            {
+                cp.reset();
+            }
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "Bucket") << "Ignoring merge checkpoint "
+                                    << mCheckpointFilename << ": " << e.what();
+            cp.reset();
+        }
+    }
+
+    if (cp)
+    {
+        CLOG(INFO, "Bucket") << "Resuming merge from " << mCheckpointFilename
+                             << " at " << cp->mBytesPut << " bytes";
+        mNextCheckpoint = cp->mBytesPut + mInterval;
+    }
+    else
+    {
+        std::remove(mCheckpointFilename.c_str());
+        std::remove(mOutputFilename.c_str());
+    }
+    return cp;
+}
+
+bool
+MergeCheckpointer::isDue(uint64_t bytesPut) const
+{
+    return bytesPut >= mNextCheckpoint;
+}
+
+void
+MergeCheckpointer::save(MergeCheckpoint& cp)
+{
+    cp.mInputs = mInputs;
+    // The checkpoint must never describe output that a crash could lose.
+    fs::syncFile(mOutputFilename);
+    cp.save(mCheckpointFilename);
+    mNextCheckpoint = cp.mBytesPut + mInterval;
+
+    if (mCheckpointsBeforeInterrupt != 0 && --mCheckpointsBeforeInterrupt == 0)
+    {
+        throw std::runtime_error("merge interrupted for testing");
+    }
+}
+
+void
+MergeCheckpointer::finish()
+{
+    std::remove(mCheckpointFilename.c_str());
+}
+}
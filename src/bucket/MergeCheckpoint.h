@@ -0,0 +1,77 @@
+#pragma once
+
+
+#include "overlay/VIIXDR.h"
+#include "util/NonCopyable.h"
+#include "util/optional.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace viichain
+{
+
+// Progress of a partially written merge output: how many bytes of the output
+// are complete, where each input resumes, and the hasher and buffered entry
+// of the output at that point. Inputs are ordered old, new, shadows.
+struct MergeCheckpoint
+{
+    static constexpr uint64_t kCheckpointFormatVersion = 1;
+
+    std::vector<Hash> mInputs;
+    std::vector<uint64_t> mInputOffsets;
+    uint64_t mBytesPut{0};
+    uint64_t mObjectsPut{0};
+    std::vector<uint8_t> mHashState;
+    optional<BucketEntry> mBuffered;
+
+    static std::unique_ptr<MergeCheckpoint> load(std::string const& filename);
+
+    void save(std::string const& filename) const;
+};
+
+// Owns the partial output and checkpoint files of one resumable merge. The
+// files are named after the merge's Bucket::mergeKey, so a node that restarts
+// the same merge after a crash finds and continues them.
+class MergeCheckpointer : NonMovableOrCopyable
+{
+    std::string mOutputFilename;
+    std::string mCheckpointFilename;
+    uint64_t mInterval;
+    uint64_t mNextCheckpoint;
+    uint32_t mCheckpointsBeforeInterrupt;
+    std::function<void()> mRelease;
+    std::vector<Hash> mInputs;
+
+  public:
+    static std::string outputFilename(std::string const& mergeDir,
+                                      Hash const& key);
+    static std::string checkpointFilename(std::string const& mergeDir,
+                                          Hash const& key);
+
+    // A nonzero checkpointsBeforeInterrupt makes save() throw after that many
+    // checkpoints, simulating a crash in tests.
+    MergeCheckpointer(std::string const& mergeDir, Hash const& key,
+                      uint64_t interval, uint32_t checkpointsBeforeInterrupt,
+                      std::function<void()> release);
+    ~MergeCheckpointer();
+
+    std::string const& getOutputFilename() const;
+
+    // Must be called before the merge starts. Returns the saved checkpoint if
+    // it belongs to a merge of inputs and the partial output holds everything
+    // it covers. Otherwise removes any leftover files and returns nullptr.
+    std::unique_ptr<MergeCheckpoint> resume(std::vector<Hash> const& inputs);
+
+    bool isDue(uint64_t bytesPut) const;
+
+    // Records the merge inputs in cp and writes it. The partial output must
+    // already be flushed up to cp.mBytesPut.
+    void save(MergeCheckpoint& cp);
+
+    // Removes the checkpoint once the output has been adopted as a bucket.
+    void finish();
+};
+}
@@ -0,0 +1,287 @@
+#include "util/asio.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketBloomFilter.h"
+#include "bucket/BucketIndex.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "bucket/BucketStats.h"
+#include "bucket/BucketTests.h"
+#include "ledger/LedgerHashUtils.h"
+#include "ledger/test/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Fs.h"
+#include "util/Timer.h"
+#include "util/types.h"
+
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace viichain;
+using namespace BucketTests;
+
+namespace BucketIndexTests
+{
+
+static void
+checkBucketLookups(Config const& cfg, bool expectPaged)
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto vers = getAppLedgerVersion(app);
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(1000);
+    std::vector<LedgerKey> dead;
+    for (auto const& e : LedgerTestUtils::generateValidLedgerEntries(100))
+    {
+        dead.emplace_back(LedgerEntryKey(e));
+    }
+
+    auto b = Bucket::fresh(bm, vers, {}, live, dead, true);
+    REQUIRE(b->isIndexed());
+    REQUIRE(b->getIndex().isPaged() == expectPaged);
+
+    for (auto const& e : live)
+    {
+        auto be = b->getBucketEntry(LedgerEntryKey(e));
+        REQUIRE(be);
+        REQUIRE(be->type() == LIVEENTRY);
+        REQUIRE(be->liveEntry() == e);
+    }
+    for (auto const& k : dead)
+    {
+        auto be = b->getBucketEntry(k);
+        REQUIRE(be);
+        REQUIRE(be->type() == DEADENTRY);
+        REQUIRE(be->deadEntry() == k);
+    }
+    for (auto const& e : LedgerTestUtils::generateValidLedgerEntries(100))
+    {
+        REQUIRE(!b->getBucketEntry(LedgerEntryKey(e)));
+    }
+
+    auto indexFilename = BucketIndex::indexFilename(b->getFilename());
+    REQUIRE(fs::exists(indexFilename));
+    auto loaded = BucketIndex::load(indexFilename);
+    REQUIRE(loaded->isPaged() == b->getIndex().isPaged());
+    REQUIRE(loaded->size() == b->getIndex().size());
+    REQUIRE(loaded->getPageSize() == b->getIndex().getPageSize());
+    auto rebuilt = BucketIndex::createIndex(
+        b->getFilename(), b->getIndex().getPageSize(),
+        expectPaged ? 0 : std::numeric_limits<uint64_t>::max());
+    REQUIRE(rebuilt->size() == b->getIndex().size());
+}
+}
+
+using namespace BucketIndexTests;
+
+TEST_CASE("bucket index lookups", "[bucket][bucketindex]")
+{
+    Config cfg(getTestConfig());
+    cfg.EXPERIMENTAL_BUCKETLIST_DB = true;
+
+    SECTION("individual index")
+    {
+        checkBucketLookups(cfg, false);
+    }
+
+    SECTION("paged index")
+    {
+        cfg.BUCKETLIST_DB_INDEX_CUTOFF = 0;
+        cfg.BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT = 10;
+        checkBucketLookups(cfg, true);
+    }
+
+    SECTION("paged index over mapped file")
+    {
+        cfg.MMAP_BUCKET_FILES = true;
+        cfg.BUCKETLIST_DB_INDEX_CUTOFF = 0;
+        cfg.BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT = 10;
+        checkBucketLookups(cfg, true);
+    }
+}
+
+TEST_CASE("bucket list lookups", "[bucket][bucketindex][bucketlist]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.EXPERIMENTAL_BUCKETLIST_DB = true;
+    cfg.BUCKETLIST_DB_INDEX_CUTOFF = 0;
+    cfg.BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT = 10;
+
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Application::pointer app = createTestApplication(clock, cfg);
+        BucketList bl;
+        std::unordered_map<LedgerKey, LedgerEntry> live;
+        std::unordered_set<LedgerKey> dead;
+
+        for (uint32_t i = 1;
+             !app->getClock().getIOContext().stopped() && i < 130; ++i)
+        {
+            app->getClock().crank(false);
+            auto liveBatch = LedgerTestUtils::generateValidLedgerEntries(8);
+            std::vector<LedgerKey> deadBatch;
+
+            if (i % 3 == 0 && live.size() > 1)
+            {
+                auto killed = live.begin();
+                auto updated = std::next(killed);
+                updated->second.lastModifiedLedgerSeq = i;
+                liveBatch.emplace_back(updated->second);
+                deadBatch.emplace_back(killed->first);
+                dead.insert(killed->first);
+                live.erase(killed);
+            }
+
+            for (auto const& e : liveBatch)
+            {
+                live[LedgerEntryKey(e)] = e;
+            }
+            bl.addBatch(*app, i, getAppLedgerVersion(app), {}, liveBatch,
+                        deadBatch);
+        }
+
+        for (auto const& kv : live)
+        {
+            auto e = bl.getLedgerEntry(kv.first);
+            REQUIRE(e);
+            REQUIRE(*e == kv.second);
+        }
+        for (auto const& k : dead)
+        {
+            REQUIRE(!bl.getLedgerEntry(k));
+        }
+    });
+}
+
+TEST_CASE("bucket bloom filter", "[bucket][bucketindex][bloom]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.BUCKET_BLOOM_FILTER_BITS_PER_KEY = 10;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(1000);
+    auto b = Bucket::fresh(bm, getAppLedgerVersion(app), {}, live, {}, true);
+    REQUIRE(b->hasBloomFilter());
+    REQUIRE(!b->isIndexed());
+
+    auto filterFilename = BucketBloomFilter::filterFilename(b->getFilename());
+    REQUIRE(fs::exists(filterFilename));
+    auto loaded = BucketBloomFilter::load(filterFilename);
+    auto rebuilt = BucketBloomFilter::createFilter(b->getFilename(), 10);
+    REQUIRE(loaded->getNumBits() == b->getBloomFilter().getNumBits());
+
+    for (auto const& e : live)
+    {
+        auto k = LedgerEntryKey(e);
+        REQUIRE(b->getBloomFilter().mayContain(k));
+        REQUIRE(loaded->mayContain(k));
+        REQUIRE(rebuilt->mayContain(k));
+        REQUIRE(b->getBucketEntry(k));
+    }
+
+    size_t falsePositives = 0;
+    auto absent = LedgerTestUtils::generateValidLedgerEntries(1000);
+    for (auto const& e : absent)
+    {
+        auto k = LedgerEntryKey(e);
+        if (b->getBloomFilter().mayContain(k))
+        {
+            ++falsePositives;
+        }
+        REQUIRE(loaded->mayContain(k) == b->getBloomFilter().mayContain(k));
+        REQUIRE(!b->getBucketEntry(k));
+    }
+    REQUIRE(falsePositives < absent.size() / 20);
+}
+
+TEST_CASE("bucket stats", "[bucket][bucketindex][bucketstats]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.BUCKET_STATS = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto vers = getAppLedgerVersion(app);
+
+    auto init = LedgerTestUtils::generateValidLedgerEntries(100);
+    auto live = LedgerTestUtils::generateValidLedgerEntries(400);
+    std::vector<LedgerKey> dead;
+    for (auto const& e : LedgerTestUtils::generateValidLedgerEntries(50))
+    {
+        dead.emplace_back(LedgerEntryKey(e));
+    }
+    auto b = Bucket::fresh(bm, vers, init, live, dead, true);
+    REQUIRE(b->hasStats());
+    auto const& stats = b->getStats();
+
+    BucketStats expected;
+    {
+        XDRBufferedInputFileStream in;
+        in.open(b->getFilename());
+        BucketEntry be;
+        size_t pos = 0;
+        while (in.readOne(be))
+        {
+            expected.add(be, in.pos() - pos);
+            pos = in.pos();
+        }
+    }
+    bool useInit =
+        vers >= Bucket::FIRST_PROTOCOL_SUPPORTING_INITENTRY_AND_METAENTRY;
+    REQUIRE(stats.mInitEntries == (useInit ? init.size() : 0));
+    REQUIRE(stats.mLiveEntries == live.size() + (useInit ? 0 : init.size()));
+    REQUIRE(stats.mDeadEntries == dead.size());
+    REQUIRE(stats.mBytes == b->getSize());
+    REQUIRE(*stats.mMinKey == *expected.mMinKey);
+    REQUIRE(*stats.mMaxKey == *expected.mMaxKey);
+
+    size_t total = 0;
+    for (auto const& kv : stats.mByType)
+    {
+        REQUIRE(kv.second.mEntries == expected.mByType[kv.first].mEntries);
+        REQUIRE(kv.second.mBytes == expected.mByType[kv.first].mBytes);
+        total += kv.second.mEntries;
+    }
+    REQUIRE(total == init.size() + live.size() + dead.size());
+
+    auto loaded =
+        BucketStats::load(BucketStats::statsFilename(b->getFilename()));
+    REQUIRE(loaded->mLiveEntries == stats.mLiveEntries);
+    REQUIRE(loaded->mByType.size() == stats.mByType.size());
+    REQUIRE(*loaded->mMaxKey == *stats.mMaxKey);
+    auto rebuilt = BucketStats::createStats(b->getFilename());
+    REQUIRE(rebuilt->mBytes == stats.mBytes);
+    REQUIRE(rebuilt->mDeadEntries == stats.mDeadEntries);
+
+    // A bucket without a stats file has them built when they are asked for.
+    auto statsFilename = BucketStats::statsFilename(b->getFilename());
+    std::remove(statsFilename.c_str());
+    auto reloaded = std::make_shared<Bucket>(b->getFilename(), b->getHash());
+    REQUIRE(!reloaded->hasStats());
+    REQUIRE(bm.loadBucketStats(reloaded));
+    REQUIRE(reloaded->getStats().mBytes == stats.mBytes);
+    REQUIRE(fs::exists(statsFilename));
+}
+
+TEST_CASE("bucket stats disabled", "[bucket][bucketindex][bucketstats]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto b = Bucket::fresh(bm, getAppLedgerVersion(app), {},
+                           LedgerTestUtils::generateValidLedgerEntries(10), {},
+                           true);
+    REQUIRE(!b->hasStats());
+    REQUIRE(!bm.loadBucketStats(b));
+    REQUIRE(!fs::exists(BucketStats::statsFilename(b->getFilename())));
+}
@@ -6,16 +6,24 @@
 #include "bucket/BucketManager.h"
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/BucketTests.h"
+#include "bucket/FutureBucket.h"
+#include "bucket/MergeCheckpoint.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
+#include "util/Fs.h"
 #include "util/Math.h"
 #include "util/Timer.h"
 
+#include <fstream>
+#include <future>
+
 using namespace viichain;
 using namespace BucketTests;
 
@@ -308,6 +316,211 @@ TEST_CASE("bucketmanager ownership", "[bucket][bucketmanager]")
     });
 }
 
+TEST_CASE("durable bucket writes", "[bucket][bucketmanager]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.DURABLE_BUCKET_WRITES = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto& syncTimer = app->getMetrics().NewTimer({"bucket", "file", "fsync"});
+    auto before = syncTimer.count();
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(10);
+    auto b = Bucket::fresh(bm, getAppLedgerVersion(app), {}, live, {}, true);
+    REQUIRE(fs::exists(b->getFilename()));
+    // One sync of the file and one of the bucket directory.
+    REQUIRE(syncTimer.count() == before + 2);
+
+    // A bucket identical to an existing one is discarded without syncing.
+    Bucket::fresh(bm, getAppLedgerVersion(app), {}, live, {}, true);
+    REQUIRE(syncTimer.count() == before + 2);
+}
+
+TEST_CASE("stale bucket sidecar files removed", "[bucket][bucketmanager]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto bucketName = bm.getBucketDir() + "/bucket-" +
+                      binToHex(HashUtils::random()) + ".xdr";
+    auto statsName = BucketStats::statsFilename(bucketName);
+    std::ofstream(statsName) << "stale";
+    REQUIRE(fs::exists(statsName));
+
+    // Assuming the state runs the cleanup of files no bucket refers to.
+    bm.assumeState(app->getLedgerManager().getLastClosedLedgerHAS(),
+                   getAppLedgerVersion(app));
+    REQUIRE(!fs::exists(statsName));
+}
+
+TEST_CASE("concurrent bucket loads share one bucket",
+          "[bucket][bucketmanager]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.EXPERIMENTAL_BUCKETLIST_DB = true;
+    cfg.DISABLE_BUCKET_GC = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto b = Bucket::fresh(bm, getAppLedgerVersion(app), {},
+                           LedgerTestUtils::generateValidLedgerEntries(100),
+                           {}, true);
+    auto hash = b->getHash();
+    auto indexFilename = BucketIndex::indexFilename(b->getFilename());
+    REQUIRE(fs::exists(indexFilename));
+
+    // Forget the bucket but keep its file, and make loads rebuild the index.
+    b.reset();
+    bm.forgetUnreferencedBuckets();
+    std::remove(indexFilename.c_str());
+
+    std::vector<std::future<std::shared_ptr<Bucket>>> loads;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        loads.emplace_back(std::async(std::launch::async, [&]() {
+            return bm.getBucketByHash(hash);
+        }));
+    }
+    auto first = loads.front().get();
+    REQUIRE(first);
+    REQUIRE(first->isIndexed());
+    for (size_t i = 1; i < loads.size(); ++i)
+    {
+        REQUIRE(loads[i].get() == first);
+    }
+    REQUIRE(fs::exists(indexFilename));
+}
+
+TEST_CASE("resume interrupted merge", "[bucket][bucketmanager]")
+{
+    VirtualClock clock;
+    Config cfgA(getTestConfig(0));
+    cfgA.BUCKET_MERGE_CHECKPOINT_INTERVAL = 1024;
+    cfgA.ARTIFICIALLY_INTERRUPT_MERGES_FOR_TESTING = 5;
+    Config cfgB(getTestConfig(1));
+    cfgB.BUCKET_MERGE_CHECKPOINT_INTERVAL = 1024;
+    Application::pointer appA = createTestApplication(clock, cfgA);
+    Application::pointer appB = createTestApplication(clock, cfgB);
+    auto& bmA = appA->getBucketManager();
+    auto& bmB = appB->getBucketManager();
+    auto vers = getAppLedgerVersion(appA);
+
+    auto oldLive = LedgerTestUtils::generateValidLedgerEntries(500);
+    auto newLive = LedgerTestUtils::generateValidLedgerEntries(500);
+    std::vector<LedgerKey> newDead;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        newDead.emplace_back(LedgerEntryKey(oldLive[i]));
+        newLive.emplace_back(oldLive[i + 100]);
+        newLive.back().lastModifiedLedgerSeq++;
+    }
+
+    auto oldA = Bucket::fresh(bmA, vers, {}, oldLive, {}, true);
+    auto newA = Bucket::fresh(bmA, vers, {}, newLive, newDead, true);
+    REQUIRE_THROWS_AS(Bucket::merge(bmA, vers, oldA, newA, {}, true, true),
+                      std::runtime_error);
+
+    auto key = Bucket::mergeKey(vers, oldA, newA, {}, true);
+    auto checkpointA =
+        MergeCheckpointer::checkpointFilename(bmA.getMergeDir(), key);
+    auto outputA = MergeCheckpointer::outputFilename(bmA.getMergeDir(), key);
+    REQUIRE(fs::exists(checkpointA));
+    REQUIRE(fs::exists(outputA));
+
+    SECTION("resume on another node")
+    {
+        // Move the interrupted merge to a node that does not interrupt it.
+        auto checkpointB =
+            MergeCheckpointer::checkpointFilename(bmB.getMergeDir(), key);
+        {
+            std::ifstream in(checkpointA, std::ios::binary);
+            std::ofstream out(checkpointB, std::ios::binary);
+            out << in.rdbuf();
+        }
+        {
+            std::ifstream in(outputA, std::ios::binary);
+            std::ofstream out(
+                MergeCheckpointer::outputFilename(bmB.getMergeDir(), key),
+                std::ios::binary);
+            out << in.rdbuf();
+        }
+
+        auto oldB = Bucket::fresh(bmB, vers, {}, oldLive, {}, true);
+        auto newB = Bucket::fresh(bmB, vers, {}, newLive, newDead, true);
+        auto resumedBefore = bmB.readMergeCounters().mResumedMerges;
+        auto resumed = Bucket::merge(bmB, vers, oldB, newB, {}, true, true);
+        REQUIRE(bmB.readMergeCounters().mResumedMerges == resumedBefore + 1);
+        REQUIRE(!fs::exists(checkpointB));
+
+        auto full = Bucket::merge(bmB, vers, oldB, newB, {}, true, true);
+        REQUIRE(bmB.readMergeCounters().mResumedMerges == resumedBefore + 1);
+        REQUIRE(resumed->getHash() == full->getHash());
+        REQUIRE(EntryCounts(resumed).sum() == EntryCounts(full).sum());
+    }
+
+    SECTION("checkpoint removed with its inputs")
+    {
+        bmA.forgetUnreferencedBuckets();
+        REQUIRE(fs::exists(checkpointA));
+
+        oldA.reset();
+        newA.reset();
+        bmA.forgetUnreferencedBuckets();
+        REQUIRE(!fs::exists(checkpointA));
+        REQUIRE(!fs::exists(outputA));
+    }
+}
+
+TEST_CASE("identical merges share one future", "[bucket][bucketmanager]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto vers = getAppLedgerVersion(app);
+
+    auto curr = Bucket::fresh(bm, vers, {},
+                              LedgerTestUtils::generateValidLedgerEntries(100),
+                              {}, true);
+    auto snap = Bucket::fresh(bm, vers, {},
+                              LedgerTestUtils::generateValidLedgerEntries(100),
+                              {}, true);
+    auto before = bm.readMergeCounters();
+
+    FutureBucket fb1(*app, curr, snap, {}, vers, true, true);
+    FutureBucket fb2(*app, curr, snap, {}, vers, true, true);
+    auto after = bm.readMergeCounters();
+    REQUIRE(after.mMergeReattachmentMisses ==
+            before.mMergeReattachmentMisses + 1);
+    REQUIRE(after.mRunningMergeReattachments +
+                after.mFinishedMergeReattachments ==
+            before.mRunningMergeReattachments +
+                before.mFinishedMergeReattachments + 1);
+
+    auto out1 = fb1.resolve();
+    auto out2 = fb2.resolve();
+    REQUIRE(out1 == out2);
+
+    // Once finished, the output is reused while it is still alive.
+    bm.forgetUnreferencedBuckets();
+    before = bm.readMergeCounters();
+    FutureBucket fb3(*app, curr, snap, {}, vers, true, true);
+    REQUIRE(fb3.resolve() == out1);
+    after = bm.readMergeCounters();
+    REQUIRE(after.mFinishedMergeReattachments ==
+            before.mFinishedMergeReattachments + 1);
+
+    // Merges that keep and drop dead entries are distinct.
+    FutureBucket fb4(*app, curr, snap, {}, vers, false, true);
+    fb4.resolve();
+    REQUIRE(bm.readMergeCounters().mMergeReattachmentMisses ==
+            after.mMergeReattachmentMisses + 1);
+}
+
 class StopAndRestartBucketMergesTest
 {
     static void
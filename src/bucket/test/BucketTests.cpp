@@ -16,6 +16,8 @@
 #include "util/Timer.h"
 #include "xdrpp/autocheck.h"
 
+#include <fstream>
+
 using namespace viichain;
 
 namespace BucketTests
@@ -326,6 +328,188 @@ TEST_CASE("merges refuse to exceed max protocol version",
                       std::runtime_error);
 }
 
+TEST_CASE("parallel merge matches sequential merge", "[bucket][bucketmerge]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(1));
+    cfg.BUCKET_MERGE_THREADS = 4;
+    cfg.BUCKET_MERGE_MIN_PARTITION_SIZE = 1;
+    cfg.BUCKET_STATS = true;
+    // Split points come from the bucket index.
+    cfg.EXPERIMENTAL_BUCKETLIST_DB = true;
+    cfg.BUCKET_BLOOM_FILTER_BITS_PER_KEY = 10;
+    SECTION("individual index")
+    {
+    }
+    SECTION("paged index")
+    {
+        cfg.BUCKETLIST_DB_INDEX_CUTOFF = 0;
+        cfg.BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT = 10;
+    }
+
+    auto oldLive = LedgerTestUtils::generateValidLedgerEntries(400);
+    auto added = LedgerTestUtils::generateValidLedgerEntries(200);
+    std::vector<LedgerEntry> updated(oldLive.begin(), oldLive.begin() + 100);
+    for (auto& e : updated)
+    {
+        ++e.lastModifiedLedgerSeq;
+    }
+    std::vector<LedgerKey> dead;
+    for (size_t i = 100; i < 150; ++i)
+    {
+        dead.emplace_back(LedgerEntryKey(oldLive[i]));
+    }
+    std::vector<LedgerEntry> shadowed(added.begin(), added.begin() + 30);
+
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Config seqCfg(getTestConfig(0));
+        seqCfg.LEDGER_PROTOCOL_VERSION = cfg.LEDGER_PROTOCOL_VERSION;
+        seqCfg.BUCKET_STATS = true;
+        Application::pointer seqApp = createTestApplication(clock, seqCfg);
+        Application::pointer parApp = createTestApplication(clock, cfg);
+        auto vers = getAppLedgerVersion(parApp);
+
+        auto doMerge = [&](Application::pointer app) {
+            auto& bm = app->getBucketManager();
+            auto bOld = Bucket::fresh(bm, vers, {}, oldLive, {}, true);
+            auto bNew = Bucket::fresh(bm, vers, added, updated, dead, true);
+            auto bShadow = Bucket::fresh(bm, vers, {}, shadowed, {}, true);
+            return Bucket::merge(bm, vers, bOld, bNew, {bShadow}, true, true);
+        };
+        auto seq = doMerge(seqApp);
+        auto par = doMerge(parApp);
+
+        REQUIRE(seq->getHash() == par->getHash());
+        REQUIRE(seq->getSize() == par->getSize());
+        EntryCounts seqCounts(seq);
+        EntryCounts parCounts(par);
+        REQUIRE(seqCounts.sum() == parCounts.sum());
+        REQUIRE(seqCounts.nMeta == parCounts.nMeta);
+        REQUIRE(seq->getStats().mBytes == par->getStats().mBytes);
+        REQUIRE(seq->getStats().mLiveEntries == par->getStats().mLiveEntries);
+        REQUIRE(*seq->getStats().mMinKey == *par->getStats().mMinKey);
+        REQUIRE(*seq->getStats().mMaxKey == *par->getStats().mMaxKey);
+
+        // The index and bloom filter combined from the partitions find
+        // every entry.
+        REQUIRE(par->isIndexed());
+        REQUIRE(par->hasBloomFilter());
+        for (BucketInputIterator it(seq); it; ++it)
+        {
+            auto found =
+                par->getBucketEntry(BucketIndex::getBucketLedgerKey(*it));
+            REQUIRE(found);
+            REQUIRE(*found == *it);
+        }
+
+        auto seqMc = seqApp->getBucketManager().readMergeCounters();
+        auto parMc = parApp->getBucketManager().readMergeCounters();
+        REQUIRE(seqMc.mOldEntriesDefaultAccepted ==
+                parMc.mOldEntriesDefaultAccepted);
+        REQUIRE(seqMc.mNewEntriesDefaultAccepted ==
+                parMc.mNewEntriesDefaultAccepted);
+        REQUIRE(seqMc.mNewEntriesMergedWithOldNeitherInit ==
+                parMc.mNewEntriesMergedWithOldNeitherInit);
+        REQUIRE(seqMc.mOutputIteratorBufferUpdates ==
+                parMc.mOutputIteratorBufferUpdates);
+        REQUIRE(seqMc.mPreInitEntryProtocolMerges ==
+                parMc.mPreInitEntryProtocolMerges);
+        REQUIRE(seqMc.mPostInitEntryProtocolMerges ==
+                parMc.mPostInitEntryProtocolMerges);
+    });
+}
+
+TEST_CASE("failed parallel merge removes its partitions",
+          "[bucket][bucketmerge]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.BUCKET_MERGE_THREADS = 4;
+    cfg.BUCKET_MERGE_MIN_PARTITION_SIZE = 1;
+    cfg.EXPERIMENTAL_BUCKETLIST_DB = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto vers = getAppLedgerVersion(app);
+
+    auto bOld = Bucket::fresh(bm, vers, {},
+                              LedgerTestUtils::generateValidLedgerEntries(400),
+                              {}, true);
+    auto bNew = Bucket::fresh(bm, vers, {},
+                              LedgerTestUtils::generateValidLedgerEntries(400),
+                              {}, true);
+
+    // Give the last record of the new bucket a size running past the end of
+    // the file, so that only the last partition fails.
+    auto const& index = bNew->getIndex();
+    uint64_t offset;
+    REQUIRE(index.lookup(index.getKey(index.size() - 1), offset));
+    {
+        std::fstream f(bNew->getFilename(),
+                       std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(offset);
+        char const mark[] = {'\x80', '\x0f', '\xff', '\xf0'};
+        f.write(mark, sizeof(mark));
+    }
+
+    REQUIRE_THROWS(Bucket::merge(bm, vers, bOld, bNew, {}, true, true));
+    auto leftovers =
+        fs::findfiles(bm.getTmpDir(), [](std::string const& name) {
+            return name.find("tmp-bucket-") == 0;
+        });
+    REQUIRE(leftovers.empty());
+}
+
+#ifdef USE_ZSTD
+TEST_CASE("compressed buckets match uncompressed buckets",
+          "[bucket][bucketcompression]")
+{
+    VirtualClock clock;
+    Config rawCfg(getTestConfig(0));
+    Config cfg(getTestConfig(1));
+    cfg.COMPRESS_BUCKET_FILES = true;
+    cfg.EXPERIMENTAL_BUCKETLIST_DB = true;
+    cfg.BUCKETLIST_DB_INDEX_CUTOFF = 0;
+    cfg.BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT = 10;
+    Application::pointer rawApp = createTestApplication(clock, rawCfg);
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto vers = getAppLedgerVersion(app);
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(2000);
+    auto added = LedgerTestUtils::generateValidLedgerEntries(500);
+    auto doMerge = [&](Application::pointer app) {
+        auto& bm = app->getBucketManager();
+        auto bOld = Bucket::fresh(bm, vers, {}, live, {}, true);
+        auto bNew = Bucket::fresh(bm, vers, added, {}, {}, true);
+        return Bucket::merge(bm, vers, bOld, bNew, {}, true, true);
+    };
+    auto raw = doMerge(rawApp);
+    auto b = doMerge(app);
+
+    REQUIRE(!raw->isCompressed());
+    REQUIRE(b->isCompressed());
+    REQUIRE(b->getHash() == raw->getHash());
+    REQUIRE(b->getSize() == raw->getSize());
+    REQUIRE(fileSize(b->getFilename()) < fileSize(raw->getFilename()));
+    REQUIRE(countEntries(b) == live.size() + added.size());
+
+    for (auto const& e : added)
+    {
+        auto be = b->getBucketEntry(LedgerEntryKey(e));
+        REQUIRE(be);
+        REQUIRE(be->liveEntry() == e);
+    }
+
+    auto decompressed = b->getFilename() + ".raw";
+    BlockCompressedReader::decompressFile(b->getFilename(), decompressed);
+    auto readFile = [](std::string const& name) {
+        std::ifstream in(name, std::ifstream::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    };
+    REQUIRE(readFile(decompressed) == readFile(raw->getFilename()));
+    std::remove(decompressed.c_str());
+}
+#endif
+
 TEST_CASE("bucket output iterator rejects wrong-version entries",
           "[bucket][bucketinitoutput]")
 {
@@ -674,6 +858,13 @@ TEST_CASE("bucket apply", "[bucket]")
 {
     VirtualClock clock;
     Config cfg(getTestConfig());
+    SECTION("read from file")
+    {
+    }
+    SECTION("read from mapping")
+    {
+        cfg.MMAP_BUCKET_FILES = true;
+    }
     for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
         Application::pointer app = createTestApplication(clock, cfg);
         app->start();
@@ -697,6 +888,8 @@ TEST_CASE("bucket apply", "[bucket]")
         std::shared_ptr<Bucket> death =
             Bucket::fresh(app->getBucketManager(), getAppLedgerVersion(app), {},
                           noLive, dead, /*countMergeEvents=*/true);
+        REQUIRE(static_cast<bool>(birth->getMapping()) ==
+                cfg.MMAP_BUCKET_FILES);
 
         CLOG(INFO, "Bucket")
             << "Applying bucket with " << live.size() << " live entries";
@@ -109,6 +109,24 @@ ApplyLedgerChainWork::getCurrentTxSet()
     return std::make_shared<TxSetFrame>(lm.getLastClosedLedgerHeader().hash);
 }
 
+void
+ApplyLedgerChainWork::prefetchTxSet(uint32_t seq)
+{
+    // Reads ahead to the transactions of ledger seq, if they are in the
+    // current file. getCurrentTxSet starts from mTxHistoryEntry, so the
+    // entry read here is not lost.
+    while (mTxHistoryEntry.ledgerSeq < seq && mTxIn &&
+           mTxIn.readOne(mTxHistoryEntry))
+    {
+    }
+
+    if (mTxHistoryEntry.ledgerSeq == seq)
+    {
+        TxSetFrame txSet(mApp.getNetworkID(), mTxHistoryEntry.txSet);
+        mApp.getLedgerManager().prefetchTxSetAsync(txSet, seq);
+    }
+}
+
 bool
 ApplyLedgerChainWork::applyHistoryOfSingleLedger()
 {
@@ -195,6 +213,9 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
             hexAbbrev(header.scpValue.txSetHash)));
     }
 
+    // Load the next ledger's entries while this one applies.
+    prefetchTxSet(header.ledgerSeq + 1);
+
     LedgerCloseData closeData(header.ledgerSeq, txset, header.scpValue);
     lm.closeLedger(closeData);
 
@@ -35,6 +35,7 @@ class ApplyLedgerChainWork : public BasicWork
     bool mFilesOpen{false};
 
     TxSetFramePtr getCurrentTxSet();
+    void prefetchTxSet(uint32_t seq);
     void openCurrentInputFiles();
     bool applyHistoryOfSingleLedger();
 
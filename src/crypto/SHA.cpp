@@ -2,6 +2,7 @@
 #include "crypto/SHA.h"
 #include "crypto/ByteSlice.h"
 #include "util/NonCopyable.h"
+#include <cstring>
 #include <sodium.h>
 
 namespace viichain
@@ -28,6 +29,8 @@ class SHA256Impl : public SHA256, NonCopyable
     void reset() override;
     void add(ByteSlice const& bin) override;
     uint256 finish() override;
+    std::vector<uint8_t> saveState() const override;
+    void restoreState(std::vector<uint8_t> const& state) override;
 };
 
 std::unique_ptr<SHA256>
@@ -80,6 +83,28 @@ SHA256Impl::finish()
     return out;
 }
 
+std::vector<uint8_t>
+SHA256Impl::saveState() const
+{
+    if (mFinished)
+    {
+        throw std::runtime_error("saving state of finished SHA256");
+    }
+    auto p = reinterpret_cast<uint8_t const*>(&mState);
+    return std::vector<uint8_t>(p, p + sizeof(mState));
+}
+
+void
+SHA256Impl::restoreState(std::vector<uint8_t> const& state)
+{
+    if (state.size() != sizeof(mState))
+    {
+        throw std::runtime_error("malformed SHA256 state");
+    }
+    std::memcpy(&mState, state.data(), sizeof(mState));
+    mFinished = false;
+}
+
 HmacSha256Mac
 hmacSha256(HmacSha256Key const& key, ByteSlice const& bin)
 {
@@ -4,6 +4,7 @@
 #include "crypto/ByteSlice.h"
 #include "xdr/vii-types.h"
 #include <memory>
+#include <vector>
 
 namespace viichain
 {
@@ -18,6 +19,11 @@ class SHA256
     virtual void reset() = 0;
     virtual void add(ByteSlice const& bin) = 0;
     virtual uint256 finish() = 0;
+
+    // Intermediate state of an unfinished hash, so that hashing a long
+    // stream can be resumed in a later process on the same platform.
+    virtual std::vector<uint8_t> saveState() const = 0;
+    virtual void restoreState(std::vector<uint8_t> const& state) = 0;
 };
 
 HmacSha256Mac hmacSha256(HmacSha256Key const& key, ByteSlice const& bin);
@@ -9,6 +9,8 @@
 #include "util/HashOfHash.h"
 #include "util/Math.h"
 #include "util/RandomEvictionCache.h"
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <mutex>
 #include <sodium.h>
@@ -22,23 +24,66 @@ namespace viichain
 {
 
 
-static std::mutex gVerifySigCacheMutex;
-static RandomEvictionCache<Hash, bool> gVerifySigCache(0xffff);
-static std::unique_ptr<SHA256> gHasher = SHA256::create();
-static uint64_t gVerifyCacheHit = 0;
-static uint64_t gVerifyCacheMiss = 0;
+static size_t const VERIFY_SIG_CACHE_ENTRY_BYTES =
+    sizeof(Hash) + sizeof(bool);
+
+// The signature cache is split into shards, picked by the leading bits of the
+// cache key, each behind its own lock, so that threads verifying different
+// signatures rarely wait for each other.
+static unsigned const VERIFY_SIG_CACHE_SHARD_BITS = 4;
+static size_t const VERIFY_SIG_CACHE_SHARDS = 1
+                                              << VERIFY_SIG_CACHE_SHARD_BITS;
+
+namespace
+{
+using VerifySigCache = RandomEvictionCache<Hash, bool>;
+
+size_t
+verifySigCacheShardSize(size_t totalEntries)
+{
+    return std::max<size_t>(1, (totalEntries + VERIFY_SIG_CACHE_SHARDS - 1) /
+                                   VERIFY_SIG_CACHE_SHARDS);
+}
+
+std::unique_ptr<VerifySigCache>
+makeVerifySigCacheShard(size_t totalEntries)
+{
+    size_t entries = verifySigCacheShardSize(totalEntries);
+    return std::make_unique<VerifySigCache>(
+        entries, CacheEvictionPolicy::RANDOM,
+        entries * VERIFY_SIG_CACHE_ENTRY_BYTES);
+}
+
+struct VerifySigCacheShard
+{
+    std::mutex mMutex;
+    std::unique_ptr<VerifySigCache> mCache{makeVerifySigCacheShard(0xffff)};
+    uint64_t mHits{0};
+    uint64_t mMisses{0};
+};
+}
+
+static std::array<VerifySigCacheShard, VERIFY_SIG_CACHE_SHARDS>
+    gVerifySigCacheShards;
+
+static size_t
+verifySigCacheShardIndex(Hash const& cacheKey)
+{
+    return cacheKey[0] >> (8 - VERIFY_SIG_CACHE_SHARD_BITS);
+}
 
 static Hash
-verifySigCacheKey(PublicKey const& key, Signature const& signature,
+verifySigCacheKey(PublicKey const& key, ByteSlice const& signature,
                   ByteSlice const& bin)
 {
     assert(key.type() == PUBLIC_KEY_TYPE_ED25519);
 
-    gHasher->reset();
-    gHasher->add(key.ed25519());
-    gHasher->add(signature);
-    gHasher->add(bin);
-    return gHasher->finish();
+    static thread_local std::unique_ptr<SHA256> hasher = SHA256::create();
+    hasher->reset();
+    hasher->add(key.ed25519());
+    hasher->add(signature);
+    hasher->add(bin);
+    return hasher->finish();
 }
 
 SecretKey::SecretKey() : mKeyType(PUBLIC_KEY_TYPE_ED25519)
@@ -211,18 +256,51 @@ SecretKey::fromStrKeySeed(std::string const& strKeySeed)
 void
 PubKeyUtils::clearVerifySigCache()
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.clear();
+    for (auto& shard : gVerifySigCacheShards)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache->clear();
+    }
+}
+
+void
+PubKeyUtils::setVerifySigCacheSize(size_t entries)
+{
+    for (auto& shard : gVerifySigCacheShards)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mCache->maxSize() != verifySigCacheShardSize(entries))
+        {
+            shard.mCache = makeVerifySigCacheShard(entries);
+        }
+    }
 }
 
 void
 PubKeyUtils::flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses)
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    hits = gVerifyCacheHit;
-    misses = gVerifyCacheMiss;
-    gVerifyCacheHit = 0;
-    gVerifyCacheMiss = 0;
+    hits = 0;
+    misses = 0;
+    for (auto& shard : gVerifySigCacheShards)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        hits += shard.mHits;
+        misses += shard.mMisses;
+        shard.mHits = 0;
+        shard.mMisses = 0;
+    }
+}
+
+size_t
+PubKeyUtils::getVerifySigCacheBytes()
+{
+    size_t bytes = 0;
+    for (auto& shard : gVerifySigCacheShards)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        bytes += shard.mCache->bytes();
+    }
+    return bytes;
 }
 
 std::string
@@ -303,25 +381,100 @@ PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
     }
 
     auto cacheKey = verifySigCacheKey(key, signature, bin);
+    auto& shard = gVerifySigCacheShards[verifySigCacheShardIndex(cacheKey)];
 
     {
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        if (gVerifySigCache.exists(cacheKey))
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mCache->exists(cacheKey))
         {
-            ++gVerifyCacheHit;
-            return gVerifySigCache.get(cacheKey);
+            ++shard.mHits;
+            return shard.mCache->get(cacheKey);
         }
+        ++shard.mMisses;
     }
 
-    ++gVerifyCacheMiss;
     bool ok =
         (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
                                      key.ed25519().data()) == 0);
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.put(cacheKey, ok);
+    std::lock_guard<std::mutex> guard(shard.mMutex);
+    shard.mCache->put(cacheKey, ok, VERIFY_SIG_CACHE_ENTRY_BYTES);
     return ok;
 }
 
+std::vector<bool>
+PubKeyUtils::verifySigs(std::vector<SignatureCheck> const& checks)
+{
+    std::vector<bool> res(checks.size(), false);
+    std::vector<Hash> cacheKeys(checks.size());
+    std::array<std::vector<size_t>, VERIFY_SIG_CACHE_SHARDS> byShard;
+    for (size_t i = 0; i < checks.size(); ++i)
+    {
+        auto const& check = checks[i];
+        assert(check.key.type() == PUBLIC_KEY_TYPE_ED25519);
+        if (check.signature.size() != 64)
+        {
+            continue;
+        }
+        cacheKeys[i] =
+            verifySigCacheKey(check.key, check.signature, check.message);
+        byShard[verifySigCacheShardIndex(cacheKeys[i])].emplace_back(i);
+    }
+
+    // Looks every signature up with one lock per shard, keeping only the
+    // misses in byShard.
+    for (size_t s = 0; s < VERIFY_SIG_CACHE_SHARDS; ++s)
+    {
+        auto& indexes = byShard[s];
+        if (indexes.empty())
+        {
+            continue;
+        }
+        auto& shard = gVerifySigCacheShards[s];
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        auto hits = std::remove_if(
+            indexes.begin(), indexes.end(), [&](size_t i) {
+                if (!shard.mCache->exists(cacheKeys[i]))
+                {
+                    return false;
+                }
+                res[i] = shard.mCache->get(cacheKeys[i]);
+                return true;
+            });
+        shard.mHits += indexes.end() - hits;
+        indexes.erase(hits, indexes.end());
+        shard.mMisses += indexes.size();
+    }
+
+    for (auto const& indexes : byShard)
+    {
+        for (auto i : indexes)
+        {
+            auto const& check = checks[i];
+            res[i] =
+                (crypto_sign_verify_detached(
+                     check.signature.data(), check.message.data(),
+                     check.message.size(), check.key.ed25519().data()) == 0);
+        }
+    }
+
+    for (size_t s = 0; s < VERIFY_SIG_CACHE_SHARDS; ++s)
+    {
+        auto const& indexes = byShard[s];
+        if (indexes.empty())
+        {
+            continue;
+        }
+        auto& shard = gVerifySigCacheShards[s];
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        for (auto i : indexes)
+        {
+            shard.mCache->put(cacheKeys[i], res[i],
+                              VERIFY_SIG_CACHE_ENTRY_BYTES);
+        }
+    }
+    return res;
+}
+
 PublicKey
 PubKeyUtils::random()
 {
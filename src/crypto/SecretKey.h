@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include "crypto/ByteSlice.h"
 #include "crypto/KeyUtils.h"
 #include "util/XDROperators.h"
 #include "xdr/vii-types.h"
@@ -8,11 +9,11 @@
 #include <array>
 #include <functional>
 #include <ostream>
+#include <vector>
 
 namespace viichain
 {
 
-class ByteSlice;
 struct SecretValue;
 struct SignerKey;
 
@@ -93,8 +94,29 @@ namespace PubKeyUtils
 bool verifySig(PublicKey const& key, Signature const& signature,
                ByteSlice const& bin);
 
+// A signature to check with verifySigs. The signature and message are not
+// copied and must outlive the check.
+struct SignatureCheck
+{
+    PublicKey key;
+    ByteSlice signature;
+    ByteSlice message;
+};
+
+// Checks each signature like verifySig, but looks the whole batch up in the
+// signature cache and records the results under a single lock each, and
+// returns whether each of them is valid. libsodium has no batch equation for
+// ed25519, so the signatures missing from the cache are still verified one
+// at a time.
+std::vector<bool> verifySigs(std::vector<SignatureCheck> const& checks);
+
 void clearVerifySigCache();
+// Resizes the signature cache to hold about this many results, emptying it
+// if its size changes.
+void setVerifySigCacheSize(size_t entries);
 void flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses);
+// Bytes taken by the keys and results in the signature cache.
+size_t getVerifySigCacheBytes();
 
 PublicKey random();
 }
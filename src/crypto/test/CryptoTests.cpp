@@ -8,6 +8,7 @@
 #include "lib/catch.hpp"
 #include "test/test.h"
 #include "util/Logging.h"
+#include "util/format.h"
 #include <autocheck/autocheck.hpp>
 #include <map>
 #include <regex>
@@ -149,6 +150,79 @@ TEST_CASE("sign tests", "[crypto]")
     CHECK(!PubKeyUtils::verifySig(pk, sig, msg));
 }
 
+TEST_CASE("batch verify", "[crypto]")
+{
+    PubKeyUtils::clearVerifySigCache();
+    uint64_t hits, misses;
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+    auto sk1 = SecretKey::random();
+    auto sk2 = SecretKey::random();
+    std::string msg = "hello";
+    std::string otherMsg = "helloo";
+    auto sig1 = sk1.sign(msg);
+    auto sig2 = sk2.sign(msg);
+    auto badSig = sig2;
+    badSig[4] ^= 1;
+    auto shortSig = sig1;
+    shortSig.resize(32);
+
+    std::vector<PubKeyUtils::SignatureCheck> checks{
+        {sk1.getPublicKey(), sig1, msg},
+        {sk2.getPublicKey(), sig1, msg},
+        {sk1.getPublicKey(), sig1, otherMsg},
+        {sk2.getPublicKey(), badSig, msg},
+        {sk2.getPublicKey(), sig2, msg},
+        {sk1.getPublicKey(), shortSig, msg}};
+    std::vector<bool> expected{true, false, false, false, true, false};
+
+    REQUIRE(PubKeyUtils::verifySigs(checks) == expected);
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == 0);
+    REQUIRE(misses == 5);
+
+    SECTION("results are cached")
+    {
+        REQUIRE(PubKeyUtils::verifySigs(checks) == expected);
+        PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+        REQUIRE(hits == 5);
+        REQUIRE(misses == 0);
+    }
+
+    SECTION("verifySig finds the results")
+    {
+        REQUIRE(PubKeyUtils::verifySig(sk2.getPublicKey(), sig2, msg));
+        REQUIRE(!PubKeyUtils::verifySig(sk2.getPublicKey(), badSig, msg));
+        PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+        REQUIRE(hits == 2);
+        REQUIRE(misses == 0);
+    }
+}
+
+TEST_CASE("signature cache size", "[crypto]")
+{
+    size_t const entries = 64;
+    PubKeyUtils::setVerifySigCacheSize(entries);
+    PubKeyUtils::clearVerifySigCache();
+    uint64_t hits, misses;
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+    auto sk = SecretKey::random();
+    for (int i = 0; i < 500; ++i)
+    {
+        auto msg = fmt::format("message {}", i);
+        REQUIRE(PubKeyUtils::verifySig(sk.getPublicKey(), sk.sign(msg), msg));
+    }
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == 0);
+    REQUIRE(misses == 500);
+    REQUIRE(PubKeyUtils::getVerifySigCacheBytes() > 0);
+    REQUIRE(PubKeyUtils::getVerifySigCacheBytes() <=
+            entries * (sizeof(Hash) + sizeof(bool)));
+
+    PubKeyUtils::setVerifySigCacheSize(getTestConfig().SIGNATURE_CACHE_SIZE);
+}
+
 struct SignVerifyTestcase
 {
     SecretKey key;
@@ -32,6 +32,7 @@
 #ifdef USE_POSTGRES
 #include <lib/soci/src/backends/postgresql/soci-postgresql.h>
 #endif
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
@@ -289,6 +290,16 @@ Database::getSelectTimer(std::string const& entityName)
         .TimeScope();
 }
 
+optional<medida::TimerContext>
+Database::getSelectTimer(std::string const& entityName, soci::session& session)
+{
+    if (&session != &mSession)
+    {
+        return nullopt<medida::TimerContext>();
+    }
+    return make_optional<medida::TimerContext>(getSelectTimer(entityName));
+}
+
 medida::TimerContext
 Database::getDeleteTimer(std::string const& entityName)
 {
@@ -299,6 +310,16 @@ Database::getDeleteTimer(std::string const& entityName)
         .TimeScope();
 }
 
+optional<medida::TimerContext>
+Database::getDeleteTimer(std::string const& entityName, soci::session& session)
+{
+    if (&session != &mSession)
+    {
+        return nullopt<medida::TimerContext>();
+    }
+    return make_optional<medida::TimerContext>(getDeleteTimer(entityName));
+}
+
 medida::TimerContext
 Database::getUpdateTimer(std::string const& entityName)
 {
@@ -319,6 +340,16 @@ Database::getUpsertTimer(std::string const& entityName)
         .TimeScope();
 }
 
+optional<medida::TimerContext>
+Database::getUpsertTimer(std::string const& entityName, soci::session& session)
+{
+    if (&session != &mSession)
+    {
+        return nullopt<medida::TimerContext>();
+    }
+    return make_optional<medida::TimerContext>(getUpsertTimer(entityName));
+}
+
 void
 Database::setCurrentTransactionReadOnly()
 {
@@ -399,7 +430,10 @@ Database::getPool()
             s += removePasswordFromConnectionString(c.value);
             throw std::runtime_error(s);
         }
-        size_t n = std::thread::hardware_concurrency();
+        // hardware_concurrency may be 0 or 1. Keep a session beyond one per
+        // core for the write-behind thread and one for a background
+        // prefetch, whose callers on the main thread wait for them.
+        size_t n = std::max(std::thread::hardware_concurrency(), 1u) + 2;
         LOG(INFO) << "Establishing " << n << "-entry connection pool to: "
                   << removePasswordFromConnectionString(c.value);
         mPool = std::make_unique<soci::connection_pool>(n);
@@ -409,7 +443,7 @@ Database::getPool()
             soci::session& sess = mPool->at(i);
             sess.open(c.value);
             DatabaseConfigureSessionOp op(sess);
-            doDatabaseTypeSpecificOperation(op);
+            doDatabaseTypeSpecificOperation(op, sess);
         }
     }
     assert(mPool);
@@ -473,6 +507,20 @@ Database::getPreparedStatement(std::string const& query)
     return sc;
 }
 
+StatementContext
+Database::getPreparedStatement(std::string const& query,
+                               soci::session& session)
+{
+    if (&session == &mSession)
+    {
+        return getPreparedStatement(query);
+    }
+    auto p = std::make_shared<soci::statement>(session);
+    p->alloc();
+    p->prepare(query);
+    return StatementContext(p);
+}
+
 std::shared_ptr<SQLLogContext>
 Database::captureAndLogSQL(std::string contextName)
 {
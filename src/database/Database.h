@@ -6,6 +6,7 @@
 #include "overlay/VIIXDR.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
+#include "util/optional.h"
 #include <set>
 #include <soci.h>
 #include <string>
@@ -85,13 +86,26 @@ class Database : NonMovableOrCopyable
 
                     StatementContext getPreparedStatement(std::string const& query);
 
+    // Prepares query on session, which may be a pool session used off the
+    // main thread. Only statements on the main session are cached.
+    StatementContext getPreparedStatement(std::string const& query,
+                                          soci::session& session);
+
             void clearPreparedStatementCache();
 
                 medida::TimerContext getInsertTimer(std::string const& entityName);
     medida::TimerContext getSelectTimer(std::string const& entityName);
+    // Times selects on the main session only; queries on other sessions run
+    // concurrently with it and would skew the idle-time accounting.
+    optional<medida::TimerContext>
+    getSelectTimer(std::string const& entityName, soci::session& session);
     medida::TimerContext getDeleteTimer(std::string const& entityName);
+    optional<medida::TimerContext>
+    getDeleteTimer(std::string const& entityName, soci::session& session);
     medida::TimerContext getUpdateTimer(std::string const& entityName);
     medida::TimerContext getUpsertTimer(std::string const& entityName);
+    optional<medida::TimerContext>
+    getUpsertTimer(std::string const& entityName, soci::session& session);
 
                 void setCurrentTransactionReadOnly();
 
@@ -99,6 +113,9 @@ class Database : NonMovableOrCopyable
 
         template <typename T>
     T doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op);
+    template <typename T>
+    T doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op,
+                                      soci::session& session);
 
             bool canUsePool() const;
 
@@ -121,7 +138,15 @@ template <typename T>
 T
 Database::doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op)
 {
-    auto b = mSession.get_backend();
+    return doDatabaseTypeSpecificOperation(op, mSession);
+}
+
+template <typename T>
+T
+Database::doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op,
+                                          soci::session& session)
+{
+    auto b = session.get_backend();
     if (auto sq = dynamic_cast<soci::sqlite3_session_backend*>(b))
     {
         return op.doSqliteSpecificOperation(sq);
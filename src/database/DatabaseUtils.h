@@ -2,6 +2,12 @@
 
 
 #include "Database.h"
+#ifdef USE_POSTGRES
+#include <iomanip>
+#include <libpq-fe.h>
+#include <limits>
+#include <sstream>
+#endif
 
 namespace viichain
 {
@@ -11,4 +17,57 @@ void deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
                             uint32_t count, std::string const& tableName,
                             std::string const& ledgerSeqColumn);
 }
+
+#ifdef USE_POSTGRES
+template <typename T>
+inline void
+marshalToPGArrayItem(PGconn* conn, std::ostringstream& oss, const T& item)
+{
+                    oss << std::setprecision(std::numeric_limits<T>::max_digits10) << item;
+}
+
+template <>
+inline void
+marshalToPGArrayItem<std::string>(PGconn* conn, std::ostringstream& oss,
+                                  const std::string& item)
+{
+    std::vector<char> buf(item.size() * 2 + 1, '\0');
+    int err = 0;
+    size_t len =
+        PQescapeStringConn(conn, buf.data(), item.c_str(), item.size(), &err);
+    if (err != 0)
+    {
+        throw std::runtime_error("Could not escape string in SQL");
+    }
+    oss << '"';
+    oss.write(buf.data(), len);
+    oss << '"';
+}
+
+template <typename T>
+inline void
+marshalToPGArray(PGconn* conn, std::string& out, const std::vector<T>& v,
+                 const std::vector<soci::indicator>* ind = nullptr)
+{
+    std::ostringstream oss;
+    oss << '{';
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        if (i > 0)
+        {
+            oss << ',';
+        }
+        if (ind && (*ind)[i] == soci::i_null)
+        {
+            oss << "NULL";
+        }
+        else
+        {
+            marshalToPGArrayItem(conn, oss, v[i]);
+        }
+    }
+    oss << '}';
+    out = oss.str();
+}
+#endif
 }
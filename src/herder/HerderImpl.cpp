@@ -28,6 +28,7 @@
 #include "medida/counter.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "util/Decoder.h"
 #include "util/XDRStream.h"
 #include "xdrpp/marshal.h"
@@ -607,7 +608,12 @@ bool
 HerderImpl::recvTxSet(Hash const& hash, const TxSetFrame& t)
 {
     auto txset = std::make_shared<TxSetFrame>(t);
-    return mPendingEnvelopes.recvTxSet(hash, txset);
+    if (!mPendingEnvelopes.recvTxSet(hash, txset))
+    {
+        return false;
+    }
+    txset->preverifySignatures(mApp);
+    return true;
 }
 
 void
@@ -666,11 +672,18 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
     }
 
             auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
-    auto proposedSet = mTransactionQueue.toTxSet(lcl.hash);
-    auto removed = proposedSet->trimInvalid(mApp);
-    mTransactionQueue.remove(removed);
-
-    proposedSet->surgePricingFilter(mApp);
+    TxSetFramePtr proposedSet;
+    {
+        auto timer = mApp.getMetrics()
+                         .NewTimer({"herder", "txset", "build"})
+                         .TimeScope();
+        proposedSet =
+            mTransactionQueue.toSurgePricedTxSet(lcl.hash, lcl.header);
+        auto removed = proposedSet->trimInvalid(mApp);
+        mTransactionQueue.remove(removed);
+
+        proposedSet->surgePricingFilter(mApp);
+    }
 
     if (!proposedSet->checkValid(mApp))
     {
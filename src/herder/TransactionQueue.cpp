@@ -3,14 +3,19 @@
 #include "crypto/SecretKey.h"
 #include "ledger/LedgerTxn.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "transactions/TransactionUtils.h"
 #include "util/HashOfHash.h"
 #include "util/XDROperators.h"
+#include "util/numeric.h"
+#include "xdrpp/marshal.h"
 
 #include <algorithm>
 #include <lib/util/format.h>
+#include <medida/counter.h>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
+#include <queue>
 
 namespace viichain
 {
@@ -79,11 +84,52 @@ TransactionQueue::TxMap::recalculate()
     }
 }
 
+static size_t
+txBytes(TransactionFramePtr const& tx)
+{
+    return xdr::xdr_size(tx->getEnvelope());
+}
+
+// Whether tx1 bids a higher fee per operation than tx2.
+static bool
+hasHigherFeeRate(TransactionFramePtr const& tx1,
+                 TransactionFramePtr const& tx2)
+{
+    auto ops1 = std::max<uint64_t>(1, tx1->getOperations().size());
+    auto ops2 = std::max<uint64_t>(1, tx2->getOperations().size());
+    return bigMultiply(static_cast<uint64_t>(tx1->getFeeBid()), ops2) >
+           bigMultiply(static_cast<uint64_t>(tx2->getFeeBid()), ops1);
+}
+
+bool
+TransactionQueue::FeeRateCompare::operator()(
+    TransactionFramePtr const& tx1, TransactionFramePtr const& tx2) const
+{
+    if (hasHigherFeeRate(tx1, tx2))
+    {
+        return true;
+    }
+    if (hasHigherFeeRate(tx2, tx1))
+    {
+        return false;
+    }
+    return lessThanXored(tx1->getFullHash(), tx2->getFullHash(), mSeed);
+}
+
 TransactionQueue::TransactionQueue(Application& app, int pendingDepth,
                                    int banDepth)
     : mApp(app)
+    , mOpsCount(
+          app.getMetrics().NewCounter({"herder", "pending-txs", "ops"}))
+    , mBytesCount(
+          app.getMetrics().NewCounter({"herder", "pending-txs", "bytes"}))
+    , mEvicted(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "evicted"}, "transaction"))
+    , mMaxOps(app.getConfig().TRANSACTION_QUEUE_MAX_OPS)
+    , mMaxBytes(app.getConfig().TRANSACTION_QUEUE_MAX_BYTES)
     , mPendingTransactions(pendingDepth)
     , mBannedTransactions(banDepth)
+    , mChainHeads(FeeRateCompare{HashUtils::random()})
 {
     for (auto i = 0; i < pendingDepth; i++)
     {
@@ -105,6 +151,12 @@ TransactionQueue::tryAdd(TransactionFramePtr tx)
         return TransactionQueue::AddResult::ADD_STATUS_DUPLICATE;
     }
 
+    std::vector<TransactionFramePtr> evictions;
+    if (!findEvictions(tx, evictions))
+    {
+        return TransactionQueue::AddResult::ADD_STATUS_QUEUE_FULL;
+    }
+
     auto info = getAccountTransactionQueueInfo(tx->getSourceID());
     LedgerTxn ltx(mApp.getLedgerTxnRoot());
     if (!tx->checkValid(ltx, info.mMaxSeq))
@@ -120,8 +172,16 @@ TransactionQueue::tryAdd(TransactionFramePtr tx)
         return TransactionQueue::AddResult::ADD_STATUS_ERROR;
     }
 
+    if (!evictions.empty())
+    {
+        remove(evictions);
+        mEvicted.Mark(evictions.size());
+    }
+
     auto map = findOrAdd(mPendingTransactions[0], tx->getSourceID());
     map->addTx(tx);
+    addToIndex(tx);
+    updateSizeMetrics();
 
     return TransactionQueue::AddResult::ADD_STATUS_PENDING;
 }
@@ -149,6 +209,7 @@ TransactionQueue::remove(std::vector<TransactionFramePtr> const& dropTxs)
                 auto j = txs.find(txID);
                 if (j != txs.end())
                 {
+                    removeFromIndex(j->second);
                     txs.erase(j);
                     if (txs.empty())
                     {
@@ -167,6 +228,7 @@ TransactionQueue::remove(std::vector<TransactionFramePtr> const& dropTxs)
             txm->recalculate();
         }
     }
+    updateSizeMetrics();
 }
 
 bool
@@ -219,6 +281,7 @@ TransactionQueue::shift()
         for (auto const& toBan : map.second->mTransactions)
         {
             bannedFront.insert(toBan.first);
+            removeFromIndex(toBan.second);
         }
     }
 
@@ -229,6 +292,7 @@ TransactionQueue::shift()
     {
         mSizeByAge[i]->set_count(countTxs(mPendingTransactions[i]));
     }
+    updateSizeMetrics();
 }
 
 int
@@ -237,6 +301,18 @@ TransactionQueue::countBanned(int index) const
     return static_cast<int>(mBannedTransactions[index].size());
 }
 
+size_t
+TransactionQueue::getQueueOps() const
+{
+    return mQueueOps;
+}
+
+size_t
+TransactionQueue::getQueueBytes() const
+{
+    return mQueueBytes;
+}
+
 std::shared_ptr<TxSetFrame>
 TransactionQueue::toTxSet(Hash const& lclHash) const
 {
@@ -256,6 +332,172 @@ TransactionQueue::toTxSet(Hash const& lclHash) const
     return result;
 }
 
+std::shared_ptr<TxSetFrame>
+TransactionQueue::toSurgePricedTxSet(Hash const& lclHash,
+                                     LedgerHeader const& header) const
+{
+    auto result = std::make_shared<TxSetFrame>(lclHash);
+
+    bool maxIsOps = header.ledgerVersion >= 11;
+    size_t opsLeft = maxIsOps ? header.maxTxSetSize
+                              : (header.maxTxSetSize * MAX_OPS_PER_TX);
+
+    // The transactions that follow one already taken from the same account,
+    // which compete with the chain heads not looked at yet.
+    auto const& better = mChainHeads.key_comp();
+    auto worse = [&](TransactionFramePtr const& tx1,
+                     TransactionFramePtr const& tx2) {
+        return better(tx2, tx1);
+    };
+    std::priority_queue<TransactionFramePtr, std::vector<TransactionFramePtr>,
+                        decltype(worse)>
+        successors(worse);
+
+    auto head = mChainHeads.begin();
+    while (opsLeft > 0)
+    {
+        TransactionFramePtr tx;
+        if (!successors.empty() &&
+            (head == mChainHeads.end() || better(successors.top(), *head)))
+        {
+            tx = successors.top();
+            successors.pop();
+        }
+        else if (head != mChainHeads.end())
+        {
+            tx = *head++;
+        }
+        else
+        {
+            break;
+        }
+
+        size_t opsCount =
+            maxIsOps ? tx->getOperations().size() : MAX_OPS_PER_TX;
+        if (opsCount > opsLeft)
+        {
+            // Like surgePricingFilter, leaves out the rest of the account's
+            // transactions as well.
+            continue;
+        }
+        result->add(tx);
+        opsLeft -= opsCount;
+
+        auto const& chain = mAccountChains.at(tx->getSourceID());
+        auto next = chain.upper_bound(tx->getSeqNum());
+        if (next != chain.end())
+        {
+            successors.push(next->second);
+        }
+    }
+
+    return result;
+}
+
+void
+TransactionQueue::addToIndex(TransactionFramePtr const& tx)
+{
+    auto& chain = mAccountChains[tx->getSourceID()];
+    if (!chain.empty())
+    {
+        mChainHeads.erase(chain.begin()->second);
+    }
+    if (chain.emplace(tx->getSeqNum(), tx).second)
+    {
+        mQueueOps += tx->getOperations().size();
+        mQueueBytes += txBytes(tx);
+    }
+    mChainHeads.insert(chain.begin()->second);
+}
+
+void
+TransactionQueue::removeFromIndex(TransactionFramePtr const& tx)
+{
+    auto chainIt = mAccountChains.find(tx->getSourceID());
+    if (chainIt == mAccountChains.end())
+    {
+        return;
+    }
+    auto& chain = chainIt->second;
+    auto it = chain.find(tx->getSeqNum());
+    if (it == chain.end() || it->second->getFullHash() != tx->getFullHash())
+    {
+        return;
+    }
+
+    bool wasHead = it == chain.begin();
+    if (wasHead)
+    {
+        mChainHeads.erase(it->second);
+    }
+    mQueueOps -= it->second->getOperations().size();
+    mQueueBytes -= txBytes(it->second);
+    chain.erase(it);
+    if (chain.empty())
+    {
+        mAccountChains.erase(chainIt);
+    }
+    else if (wasHead)
+    {
+        mChainHeads.insert(chain.begin()->second);
+    }
+}
+
+bool
+TransactionQueue::findEvictions(
+    TransactionFramePtr const& tx,
+    std::vector<TransactionFramePtr>& evictions) const
+{
+    size_t ops = tx->getOperations().size();
+    size_t bytes = txBytes(tx);
+    if (ops > mMaxOps || bytes > mMaxBytes)
+    {
+        return false;
+    }
+
+    size_t opsFreed = 0;
+    size_t bytesFreed = 0;
+    auto fits = [&]() {
+        return mQueueOps - opsFreed + ops <= mMaxOps &&
+               mQueueBytes - bytesFreed + bytes <= mMaxBytes;
+    };
+
+    for (auto head = mChainHeads.rbegin();
+         head != mChainHeads.rend() && !fits(); ++head)
+    {
+        // The transaction may follow the ones of its account in the queue,
+        // so their chain is never pushed out for it.
+        if ((*head)->getSourceID() == tx->getSourceID())
+        {
+            continue;
+        }
+        if (!hasHigherFeeRate(tx, *head))
+        {
+            break;
+        }
+        for (auto const& seqTx : mAccountChains.at((*head)->getSourceID()))
+        {
+            evictions.emplace_back(seqTx.second);
+            opsFreed += seqTx.second->getOperations().size();
+            bytesFreed += txBytes(seqTx.second);
+        }
+    }
+
+    if (!fits())
+    {
+        evictions.clear();
+        return false;
+    }
+    return true;
+}
+
+void
+TransactionQueue::updateSizeMetrics()
+{
+    mOpsCount.set_count(mQueueOps);
+    mBytesCount.set_count(mQueueBytes);
+}
+
 bool
 operator==(TransactionQueue::AccountTxQueueInfo const& x,
            TransactionQueue::AccountTxQueueInfo const& y)
@@ -9,7 +9,9 @@
 #include "xdr/vii-transaction.h"
 
 #include <deque>
+#include <map>
 #include <memory>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -17,6 +19,7 @@
 namespace medida
 {
 class Counter;
+class Meter;
 }
 
 namespace viichain
@@ -33,6 +36,9 @@ class TransactionQueue
         ADD_STATUS_DUPLICATE,
         ADD_STATUS_ERROR,
         ADD_STATUS_TRY_AGAIN_LATER,
+        // The queue is full and the transaction does not bid a higher fee
+        // per operation than the transactions it would push out.
+        ADD_STATUS_QUEUE_FULL,
         ADD_STATUS_COUNT
     };
 
@@ -65,18 +71,65 @@ class TransactionQueue
 
     int countBanned(int index) const;
     bool isBanned(Hash const& hash) const;
+
+    // Operations and XDR bytes of the transactions in the queue.
+    size_t getQueueOps() const;
+    size_t getQueueBytes() const;
+
     std::shared_ptr<TxSetFrame> toTxSet(Hash const& lclHash) const;
 
+    // Builds a transaction set that fits in the maxTxSetSize of header, as
+    // TxSetFrame::surgePricingFilter would pick it: the transactions with
+    // the highest fee per operation first, each account's in sequence order.
+    // Only walks the transactions it takes and the ones that do not fit.
+    std::shared_ptr<TxSetFrame>
+    toSurgePricedTxSet(Hash const& lclHash, LedgerHeader const& header) const;
+
   private:
+    // Orders transactions by fee per operation, highest first, then by
+    // their full hash xored with a random seed.
+    struct FeeRateCompare
+    {
+        Hash mSeed;
+        bool operator()(TransactionFramePtr const& tx1,
+                        TransactionFramePtr const& tx2) const;
+    };
+
     Application& mApp;
     std::vector<medida::Counter*> mSizeByAge;
+    medida::Counter& mOpsCount;
+    medida::Counter& mBytesCount;
+    medida::Meter& mEvicted;
+
+    size_t const mMaxOps;
+    size_t const mMaxBytes;
+    size_t mQueueOps{0};
+    size_t mQueueBytes{0};
     std::deque<AccountTxMap> mPendingTransactions;
     std::deque<std::unordered_set<Hash>> mBannedTransactions;
 
+    // The pending transactions of each account by sequence number, whatever
+    // their age, and the first transaction of each of these chains, kept in
+    // fee rate order as transactions come and go.
+    std::unordered_map<AccountID,
+                       std::map<SequenceNumber, TransactionFramePtr>>
+        mAccountChains;
+    std::set<TransactionFramePtr, FeeRateCompare> mChainHeads;
+
     bool contains(TransactionFramePtr tx) const;
+
+    void addToIndex(TransactionFramePtr const& tx);
+    void removeFromIndex(TransactionFramePtr const& tx);
+
+    // Finds the account chains, lowest fee rate first, to push out to make
+    // room for tx. Returns false if they cannot make enough room or do not
+    // all bid a lower fee rate than tx.
+    bool findEvictions(TransactionFramePtr const& tx,
+                       std::vector<TransactionFramePtr>& evictions) const;
+    void updateSizeMetrics();
 };
 
 static const char* TX_STATUS_STRING[static_cast<int>(
     TransactionQueue::AddResult::ADD_STATUS_COUNT)] = {
-    "PENDING", "DUPLICATE", "ERROR", "TRY_AGAIN_LATER"};
+    "PENDING", "DUPLICATE", "ERROR", "TRY_AGAIN_LATER", "QUEUE_FULL"};
 }
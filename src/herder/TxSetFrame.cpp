@@ -4,6 +4,7 @@
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
@@ -11,11 +12,15 @@
 #include "ledger/LedgerTxnHeader.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "transactions/TransactionUtils.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <numeric>
 
@@ -26,6 +31,10 @@ namespace viichain
 
 using namespace std;
 
+// Below this many signatures, spreading them over more jobs costs more than
+// it saves.
+static size_t const PREVERIFY_MIN_SIGNATURES_PER_JOB = 64;
+
 TxSetFrame::TxSetFrame(Hash const& previousLedgerHash)
     : mHashIsValid(false), mPreviousLedgerHash(previousLedgerHash)
 {
@@ -269,6 +278,15 @@ TxSetFrame::checkOrTrim(
         lastHash = tx->getFullHash();
     }
 
+    // checkValid verifies the signatures one by one, so verify them all in
+    // one batch first and let it find the results in the signature cache.
+    std::vector<PubKeyUtils::SignatureCheck> signatureChecks;
+    for (auto& tx : mTransactions)
+    {
+        tx->addSignatureChecks(ltx, signatureChecks);
+    }
+    PubKeyUtils::verifySigs(signatureChecks);
+
     for (auto& item : accountTxMap)
     {
         TransactionFramePtr lastTx;
@@ -332,6 +350,9 @@ TxSetFrame::trimInvalid(Application& app)
 bool
 TxSetFrame::checkValid(Application& app)
 {
+    auto timer = app.getMetrics()
+                     .NewTimer({"herder", "txset", "check-valid"})
+                     .TimeScope();
     auto& lcl = app.getLedgerManager().getLastClosedLedgerHeader();
         if (lcl.hash != mPreviousLedgerHash)
     {
@@ -371,6 +392,49 @@ TxSetFrame::checkValid(Application& app)
     return checkOrTrim(app, processInvalidTxLambda, processInsufficientBalance);
 }
 
+void
+TxSetFrame::preverifySignatures(Application& app)
+{
+    // The checks point into the transactions, which are kept alive by the
+    // jobs even if they get removed from this set in the meantime.
+    auto txs = std::make_shared<std::vector<TransactionFramePtr>>(
+        mTransactions);
+    auto checks = std::make_shared<std::vector<PubKeyUtils::SignatureCheck>>();
+    for (auto& tx : *txs)
+    {
+        tx->addMasterKeySignatureChecks(*checks);
+    }
+    if (checks->empty())
+    {
+        return;
+    }
+
+    size_t jobs = (checks->size() + PREVERIFY_MIN_SIGNATURES_PER_JOB - 1) /
+                  PREVERIFY_MIN_SIGNATURES_PER_JOB;
+    jobs = std::min<size_t>(jobs, app.getConfig().WORKER_THREADS);
+    size_t perJob = (checks->size() + jobs - 1) / jobs;
+
+    auto& timer =
+        app.getMetrics().NewTimer({"herder", "txset", "preverify-signatures"});
+    auto start = std::chrono::steady_clock::now();
+    auto remaining = std::make_shared<std::atomic<size_t>>(jobs);
+    for (size_t begin = 0; begin < checks->size(); begin += perJob)
+    {
+        size_t end = std::min(checks->size(), begin + perJob);
+        app.postOnBackgroundThread(
+            [txs, checks, begin, end, remaining, start, &timer]() {
+                PubKeyUtils::verifySigs(
+                    std::vector<PubKeyUtils::SignatureCheck>(
+                        checks->begin() + begin, checks->begin() + end));
+                if (--*remaining == 0)
+                {
+                    timer.Update(std::chrono::steady_clock::now() - start);
+                }
+            },
+            "TxSetSignaturePreverification");
+    }
+}
+
 void
 TxSetFrame::removeTx(TransactionFramePtr tx)
 {
@@ -54,6 +54,11 @@ class TxSetFrame
 
     bool checkValid(Application& app);
 
+    // Verifies, on the worker threads, the signatures made by the master keys
+    // of the source accounts, so that checkValid finds them in the signature
+    // cache rather than verifying them on the main thread.
+    void preverifySignatures(Application& app);
+
             std::vector<TransactionFramePtr> trimInvalid(Application& app);
     void surgePricingFilter(Application& app);
 
@@ -10,6 +10,7 @@
 #include "test/test.h"
 
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "ledger/LedgerHeaderUtils.h"
 #include "ledger/LedgerManager.h"
@@ -17,6 +18,8 @@
 #include "ledger/LedgerTxnHeader.h"
 #include "lib/catch.hpp"
 #include "main/CommandHandler.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "overlay/OverlayManager.h"
 #include "test/TxTests.h"
 #include "transactions/OperationFrame.h"
@@ -24,6 +27,8 @@
 
 #include "xdrpp/marshal.h"
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 using namespace viichain;
 using namespace viichain::txtest;
@@ -307,6 +312,31 @@ testTxSet(uint32 protocolVersion)
             txSet->trimInvalid(*app);
             REQUIRE(txSet->checkValid(*app));
         }
+        SECTION("preverified signatures")
+        {
+            PubKeyUtils::clearVerifySigCache();
+            auto& timer = app->getMetrics().NewTimer(
+                {"herder", "txset", "preverify-signatures"});
+            auto count = timer.count();
+            txSet->preverifySignatures(*app);
+            // The jobs run on worker threads, so wait for them in real time.
+            auto deadline =
+                std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (timer.count() == count &&
+                   std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            REQUIRE(timer.count() != count);
+
+            uint64_t hits, misses;
+            PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+            REQUIRE(misses == txSet->mTransactions.size());
+            REQUIRE(txSet->checkValid(*app));
+            PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+            REQUIRE(misses == 0);
+            REQUIRE(hits >= txSet->mTransactions.size());
+        }
     }
     SECTION("invalid tx")
     {
@@ -1,6 +1,8 @@
 
 #include "crypto/SecretKey.h"
 #include "herder/TransactionQueue.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "test/TestAccount.h"
 #include "test/TestUtils.h"
 #include "test/TxTests.h"
@@ -8,6 +10,7 @@
 #include "util/Timer.h"
 
 #include <lib/catch.hpp>
+#include <set>
 
 using namespace viichain;
 using namespace viichain::txtest;
@@ -22,6 +25,17 @@ transaction(Application& app, TestAccount& account, int sequenceDelta)
         {payment(account.getPublicKey(), 1)});
 }
 
+TransactionFramePtr
+transactionWithFee(Application& app, TestAccount& account, int sequenceDelta,
+                   uint32_t fee)
+{
+    auto tx = transaction(app, account, sequenceDelta);
+    tx->getEnvelope().tx.fee = fee;
+    tx->getEnvelope().signatures.clear();
+    tx->addSignature(account);
+    return tx;
+}
+
 TransactionFramePtr
 invalidTransaction(Application& app, TestAccount& account, int sequenceDelta)
 {
@@ -404,3 +418,155 @@ TEST_CASE("TransactionQueue", "[herder][TransactionQueue]")
         test.check();
     }
 }
+
+TEST_CASE("TransactionQueue surge priced tx set", "[herder][TransactionQueue]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto const minBalance2 = app->getLedgerManager().getLastMinBalance(2);
+
+    auto root = TestAccount::createRoot(*app);
+    auto account1 = root.create("a1", minBalance2);
+    auto account2 = root.create("a2", minBalance2);
+    auto account3 = root.create("a3", minBalance2);
+
+    auto txA1T1 = transactionWithFee(*app, account1, 1, 300);
+    auto txA1T2 = transactionWithFee(*app, account1, 2, 100);
+    auto txA2T1 = transactionWithFee(*app, account2, 1, 200);
+    auto txA3T1 = transactionWithFee(*app, account3, 1, 150);
+
+    TransactionQueue queue{*app, 4, 2};
+    for (auto const& tx : {txA1T1, txA1T2, txA2T1, txA3T1})
+    {
+        REQUIRE(queue.tryAdd(tx) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+    }
+
+    auto header = app->getLedgerManager().getLastClosedLedgerHeader().header;
+    auto check = [&](uint32_t maxTxSetSize,
+                     std::vector<TransactionFramePtr> const& expected) {
+        header.maxTxSetSize = maxTxSetSize;
+        auto txSet = queue.toSurgePricedTxSet({}, header);
+        std::set<Hash> got, want;
+        for (auto const& tx : txSet->mTransactions)
+        {
+            got.insert(tx->getFullHash());
+        }
+        for (auto const& tx : expected)
+        {
+            want.insert(tx->getFullHash());
+        }
+        REQUIRE(got == want);
+    };
+
+    SECTION("everything fits")
+    {
+        check(4, {txA1T1, txA1T2, txA2T1, txA3T1});
+        check(10, {txA1T1, txA1T2, txA2T1, txA3T1});
+    }
+
+    SECTION("highest fees first")
+    {
+        check(3, {txA1T1, txA2T1, txA3T1});
+        check(2, {txA1T1, txA2T1});
+        check(1, {txA1T1});
+    }
+
+    SECTION("chain head removed")
+    {
+        queue.remove({txA1T1});
+        check(2, {txA2T1, txA3T1});
+        check(3, {txA1T2, txA2T1, txA3T1});
+    }
+
+    SECTION("oldest transactions shifted out")
+    {
+        queue.shift();
+        queue.shift();
+        queue.shift();
+        queue.shift();
+        check(4, {});
+    }
+}
+
+TEST_CASE("TransactionQueue eviction", "[herder][TransactionQueue]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.TRANSACTION_QUEUE_MAX_OPS = 3;
+    auto app = createTestApplication(clock, cfg);
+    auto const minBalance2 = app->getLedgerManager().getLastMinBalance(2);
+
+    auto root = TestAccount::createRoot(*app);
+    auto account1 = root.create("a1", minBalance2);
+    auto account2 = root.create("a2", minBalance2);
+    auto account3 = root.create("a3", minBalance2);
+
+    auto& evicted = app->getMetrics().NewMeter(
+        {"herder", "pending-txs", "evicted"}, "transaction");
+    auto evictedBefore = evicted.count();
+
+    TransactionQueue queue{*app, 4, 2};
+    auto add = [&](TransactionFramePtr const& tx,
+                   TransactionQueue::AddResult result) {
+        REQUIRE(queue.tryAdd(tx) == result);
+    };
+    auto check = [&](std::vector<TransactionFramePtr> const& expected) {
+        std::set<Hash> got, want;
+        for (auto const& tx : queue.toTxSet({})->mTransactions)
+        {
+            got.insert(tx->getFullHash());
+        }
+        for (auto const& tx : expected)
+        {
+            want.insert(tx->getFullHash());
+        }
+        REQUIRE(got == want);
+        REQUIRE(queue.getQueueOps() == expected.size());
+        REQUIRE(queue.getQueueBytes() > 0);
+    };
+
+    auto txA1T1 = transactionWithFee(*app, account1, 1, 100);
+    auto txA1T2 = transactionWithFee(*app, account1, 2, 100);
+    auto txA2T1 = transactionWithFee(*app, account2, 1, 200);
+    add(txA1T1, TransactionQueue::AddResult::ADD_STATUS_PENDING);
+    add(txA1T2, TransactionQueue::AddResult::ADD_STATUS_PENDING);
+    add(txA2T1, TransactionQueue::AddResult::ADD_STATUS_PENDING);
+    check({txA1T1, txA1T2, txA2T1});
+
+    SECTION("fee too low")
+    {
+        add(transactionWithFee(*app, account3, 1, 100),
+            TransactionQueue::AddResult::ADD_STATUS_QUEUE_FULL);
+        check({txA1T1, txA1T2, txA2T1});
+        REQUIRE(evicted.count() == evictedBefore);
+    }
+
+    SECTION("lowest fee chain evicted")
+    {
+        auto txA3T1 = transactionWithFee(*app, account3, 1, 300);
+        add(txA3T1, TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        check({txA2T1, txA3T1});
+        REQUIRE(evicted.count() == evictedBefore + 2);
+
+        SECTION("own chain kept")
+        {
+            auto txA2T2 = transactionWithFee(*app, account2, 2, 500);
+            add(txA2T2, TransactionQueue::AddResult::ADD_STATUS_PENDING);
+            check({txA2T1, txA2T2, txA3T1});
+
+            auto txA2T3 = transactionWithFee(*app, account2, 3, 1000);
+            add(txA2T3, TransactionQueue::AddResult::ADD_STATUS_PENDING);
+            check({txA2T1, txA2T2, txA2T3});
+            REQUIRE(evicted.count() == evictedBefore + 3);
+        }
+    }
+
+    SECTION("invalid transaction does not evict")
+    {
+        auto tx = transactionWithFee(*app, account3, 5, 300);
+        add(tx, TransactionQueue::AddResult::ADD_STATUS_ERROR);
+        check({txA1T1, txA1T2, txA2T1});
+        REQUIRE(evicted.count() == evictedBefore);
+    }
+}
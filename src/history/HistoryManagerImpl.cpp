@@ -17,6 +17,7 @@
 #include "historywork/ResolveSnapshotWork.h"
 #include "historywork/WriteSnapshotWork.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/LedgerTxn.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -270,6 +271,8 @@ HistoryManagerImpl::takeSnapshotAndPublish(HistoryArchiveState const& has)
     {
         return;
     }
+    // Only publish ledgers whose entries are all in the database.
+    mApp.getLedgerTxnRoot().waitForPendingWrites();
     auto ledgerSeq = has.currentLedger;
     CLOG(DEBUG, "History") << "Activating publish for ledger " << ledgerSeq;
     auto snap = std::make_shared<StateSnapshot>(mApp, has);
@@ -0,0 +1,74 @@
+#include "historywork/DecompressBucketWork.h"
+#include "main/Application.h"
+#include "util/BlockCompressedFile.h"
+#include "util/Logging.h"
+
+namespace viichain
+{
+
+DecompressBucketWork::DecompressBucketWork(Application& app,
+                                           std::string const& from,
+                                           std::string const& to)
+    : BasicWork(app, "decompress-bucket-" + from, RETRY_NEVER)
+    , mFrom(from)
+    , mTo(to)
+{
+}
+
+BasicWork::State
+DecompressBucketWork::onRun()
+{
+    if (mDone)
+    {
+        return mEc ? State::WORK_FAILURE : State::WORK_SUCCESS;
+    }
+
+    spawnDecompressor();
+    return State::WORK_WAITING;
+}
+
+void
+DecompressBucketWork::onReset()
+{
+    mDone = false;
+    mEc.clear();
+}
+
+void
+DecompressBucketWork::spawnDecompressor()
+{
+    std::string from = mFrom;
+    std::string to = mTo;
+    Application& app = this->mApp;
+    std::weak_ptr<DecompressBucketWork> weak(
+        std::static_pointer_cast<DecompressBucketWork>(shared_from_this()));
+    app.postOnBackgroundThread(
+        [&app, from, to, weak]() {
+            std::error_code ec;
+            try
+            {
+                BlockCompressedReader::decompressFile(from, to);
+            }
+            catch (std::exception const& e)
+            {
+                CLOG(WARNING, "History") << "Failed to decompress bucket "
+                                         << from << ": " << e.what();
+                std::remove(to.c_str());
+                ec = std::make_error_code(std::errc::io_error);
+            }
+
+            app.postOnMainThread(
+                [weak, ec]() {
+                    auto self = weak.lock();
+                    if (self)
+                    {
+                        self->mEc = ec;
+                        self->mDone = true;
+                        self->wakeUp();
+                    }
+                },
+                "DecompressBucket: finish");
+        },
+        "DecompressBucket: start in background");
+}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "work/Work.h"
+
+namespace viichain
+{
+
+// Writes the uncompressed XDR stream of a block-compressed bucket file to
+// another file on a background thread, so it can be gzipped and published
+// like any other bucket.
+class DecompressBucketWork : public BasicWork
+{
+    std::string const mFrom;
+    std::string const mTo;
+    bool mDone{false};
+    std::error_code mEc;
+
+    void spawnDecompressor();
+
+  public:
+    DecompressBucketWork(Application& app, std::string const& from,
+                         std::string const& to);
+    ~DecompressBucketWork() = default;
+
+  protected:
+    BasicWork::State onRun() override;
+    void onReset() override;
+    bool
+    onAbort() override
+    {
+        return true;
+    };
+};
+}
@@ -1,6 +1,7 @@
 
 #include "GzipAndPutFilesWork.h"
 #include "bucket/BucketManager.h"
+#include "historywork/DecompressBucketWork.h"
 #include "historywork/GzipFileWork.h"
 #include "historywork/MakeRemoteDirWork.h"
 #include "historywork/PutRemoteFileWork.h"
@@ -33,10 +34,31 @@ GzipAndPutFilesWork::doWork()
         std::vector<std::string> bucketsToSend =
             mSnapshot->mLocalState.differingBuckets(mRemoteState);
 
+        // Compressed buckets are published in the canonical format, so they
+        // are first decompressed into the snapshot dir.
         for (auto const& hash : bucketsToSend)
         {
             auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
             assert(b);
+            if (b->isCompressed())
+            {
+                auto f = std::make_shared<FileTransferInfo>(
+                    mSnapshot->mSnapDir, HISTORY_FILE_TYPE_BUCKET, hash);
+                auto decompress = std::make_shared<DecompressBucketWork>(
+                    mApp, b->getFilename(), f->localPath_nogz());
+                auto gzipFile =
+                    std::make_shared<GzipFileWork>(mApp, f->localPath_nogz());
+                auto mkdir = std::make_shared<MakeRemoteDirWork>(
+                    mApp, f->remoteDir(), mArchive);
+                auto putFile = std::make_shared<PutRemoteFileWork>(
+                    mApp, f->localPath_gz(), f->remoteName(), mArchive);
+
+                std::vector<std::shared_ptr<BasicWork>> seq{
+                    decompress, gzipFile, mkdir, putFile};
+                addWork<WorkSequence>(
+                    "decompress-gzip-and-put-file-" + f->localPath_gz(), seq);
+                continue;
+            }
             files.push_back(std::make_shared<FileTransferInfo>(*b));
         }
         for (auto f : files)
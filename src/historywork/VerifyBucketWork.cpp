@@ -59,7 +59,8 @@ VerifyBucketWork::adoptBucket()
 
     auto b = mApp.getBucketManager().adoptFileAsBucket(mBucketFile, mHash,
                                                        0,
-                                                       0);
+                                                       0, nullptr,
+                                                       nullptr, nullptr);
     mBuckets[binToHex(mHash)] = b;
 }
 
@@ -0,0 +1,193 @@
+
+#include "ledger/CompactLedgerKey.h"
+#include "crypto/ByteSliceHasher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace viichain
+{
+
+constexpr size_t CompactLedgerKey::kAccountOffset;
+constexpr size_t CompactLedgerKey::kDataOffset;
+constexpr size_t CompactLedgerKey::kMaxSize;
+
+CompactLedgerKey::CompactLedgerKey(LedgerKey const& key)
+{
+    auto putAccount = [&](AccountID const& accountID) {
+        auto const& bytes = accountID.ed25519();
+        std::copy(bytes.begin(), bytes.end(), mBytes.begin() + kAccountOffset);
+    };
+
+    mBytes[0] = static_cast<uint8_t>(key.type());
+    size_t size = kDataOffset;
+    switch (key.type())
+    {
+    case ACCOUNT:
+        putAccount(key.account().accountID);
+        break;
+    case TRUSTLINE:
+    {
+        auto const& asset = key.trustLine().asset;
+        putAccount(key.trustLine().accountID);
+        mBytes[1] = static_cast<uint8_t>(asset.type());
+        switch (asset.type())
+        {
+        case ASSET_TYPE_NATIVE:
+            break;
+        case ASSET_TYPE_CREDIT_ALPHANUM4:
+        {
+            auto const& a4 = asset.alphaNum4();
+            auto const& issuer = a4.issuer.ed25519();
+            std::copy(a4.assetCode.begin(), a4.assetCode.end(),
+                      mBytes.begin() + size);
+            size += a4.assetCode.size();
+            std::copy(issuer.begin(), issuer.end(), mBytes.begin() + size);
+            size += issuer.size();
+            break;
+        }
+        case ASSET_TYPE_CREDIT_ALPHANUM12:
+        {
+            auto const& a12 = asset.alphaNum12();
+            auto const& issuer = a12.issuer.ed25519();
+            std::copy(a12.assetCode.begin(), a12.assetCode.end(),
+                      mBytes.begin() + size);
+            size += a12.assetCode.size();
+            std::copy(issuer.begin(), issuer.end(), mBytes.begin() + size);
+            size += issuer.size();
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown asset type");
+        }
+        break;
+    }
+    case OFFER:
+    {
+        putAccount(key.offer().sellerID);
+        auto offerID = static_cast<uint64_t>(key.offer().offerID);
+        for (int i = 7; i >= 0; --i, offerID >>= 8)
+        {
+            mBytes[size + i] = static_cast<uint8_t>(offerID);
+        }
+        size += 8;
+        break;
+    }
+    case DATA:
+    {
+        auto const& name = key.data().dataName;
+        if (name.size() > kMaxSize - kDataOffset)
+        {
+            throw std::runtime_error("Data name is too long");
+        }
+        putAccount(key.data().accountID);
+        mBytes[1] = static_cast<uint8_t>(name.size());
+        std::copy(name.begin(), name.end(), mBytes.begin() + size);
+        size += name.size();
+        break;
+    }
+    default:
+        throw std::runtime_error("Unknown key type");
+    }
+
+    mSize = static_cast<uint8_t>(size);
+    mHash = shortHash::computeHash(ByteSlice(mBytes.data(), mSize));
+}
+
+LedgerEntryType
+CompactLedgerKey::type() const
+{
+    return static_cast<LedgerEntryType>(mBytes[0]);
+}
+
+LedgerKey
+CompactLedgerKey::toLedgerKey() const
+{
+    auto getAccount = [&](AccountID& accountID) {
+        accountID.type(PUBLIC_KEY_TYPE_ED25519);
+        std::copy(mBytes.begin() + kAccountOffset,
+                  mBytes.begin() + kDataOffset, accountID.ed25519().begin());
+    };
+
+    LedgerKey key;
+    key.type(type());
+    size_t pos = kDataOffset;
+    switch (type())
+    {
+    case ACCOUNT:
+        getAccount(key.account().accountID);
+        break;
+    case TRUSTLINE:
+    {
+        auto& asset = key.trustLine().asset;
+        getAccount(key.trustLine().accountID);
+        asset.type(static_cast<AssetType>(mBytes[1]));
+        switch (asset.type())
+        {
+        case ASSET_TYPE_NATIVE:
+            break;
+        case ASSET_TYPE_CREDIT_ALPHANUM4:
+        {
+            auto& a4 = asset.alphaNum4();
+            std::copy(mBytes.begin() + pos,
+                      mBytes.begin() + pos + a4.assetCode.size(),
+                      a4.assetCode.begin());
+            pos += a4.assetCode.size();
+            a4.issuer.type(PUBLIC_KEY_TYPE_ED25519);
+            std::copy(mBytes.begin() + pos, mBytes.begin() + mSize,
+                      a4.issuer.ed25519().begin());
+            break;
+        }
+        case ASSET_TYPE_CREDIT_ALPHANUM12:
+        {
+            auto& a12 = asset.alphaNum12();
+            std::copy(mBytes.begin() + pos,
+                      mBytes.begin() + pos + a12.assetCode.size(),
+                      a12.assetCode.begin());
+            pos += a12.assetCode.size();
+            a12.issuer.type(PUBLIC_KEY_TYPE_ED25519);
+            std::copy(mBytes.begin() + pos, mBytes.begin() + mSize,
+                      a12.issuer.ed25519().begin());
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown asset type");
+        }
+        break;
+    }
+    case OFFER:
+    {
+        getAccount(key.offer().sellerID);
+        uint64_t offerID = 0;
+        for (size_t i = 0; i < 8; ++i)
+        {
+            offerID = (offerID << 8) | mBytes[pos + i];
+        }
+        key.offer().offerID = static_cast<int64_t>(offerID);
+        break;
+    }
+    case DATA:
+        getAccount(key.data().accountID);
+        key.data().dataName.assign(
+            reinterpret_cast<char const*>(mBytes.data()) + pos, mBytes[1]);
+        break;
+    default:
+        throw std::runtime_error("Unknown key type");
+    }
+    return key;
+}
+
+bool
+operator==(CompactLedgerKey const& lhs, CompactLedgerKey const& rhs)
+{
+    return lhs.mHash == rhs.mHash && lhs.mSize == rhs.mSize &&
+           std::memcmp(lhs.mBytes.data(), rhs.mBytes.data(), lhs.mSize) == 0;
+}
+
+bool
+operator!=(CompactLedgerKey const& lhs, CompactLedgerKey const& rhs)
+{
+    return !(lhs == rhs);
+}
+}
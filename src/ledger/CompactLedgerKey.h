@@ -0,0 +1,66 @@
+#pragma once
+
+
+#include "xdr/vii-ledger.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+namespace viichain
+{
+
+// A LedgerKey packed into one fixed-size buffer together with its hash.
+//
+// LedgerKey is an XDR union whose data names live on the heap, so copying,
+// hashing and comparing one walks the union every time. The compact form is
+// encoded once: a type tag, an auxiliary byte (the asset type of a trustline
+// or the length of a data name), the account and the type-specific fields.
+// Hashing returns the cached value and comparison is a hash check followed
+// by a memcmp of the used bytes.
+//
+// Maps inside the ledger layer are keyed by CompactLedgerKey; LedgerKey is
+// still used at the XDR and SQL boundaries.
+class CompactLedgerKey
+{
+    static constexpr size_t kAccountOffset = 2;
+    static constexpr size_t kDataOffset = kAccountOffset + 32;
+    static constexpr size_t kMaxSize = kDataOffset + 64;
+
+    uint64_t mHash{0};
+    uint8_t mSize{0};
+    std::array<uint8_t, kMaxSize> mBytes{};
+
+  public:
+    CompactLedgerKey() = default;
+    explicit CompactLedgerKey(LedgerKey const& key);
+
+    LedgerEntryType type() const;
+
+    uint64_t
+    hash() const
+    {
+        return mHash;
+    }
+
+    LedgerKey toLedgerKey() const;
+
+    friend bool operator==(CompactLedgerKey const& lhs,
+                           CompactLedgerKey const& rhs);
+    friend bool operator!=(CompactLedgerKey const& lhs,
+                           CompactLedgerKey const& rhs);
+};
+}
+
+namespace std
+{
+template <> class hash<viichain::CompactLedgerKey>
+{
+  public:
+    size_t
+    operator()(viichain::CompactLedgerKey const& key) const
+    {
+        return static_cast<size_t>(key.hash());
+    }
+};
+}
@@ -7,6 +7,42 @@
 
 namespace std
 {
+template <> class hash<viichain::Asset>
+{
+  public:
+    size_t
+    operator()(viichain::Asset const& asset) const
+    {
+        size_t res = asset.type();
+        switch (asset.type())
+        {
+        case viichain::ASSET_TYPE_NATIVE:
+            break;
+        case viichain::ASSET_TYPE_CREDIT_ALPHANUM4:
+        {
+            auto& a4 = asset.alphaNum4();
+            res ^= viichain::shortHash::computeHash(
+                viichain::ByteSlice(a4.issuer.ed25519().data(), 8));
+            res ^= viichain::shortHash::computeHash(
+                viichain::ByteSlice(a4.assetCode.data(), a4.assetCode.size()));
+            break;
+        }
+        case viichain::ASSET_TYPE_CREDIT_ALPHANUM12:
+        {
+            auto& a12 = asset.alphaNum12();
+            res ^= viichain::shortHash::computeHash(
+                viichain::ByteSlice(a12.issuer.ed25519().data(), 8));
+            res ^= viichain::shortHash::computeHash(viichain::ByteSlice(
+                a12.assetCode.data(), a12.assetCode.size()));
+            break;
+        }
+        default:
+            abort();
+        }
+        return res;
+    }
+};
+
 template <> class hash<viichain::LedgerKey>
 {
   public:
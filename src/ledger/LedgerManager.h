@@ -10,6 +10,7 @@ namespace viichain
 
 class LedgerCloseData;
 class Database;
+class TxSetFrame;
 
 class LedgerManager
 {
@@ -94,6 +95,12 @@ class LedgerManager
 
                     virtual void closeLedger(LedgerCloseData const& ledgerData) = 0;
 
+    // Starts loading the entries that txSet touches into the ledger state
+    // cache on a background thread, ahead of closing ledger ledgerSeq with
+    // it.
+    virtual void prefetchTxSetAsync(TxSetFrame const& txSet,
+                                    uint32_t ledgerSeq) = 0;
+
         virtual void deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                   uint32_t count) = 0;
 
@@ -19,11 +19,13 @@
 #include "ledger/LedgerTxn.h"
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
+#include "ledger/LedgerTxnSnapshot.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "main/ErrorMessages.h"
 #include "overlay/OverlayManager.h"
 #include "transactions/OperationFrame.h"
+#include "transactions/TransactionHistoryBatch.h"
 #include "transactions/TransactionUtils.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
@@ -36,7 +38,10 @@
 #include "xdrpp/printer.h"
 #include "xdrpp/types.h"
 
+#include <algorithm>
 #include <chrono>
+#include <future>
+#include <map>
 #include <numeric>
 #include <sstream>
 
@@ -92,6 +97,8 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     : mApp(app)
     , mTransactionApply(
           app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
+    , mTransactionStoreHistory(app.getMetrics().NewTimer(
+          {"ledger", "transaction", "store-history"}))
     , mTransactionCount(
           app.getMetrics().NewHistogram({"ledger", "transaction", "count"}))
     , mOperationCount(
@@ -104,6 +111,17 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
           app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
     , mPrefetchHitRate(
           app.getMetrics().NewCounter({"ledger", "prefetch", "hit-rate"}))
+    , mEntryCacheHitRate(app.getMetrics().NewCounter(
+          {"ledger", "entry-cache",
+           app.getConfig().ENTRY_CACHE_EVICTION_POLICY == "TINY_LFU"
+               ? "tiny-lfu-hit-rate"
+               : "random-hit-rate"}))
+    , mEntryCacheBytes(
+          app.getMetrics().NewCounter({"ledger", "entry-cache", "bytes"}))
+    , mParallelApplyCount(app.getMetrics().NewCounter(
+          {"ledger", "transaction", "parallel-apply"}))
+    , mParallelApplyFallbackCount(app.getMetrics().NewCounter(
+          {"ledger", "transaction", "parallel-fallback"}))
     , mLastClose(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "queued-ledgers"}))
@@ -233,6 +251,14 @@ LedgerManagerImpl::loadLastKnownLedger(
     }
     else
     {
+        auto pendingChanges = mApp.getPersistentState().getState(
+            PersistentState::kWriteBehindChanges);
+        if (!pendingChanges.empty())
+        {
+            LOG(INFO) << "Writing ledger entries left behind at shutdown";
+            mApp.getLedgerTxnRoot().replayPendingWrite(pendingChanges);
+        }
+
         LOG(INFO) << "Loading last known ledger";
         Hash lastLedgerHash = hexToBin256(lastLedger);
 
@@ -724,6 +750,9 @@ LedgerManagerImpl::syncMetrics()
     mLedgerAge.set_count(secondsSinceLastLedgerClose());
     mPrefetchHitRate.set_count(
         std::llround(mApp.getLedgerTxnRoot().getPrefetchHitRate() * 100));
+    mEntryCacheHitRate.set_count(
+        std::llround(mApp.getLedgerTxnRoot().getEntryCacheHitRate() * 100));
+    mEntryCacheBytes.set_count(mApp.getLedgerTxnRoot().getEntryCacheBytes());
     mApp.syncOwnMetrics();
 }
 
@@ -732,6 +761,10 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
 {
     DBTimeExcluder qtExclude(mApp);
 
+    // With write-behind, the entries of the previous ledger may still be
+    // being written; finish before this ledger starts writing history.
+    mApp.getLedgerTxnRoot().waitForPendingWrites();
+
     LedgerTxn ltx(mApp.getLedgerTxnRoot());
     auto header = ltx.loadHeader();
     ++header.current().ledgerSeq;
@@ -791,13 +824,20 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
                 vector<TransactionFramePtr> txs = ledgerData.getTxSet()->sortForApply();
 
         prefetchTxSourceIds(txs);
+    TransactionHistoryBatch historyBatch(header.current().ledgerSeq);
     processFeesSeqNums(txs, ltx,
-                       ledgerData.getTxSet()->getBaseFee(header.current()));
+                       ledgerData.getTxSet()->getBaseFee(header.current()),
+                       historyBatch);
 
     TransactionResultSet txResultSet;
     txResultSet.results.reserve(txs.size());
 
-    applyTransactions(txs, ltx, txResultSet);
+    applyTransactions(txs, ltx, txResultSet, historyBatch);
+
+    {
+        auto storeTime = mTransactionStoreHistory.TimeScope();
+        historyBatch.flush(getDatabase());
+    }
 
     ltx.loadHeader().current().txSetResultHash =
         sha256(xdr::xdr_to_opaque(txResultSet));
@@ -885,7 +925,8 @@ LedgerManagerImpl::advanceLedgerPointers(LedgerHeader const& header)
 void
 LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
                                       AbstractLedgerTxn& ltxOuter,
-                                      int64_t baseFee)
+                                      int64_t baseFee,
+                                      TransactionHistoryBatch& historyBatch)
 {
     CLOG(DEBUG, "Ledger")
         << "processing fees and sequence numbers with base fee " << baseFee;
@@ -893,13 +934,12 @@ LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
     try
     {
         LedgerTxn ltx(ltxOuter);
-        auto ledgerSeq = ltx.loadHeader().current().ledgerSeq;
         for (auto tx : txs)
         {
             LedgerTxn ltxTx(ltx);
             tx->processFeeSeqNum(ltxTx, baseFee);
-            tx->storeTransactionFee(mApp.getDatabase(), ledgerSeq,
-                                    ltxTx.getChanges(), ++index);
+            tx->storeTransactionFee(historyBatch, ltxTx.getChanges(),
+                                    ++index);
             ltxTx.commit();
         }
         ltx.commit();
@@ -928,6 +968,30 @@ LedgerManagerImpl::prefetchTxSourceIds(std::vector<TransactionFramePtr>& txs)
     }
 }
 
+static void
+insertTransactionDataKeys(TransactionFramePtr const& tx,
+                          std::unordered_set<LedgerKey>& keys)
+{
+    for (auto const& op : tx->getOperations())
+    {
+        if (!(tx->getSourceID() == op->getSourceID()))
+        {
+            keys.emplace(accountKey(op->getSourceID()));
+        }
+        op->insertLedgerKeysToPrefetch(keys);
+    }
+}
+
+static void
+insertTransactionDataKeys(std::vector<TransactionFramePtr> const& txs,
+                          std::unordered_set<LedgerKey>& keys)
+{
+    for (auto const& tx : txs)
+    {
+        insertTransactionDataKeys(tx, keys);
+    }
+}
+
 void
 LedgerManagerImpl::prefetchTransactionData(
     std::vector<TransactionFramePtr>& txs)
@@ -936,25 +1000,32 @@ LedgerManagerImpl::prefetchTransactionData(
     {
         auto& root = mApp.getLedgerTxnRoot();
         std::unordered_set<LedgerKey> keysToPrefetch;
-        for (auto const& tx : txs)
+        insertTransactionDataKeys(txs, keysToPrefetch);
+        root.prefetch(keysToPrefetch);
+    }
+}
+
+void
+LedgerManagerImpl::prefetchTxSetAsync(TxSetFrame const& txSet,
+                                      uint32_t ledgerSeq)
+{
+    if (mApp.getConfig().PREFETCH_BATCH_SIZE > 0)
+    {
+        std::unordered_set<LedgerKey> keys;
+        for (auto const& tx : txSet.mTransactions)
         {
-            for (auto const& op : tx->getOperations())
-            {
-                if (!(tx->getSourceID() == op->getSourceID()))
-                {
-                    keysToPrefetch.emplace(accountKey(op->getSourceID()));
-                }
-                op->insertLedgerKeysToPrefetch(keysToPrefetch);
-            }
+            keys.emplace(accountKey(tx->getSourceID()));
         }
-        root.prefetch(keysToPrefetch);
+        insertTransactionDataKeys(txSet.mTransactions, keys);
+        mApp.getLedgerTxnRoot().prefetchAsync(std::move(keys), ledgerSeq);
     }
 }
 
 void
 LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
                                      AbstractLedgerTxn& ltx,
-                                     TransactionResultSet& txResultSet)
+                                     TransactionResultSet& txResultSet,
+                                     TransactionHistoryBatch& historyBatch)
 {
     int index = 0;
 
@@ -975,47 +1046,262 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
 
     prefetchTransactionData(txs);
 
+    std::vector<TransactionMeta> metas;
+    if (mApp.getConfig().PARALLEL_TX_APPLY_THREADS > 1)
+    {
+        applyTransactionsInParallel(txs, ltx, metas);
+    }
+
     for (auto tx : txs)
     {
-        auto txTime = mTransactionApply.TimeScope();
         TransactionMeta tm(1);
-        try
+        if (!metas.empty())
         {
-            CLOG(DEBUG, "Tx")
-                << " tx#" << index << " = " << hexAbbrev(tx->getFullHash())
-                << " ops=" << tx->getOperations().size()
-                << " txseq=" << tx->getSeqNum() << " (@ "
-                << mApp.getConfig().toShortString(tx->getSourceID()) << ")";
-            tx->apply(mApp, ltx, tm.v1());
+            tm = std::move(metas[index]);
         }
-        catch (InvariantDoesNotHold&)
+        else
         {
-            CLOG(ERROR, "Ledger")
-                << "Invariant failure during tx->apply for tx "
-                << tx->getFullHash();
-            throw;
+            auto txTime = mTransactionApply.TimeScope();
+            if (!applyTransaction(tx, index, ltx, tm))
+            {
+                mInternalErrorCount.inc();
+            }
         }
-        catch (std::runtime_error& e)
+        tx->storeTransaction(historyBatch, tm, ++index, txResultSet);
+    }
+
+    logTxApplyMetrics(ltx, numTxs, numOps);
+}
+
+bool
+LedgerManagerImpl::applyTransaction(TransactionFramePtr const& tx, int index,
+                                    AbstractLedgerTxn& ltx,
+                                    TransactionMeta& tm)
+{
+    try
+    {
+        CLOG(DEBUG, "Tx") << " tx#" << index << " = "
+                          << hexAbbrev(tx->getFullHash())
+                          << " ops=" << tx->getOperations().size()
+                          << " txseq=" << tx->getSeqNum() << " (@ "
+                          << mApp.getConfig().toShortString(tx->getSourceID())
+                          << ")";
+        tx->apply(mApp, ltx, tm.v1());
+    }
+    catch (InvariantDoesNotHold&)
+    {
+        CLOG(ERROR, "Ledger") << "Invariant failure during tx->apply for tx "
+                              << tx->getFullHash();
+        throw;
+    }
+    catch (std::runtime_error& e)
+    {
+        CLOG(ERROR, "Ledger") << "Exception during tx->apply for tx "
+                              << tx->getFullHash() << " : " << e.what();
+        tx->getResult().result.code(txINTERNAL_ERROR);
+        return false;
+    }
+    catch (...)
+    {
+        CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply for tx "
+                              << tx->getFullHash();
+        tx->getResult().result.code(txINTERNAL_ERROR);
+        return false;
+    }
+    return true;
+}
+
+namespace
+{
+// Transactions applied together on one thread, in apply order, and the union
+// of their footprints.
+struct ParallelApplyGroup
+{
+    std::vector<size_t> mTxs;
+    std::vector<LedgerKey> mFootprint;
+    size_t mNumOps{0};
+    std::unique_ptr<LedgerTxnSnapshot> mSnapshot;
+};
+
+size_t
+findCluster(std::vector<size_t>& parents, size_t i)
+{
+    while (parents[i] != i)
+    {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+}
+
+// Splits txs into at most maxGroups groups such that no ledger entry is in
+// the footprint of transactions from two different groups. The footprint of
+// a transaction is its source account plus the keys its operations prefetch;
+// nothing guarantees that it is complete, so the caller has to detect
+// transactions reaching outside it.
+static std::vector<ParallelApplyGroup>
+partitionTransactions(std::vector<TransactionFramePtr> const& txs,
+                      size_t maxGroups)
+{
+    std::vector<std::unordered_set<LedgerKey>> footprints(txs.size());
+    std::vector<size_t> parents(txs.size());
+    std::unordered_map<LedgerKey, size_t> owners;
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        parents[i] = i;
+        footprints[i].emplace(accountKey(txs[i]->getSourceID()));
+        insertTransactionDataKeys(txs[i], footprints[i]);
+        for (auto const& key : footprints[i])
+        {
+            auto res = owners.emplace(key, i);
+            if (!res.second)
+            {
+                parents[findCluster(parents, i)] =
+                    findCluster(parents, res.first->second);
+            }
+        }
+    }
+
+    std::map<size_t, std::vector<size_t>> clusters;
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        clusters[findCluster(parents, i)].emplace_back(i);
+    }
+
+    // Largest clusters first, each to the group with the fewest operations.
+    std::vector<std::vector<size_t>*> bySize;
+    for (auto& kv : clusters)
+    {
+        bySize.emplace_back(&kv.second);
+    }
+    std::stable_sort(bySize.begin(), bySize.end(),
+                     [](std::vector<size_t> const* lhs,
+                        std::vector<size_t> const* rhs) {
+                         return lhs->size() > rhs->size();
+                     });
+
+    std::vector<ParallelApplyGroup> groups(
+        std::min(maxGroups, clusters.size()));
+    for (auto cluster : bySize)
+    {
+        auto& group = *std::min_element(
+            groups.begin(), groups.end(),
+            [](ParallelApplyGroup const& lhs, ParallelApplyGroup const& rhs) {
+                return lhs.mNumOps < rhs.mNumOps;
+            });
+        for (auto i : *cluster)
+        {
+            group.mTxs.emplace_back(i);
+            group.mNumOps += txs[i]->getOperations().size();
+            group.mFootprint.insert(group.mFootprint.end(),
+                                    footprints[i].begin(),
+                                    footprints[i].end());
+        }
+    }
+    for (auto& group : groups)
+    {
+        std::sort(group.mTxs.begin(), group.mTxs.end());
+    }
+    return groups;
+}
+
+bool
+LedgerManagerImpl::applyTransactionsInParallel(
+    std::vector<TransactionFramePtr>& txs, AbstractLedgerTxn& ltx,
+    std::vector<TransactionMeta>& metas)
+{
+    auto groups = partitionTransactions(
+        txs, mApp.getConfig().PARALLEL_TX_APPLY_THREADS);
+    if (groups.size() < 2)
+    {
+        return false;
+    }
+
+    std::vector<TransactionResult> savedResults;
+    savedResults.reserve(txs.size());
+    for (auto const& tx : txs)
+    {
+        savedResults.emplace_back(tx->getResult());
+    }
+    for (auto& group : groups)
+    {
+        group.mSnapshot =
+            std::make_unique<LedgerTxnSnapshot>(ltx, group.mFootprint);
+    }
+
+    // Every element is written by exactly one thread.
+    std::vector<TransactionMeta> groupMetas(txs.size(), TransactionMeta(1));
+    std::vector<uint8_t> internalErrors(txs.size(), 0);
+    auto applyGroup = [&](ParallelApplyGroup& group) {
+        LedgerTxn ltxGroup(*group.mSnapshot);
+        for (auto i : group.mTxs)
+        {
+            auto txTime = mTransactionApply.TimeScope();
+            if (!applyTransaction(txs[i], static_cast<int>(i), ltxGroup,
+                                  groupMetas[i]))
+            {
+                internalErrors[i] = 1;
+            }
+            if (group.mSnapshot->footprintViolated())
+            {
+                return false;
+            }
+        }
+        ltxGroup.commit();
+        return !group.mSnapshot->footprintViolated();
+    };
+
+    std::vector<std::future<bool>> futures;
+    for (auto& group : groups)
+    {
+        futures.emplace_back(
+            std::async(std::launch::async, applyGroup, std::ref(group)));
+    }
+    bool success = true;
+    for (auto& f : futures)
+    {
+        try
+        {
+            success = f.get() && success;
+        }
+        catch (std::exception& e)
         {
-            CLOG(ERROR, "Ledger") << "Exception during tx->apply for tx "
-                                  << tx->getFullHash() << " : " << e.what();
-            mInternalErrorCount.inc();
-            tx->getResult().result.code(txINTERNAL_ERROR);
+            // Including invariant failures: applying serially reproduces
+            // them in apply order.
+            CLOG(WARNING, "Ledger")
+                << "Exception during parallel tx apply: " << e.what();
+            success = false;
         }
         catch (...)
         {
-            CLOG(ERROR, "Ledger")
-                << "Unknown exception during tx->apply for tx "
-                << tx->getFullHash();
-            mInternalErrorCount.inc();
-            tx->getResult().result.code(txINTERNAL_ERROR);
+            CLOG(WARNING, "Ledger")
+                << "Unknown exception during parallel tx apply";
+            success = false;
         }
-        auto ledgerSeq = ltx.loadHeader().current().ledgerSeq;
-        tx->storeTransaction(mApp.getDatabase(), ledgerSeq, tm, ++index,
-                             txResultSet);
     }
 
-    logTxApplyMetrics(ltx, numTxs, numOps);
+    if (!success)
+    {
+        CLOG(DEBUG, "Ledger") << "Parallel tx apply reached outside of the "
+                                 "transaction footprints, applying serially";
+        for (size_t i = 0; i < txs.size(); ++i)
+        {
+            txs[i]->restoreResult(savedResults[i]);
+        }
+        mParallelApplyFallbackCount.inc();
+        return false;
+    }
+
+    for (auto const& group : groups)
+    {
+        group.mSnapshot->commitInto(ltx);
+    }
+    mInternalErrorCount.inc(
+        std::count(internalErrors.begin(), internalErrors.end(), 1));
+    mParallelApplyCount.inc();
+    metas = std::move(groupMetas);
+    return true;
 }
 
 void
@@ -1030,6 +1316,9 @@ LedgerManagerImpl::logTxApplyMetrics(AbstractLedgerTxn& ltx, size_t numTxs,
                           << ", prefetch hit rate (%): " << hitRate;
 
         mPrefetchHitRate.set_count(std::llround(hitRate));
+    mEntryCacheHitRate.set_count(std::llround(
+        mApp.getLedgerTxnRoot().getEntryCacheHitRate() * 100));
+    mEntryCacheBytes.set_count(mApp.getLedgerTxnRoot().getEntryCacheBytes());
 }
 
 void
@@ -23,6 +23,7 @@ class AbstractLedgerTxn;
 class Application;
 class Database;
 class LedgerTxnHeader;
+class TransactionHistoryBatch;
 
 class LedgerManagerImpl : public LedgerManager
 {
@@ -33,6 +34,7 @@ class LedgerManagerImpl : public LedgerManager
 
   private:
     medida::Timer& mTransactionApply;
+    medida::Timer& mTransactionStoreHistory;
     medida::Histogram& mTransactionCount;
     medida::Histogram& mOperationCount;
     medida::Counter& mInternalErrorCount;
@@ -40,6 +42,10 @@ class LedgerManagerImpl : public LedgerManager
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
     medida::Counter& mPrefetchHitRate;
+    medida::Counter& mEntryCacheHitRate;
+    medida::Counter& mEntryCacheBytes;
+    medida::Counter& mParallelApplyCount;
+    medida::Counter& mParallelApplyFallbackCount;
     VirtualClock::time_point mLastClose;
 
     medida::Counter& mSyncingLedgersSize;
@@ -56,11 +62,26 @@ class LedgerManagerImpl : public LedgerManager
                          CatchupConfiguration::Mode catchupMode);
 
     void processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
-                            AbstractLedgerTxn& ltxOuter, int64_t baseFee);
+                            AbstractLedgerTxn& ltxOuter, int64_t baseFee,
+                            TransactionHistoryBatch& historyBatch);
 
     void applyTransactions(std::vector<TransactionFramePtr>& txs,
                            AbstractLedgerTxn& ltx,
-                           TransactionResultSet& txResultSet);
+                           TransactionResultSet& txResultSet,
+                           TransactionHistoryBatch& historyBatch);
+
+    // Returns false if the transaction failed with an internal error.
+    bool applyTransaction(TransactionFramePtr const& tx, int index,
+                          AbstractLedgerTxn& ltx, TransactionMeta& tm);
+
+    // Applies groups of transactions with disjoint footprints on separate
+    // threads and merges the entries they changed into ltx, filling metas in
+    // apply order. Returns false, with ltx and the transaction results as
+    // they were, if the transactions do not split into groups or one of them
+    // accessed an entry outside its footprint.
+    bool applyTransactionsInParallel(std::vector<TransactionFramePtr>& txs,
+                                     AbstractLedgerTxn& ltx,
+                                     std::vector<TransactionMeta>& metas);
 
     void ledgerClosed(AbstractLedgerTxn& ltx);
 
@@ -129,6 +150,8 @@ class LedgerManagerImpl : public LedgerManager
     void startCatchup(CatchupConfiguration configuration) override;
 
     void closeLedger(LedgerCloseData const& ledgerData) override;
+    void prefetchTxSetAsync(TxSetFrame const& txSet,
+                            uint32_t ledgerSeq) override;
     void deleteOldEntries(Database& db, uint32_t ledgerSeq,
                           uint32_t count) override;
 };
@@ -4,11 +4,15 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "ledger/CompactLedgerKey.h"
 #include "ledger/LedgerRange.h"
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
 #include "ledger/LedgerTxnImpl.h"
+#include "main/PersistentState.h"
+#include "util/Decoder.h"
 #include "util/GlobalChecks.h"
+#include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdr/vii-ledger-entries.h"
@@ -101,6 +105,12 @@ EntryIterator::key() const
     return getImpl()->key();
 }
 
+CompactLedgerKey const&
+EntryIterator::compactKey() const
+{
+    return getImpl()->compactKey();
+}
+
 AbstractLedgerTxn::~AbstractLedgerTxn()
 {
 }
@@ -125,9 +135,27 @@ LedgerTxn::Impl::Impl(LedgerTxn& self, AbstractLedgerTxnParent& parent,
     , mIsSealed(false)
     , mConsistency(LedgerTxnConsistency::EXACT)
 {
+    auto parentLtx = dynamic_cast<LedgerTxn*>(&mParent);
+    mArena = parentLtx ? parentLtx->getImpl()->mArena
+                       : std::make_shared<Arena>();
     mParent.addChild(self);
 }
 
+LedgerTxn::Impl::~Impl()
+{
+    // Every entry in the arena holds a reference to it, so once the
+    // outermost LedgerTxn drops its own entries it must be the last owner.
+    mEntry.clear();
+    assert(dynamic_cast<LedgerTxn*>(&mParent) || mArena.use_count() == 1);
+}
+
+std::shared_ptr<LedgerEntry>
+LedgerTxn::Impl::makeEntry(LedgerEntry const& entry) const
+{
+    return std::allocate_shared<LedgerEntry>(
+        ArenaAllocator<LedgerEntry>(mArena), entry);
+}
+
 LedgerTxn::~LedgerTxn()
 {
     if (mImpl)
@@ -238,10 +266,11 @@ LedgerTxn::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
     {
         for (; (bool)iter; ++iter)
         {
-            auto const& key = iter.key();
+            auto const& key = iter.compactKey();
+            markOfferDirty(key);
             if (iter.entryExists())
             {
-                mEntry[key] = std::make_shared<LedgerEntry>(iter.entry());
+                mEntry[key] = makeEntry(iter.entry());
             }
             else if (!mParent.getNewestVersion(key))
             { // Created in this LedgerTxn
@@ -279,19 +308,20 @@ LedgerTxn::Impl::create(LedgerTxn& self, LedgerEntry const& entry)
     throwIfSealed();
     throwIfChild();
 
-    auto key = LedgerEntryKey(entry);
+    CompactLedgerKey key(LedgerEntryKey(entry));
     if (getNewestVersion(key))
     {
         throw std::runtime_error("Key already exists");
     }
 
-    auto current = std::make_shared<LedgerEntry>(entry);
+    auto current = makeEntry(entry);
     auto impl = LedgerTxnEntry::makeSharedImpl(self, *current);
 
                     mActive.emplace(key, toEntryImplBase(impl));
     LedgerTxnEntry ltxe(impl);
 
         mEntry[key] = current;
+    markOfferDirty(key);
     return ltxe;
 }
 
@@ -308,24 +338,25 @@ LedgerTxn::Impl::createOrUpdateWithoutLoading(LedgerTxn& self,
     throwIfSealed();
     throwIfChild();
 
-    auto key = LedgerEntryKey(entry);
+    CompactLedgerKey key(LedgerEntryKey(entry));
     auto iter = mActive.find(key);
     if (iter != mActive.end())
     {
         throw std::runtime_error("Key is already active");
     }
 
-            mEntry[key] = std::make_shared<LedgerEntry>(entry);
+            mEntry[key] = makeEntry(entry);
+    markOfferDirty(key);
 }
 
 void
 LedgerTxn::deactivate(LedgerKey const& key)
 {
-    getImpl()->deactivate(key);
+    getImpl()->deactivate(CompactLedgerKey(key));
 }
 
 void
-LedgerTxn::Impl::deactivate(LedgerKey const& key)
+LedgerTxn::Impl::deactivate(CompactLedgerKey const& key)
 {
     auto iter = mActive.find(key);
     if (iter == mActive.end())
@@ -354,11 +385,11 @@ LedgerTxn::Impl::deactivateHeader()
 void
 LedgerTxn::erase(LedgerKey const& key)
 {
-    getImpl()->erase(key);
+    getImpl()->erase(CompactLedgerKey(key));
 }
 
 void
-LedgerTxn::Impl::erase(LedgerKey const& key)
+LedgerTxn::Impl::erase(CompactLedgerKey const& key)
 {
     throwIfSealed();
     throwIfChild();
@@ -388,6 +419,7 @@ LedgerTxn::Impl::erase(LedgerKey const& key)
                                                 mEntry.emplace(key, nullptr);
         }
     }
+    markOfferDirty(key);
         
     if (isActive)
     {
@@ -398,11 +430,11 @@ LedgerTxn::Impl::erase(LedgerKey const& key)
 void
 LedgerTxn::eraseWithoutLoading(LedgerKey const& key)
 {
-    getImpl()->eraseWithoutLoading(key);
+    getImpl()->eraseWithoutLoading(CompactLedgerKey(key));
 }
 
 void
-LedgerTxn::Impl::eraseWithoutLoading(LedgerKey const& key)
+LedgerTxn::Impl::eraseWithoutLoading(CompactLedgerKey const& key)
 {
     throwIfSealed();
     throwIfChild();
@@ -419,6 +451,7 @@ LedgerTxn::Impl::eraseWithoutLoading(LedgerKey const& key)
     {
                                 mEntry.emplace(key, nullptr);
     }
+    markOfferDirty(key);
         
     if (isActive)
     {
@@ -439,12 +472,12 @@ LedgerTxn::Impl::getAllOffers()
     auto offers = mParent.getAllOffers();
     for (auto const& kv : mEntry)
     {
-        auto const& key = kv.first;
         auto const& entry = kv.second;
-        if (key.type() != OFFER)
+        if (kv.first.type() != OFFER)
         {
             continue;
         }
+        auto key = kv.first.toLedgerKey();
         if (!entry)
         {
             offers.erase(key);
@@ -455,57 +488,117 @@ LedgerTxn::Impl::getAllOffers()
     return offers;
 }
 
-std::shared_ptr<LedgerEntry const>
-LedgerTxn::getBestOffer(Asset const& buying, Asset const& selling,
-                        std::unordered_set<LedgerKey>& exclude)
+static OfferDescriptor
+getOfferDescriptor(LedgerEntry const& entry)
 {
-    return getImpl()->getBestOffer(buying, selling, exclude);
+    auto const& oe = entry.data.offer();
+    return {oe.price, oe.offerID};
 }
 
-std::shared_ptr<LedgerEntry const>
-LedgerTxn::Impl::getBestOffer(Asset const& buying, Asset const& selling,
-                              std::unordered_set<LedgerKey>& exclude)
+bool
+operator==(AssetPair const& lhs, AssetPair const& rhs)
 {
-    auto end = mEntry.cend();
-    auto bestOfferIter = end;
-    if (exclude.size() + mEntry.size() > exclude.bucket_count())
+    return lhs.buying == rhs.buying && lhs.selling == rhs.selling;
+}
+
+size_t
+AssetPairHash::operator()(AssetPair const& key) const
+{
+    std::hash<Asset> hashAsset;
+    return hashAsset(key.buying) ^ (hashAsset(key.selling) << 1);
+}
+
+void
+LedgerTxn::Impl::markOfferDirty(CompactLedgerKey const& key)
+{
+    if (key.type() == OFFER)
     {
-                                exclude.reserve(exclude.size() + mEntry.size());
+        mDirtyOffers.insert(key);
     }
-    for (auto iter = mEntry.cbegin(); iter != end; ++iter)
+}
+
+void
+LedgerTxn::Impl::updateOrderBook()
+{
+    for (auto dirtyIter = mDirtyOffers.begin();
+         dirtyIter != mDirtyOffers.end();)
     {
-        auto const& key = iter->first;
-        auto const& entry = iter->second;
-        if (key.type() != OFFER)
+        auto const& key = *dirtyIter;
+
+        auto posIter = mOrderBookPositions.find(key);
+        if (posIter != mOrderBookPositions.end())
         {
-            continue;
+            auto bookIter = mOrderBook.find(posIter->second.first);
+            bookIter->second.erase(posIter->second.second);
+            if (bookIter->second.empty())
+            {
+                mOrderBook.erase(bookIter);
+            }
+            mOrderBookPositions.erase(posIter);
         }
 
-        if (!exclude.insert(key).second)
+        auto entryIter = mEntry.find(key);
+        if (entryIter != mEntry.end() && entryIter->second)
         {
-            continue;
+            auto const& oe = entryIter->second->data.offer();
+            AssetPair assets{oe.buying, oe.selling};
+            auto offerIter = mOrderBook[assets].emplace(
+                getOfferDescriptor(*entryIter->second), key);
+            mOrderBookPositions.emplace(key,
+                                        std::make_pair(assets, offerIter));
         }
 
-        if (!(entry && entry->data.offer().buying == buying &&
-              entry->data.offer().selling == selling))
+        if (mActive.find(key) == mActive.end())
         {
-            continue;
+            dirtyIter = mDirtyOffers.erase(dirtyIter);
         }
-
-        if ((bestOfferIter == end) ||
-            isBetterOffer(*entry, *bestOfferIter->second))
+        else
         {
-            bestOfferIter = iter;
+            ++dirtyIter;
         }
     }
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxn::getBestOffer(Asset const& buying, Asset const& selling,
+                        OfferDescriptor const* worseThan)
+{
+    return getImpl()->getBestOffer(buying, selling, worseThan);
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxn::Impl::getBestOffer(Asset const& buying, Asset const& selling,
+                              OfferDescriptor const* worseThan)
+{
+    updateOrderBook();
 
     std::shared_ptr<LedgerEntry const> bestOffer;
-    if (bestOfferIter != end)
+    auto bookIter = mOrderBook.find(AssetPair{buying, selling});
+    if (bookIter != mOrderBook.end())
+    {
+        auto const& book = bookIter->second;
+        auto offerIter =
+            worseThan ? book.upper_bound(*worseThan) : book.begin();
+        if (offerIter != book.end())
+        {
+            bestOffer = std::make_shared<LedgerEntry const>(
+                *mEntry.at(offerIter->second));
+        }
+    }
+
+    // Offers recorded at this level, whether modified or erased, shadow the
+    // versions in the parent. Those only need skipping while they could
+    // still beat bestOffer.
+    auto parentBestOffer = mParent.getBestOffer(buying, selling, worseThan);
+    while (parentBestOffer &&
+           !(bestOffer && isBetterOffer(*bestOffer, *parentBestOffer)) &&
+           mEntry.find(CompactLedgerKey(LedgerEntryKey(*parentBestOffer))) !=
+               mEntry.end())
     {
-        bestOffer = std::make_shared<LedgerEntry const>(*bestOfferIter->second);
+        auto shadowed = getOfferDescriptor(*parentBestOffer);
+        parentBestOffer = mParent.getBestOffer(buying, selling, &shadowed);
     }
 
-    auto parentBestOffer = mParent.getBestOffer(buying, selling, exclude);
     if (bestOffer && parentBestOffer)
     {
         return isBetterOffer(*bestOffer, *parentBestOffer) ? bestOffer
@@ -549,7 +642,7 @@ LedgerTxn::Impl::getChanges()
                 else
                 {
                     changes.emplace_back(LEDGER_ENTRY_REMOVED);
-                    changes.back().removed() = key;
+                    changes.back().removed() = key.toLedgerKey();
                 }
             }
             else
@@ -581,7 +674,7 @@ LedgerTxn::Impl::getDelta()
             auto const& key = kv.first;
             auto previous = mParent.getNewestVersion(key);
 
-                                                delta.entry[key] = {kv.second, previous};
+                                                delta.entry[key.toLedgerKey()] = {kv.second, previous};
         }
         delta.header = {*mHeader, mParent.getHeader()};
     });
@@ -788,7 +881,7 @@ LedgerTxn::Impl::getAllEntries(std::vector<LedgerEntry>& initEntries,
             }
             else
             {
-                resDead.emplace_back(key);
+                resDead.emplace_back(key.toLedgerKey());
             }
         }
     });
@@ -799,12 +892,18 @@ LedgerTxn::Impl::getAllEntries(std::vector<LedgerEntry>& initEntries,
 
 std::shared_ptr<LedgerEntry const>
 LedgerTxn::getNewestVersion(LedgerKey const& key) const
+{
+    return getImpl()->getNewestVersion(CompactLedgerKey(key));
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxn::getNewestVersion(CompactLedgerKey const& key) const
 {
     return getImpl()->getNewestVersion(key);
 }
 
 std::shared_ptr<LedgerEntry const>
-LedgerTxn::Impl::getNewestVersion(LedgerKey const& key) const
+LedgerTxn::Impl::getNewestVersion(CompactLedgerKey const& key) const
 {
     auto iter = mEntry.find(key);
     if (iter != mEntry.end())
@@ -828,12 +927,12 @@ LedgerTxn::Impl::getOffersByAccountAndAsset(AccountID const& account,
     auto offers = mParent.getOffersByAccountAndAsset(account, asset);
     for (auto const& kv : mEntry)
     {
-        auto const& key = kv.first;
         auto const& entry = kv.second;
-        if (key.type() != OFFER)
+        if (kv.first.type() != OFFER)
         {
             continue;
         }
+        auto key = kv.first.toLedgerKey();
         if (!entry)
         {
             offers.erase(key);
@@ -857,11 +956,11 @@ LedgerTxn::Impl::getOffersByAccountAndAsset(AccountID const& account,
 LedgerTxnEntry
 LedgerTxn::load(LedgerKey const& key)
 {
-    return getImpl()->load(*this, key);
+    return getImpl()->load(*this, CompactLedgerKey(key));
 }
 
 LedgerTxnEntry
-LedgerTxn::Impl::load(LedgerTxn& self, LedgerKey const& key)
+LedgerTxn::Impl::load(LedgerTxn& self, CompactLedgerKey const& key)
 {
     throwIfSealed();
     throwIfChild();
@@ -876,13 +975,14 @@ LedgerTxn::Impl::load(LedgerTxn& self, LedgerKey const& key)
         return {};
     }
 
-    auto current = std::make_shared<LedgerEntry>(*newest);
+    auto current = makeEntry(*newest);
     auto impl = LedgerTxnEntry::makeSharedImpl(self, *current);
 
                     mActive.emplace(key, toEntryImplBase(impl));
     LedgerTxnEntry ltxe(impl);
 
         mEntry[key] = current;
+    markOfferDirty(key);
     return ltxe;
 }
 
@@ -907,7 +1007,8 @@ LedgerTxn::Impl::loadAllOffers(LedgerTxn& self)
         {
             auto const& key = kv.first;
             auto const& sellerID = key.offer().sellerID;
-            offersByAccount[sellerID].emplace_back(load(self, key));
+            offersByAccount[sellerID].emplace_back(
+                load(self, CompactLedgerKey(key)));
         }
         return offersByAccount;
     }
@@ -931,9 +1032,9 @@ LedgerTxn::Impl::loadBestOffer(LedgerTxn& self, Asset const& buying,
     throwIfSealed();
     throwIfChild();
 
-    std::unordered_set<LedgerKey> exclude;
-    auto le = getBestOffer(buying, selling, exclude);
-    return le ? load(self, LedgerEntryKey(*le)) : LedgerTxnEntry();
+    auto le = getBestOffer(buying, selling, nullptr);
+    return le ? load(self, CompactLedgerKey(LedgerEntryKey(*le)))
+              : LedgerTxnEntry();
 }
 
 LedgerTxnHeader
@@ -979,8 +1080,7 @@ LedgerTxn::Impl::loadOffersByAccountAndAsset(LedgerTxn& self,
         res.reserve(offers.size());
         for (auto const& kv : offers)
         {
-            auto const& key = kv.first;
-            res.emplace_back(load(self, key));
+            res.emplace_back(load(self, CompactLedgerKey(kv.first)));
         }
         return res;
     }
@@ -994,11 +1094,12 @@ LedgerTxn::Impl::loadOffersByAccountAndAsset(LedgerTxn& self,
 ConstLedgerTxnEntry
 LedgerTxn::loadWithoutRecord(LedgerKey const& key)
 {
-    return getImpl()->loadWithoutRecord(*this, key);
+    return getImpl()->loadWithoutRecord(*this, CompactLedgerKey(key));
 }
 
 ConstLedgerTxnEntry
-LedgerTxn::Impl::loadWithoutRecord(LedgerTxn& self, LedgerKey const& key)
+LedgerTxn::Impl::loadWithoutRecord(LedgerTxn& self,
+                                   CompactLedgerKey const& key)
 {
     throwIfSealed();
     throwIfChild();
@@ -1090,7 +1191,7 @@ LedgerTxn::Impl::maybeUpdateLastModified() const
         std::shared_ptr<LedgerEntry> entry;
         if (kv.second)
         {
-            entry = std::make_shared<LedgerEntry>(*kv.second);
+            entry = makeEntry(*kv.second);
             if (mShouldUpdateLastModified)
             {
                 entry->lastModifiedLedgerSeq = mHeader->ledgerSeq;
@@ -1133,6 +1234,7 @@ void
 LedgerTxn::Impl::EntryIteratorImpl::advance()
 {
     ++mIter;
+    mHasKey = false;
 }
 
 bool
@@ -1155,6 +1257,17 @@ LedgerTxn::Impl::EntryIteratorImpl::entryExists() const
 
 LedgerKey const&
 LedgerTxn::Impl::EntryIteratorImpl::key() const
+{
+    if (!mHasKey)
+    {
+        mKey = mIter->first.toLedgerKey();
+        mHasKey = true;
+    }
+    return mKey;
+}
+
+CompactLedgerKey const&
+LedgerTxn::Impl::EntryIteratorImpl::compactKey() const
 {
     return mIter->first;
 }
@@ -1165,20 +1278,77 @@ LedgerTxn::Impl::EntryIteratorImpl::clone() const
     return std::make_unique<EntryIteratorImpl>(mIter, mEnd);
 }
 
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::PendingEntryIteratorImpl(
+    IteratorType const& begin, IteratorType const& end)
+    : mIter(begin), mEnd(end)
+{
+}
+
+void
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::advance()
+{
+    ++mIter;
+    mHasKey = false;
+}
+
+bool
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::atEnd() const
+{
+    return mIter == mEnd;
+}
+
+LedgerEntry const&
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::entry() const
+{
+    return *(mIter->second);
+}
+
+bool
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::entryExists() const
+{
+    return (bool)(mIter->second);
+}
+
+LedgerKey const&
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::key() const
+{
+    if (!mHasKey)
+    {
+        mKey = mIter->first.toLedgerKey();
+        mHasKey = true;
+    }
+    return mKey;
+}
+
+CompactLedgerKey const&
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::compactKey() const
+{
+    return mIter->first;
+}
+
+std::unique_ptr<EntryIterator::AbstractImpl>
+LedgerTxnRoot::Impl::PendingEntryIteratorImpl::clone() const
+{
+    return std::make_unique<PendingEntryIteratorImpl>(mIter, mEnd);
+}
+
 LedgerTxnRoot::LedgerTxnRoot(Database& db, size_t entryCacheSize,
-                             size_t bestOfferCacheSize,
-                             size_t prefetchBatchSize)
-    : mImpl(std::make_unique<Impl>(db, entryCacheSize, bestOfferCacheSize,
-                                   prefetchBatchSize))
+                             size_t prefetchBatchSize, bool writeBehind,
+                             CacheEvictionPolicy cachePolicy,
+                             size_t entryCacheBytes)
+    : mImpl(std::make_unique<Impl>(db, entryCacheSize, prefetchBatchSize,
+                                   writeBehind, cachePolicy, entryCacheBytes))
 {
 }
 
 LedgerTxnRoot::Impl::Impl(Database& db, size_t entryCacheSize,
-                          size_t bestOfferCacheSize, size_t prefetchBatchSize)
+                          size_t prefetchBatchSize, bool writeBehind,
+                          CacheEvictionPolicy cachePolicy,
+                          size_t entryCacheBytes)
     : mDatabase(db)
     , mHeader(std::make_unique<LedgerHeader>())
-    , mEntryCache(entryCacheSize)
-    , mBestOffersCache(bestOfferCacheSize)
+    , mEntryCache(entryCacheSize, cachePolicy, entryCacheBytes)
+    , mWriteBehind(writeBehind)
     , mMaxCacheSize(entryCacheSize)
     , mBulkLoadBatchSize(prefetchBatchSize)
     , mChild(nullptr)
@@ -1195,6 +1365,17 @@ LedgerTxnRoot::Impl::~Impl()
     {
         mChild->rollback();
     }
+    discardAsyncPrefetch();
+
+    if (mWriteBehindThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mWriteBehindMutex);
+            mStopWriteBehind = true;
+        }
+        mWriteBehindCV.notify_all();
+        mWriteBehindThread.join();
+    }
 }
 
 void
@@ -1210,6 +1391,7 @@ LedgerTxnRoot::Impl::addChild(AbstractLedgerTxn& child)
     {
         throw std::runtime_error("LedgerTxnRoot already has child");
     }
+    prunePendingEntries();
     mTransaction = std::make_unique<soci::transaction>(mDatabase.getSession());
     mChild = &child;
 }
@@ -1229,6 +1411,39 @@ LedgerTxnRoot::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
     mImpl->commitChild(std::move(iter), cons);
 }
 
+// Records in storestate the ledger entries being written behind, or clears
+// them once they are written.
+static void
+setWriteBehindChanges(Database& db, soci::session& session,
+                      std::string const& changes)
+{
+    auto name = PersistentState::getStoreStateName(
+        PersistentState::kWriteBehindChanges);
+    auto prep = db.getPreparedStatement(
+        "UPDATE storestate SET state = :v WHERE statename = :n;", session);
+    auto& st = prep.statement();
+    st.exchange(soci::use(changes));
+    st.exchange(soci::use(name));
+    st.define_and_bind();
+    st.execute(true);
+
+    if (st.get_affected_rows() != 1)
+    {
+        auto prep2 = db.getPreparedStatement(
+            "INSERT INTO storestate (statename, state) VALUES (:n, :v);",
+            session);
+        auto& st2 = prep2.statement();
+        st2.exchange(soci::use(name));
+        st2.exchange(soci::use(changes));
+        st2.define_and_bind();
+        st2.execute(true);
+        if (st2.get_affected_rows() != 1)
+        {
+            throw std::runtime_error("Could not insert data in SQL");
+        }
+    }
+}
+
 static void
 accum(EntryIterator const& iter, std::vector<EntryIterator>& upsertBuffer,
       std::vector<EntryIterator>& deleteBuffer)
@@ -1242,7 +1457,7 @@ accum(EntryIterator const& iter, std::vector<EntryIterator>& upsertBuffer,
 void
 BulkLedgerEntryChangeAccumulator::accumulate(EntryIterator const& iter)
 {
-    switch (iter.key().type())
+    switch (iter.compactKey().type())
     {
     case ACCOUNT:
         accum(iter, mAccountsToUpsert, mAccountsToDelete);
@@ -1264,54 +1479,55 @@ BulkLedgerEntryChangeAccumulator::accumulate(EntryIterator const& iter)
 void
 LedgerTxnRoot::Impl::bulkApply(BulkLedgerEntryChangeAccumulator& bleca,
                                size_t bufferThreshold,
-                               LedgerTxnConsistency cons)
+                               LedgerTxnConsistency cons,
+                               soci::session& session)
 {
     auto& upsertAccounts = bleca.getAccountsToUpsert();
     if (upsertAccounts.size() > bufferThreshold)
     {
-        bulkUpsertAccounts(upsertAccounts);
+        bulkUpsertAccounts(upsertAccounts, session);
         upsertAccounts.clear();
     }
     auto& deleteAccounts = bleca.getAccountsToDelete();
     if (deleteAccounts.size() > bufferThreshold)
     {
-        bulkDeleteAccounts(deleteAccounts, cons);
+        bulkDeleteAccounts(deleteAccounts, cons, session);
         deleteAccounts.clear();
     }
     auto& upsertTrustLines = bleca.getTrustLinesToUpsert();
     if (upsertTrustLines.size() > bufferThreshold)
     {
-        bulkUpsertTrustLines(upsertTrustLines);
+        bulkUpsertTrustLines(upsertTrustLines, session);
         upsertTrustLines.clear();
     }
     auto& deleteTrustLines = bleca.getTrustLinesToDelete();
     if (deleteTrustLines.size() > bufferThreshold)
     {
-        bulkDeleteTrustLines(deleteTrustLines, cons);
+        bulkDeleteTrustLines(deleteTrustLines, cons, session);
         deleteTrustLines.clear();
     }
     auto& upsertOffers = bleca.getOffersToUpsert();
     if (upsertOffers.size() > bufferThreshold)
     {
-        bulkUpsertOffers(upsertOffers);
+        bulkUpsertOffers(upsertOffers, session);
         upsertOffers.clear();
     }
     auto& deleteOffers = bleca.getOffersToDelete();
     if (deleteOffers.size() > bufferThreshold)
     {
-        bulkDeleteOffers(deleteOffers, cons);
+        bulkDeleteOffers(deleteOffers, cons, session);
         deleteOffers.clear();
     }
     auto& upsertAccountData = bleca.getAccountDataToUpsert();
     if (upsertAccountData.size() > bufferThreshold)
     {
-        bulkUpsertAccountData(upsertAccountData);
+        bulkUpsertAccountData(upsertAccountData, session);
         upsertAccountData.clear();
     }
     auto& deleteAccountData = bleca.getAccountDataToDelete();
     if (deleteAccountData.size() > bufferThreshold)
     {
-        bulkDeleteAccountData(deleteAccountData, cons);
+        bulkDeleteAccountData(deleteAccountData, cons, session);
         deleteAccountData.clear();
     }
 }
@@ -1321,19 +1537,58 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
 {
             auto childHeader = std::make_unique<LedgerHeader>(mChild->getHeader());
 
+    std::shared_ptr<PendingWrite> pending;
+    if (mWriteBehind)
+    {
+        waitForPendingWrites();
+        mPendingEntries.clear();
+        pending = std::make_shared<PendingWrite>();
+        pending->mConsistency = cons;
+    }
+
     auto bleca = BulkLedgerEntryChangeAccumulator();
     try
     {
         while ((bool)iter)
         {
+            updateOrderBook(iter);
+            if (mAsyncPrefetch)
+            {
+                mAsyncPrefetch->mCommittedKeys.insert(iter.compactKey());
+            }
+            if (pending)
+            {
+                auto entry = iter.entryExists()
+                                 ? std::make_shared<LedgerEntry const>(
+                                       iter.entry())
+                                 : nullptr;
+                pending->mEntries.emplace_back(iter.compactKey(), entry);
+                mPendingEntries[iter.compactKey()] = entry;
+                ++iter;
+                continue;
+            }
             bleca.accumulate(iter);
             ++iter;
             size_t bufferThreshold =
                 (bool)iter ? LEDGER_ENTRY_BATCH_COMMIT_SIZE : 0;
-            bulkApply(bleca, bufferThreshold, cons);
+            bulkApply(bleca, bufferThreshold, cons, mDatabase.getSession());
+        }
+
+        // The entries are stored with the header and cleared in the same
+        // transaction that writes them, so a node that stops in between
+        // writes them on restart.
+        if (pending && !pending->mEntries.empty())
+        {
+            setWriteBehindChanges(mDatabase, mDatabase.getSession(),
+                                  encodePendingEntries(pending->mEntries));
         }
                                         mDatabase.clearPreparedStatementCache();
         mTransaction->commit();
+
+        if (pending && !pending->mEntries.empty())
+        {
+            queuePendingWrite(std::move(pending));
+        }
     }
     catch (std::exception& e)
     {
@@ -1346,8 +1601,7 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
             "unknown fatal error during commit to LedgerTxnRoot");
     }
 
-        mBestOffersCache.clear();
-    mEntryCache.clear();
+        mEntryCache.clear();
     mPrefetchMetrics.clear();
 
         mTransaction.reset();
@@ -1356,6 +1610,233 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
     mChild = nullptr;
 }
 
+void
+LedgerTxnRoot::Impl::queuePendingWrite(
+    std::shared_ptr<PendingWrite const> write)
+{
+    if (!mWriteBehindThread.joinable())
+    {
+        // The pool is created lazily, so get it before leaving the main thread.
+        auto& pool = mDatabase.getPool();
+        mWriteBehindThread =
+            std::thread([this, &pool]() { writeBehind(pool); });
+    }
+    {
+        std::lock_guard<std::mutex> lock(mWriteBehindMutex);
+        mPendingWrite = std::move(write);
+    }
+    mWriteBehindCV.notify_all();
+}
+
+void
+LedgerTxnRoot::Impl::writeBehind(soci::connection_pool& pool)
+{
+    std::unique_lock<std::mutex> lock(mWriteBehindMutex);
+    while (true)
+    {
+        mWriteBehindCV.wait(
+            lock, [this]() { return mPendingWrite || mStopWriteBehind; });
+        if (!mPendingWrite)
+        {
+            return;
+        }
+
+        auto write = mPendingWrite;
+        lock.unlock();
+        writePending(*write, pool);
+        lock.lock();
+        mPendingWrite.reset();
+        mWriteBehindCV.notify_all();
+    }
+}
+
+void
+LedgerTxnRoot::Impl::writePending(PendingWrite const& write,
+                                  soci::connection_pool& pool)
+{
+    // A failed write aborts the node. Its entries are still in storestate,
+    // so they are written when the node starts again.
+    try
+    {
+        // The session is only leased for the write, so that an idle
+        // write-behind thread does not keep it from prefetches.
+        soci::session session(pool);
+        soci::transaction tx(session);
+        applyPendingWrite(write, session);
+        tx.commit();
+    }
+    catch (std::exception& e)
+    {
+        printErrorAndAbort("fatal error during write-behind to LedgerTxnRoot: ",
+                           e.what());
+    }
+    catch (...)
+    {
+        printErrorAndAbort(
+            "unknown fatal error during write-behind to LedgerTxnRoot");
+    }
+}
+
+void
+LedgerTxnRoot::Impl::applyPendingWrite(PendingWrite const& write,
+                                       soci::session& session)
+{
+    auto bleca = BulkLedgerEntryChangeAccumulator();
+    EntryIterator iter(std::make_unique<PendingEntryIteratorImpl>(
+        write.mEntries.cbegin(), write.mEntries.cend()));
+    while ((bool)iter)
+    {
+        bleca.accumulate(iter);
+        ++iter;
+        size_t bufferThreshold =
+            (bool)iter ? LEDGER_ENTRY_BATCH_COMMIT_SIZE : 0;
+        bulkApply(bleca, bufferThreshold, write.mConsistency, session);
+    }
+    setWriteBehindChanges(mDatabase, session, "");
+}
+
+// The pending entries are stored as LedgerEntryChanges: an update for each
+// upsert and a removal for each erase.
+std::string
+LedgerTxnRoot::Impl::encodePendingEntries(PendingEntries const& entries)
+{
+    LedgerEntryChanges changes;
+    changes.reserve(entries.size());
+    for (auto const& kv : entries)
+    {
+        if (kv.second)
+        {
+            changes.emplace_back(LEDGER_ENTRY_UPDATED);
+            changes.back().updated() = *kv.second;
+        }
+        else
+        {
+            changes.emplace_back(LEDGER_ENTRY_REMOVED);
+            changes.back().removed() = kv.first.toLedgerKey();
+        }
+    }
+    return decoder::encode_b64(xdr::xdr_to_opaque(changes));
+}
+
+LedgerTxnRoot::Impl::PendingEntries
+LedgerTxnRoot::Impl::decodePendingEntries(std::string const& encoded)
+{
+    std::vector<uint8_t> buffer;
+    decoder::decode_b64(encoded, buffer);
+    LedgerEntryChanges changes;
+    xdr::xdr_from_opaque(buffer, changes);
+
+    PendingEntries entries;
+    entries.reserve(changes.size());
+    for (auto const& change : changes)
+    {
+        switch (change.type())
+        {
+        case LEDGER_ENTRY_UPDATED:
+            entries.emplace_back(
+                CompactLedgerKey(LedgerEntryKey(change.updated())),
+                std::make_shared<LedgerEntry const>(change.updated()));
+            break;
+        case LEDGER_ENTRY_REMOVED:
+            entries.emplace_back(CompactLedgerKey(change.removed()),
+                                 nullptr);
+            break;
+        default:
+            throw std::runtime_error("Unexpected write-behind change");
+        }
+    }
+    return entries;
+}
+
+void
+LedgerTxnRoot::replayPendingWrite(std::string const& changes)
+{
+    mImpl->replayPendingWrite(changes);
+}
+
+void
+LedgerTxnRoot::Impl::replayPendingWrite(std::string const& changes)
+{
+    throwIfChild();
+    waitForPendingWrites();
+
+    // The stored changes do not say how strictly the original erases were
+    // checked, so they are checked loosely.
+    PendingWrite write;
+    write.mEntries = decodePendingEntries(changes);
+    write.mConsistency = LedgerTxnConsistency::EXTRA_DELETES;
+
+    soci::transaction tx(mDatabase.getSession());
+    applyPendingWrite(write, mDatabase.getSession());
+    tx.commit();
+
+    mEntryCache.clear();
+    mPrefetchMetrics.clear();
+}
+
+void
+LedgerTxnRoot::waitForPendingWrites()
+{
+    mImpl->waitForPendingWrites();
+}
+
+void
+LedgerTxnRoot::Impl::waitForPendingWrites() const
+{
+    {
+        std::unique_lock<std::mutex> lock(mWriteBehindMutex);
+        mWriteBehindCV.wait(lock, [this]() { return !mPendingWrite; });
+    }
+    if (!mChild)
+    {
+        mPendingEntries.clear();
+    }
+}
+
+void
+LedgerTxnRoot::Impl::prunePendingEntries() const
+{
+    {
+        std::lock_guard<std::mutex> lock(mWriteBehindMutex);
+        if (mPendingWrite)
+        {
+            return;
+        }
+    }
+    mPendingEntries.clear();
+}
+
+void
+LedgerTxnRoot::Impl::mergePendingOffers(
+    std::vector<LedgerEntry>& offers,
+    std::function<bool(OfferEntry const&)> const& match) const
+{
+    if (mPendingEntries.empty())
+    {
+        return;
+    }
+
+    std::vector<LedgerEntry> res;
+    res.reserve(offers.size());
+    for (auto& offer : offers)
+    {
+        CompactLedgerKey key(LedgerEntryKey(offer));
+        if (mPendingEntries.find(key) == mPendingEntries.end())
+        {
+            res.emplace_back(std::move(offer));
+        }
+    }
+    for (auto const& kv : mPendingEntries)
+    {
+        if (kv.first.type() == OFFER && kv.second &&
+            match(kv.second->data.offer()))
+        {
+            res.emplace_back(*kv.second);
+        }
+    }
+    offers.swap(res);
+}
+
 std::string
 LedgerTxnRoot::Impl::tableFromLedgerEntryType(LedgerEntryType let)
 {
@@ -1385,6 +1866,7 @@ LedgerTxnRoot::Impl::countObjects(LedgerEntryType let) const
 {
     using namespace soci;
     throwIfChild();
+    waitForPendingWrites();
 
     std::string query =
         "SELECT COUNT(*) FROM " + tableFromLedgerEntryType(let) + ";";
@@ -1406,6 +1888,7 @@ LedgerTxnRoot::Impl::countObjects(LedgerEntryType let,
 {
     using namespace soci;
     throwIfChild();
+    waitForPendingWrites();
 
     std::string query = "SELECT COUNT(*) FROM " +
                         tableFromLedgerEntryType(let) +
@@ -1428,8 +1911,9 @@ LedgerTxnRoot::Impl::deleteObjectsModifiedOnOrAfterLedger(uint32_t ledger) const
 {
     using namespace soci;
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    waitForPendingWrites();
+    clearEntryCache();
+    clearOrderBook();
 
     for (auto let : {ACCOUNT, DATA, TRUSTLINE, OFFER})
     {
@@ -1472,7 +1956,8 @@ LedgerTxnRoot::prefetch(std::unordered_set<LedgerKey> const& keys)
 uint32_t
 LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
 {
-    uint32_t total = 0;
+    uint32_t total = takeAsyncPrefetch();
+    auto& session = mDatabase.getSession();
 
     std::unordered_set<LedgerKey> accounts;
     std::unordered_set<LedgerKey> offers;
@@ -1484,14 +1969,17 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
                                std::shared_ptr<LedgerEntry const>> const& res) {
             for (auto const& item : res)
             {
-                putInEntryCache(item.first, item.second, LoadType::PREFETCH);
+                putInEntryCache(CompactLedgerKey(item.first), item.second,
+                                LoadType::PREFETCH);
                 ++total;
             }
         };
 
     auto insertIfNotLoaded = [&](std::unordered_set<LedgerKey>& keys,
                                  LedgerKey const& key) {
-        if (!mEntryCache.exists(key, false))
+        CompactLedgerKey compactKey(key);
+        if (!mEntryCache.exists(compactKey, false) &&
+            mPendingEntries.find(compactKey) == mPendingEntries.end())
         {
             keys.insert(key);
         }
@@ -1499,8 +1987,7 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
 
     for (auto const& key : keys)
     {
-        if ((static_cast<double>(mEntryCache.size()) / mMaxCacheSize) >=
-            ENTRY_CACHE_FILL_RATIO)
+        if (entryCacheFillRatio() >= ENTRY_CACHE_FILL_RATIO)
         {
             return total;
         }
@@ -1511,7 +1998,7 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             insertIfNotLoaded(accounts, key);
             if (accounts.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadAccounts(accounts));
+                cacheResult(bulkLoadAccounts(accounts, session));
                 accounts.clear();
             }
             break;
@@ -1519,7 +2006,7 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             insertIfNotLoaded(offers, key);
             if (offers.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadOffers(offers));
+                cacheResult(bulkLoadOffers(offers, session));
                 offers.clear();
             }
             break;
@@ -1527,7 +2014,7 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             insertIfNotLoaded(trustlines, key);
             if (trustlines.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadTrustLines(trustlines));
+                cacheResult(bulkLoadTrustLines(trustlines, session));
                 trustlines.clear();
             }
             break;
@@ -1535,21 +2022,180 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             insertIfNotLoaded(data, key);
             if (data.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadData(data));
+                cacheResult(bulkLoadData(data, session));
                 data.clear();
             }
             break;
         }
     }
 
-        cacheResult(bulkLoadAccounts(accounts));
-    cacheResult(bulkLoadOffers(offers));
-    cacheResult(bulkLoadTrustLines(trustlines));
-    cacheResult(bulkLoadData(data));
+        cacheResult(bulkLoadAccounts(accounts, session));
+    cacheResult(bulkLoadOffers(offers, session));
+    cacheResult(bulkLoadTrustLines(trustlines, session));
+    cacheResult(bulkLoadData(data, session));
 
     return total;
 }
 
+std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+LedgerTxnRoot::Impl::bulkLoad(std::unordered_set<LedgerKey> const& keys,
+                              soci::session& session) const
+{
+    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>> res;
+    std::unordered_set<LedgerKey> batches[4];
+
+    auto loadBatch = [&](LedgerEntryType type) {
+        auto& batch = batches[type];
+        std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+            loaded;
+        switch (type)
+        {
+        case ACCOUNT:
+            loaded = bulkLoadAccounts(batch, session);
+            break;
+        case TRUSTLINE:
+            loaded = bulkLoadTrustLines(batch, session);
+            break;
+        case OFFER:
+            loaded = bulkLoadOffers(batch, session);
+            break;
+        case DATA:
+            loaded = bulkLoadData(batch, session);
+            break;
+        default:
+            throw std::runtime_error("Unknown key type");
+        }
+        res.insert(loaded.begin(), loaded.end());
+        batch.clear();
+    };
+
+    for (auto const& key : keys)
+    {
+        batches[key.type()].insert(key);
+        if (batches[key.type()].size() == mBulkLoadBatchSize)
+        {
+            loadBatch(key.type());
+        }
+    }
+    for (auto type : {ACCOUNT, TRUSTLINE, OFFER, DATA})
+    {
+        loadBatch(type);
+    }
+    return res;
+}
+
+void
+LedgerTxnRoot::prefetchAsync(std::unordered_set<LedgerKey> keys,
+                             uint32_t ledgerSeq)
+{
+    mImpl->prefetchAsync(std::move(keys), ledgerSeq);
+}
+
+void
+LedgerTxnRoot::Impl::prefetchAsync(std::unordered_set<LedgerKey> keys,
+                                   uint32_t ledgerSeq)
+{
+    discardAsyncPrefetch();
+    // The database may not have the pending versions yet.
+    for (auto const& kv : mPendingEntries)
+    {
+        keys.erase(kv.first.toLedgerKey());
+    }
+    if (keys.empty() || !mDatabase.canUsePool())
+    {
+        return;
+    }
+
+    // The pool is created lazily, so get it before leaving the main thread.
+    auto& pool = mDatabase.getPool();
+    mAsyncPrefetch = std::make_unique<AsyncPrefetch>();
+    mAsyncPrefetch->mLedgerSeq = ledgerSeq;
+    mAsyncPrefetch->mEntries = std::async(
+        std::launch::async, [ this, &pool, keys = std::move(keys) ]() {
+            soci::session session(pool);
+            soci::transaction tx(session);
+            return bulkLoad(keys, session);
+        });
+}
+
+uint32_t
+LedgerTxnRoot::Impl::takeAsyncPrefetch()
+{
+    // Until the previous ledger is committed, the cache still belongs to an
+    // earlier ledger and is cleared on commit.
+    if (!mAsyncPrefetch || mHeader->ledgerSeq + 1 < mAsyncPrefetch->mLedgerSeq)
+    {
+        return 0;
+    }
+    auto prefetch = std::move(mAsyncPrefetch);
+    if (mHeader->ledgerSeq + 1 > prefetch->mLedgerSeq)
+    {
+        prefetch->mEntries.wait();
+        return 0;
+    }
+
+    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>> entries;
+    try
+    {
+        entries = prefetch->mEntries.get();
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Ledger") << "Background prefetch failed: " << e.what();
+        return 0;
+    }
+
+    uint32_t total = 0;
+    for (auto const& kv : entries)
+    {
+        if (entryCacheFillRatio() >= ENTRY_CACHE_FILL_RATIO)
+        {
+            break;
+        }
+
+        CompactLedgerKey key(kv.first);
+        if (prefetch->mCommittedKeys.find(key) ==
+                prefetch->mCommittedKeys.end() &&
+            !mEntryCache.exists(key, false) &&
+            mPrefetchMetrics.find(key) == mPrefetchMetrics.end())
+        {
+            putInEntryCache(key, kv.second, LoadType::PREFETCH);
+            ++total;
+        }
+    }
+    return total;
+}
+
+void
+LedgerTxnRoot::Impl::discardAsyncPrefetch() const
+{
+    if (mAsyncPrefetch)
+    {
+        // Wait for the load so that it does not outlive this object.
+        mAsyncPrefetch->mEntries.wait();
+        mAsyncPrefetch.reset();
+    }
+}
+
+void
+LedgerTxnRoot::Impl::clearEntryCache() const
+{
+    mEntryCache.clear();
+    discardAsyncPrefetch();
+}
+
+double
+LedgerTxnRoot::Impl::entryCacheFillRatio() const
+{
+    auto ratio = static_cast<double>(mEntryCache.size()) / mMaxCacheSize;
+    if (mEntryCache.maxBytes() != 0)
+    {
+        ratio = std::max(ratio, static_cast<double>(mEntryCache.bytes()) /
+                                    mEntryCache.maxBytes());
+    }
+    return ratio;
+}
+
 double
 LedgerTxnRoot::getPrefetchHitRate() const
 {
@@ -1568,6 +2214,36 @@ LedgerTxnRoot::Impl::getPrefetchHitRate() const
            (totalMisses + mTotalPrefetchHits);
 }
 
+double
+LedgerTxnRoot::getEntryCacheHitRate() const
+{
+    return mImpl->getEntryCacheHitRate();
+}
+
+double
+LedgerTxnRoot::Impl::getEntryCacheHitRate() const
+{
+    auto const& counters = mEntryCache.getCounters();
+    if (counters.mHits == 0 && counters.mMisses == 0)
+    {
+        return 0;
+    }
+    return static_cast<double>(counters.mHits) /
+           (counters.mHits + counters.mMisses);
+}
+
+size_t
+LedgerTxnRoot::getEntryCacheBytes() const
+{
+    return mImpl->getEntryCacheBytes();
+}
+
+size_t
+LedgerTxnRoot::Impl::getEntryCacheBytes() const
+{
+    return mEntryCache.bytes();
+}
+
 std::unordered_map<LedgerKey, LedgerEntry>
 LedgerTxnRoot::getAllOffers()
 {
@@ -1593,6 +2269,7 @@ LedgerTxnRoot::Impl::getAllOffers()
         printErrorAndAbort(
             "unknown fatal error when getting all offers from LedgerTxnRoot");
     }
+    mergePendingOffers(offers, [](OfferEntry const&) { return true; });
 
     std::unordered_map<LedgerKey, LedgerEntry> offersByKey(offers.size());
     for (auto const& offer : offers)
@@ -1604,45 +2281,20 @@ LedgerTxnRoot::Impl::getAllOffers()
 
 std::shared_ptr<LedgerEntry const>
 LedgerTxnRoot::getBestOffer(Asset const& buying, Asset const& selling,
-                            std::unordered_set<LedgerKey>& exclude)
+                            OfferDescriptor const* worseThan)
 {
-    return mImpl->getBestOffer(buying, selling, exclude);
-}
-
-static std::shared_ptr<LedgerEntry const>
-findIncludedOffer(std::list<LedgerEntry>::const_iterator iter,
-                  std::list<LedgerEntry>::const_iterator const& end,
-                  std::unordered_set<LedgerKey> const& exclude)
-{
-    for (; iter != end; ++iter)
-    {
-        auto key = LedgerEntryKey(*iter);
-        if (exclude.find(key) == exclude.end())
-        {
-            return std::make_shared<LedgerEntry const>(*iter);
-        }
-    }
-    return {};
+    return mImpl->getBestOffer(buying, selling, worseThan);
 }
 
 std::shared_ptr<LedgerEntry const>
 LedgerTxnRoot::Impl::getBestOffer(Asset const& buying, Asset const& selling,
-                                  std::unordered_set<LedgerKey>& exclude)
+                                  OfferDescriptor const* worseThan)
 {
-                        BestOffersCacheEntry emptyCacheEntry{{}, false};
-    auto& cached = getFromBestOffersCache(buying, selling, emptyCacheEntry);
-    auto& offers = cached.bestOffers;
-
-    auto res = findIncludedOffer(offers.cbegin(), offers.cend(), exclude);
-
-    size_t const BATCH_SIZE = 5;
-    while (!res && !cached.allLoaded)
+    if (!mOrderBookLoaded)
     {
-        std::list<LedgerEntry>::const_iterator newOfferIter;
         try
         {
-            newOfferIter = loadBestOffers(offers, buying, selling, BATCH_SIZE,
-                                          offers.size());
+            loadOrderBook();
         }
         catch (std::exception& e)
         {
@@ -1655,19 +2307,88 @@ LedgerTxnRoot::Impl::getBestOffer(Asset const& buying, Asset const& selling,
             printErrorAndAbort("unknown fatal error when getting best offer "
                                "from LedgerTxnRoot");
         }
+    }
 
-        if (std::distance(newOfferIter, offers.cend()) < BATCH_SIZE)
+    auto bookIter = mOrderBook.find(AssetPair{buying, selling});
+    if (bookIter == mOrderBook.end())
+    {
+        return {};
+    }
+    auto const& book = bookIter->second;
+    auto offerIter = worseThan ? book.upper_bound(*worseThan) : book.begin();
+    if (offerIter == book.end())
+    {
+        return {};
+    }
+
+    auto const& res = offerIter->second;
+    putInEntryCache(CompactLedgerKey(LedgerEntryKey(*res)), res,
+                    LoadType::IMMEDIATE);
+    return res;
+}
+
+void
+LedgerTxnRoot::Impl::loadOrderBook()
+{
+    clearOrderBook();
+    auto offers = loadAllOffers();
+    mergePendingOffers(offers, [](OfferEntry const&) { return true; });
+    for (auto const& offer : offers)
+    {
+        auto const& oe = offer.data.offer();
+        AssetPair assets{oe.buying, oe.selling};
+        auto le = std::make_shared<LedgerEntry const>(offer);
+        auto offerIter =
+            mOrderBook[assets].emplace(getOfferDescriptor(offer), le);
+        mOrderBookPositions.emplace(CompactLedgerKey(LedgerEntryKey(offer)),
+                                    std::make_pair(assets, offerIter));
+    }
+    mOrderBookLoaded = true;
+
+    size_t numOffers = mOrderBookPositions.size();
+    CLOG(INFO, "Ledger") << "Loaded " << numOffers << " offers in "
+                         << mOrderBook.size() << " order books";
+}
+
+void
+LedgerTxnRoot::Impl::updateOrderBook(EntryIterator const& iter)
+{
+    auto const& key = iter.compactKey();
+    if (!mOrderBookLoaded || key.type() != OFFER)
+    {
+        return;
+    }
+
+    auto posIter = mOrderBookPositions.find(key);
+    if (posIter != mOrderBookPositions.end())
+    {
+        auto bookIter = mOrderBook.find(posIter->second.first);
+        bookIter->second.erase(posIter->second.second);
+        if (bookIter->second.empty())
         {
-            cached.allLoaded = true;
+            mOrderBook.erase(bookIter);
         }
-        res = findIncludedOffer(newOfferIter, offers.cend(), exclude);
+        mOrderBookPositions.erase(posIter);
     }
 
-    if (res)
+    if (iter.entryExists())
     {
-        putInEntryCache(LedgerEntryKey(*res), res, LoadType::IMMEDIATE);
+        auto const& entry = iter.entry();
+        auto const& oe = entry.data.offer();
+        AssetPair assets{oe.buying, oe.selling};
+        auto le = std::make_shared<LedgerEntry const>(entry);
+        auto offerIter =
+            mOrderBook[assets].emplace(getOfferDescriptor(entry), le);
+        mOrderBookPositions.emplace(key, std::make_pair(assets, offerIter));
     }
-    return res;
+}
+
+void
+LedgerTxnRoot::Impl::clearOrderBook() const
+{
+    mOrderBook.clear();
+    mOrderBookPositions.clear();
+    mOrderBookLoaded = false;
 }
 
 std::unordered_map<LedgerKey, LedgerEntry>
@@ -1697,6 +2418,10 @@ LedgerTxnRoot::Impl::getOffersByAccountAndAsset(AccountID const& account,
         printErrorAndAbort("unknown fatal error when getting offers by account "
                            "and asset from LedgerTxnRoot");
     }
+    mergePendingOffers(offers, [&](OfferEntry const& oe) {
+        return oe.sellerID == account &&
+               (oe.selling == asset || oe.buying == asset);
+    });
 
     std::unordered_map<LedgerKey, LedgerEntry> res(offers.size());
     for (auto const& offer : offers)
@@ -1727,6 +2452,8 @@ LedgerTxnRoot::getInflationWinners(size_t maxWinners, int64_t minVotes)
 std::vector<InflationWinner>
 LedgerTxnRoot::Impl::getInflationWinners(size_t maxWinners, int64_t minVotes)
 {
+    // Votes are summed by the database, so it must have every pending write.
+    waitForPendingWrites();
     try
     {
         return loadInflationWinners(maxWinners, minVotes);
@@ -1746,26 +2473,39 @@ LedgerTxnRoot::Impl::getInflationWinners(size_t maxWinners, int64_t minVotes)
 
 std::shared_ptr<LedgerEntry const>
 LedgerTxnRoot::getNewestVersion(LedgerKey const& key) const
+{
+    return mImpl->getNewestVersion(CompactLedgerKey(key));
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxnRoot::getNewestVersion(CompactLedgerKey const& key) const
 {
     return mImpl->getNewestVersion(key);
 }
 
 std::shared_ptr<LedgerEntry const>
-LedgerTxnRoot::Impl::getNewestVersion(LedgerKey const& key) const
+LedgerTxnRoot::Impl::getNewestVersion(CompactLedgerKey const& compactKey) const
 {
-    if (mEntryCache.exists(key))
+    auto pending = mPendingEntries.find(compactKey);
+    if (pending != mPendingEntries.end())
     {
-        return getFromEntryCache(key);
+        return pending->second;
+    }
+
+    if (mEntryCache.exists(compactKey))
+    {
+        return getFromEntryCache(compactKey);
     }
     else
     {
-        auto& metrics = mPrefetchMetrics[key];
+        auto& metrics = mPrefetchMetrics[compactKey];
         ++metrics.misses;
     }
 
     std::shared_ptr<LedgerEntry const> entry;
     try
     {
+        auto key = compactKey.toLedgerKey();
         switch (key.type())
         {
         case ACCOUNT:
@@ -1796,7 +2536,7 @@ LedgerTxnRoot::Impl::getNewestVersion(LedgerKey const& key) const
                            "LedgerTxnRoot");
     }
 
-    putInEntryCache(key, entry, LoadType::IMMEDIATE);
+    putInEntryCache(compactKey, entry, LoadType::IMMEDIATE);
     return entry;
 }
 
@@ -1829,7 +2569,7 @@ LedgerTxnRoot::Impl::rollbackChild()
 }
 
 std::shared_ptr<LedgerEntry const>
-LedgerTxnRoot::Impl::getFromEntryCache(LedgerKey const& key) const
+LedgerTxnRoot::Impl::getFromEntryCache(CompactLedgerKey const& key) const
 {
     try
     {
@@ -1856,13 +2596,21 @@ LedgerTxnRoot::Impl::getFromEntryCache(LedgerKey const& key) const
 
 void
 LedgerTxnRoot::Impl::putInEntryCache(
-    LedgerKey const& key, std::shared_ptr<LedgerEntry const> const& entry,
-    LoadType type) const
+    CompactLedgerKey const& key,
+    std::shared_ptr<LedgerEntry const> const& entry, LoadType type) const
 {
     try
     {
-        mEntryCache.put(key, {entry, type});
-        if (type == LoadType::PREFETCH)
+        // A prefetched entry that the cache does not admit can be prefetched
+        // again, so it is only tracked once it is cached.
+        // Entries that were not found still take up their key.
+        size_t bytes = sizeof(CompactLedgerKey);
+        if (entry)
+        {
+            bytes += xdr::xdr_size(*entry);
+        }
+        if (mEntryCache.put(key, {entry, type}, bytes) &&
+            type == LoadType::PREFETCH)
         {
             if (mPrefetchMetrics.find(key) != mPrefetchMetrics.end())
             {
@@ -1879,30 +2627,6 @@ LedgerTxnRoot::Impl::putInEntryCache(
     }
 }
 
-LedgerTxnRoot::Impl::BestOffersCacheEntry&
-LedgerTxnRoot::Impl::getFromBestOffersCache(
-    Asset const& buying, Asset const& selling,
-    BestOffersCacheEntry& defaultValue) const
-{
-    try
-    {
-        auto cacheKey = binToHex(xdr::xdr_to_opaque(buying)) +
-                        binToHex(xdr::xdr_to_opaque(selling));
-        if (!mBestOffersCache.exists(cacheKey))
-        {
-            mBestOffersCache.put(cacheKey, defaultValue);
-        }
-        return mBestOffersCache.exists(cacheKey)
-                   ? mBestOffersCache.get(cacheKey)
-                   : defaultValue;
-    }
-    catch (...)
-    {
-        mBestOffersCache.clear();
-        throw;
-    }
-}
-
 void
 LedgerTxnRoot::writeSignersTableIntoAccountsTable()
 {
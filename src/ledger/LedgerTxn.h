@@ -3,6 +3,7 @@
 
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
+#include "util/RandomEvictionCache.h"
 #include "xdr/vii-ledger.h"
 #include <functional>
 #include <ledger/LedgerHashUtils.h>
@@ -23,14 +24,30 @@ enum class LedgerTxnConsistency
     EXTRA_DELETES
 };
 
+class CompactLedgerKey;
 class Database;
 struct InflationVotes;
 struct LedgerEntry;
 struct LedgerKey;
 struct LedgerRange;
 
+// Where an offer sits in the order book of its asset pair: offers with lower
+// prices come first and ties are broken by offerID.
+struct OfferDescriptor
+{
+    Price price;
+    int64_t offerID;
+};
+
+bool isBetterOffer(OfferDescriptor const& lhs, OfferDescriptor const& rhs);
 bool isBetterOffer(LedgerEntry const& lhsEntry, LedgerEntry const& rhsEntry);
 
+struct IsBetterOfferComparator
+{
+    bool operator()(OfferDescriptor const& lhs,
+                    OfferDescriptor const& rhs) const;
+};
+
 class AbstractLedgerTxn;
 
 struct InflationWinner
@@ -83,6 +100,7 @@ class EntryIterator
     bool entryExists() const;
 
     LedgerKey const& key() const;
+    CompactLedgerKey const& compactKey() const;
 };
 
 class AbstractLedgerTxnParent
@@ -96,9 +114,12 @@ class AbstractLedgerTxnParent
     virtual void rollbackChild() = 0;
 
                                         virtual std::unordered_map<LedgerKey, LedgerEntry> getAllOffers() = 0;
+
+    // Returns the best offer for the asset pair that is worse than
+    // worseThan, or the best offer overall when worseThan is null.
     virtual std::shared_ptr<LedgerEntry const>
     getBestOffer(Asset const& buying, Asset const& selling,
-                 std::unordered_set<LedgerKey>& exclude) = 0;
+                 OfferDescriptor const* worseThan) = 0;
     virtual std::unordered_map<LedgerKey, LedgerEntry>
     getOffersByAccountAndAsset(AccountID const& account,
                                Asset const& asset) = 0;
@@ -110,6 +131,8 @@ class AbstractLedgerTxnParent
 
                         virtual std::shared_ptr<LedgerEntry const>
     getNewestVersion(LedgerKey const& key) const = 0;
+    virtual std::shared_ptr<LedgerEntry const>
+    getNewestVersion(CompactLedgerKey const& key) const = 0;
 };
 
 class AbstractLedgerTxn : public AbstractLedgerTxnParent
@@ -188,7 +211,7 @@ class LedgerTxn final : public AbstractLedgerTxn
 
     std::shared_ptr<LedgerEntry const>
     getBestOffer(Asset const& buying, Asset const& selling,
-                 std::unordered_set<LedgerKey>& exclude) override;
+                 OfferDescriptor const* worseThan) override;
 
     LedgerEntryChanges getChanges() override;
 
@@ -212,6 +235,8 @@ class LedgerTxn final : public AbstractLedgerTxn
 
     std::shared_ptr<LedgerEntry const>
     getNewestVersion(LedgerKey const& key) const override;
+    std::shared_ptr<LedgerEntry const>
+    getNewestVersion(CompactLedgerKey const& key) const override;
 
     LedgerTxnEntry load(LedgerKey const& key) override;
 
@@ -244,8 +269,17 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
     std::unique_ptr<Impl> const mImpl;
 
   public:
-    explicit LedgerTxnRoot(Database& db, size_t entryCacheSize,
-                           size_t bestOfferCacheSize, size_t prefetchBatchSize);
+    // With writeBehind, commitChild returns once the header is committed
+    // and the changed ledger entries are written to the database by a
+    // background thread; reads see them in the meantime. The database must
+    // support a connection pool. cachePolicy chooses which entries the
+    // entry cache evicts once it holds entryCacheSize entries or, unless
+    // entryCacheBytes is 0, entries of entryCacheBytes bytes in total.
+    explicit LedgerTxnRoot(
+        Database& db, size_t entryCacheSize, size_t prefetchBatchSize,
+        bool writeBehind = false,
+        CacheEvictionPolicy cachePolicy = CacheEvictionPolicy::RANDOM,
+        size_t entryCacheBytes = 0);
 
     virtual ~LedgerTxnRoot();
 
@@ -268,7 +302,7 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
 
     std::shared_ptr<LedgerEntry const>
     getBestOffer(Asset const& buying, Asset const& selling,
-                 std::unordered_set<LedgerKey>& exclude) override;
+                 OfferDescriptor const* worseThan) override;
 
     std::unordered_map<LedgerKey, LedgerEntry>
     getOffersByAccountAndAsset(AccountID const& account,
@@ -281,6 +315,8 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
 
     std::shared_ptr<LedgerEntry const>
     getNewestVersion(LedgerKey const& key) const override;
+    std::shared_ptr<LedgerEntry const>
+    getNewestVersion(CompactLedgerKey const& key) const override;
 
     void rollbackChild() override;
 
@@ -290,6 +326,25 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
 
     void writeOffersIntoSimplifiedOffersTable();
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys);
+
+    // Starts loading keys for ledger ledgerSeq on a background thread with
+    // its own database session. The loaded entries enter the entry cache on
+    // the first call to prefetch after ledger ledgerSeq - 1 is committed,
+    // except those committed in the meantime.
+    void prefetchAsync(std::unordered_set<LedgerKey> keys, uint32_t ledgerSeq);
     double getPrefetchHitRate() const;
+    // Fraction of entry cache lookups that found the entry.
+    double getEntryCacheHitRate() const;
+    // Serialized size of the entries in the entry cache.
+    size_t getEntryCacheBytes() const;
+
+    // Blocks until the ledger entries of every committed child are written
+    // to the database. Returns immediately without write-behind.
+    void waitForPendingWrites();
+
+    // Writes the ledger entries of a write-behind that had not finished when
+    // the node stopped, as recorded in storestate, and clears the record.
+    // Must be called before the root has a child.
+    void replayPendingWrite(std::string const& changes);
 };
 }
@@ -188,13 +188,13 @@ LedgerTxnRoot::Impl::writeSignersTableIntoAccountsTable()
 
     sqlTx.commit();
 
-        mEntryCache.clear();
-    mBestOffersCache.clear();
+        clearEntryCache();
 }
 
 class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<int64_t> mBalances;
     std::vector<int64_t> mSeqNums;
@@ -213,8 +213,9 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
 
   public:
     BulkUpsertAccountsOperation(Database& DB,
-                                std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+                                std::vector<EntryIterator> const& entries,
+                                soci::session& session)
+        : mDB(DB), mSession(session)
     {
         mAccountIDs.reserve(entries.size());
         mBalances.reserve(entries.size());
@@ -309,7 +310,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mBalances));
@@ -325,7 +326,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(mSellingLiabilities, mLiabilitiesInds));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("account");
+            auto timer = mDB.getUpsertTimer("account", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
@@ -398,7 +399,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strBalances));
@@ -414,7 +415,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(strSellingLiabilities));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("account");
+            auto timer = mDB.getUpsertTimer("account", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
@@ -428,13 +429,15 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
 
   public:
     BulkDeleteAccountsOperation(Database& DB, LedgerTxnConsistency cons,
-                                std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+                                std::vector<EntryIterator> const& entries,
+                                soci::session& session)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -449,12 +452,12 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
     doSociGenericOperation()
     {
         std::string sql = "DELETE FROM accounts WHERE accountid = :id";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("account");
+            auto timer = mDB.getDeleteTimer("account", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size() &&
@@ -480,12 +483,12 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
         std::string sql =
             "WITH r AS (SELECT unnest(:ids::TEXT[])) "
             "DELETE FROM accounts WHERE accountid IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("account");
+            auto timer = mDB.getDeleteTimer("account", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size() &&
@@ -499,26 +502,27 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertAccounts(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session)
 {
-    BulkUpsertAccountsOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertAccountsOperation op(mDatabase, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteAccounts(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons,
+    soci::session& session)
 {
-    BulkDeleteAccountsOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteAccountsOperation op(mDatabase, cons, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropAccounts()
 {
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    waitForPendingWrites();
+    clearEntryCache();
 
     mDatabase.getSession() << "DROP TABLE IF EXISTS accounts;";
     mDatabase.getSession() << "DROP TABLE IF EXISTS signers;";
@@ -599,8 +603,7 @@ void
 LedgerTxnRoot::Impl::encodeHomeDomainsBase64()
 {
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    clearEntryCache();
 
     CLOG(INFO, "Ledger") << "Loading all home domains from accounts table";
     auto homeDomainsToEncode = loadHomeDomainsToEncode(mDatabase);
@@ -630,6 +633,7 @@ class BulkLoadAccountsOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
 
     std::vector<LedgerEntry>
@@ -657,7 +661,7 @@ class BulkLoadAccountsOperation
         st.exchange(soci::into(signers, signersInd));
         st.define_and_bind();
         {
-            auto timer = mDb.getSelectTimer("account");
+            auto timer = mDb.getSelectTimer("account", mSession);
             st.execute(true);
         }
 
@@ -720,8 +724,9 @@ class BulkLoadAccountsOperation
 
   public:
     BulkLoadAccountsOperation(Database& db,
-                              std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+                              std::unordered_set<LedgerKey> const& keys,
+                              soci::session& session)
+        : mDb(db), mSession(session)
     {
         mAccountIDs.reserve(keys.size());
         for (auto const& k : keys)
@@ -747,7 +752,7 @@ class BulkLoadAccountsOperation
             "buyingliabilities, sellingliabilities, signers FROM accounts "
             "WHERE accountid IN carray(?, ?, 'char*')";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto sqliteStatement = dynamic_cast<soci::sqlite3_statement_backend*>(
             prep.statement().get_backend());
         auto st = sqliteStatement->stmt_;
@@ -773,7 +778,7 @@ class BulkLoadAccountsOperation
             "buyingliabilities, sellingliabilities, signers FROM accounts "
             "WHERE accountid IN (SELECT * FROM r)";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         return executeAndFetch(st);
@@ -783,13 +788,13 @@ class BulkLoadAccountsOperation
 
 std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadAccounts(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadAccountsOperation op(mDatabase, keys);
+        BulkLoadAccountsOperation op(mDatabase, keys, session);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
@@ -55,6 +55,7 @@ LedgerTxnRoot::Impl::loadData(LedgerKey const& key) const
 class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
     std::vector<std::string> mDataValues;
@@ -74,8 +75,9 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
 
   public:
     BulkUpsertDataOperation(Database& DB,
-                            std::vector<LedgerEntry> const& entries)
-        : mDB(DB)
+                            std::vector<LedgerEntry> const& entries,
+                            soci::session& session)
+        : mDB(DB), mSession(session)
     {
         for (auto const& e : entries)
         {
@@ -84,8 +86,9 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
     }
 
     BulkUpsertDataOperation(Database& DB,
-                            std::vector<EntryIterator> const& entryIter)
-        : mDB(DB)
+                            std::vector<EntryIterator> const& entryIter,
+                            soci::session& session)
+        : mDB(DB), mSession(session)
     {
         for (auto const& e : entryIter)
         {
@@ -104,7 +107,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
                           ") ON CONFLICT (accountid, dataname) DO UPDATE SET "
                           "datavalue = excluded.datavalue, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mDataNames));
@@ -112,7 +115,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(mLastModifieds));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("data");
+            auto timer = mDB.getUpsertTimer("data", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
@@ -150,7 +153,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
                           "ON CONFLICT (accountid, dataname) DO UPDATE SET "
                           "datavalue = excluded.datavalue, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
@@ -158,7 +161,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(strLastModifieds));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("data");
+            auto timer = mDB.getUpsertTimer("data", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
@@ -172,14 +175,16 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
 
   public:
     BulkDeleteDataOperation(Database& DB, LedgerTxnConsistency cons,
-                            std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+                            std::vector<EntryIterator> const& entries,
+                            soci::session& session)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -196,13 +201,13 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
     {
         std::string sql = "DELETE FROM accountdata WHERE accountid = :id AND "
                           " dataname = :v1 ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mDataNames));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("data");
+            auto timer = mDB.getDeleteTimer("data", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size() &&
@@ -234,13 +239,13 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
             " ) "
             "DELETE FROM accountdata WHERE (accountid, dataname) IN "
             "(SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("data");
+            auto timer = mDB.getDeleteTimer("data", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size() &&
@@ -254,26 +259,27 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertAccountData(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session)
 {
-    BulkUpsertDataOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertDataOperation op(mDatabase, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteAccountData(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons,
+    soci::session& session)
 {
-    BulkDeleteDataOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteDataOperation op(mDatabase, cons, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropData()
 {
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    waitForPendingWrites();
+    clearEntryCache();
 
     mDatabase.getSession() << "DROP TABLE IF EXISTS accountdata;";
     mDatabase.getSession() << "CREATE TABLE accountdata"
@@ -326,8 +332,7 @@ void
 LedgerTxnRoot::Impl::encodeDataNamesBase64()
 {
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    clearEntryCache();
 
     CLOG(INFO, "Ledger")
         << "Loading all data entries from the accountdata table";
@@ -342,7 +347,8 @@ LedgerTxnRoot::Impl::encodeDataNamesBase64()
     }
     if (!dataToEncode.empty())
     {
-        BulkUpsertDataOperation op(mDatabase, dataToEncode);
+        BulkUpsertDataOperation op(mDatabase, dataToEncode,
+                                   mDatabase.getSession());
         mDatabase.doDatabaseTypeSpecificOperation(op);
         CLOG(INFO, "Ledger")
             << "Wrote " << dataToEncode.size() << " data entries";
@@ -353,6 +359,7 @@ class BulkLoadDataOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
 
@@ -368,7 +375,7 @@ class BulkLoadDataOperation
         st.exchange(soci::into(lastModified));
         st.define_and_bind();
         {
-            auto timer = mDb.getSelectTimer("data");
+            auto timer = mDb.getSelectTimer("data", mSession);
             st.execute(true);
         }
 
@@ -392,8 +399,9 @@ class BulkLoadDataOperation
 
   public:
     BulkLoadDataOperation(Database& db,
-                          std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+                          std::unordered_set<LedgerKey> const& keys,
+                          soci::session& session)
+        : mDb(db), mSession(session)
     {
         mAccountIDs.reserve(keys.size());
         mDataNames.reserve(keys.size());
@@ -431,7 +439,7 @@ class BulkLoadDataOperation
             ") SELECT accountid, dataname, datavalue, lastmodified "
             "FROM accountdata WHERE (accountid, dataname) IN r";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto sqliteStatement = dynamic_cast<soci::sqlite3_statement_backend*>(
             prep.statement().get_backend());
         auto st = sqliteStatement->stmt_;
@@ -460,7 +468,7 @@ class BulkLoadDataOperation
             "SELECT accountid, dataname, datavalue, lastmodified "
             "FROM accountdata WHERE (accountid, dataname) IN (SELECT * FROM r)";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
@@ -471,13 +479,13 @@ class BulkLoadDataOperation
 
 std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadData(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadDataOperation op(mDatabase, keys);
+        BulkLoadDataOperation op(mDatabase, keys, session);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
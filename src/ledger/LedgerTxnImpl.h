@@ -1,14 +1,16 @@
 
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
+#include "ledger/CompactLedgerKey.h"
 #include "ledger/LedgerTxn.h"
+#include "util/Arena.h"
+#include "util/OpenAddressingMap.h"
 #include "util/RandomEvictionCache.h"
-#include <list>
-#ifdef USE_POSTGRES
-#include <iomanip>
-#include <libpq-fe.h>
-#include <limits>
-#include <sstream>
-#endif
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
 
 namespace viichain
 {
@@ -36,6 +38,8 @@ class EntryIterator::AbstractImpl
 
     virtual LedgerKey const& key() const = 0;
 
+    virtual CompactLedgerKey const& compactKey() const = 0;
+
     virtual std::unique_ptr<AbstractImpl> clone() const = 0;
 };
 
@@ -103,23 +107,66 @@ class BulkLedgerEntryChangeAccumulator
     void accumulate(EntryIterator const& iter);
 };
 
+struct AssetPair
+{
+    Asset buying;
+    Asset selling;
+};
+
+bool operator==(AssetPair const& lhs, AssetPair const& rhs);
+
+struct AssetPairHash
+{
+    size_t operator()(AssetPair const& key) const;
+};
+
 class LedgerTxn::Impl
 {
     class EntryIteratorImpl;
 
-    typedef std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry>>
+    typedef OpenAddressingMap<CompactLedgerKey, std::shared_ptr<LedgerEntry>>
         EntryMap;
 
+    typedef std::multimap<OfferDescriptor, CompactLedgerKey,
+                          IsBetterOfferComparator>
+        OrderBook;
+    typedef std::unordered_map<AssetPair, OrderBook, AssetPairHash>
+        MultiOrderBook;
+
     AbstractLedgerTxnParent& mParent;
     AbstractLedgerTxn* mChild;
     std::unique_ptr<LedgerHeader> mHeader;
     std::shared_ptr<LedgerTxnHeader::Impl> mActiveHeader;
     EntryMap mEntry;
-    std::unordered_map<LedgerKey, std::shared_ptr<EntryImplBase>> mActive;
+    OpenAddressingMap<CompactLedgerKey, std::shared_ptr<EntryImplBase>>
+        mActive;
+
+    // Backs the entries of this LedgerTxn and of all its descendants. It is
+    // created by the outermost LedgerTxn and freed in bulk once that
+    // LedgerTxn and every entry allocated in it are gone. A single entry
+    // that outlives the outermost LedgerTxn therefore pins the whole arena,
+    // so anything kept longer (the root cache, the order book, snapshots)
+    // must copy the entry out with std::make_shared instead of sharing it.
+    std::shared_ptr<Arena> mArena;
     bool const mShouldUpdateLastModified;
     bool mIsSealed;
     LedgerTxnConsistency mConsistency;
 
+    // Live offers of mEntry by asset pair, best first, and the slot of each
+    // indexed key. Active entries are modified in place, so changed offer
+    // keys are queued in mDirtyOffers and reindexed before each lookup; keys
+    // that are still active stay queued.
+    MultiOrderBook mOrderBook;
+    std::unordered_map<CompactLedgerKey,
+                       std::pair<AssetPair, OrderBook::iterator>>
+        mOrderBookPositions;
+    std::unordered_set<CompactLedgerKey> mDirtyOffers;
+
+    void markOfferDirty(CompactLedgerKey const& key);
+    void updateOrderBook();
+
+    std::shared_ptr<LedgerEntry> makeEntry(LedgerEntry const& entry) const;
+
     void throwIfChild() const;
     void throwIfSealed() const;
     void throwIfNotExactConsistency() const;
@@ -146,6 +193,8 @@ class LedgerTxn::Impl
         Impl(LedgerTxn& self, AbstractLedgerTxnParent& parent,
          bool shouldUpdateLastModified);
 
+    ~Impl();
+
         void addChild(AbstractLedgerTxn& child);
 
         void commit();
@@ -154,17 +203,17 @@ class LedgerTxn::Impl
 
                         LedgerTxnEntry create(LedgerTxn& self, LedgerEntry const& entry);
 
-        void deactivate(LedgerKey const& key);
+        void deactivate(CompactLedgerKey const& key);
 
         void deactivateHeader();
 
-                        void erase(LedgerKey const& key);
+                        void erase(CompactLedgerKey const& key);
 
                     std::unordered_map<LedgerKey, LedgerEntry> getAllOffers();
 
                                     std::shared_ptr<LedgerEntry const>
     getBestOffer(Asset const& buying, Asset const& selling,
-                 std::unordered_set<LedgerKey>& exclude);
+                 OfferDescriptor const* worseThan);
 
                         LedgerEntryChanges getChanges();
 
@@ -186,14 +235,14 @@ class LedgerTxn::Impl
                        std::vector<LedgerKey>& deadEntries);
 
                         std::shared_ptr<LedgerEntry const>
-    getNewestVersion(LedgerKey const& key) const;
+    getNewestVersion(CompactLedgerKey const& key) const;
 
-                        LedgerTxnEntry load(LedgerTxn& self, LedgerKey const& key);
+                        LedgerTxnEntry load(LedgerTxn& self, CompactLedgerKey const& key);
 
             void createOrUpdateWithoutLoading(LedgerTxn& self,
                                       LedgerEntry const& entry);
 
-            void eraseWithoutLoading(LedgerKey const& key);
+            void eraseWithoutLoading(CompactLedgerKey const& key);
 
                         std::map<AccountID, std::vector<LedgerTxnEntry>>
     loadAllOffers(LedgerTxn& self);
@@ -208,7 +257,7 @@ class LedgerTxn::Impl
                                 Asset const& asset);
 
                         ConstLedgerTxnEntry loadWithoutRecord(LedgerTxn& self,
-                                          LedgerKey const& key);
+                                          CompactLedgerKey const& key);
 
         void rollback();
 
@@ -223,6 +272,10 @@ class LedgerTxn::Impl::EntryIteratorImpl : public EntryIterator::AbstractImpl
     IteratorType mIter;
     IteratorType const mEnd;
 
+    // The XDR form of the current key, built on first use.
+    mutable LedgerKey mKey;
+    mutable bool mHasKey{false};
+
   public:
     EntryIteratorImpl(IteratorType const& begin, IteratorType const& end);
 
@@ -236,6 +289,8 @@ class LedgerTxn::Impl::EntryIteratorImpl : public EntryIterator::AbstractImpl
 
     LedgerKey const& key() const override;
 
+    CompactLedgerKey const& compactKey() const override;
+
     std::unique_ptr<EntryIterator::AbstractImpl> clone() const override;
 };
 
@@ -259,24 +314,76 @@ class LedgerTxnRoot::Impl
         LoadType type;
     };
 
-    typedef RandomEvictionCache<LedgerKey, CacheEntry> EntryCache;
+    typedef RandomEvictionCache<CompactLedgerKey, CacheEntry> EntryCache;
 
-    typedef std::string BestOffersCacheKey;
-    struct BestOffersCacheEntry
-    {
-        std::list<LedgerEntry> bestOffers;
-        bool allLoaded;
-    };
-    typedef RandomEvictionCache<std::string, BestOffersCacheEntry>
-        BestOffersCache;
+    typedef std::multimap<OfferDescriptor, std::shared_ptr<LedgerEntry const>,
+                          IsBetterOfferComparator>
+        OrderBook;
+    typedef std::unordered_map<AssetPair, OrderBook, AssetPairHash>
+        MultiOrderBook;
 
     Database& mDatabase;
     std::unique_ptr<LedgerHeader> mHeader;
     mutable EntryCache mEntryCache;
-    mutable BestOffersCache mBestOffersCache;
-    mutable std::unordered_map<LedgerKey, KeyAccesses> mPrefetchMetrics;
+
+    // Every offer in the database by asset pair, best first. It is read from
+    // the offers table on the first best-offer lookup and then kept current
+    // by commitChild.
+    mutable MultiOrderBook mOrderBook;
+    mutable std::unordered_map<CompactLedgerKey,
+                               std::pair<AssetPair, OrderBook::iterator>>
+        mOrderBookPositions;
+    mutable bool mOrderBookLoaded{false};
+    mutable std::unordered_map<CompactLedgerKey, KeyAccesses>
+        mPrefetchMetrics;
     mutable uint64_t mTotalPrefetchHits{0};
 
+    // Entries being loaded by prefetchAsync, and the keys committed since
+    // the load started. The loaded versions of those keys may be stale, so
+    // they are dropped when the entries move into the entry cache.
+    struct AsyncPrefetch
+    {
+        std::future<
+            std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>>
+            mEntries;
+        std::unordered_set<CompactLedgerKey> mCommittedKeys;
+        uint32_t mLedgerSeq{0};
+    };
+    mutable std::unique_ptr<AsyncPrefetch> mAsyncPrefetch;
+
+    // The ledger entries changed by one commit, in commit order, which
+    // mWriteBehindThread writes to the database in a single transaction. A
+    // null entry is an erase. It is not modified once queued. The close
+    // transaction also stores them in storestate, so that a node that stops
+    // before they are written can write them on restart.
+    typedef std::vector<
+        std::pair<CompactLedgerKey, std::shared_ptr<LedgerEntry const>>>
+        PendingEntries;
+    struct PendingWrite
+    {
+        PendingEntries mEntries;
+        LedgerTxnConsistency mConsistency;
+    };
+    class PendingEntryIteratorImpl;
+
+    // At most one write is pending: commitChild waits for the previous one
+    // before queueing the next, so that writes never race for the database
+    // and apply in order.
+    bool const mWriteBehind;
+    std::thread mWriteBehindThread;
+    mutable std::mutex mWriteBehindMutex;
+    mutable std::condition_variable mWriteBehindCV;
+    std::shared_ptr<PendingWrite const> mPendingWrite;
+    bool mStopWriteBehind{false};
+
+    // Newest version of the entries of the pending write, which take
+    // precedence over the database. They are kept after the write completes
+    // while a child is open, as the child may be reading a database snapshot
+    // taken before.
+    mutable std::unordered_map<CompactLedgerKey,
+                               std::shared_ptr<LedgerEntry const>>
+        mPendingEntries;
+
     size_t mMaxCacheSize;
     size_t mBulkLoadBatchSize;
     std::unique_ptr<soci::transaction> mTransaction;
@@ -284,15 +391,21 @@ class LedgerTxnRoot::Impl
 
     void throwIfChild() const;
 
+    void writeBehind(soci::connection_pool& pool);
+    void writePending(PendingWrite const& write, soci::connection_pool& pool);
+    void applyPendingWrite(PendingWrite const& write, soci::session& session);
+    static std::string encodePendingEntries(PendingEntries const& entries);
+    static PendingEntries decodePendingEntries(std::string const& encoded);
+    void queuePendingWrite(std::shared_ptr<PendingWrite const> write);
+    void prunePendingEntries() const;
+    void mergePendingOffers(
+        std::vector<LedgerEntry>& offers,
+        std::function<bool(OfferEntry const&)> const& match) const;
+
     std::shared_ptr<LedgerEntry const> loadAccount(LedgerKey const& key) const;
     std::shared_ptr<LedgerEntry const> loadData(LedgerKey const& key) const;
     std::shared_ptr<LedgerEntry const> loadOffer(LedgerKey const& key) const;
     std::vector<LedgerEntry> loadAllOffers() const;
-    std::list<LedgerEntry>::const_iterator
-    loadOffers(StatementContext& prep, std::list<LedgerEntry>& offers) const;
-    std::list<LedgerEntry>::const_iterator
-    loadBestOffers(std::list<LedgerEntry>& offers, Asset const& buying,
-                   Asset const& selling, size_t numOffers, size_t offset) const;
     std::vector<LedgerEntry>
     loadOffersByAccountAndAsset(AccountID const& accountID,
                                 Asset const& asset) const;
@@ -303,44 +416,66 @@ class LedgerTxnRoot::Impl
     loadTrustLine(LedgerKey const& key) const;
 
     void bulkApply(BulkLedgerEntryChangeAccumulator& bleca,
-                   size_t bufferThreshold, LedgerTxnConsistency cons);
-    void bulkUpsertAccounts(std::vector<EntryIterator> const& entries);
+                   size_t bufferThreshold, LedgerTxnConsistency cons,
+                   soci::session& session);
+    void bulkUpsertAccounts(std::vector<EntryIterator> const& entries,
+                            soci::session& session);
     void bulkDeleteAccounts(std::vector<EntryIterator> const& entries,
-                            LedgerTxnConsistency cons);
-    void bulkUpsertTrustLines(std::vector<EntryIterator> const& entries);
+                            LedgerTxnConsistency cons, soci::session& session);
+    void bulkUpsertTrustLines(std::vector<EntryIterator> const& entries,
+                              soci::session& session);
     void bulkDeleteTrustLines(std::vector<EntryIterator> const& entries,
-                              LedgerTxnConsistency cons);
-    void bulkUpsertOffers(std::vector<EntryIterator> const& entries);
+                              LedgerTxnConsistency cons,
+                              soci::session& session);
+    void bulkUpsertOffers(std::vector<EntryIterator> const& entries,
+                          soci::session& session);
     void bulkDeleteOffers(std::vector<EntryIterator> const& entries,
-                          LedgerTxnConsistency cons);
-    void bulkUpsertAccountData(std::vector<EntryIterator> const& entries);
+                          LedgerTxnConsistency cons, soci::session& session);
+    void bulkUpsertAccountData(std::vector<EntryIterator> const& entries,
+                               soci::session& session);
     void bulkDeleteAccountData(std::vector<EntryIterator> const& entries,
-                               LedgerTxnConsistency cons);
+                               LedgerTxnConsistency cons,
+                               soci::session& session);
 
     static std::string tableFromLedgerEntryType(LedgerEntryType let);
 
                                                         std::shared_ptr<LedgerEntry const>
-    getFromEntryCache(LedgerKey const& key) const;
-    void putInEntryCache(LedgerKey const& key,
+    getFromEntryCache(CompactLedgerKey const& key) const;
+    void putInEntryCache(CompactLedgerKey const& key,
                          std::shared_ptr<LedgerEntry const> const& entry,
                          LoadType type) const;
 
-    BestOffersCacheEntry&
-    getFromBestOffersCache(Asset const& buying, Asset const& selling,
-                           BestOffersCacheEntry& defaultValue) const;
+    uint32_t takeAsyncPrefetch();
+    void discardAsyncPrefetch() const;
+    void clearEntryCache() const;
+    // The larger of the fractions of the entry cache's entry and byte limits
+    // in use.
+    double entryCacheFillRatio() const;
+
+    void loadOrderBook();
+    void updateOrderBook(EntryIterator const& iter);
+    void clearOrderBook() const;
 
     std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadAccounts(std::unordered_set<LedgerKey> const& keys) const;
+    bulkLoadAccounts(std::unordered_set<LedgerKey> const& keys,
+                     soci::session& session) const;
+    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+    bulkLoadTrustLines(std::unordered_set<LedgerKey> const& keys,
+                       soci::session& session) const;
     std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadTrustLines(std::unordered_set<LedgerKey> const& keys) const;
+    bulkLoadOffers(std::unordered_set<LedgerKey> const& keys,
+                   soci::session& session) const;
     std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadOffers(std::unordered_set<LedgerKey> const& keys) const;
+    bulkLoadData(std::unordered_set<LedgerKey> const& keys,
+                 soci::session& session) const;
     std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadData(std::unordered_set<LedgerKey> const& keys) const;
+    bulkLoad(std::unordered_set<LedgerKey> const& keys,
+             soci::session& session) const;
 
   public:
-        Impl(Database& db, size_t entryCacheSize, size_t bestOfferCacheSize,
-         size_t prefetchBatchSize);
+        Impl(Database& db, size_t entryCacheSize, size_t prefetchBatchSize,
+         bool writeBehind, CacheEvictionPolicy cachePolicy,
+         size_t entryCacheBytes);
 
     ~Impl();
 
@@ -363,7 +498,7 @@ class LedgerTxnRoot::Impl
 
                                     std::shared_ptr<LedgerEntry const>
     getBestOffer(Asset const& buying, Asset const& selling,
-                 std::unordered_set<LedgerKey>& exclude);
+                 OfferDescriptor const* worseThan);
 
                     std::unordered_map<LedgerKey, LedgerEntry>
     getOffersByAccountAndAsset(AccountID const& account, Asset const& asset);
@@ -374,7 +509,7 @@ class LedgerTxnRoot::Impl
                                                      int64_t minBalance);
 
                         std::shared_ptr<LedgerEntry const>
-    getNewestVersion(LedgerKey const& key) const;
+    getNewestVersion(CompactLedgerKey const& key) const;
 
         void rollbackChild();
 
@@ -387,60 +522,42 @@ class LedgerTxnRoot::Impl
                     void writeOffersIntoSimplifiedOffersTable();
 
                 uint32_t prefetch(std::unordered_set<LedgerKey> const& keys);
+    void prefetchAsync(std::unordered_set<LedgerKey> keys, uint32_t ledgerSeq);
 
     double getPrefetchHitRate() const;
+    double getEntryCacheHitRate() const;
+    size_t getEntryCacheBytes() const;
+
+    void waitForPendingWrites() const;
+    void replayPendingWrite(std::string const& changes);
 };
 
-#ifdef USE_POSTGRES
-template <typename T>
-inline void
-marshalToPGArrayItem(PGconn* conn, std::ostringstream& oss, const T& item)
+class LedgerTxnRoot::Impl::PendingEntryIteratorImpl
+    : public EntryIterator::AbstractImpl
 {
-                    oss << std::setprecision(std::numeric_limits<T>::max_digits10) << item;
-}
+    typedef PendingEntries::const_iterator IteratorType;
+    IteratorType mIter;
+    IteratorType const mEnd;
 
-template <>
-inline void
-marshalToPGArrayItem<std::string>(PGconn* conn, std::ostringstream& oss,
-                                  const std::string& item)
-{
-    std::vector<char> buf(item.size() * 2 + 1, '\0');
-    int err = 0;
-    size_t len =
-        PQescapeStringConn(conn, buf.data(), item.c_str(), item.size(), &err);
-    if (err != 0)
-    {
-        throw std::runtime_error("Could not escape string in SQL");
-    }
-    oss << '"';
-    oss.write(buf.data(), len);
-    oss << '"';
-}
+    mutable LedgerKey mKey;
+    mutable bool mHasKey{false};
 
-template <typename T>
-inline void
-marshalToPGArray(PGconn* conn, std::string& out, const std::vector<T>& v,
-                 const std::vector<soci::indicator>* ind = nullptr)
-{
-    std::ostringstream oss;
-    oss << '{';
-    for (size_t i = 0; i < v.size(); ++i)
-    {
-        if (i > 0)
-        {
-            oss << ',';
-        }
-        if (ind && (*ind)[i] == soci::i_null)
-        {
-            oss << "NULL";
-        }
-        else
-        {
-            marshalToPGArrayItem(conn, oss, v[i]);
-        }
-    }
-    oss << '}';
-    out = oss.str();
-}
-#endif
+  public:
+    PendingEntryIteratorImpl(IteratorType const& begin,
+                             IteratorType const& end);
+
+    void advance() override;
+
+    bool atEnd() const override;
+
+    LedgerEntry const& entry() const override;
+
+    bool entryExists() const override;
+
+    LedgerKey const& key() const override;
+
+    CompactLedgerKey const& compactKey() const override;
+
+    std::unique_ptr<EntryIterator::AbstractImpl> clone() const override;
+};
 }
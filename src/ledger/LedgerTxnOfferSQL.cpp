@@ -59,44 +59,9 @@ LedgerTxnRoot::Impl::loadAllOffers() const
     return offers;
 }
 
-std::list<LedgerEntry>::const_iterator
-LedgerTxnRoot::Impl::loadBestOffers(std::list<LedgerEntry>& offers,
-                                    Asset const& buying, Asset const& selling,
-                                    size_t numOffers, size_t offset) const
-{
-    std::string sql = "SELECT sellerid, offerid, sellingasset, buyingasset, "
-                      "amount, pricen, priced, flags, lastmodified "
-                      "FROM offers "
-                      "WHERE sellingasset = :v1 AND buyingasset = :v2";
-
-    std::string buyingAsset, sellingAsset;
-    buyingAsset = decoder::encode_b64(xdr::xdr_to_opaque(buying));
-    sellingAsset = decoder::encode_b64(xdr::xdr_to_opaque(selling));
-
-            sql += " ORDER BY price, offerid LIMIT :n OFFSET :o";
-
-    auto prep = mDatabase.getPreparedStatement(sql);
-    auto& st = prep.statement();
-    st.exchange(soci::use(sellingAsset));
-    st.exchange(soci::use(buyingAsset));
-    st.exchange(soci::use(numOffers));
-    st.exchange(soci::use(offset));
-
-    {
-        auto timer = mDatabase.getSelectTimer("offer");
-        return loadOffers(prep, offers);
-    }
-}
-
 bool
-isBetterOffer(LedgerEntry const& lhsEntry, LedgerEntry const& rhsEntry)
+isBetterOffer(OfferDescriptor const& lhs, OfferDescriptor const& rhs)
 {
-    auto const& lhs = lhsEntry.data.offer();
-    auto const& rhs = rhsEntry.data.offer();
-
-    assert(lhs.buying == rhs.buying);
-    assert(lhs.selling == rhs.selling);
-
     double lhsPrice = double(lhs.price.n) / double(lhs.price.d);
     double rhsPrice = double(rhs.price.n) / double(rhs.price.d);
     if (lhsPrice < rhsPrice)
@@ -113,6 +78,26 @@ isBetterOffer(LedgerEntry const& lhsEntry, LedgerEntry const& rhsEntry)
     }
 }
 
+bool
+isBetterOffer(LedgerEntry const& lhsEntry, LedgerEntry const& rhsEntry)
+{
+    auto const& lhs = lhsEntry.data.offer();
+    auto const& rhs = rhsEntry.data.offer();
+
+    assert(lhs.buying == rhs.buying);
+    assert(lhs.selling == rhs.selling);
+
+    return isBetterOffer(OfferDescriptor{lhs.price, lhs.offerID},
+                         OfferDescriptor{rhs.price, rhs.offerID});
+}
+
+bool
+IsBetterOfferComparator::operator()(OfferDescriptor const& lhs,
+                                    OfferDescriptor const& rhs) const
+{
+    return isBetterOffer(lhs, rhs);
+}
+
 std::vector<LedgerEntry>
 LedgerTxnRoot::Impl::loadOffersByAccountAndAsset(AccountID const& accountID,
                                                  Asset const& asset) const
@@ -154,51 +139,6 @@ processAsset(std::string const& asset)
     return res;
 }
 
-std::list<LedgerEntry>::const_iterator
-LedgerTxnRoot::Impl::loadOffers(StatementContext& prep,
-                                std::list<LedgerEntry>& offers) const
-{
-    std::string actIDStrKey;
-    std::string sellingAsset, buyingAsset;
-
-    LedgerEntry le;
-    le.data.type(OFFER);
-    OfferEntry& oe = le.data.offer();
-
-    auto& st = prep.statement();
-    st.exchange(soci::into(actIDStrKey));
-    st.exchange(soci::into(oe.offerID));
-    st.exchange(soci::into(sellingAsset));
-    st.exchange(soci::into(buyingAsset));
-    st.exchange(soci::into(oe.amount));
-    st.exchange(soci::into(oe.price.n));
-    st.exchange(soci::into(oe.price.d));
-    st.exchange(soci::into(oe.flags));
-    st.exchange(soci::into(le.lastModifiedLedgerSeq));
-    st.define_and_bind();
-    st.execute(true);
-
-    auto iterNext = offers.cend();
-    while (st.got_data())
-    {
-        oe.sellerID = KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
-        oe.selling = processAsset(sellingAsset);
-        oe.buying = processAsset(buyingAsset);
-
-        if (iterNext == offers.cend())
-        {
-            iterNext = offers.emplace(iterNext, le);
-        }
-        else
-        {
-            offers.emplace_back(le);
-        }
-        st.fetch();
-    }
-
-    return iterNext;
-}
-
 std::vector<LedgerEntry>
 LedgerTxnRoot::Impl::loadOffers(StatementContext& prep) const
 {
@@ -240,6 +180,7 @@ LedgerTxnRoot::Impl::loadOffers(StatementContext& prep) const
 class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mSellerIDs;
     std::vector<int64_t> mOfferIDs;
     std::vector<std::string> mSellingAssets;
@@ -278,8 +219,9 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
 
   public:
     BulkUpsertOffersOperation(Database& DB,
-                              std::vector<LedgerEntry> const& entries)
-        : mDB(DB)
+                              std::vector<LedgerEntry> const& entries,
+                              soci::session& session)
+        : mDB(DB), mSession(session)
     {
         mSellerIDs.reserve(entries.size());
         mOfferIDs.reserve(entries.size());
@@ -299,8 +241,9 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
     }
 
     BulkUpsertOffersOperation(Database& DB,
-                              std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+                              std::vector<EntryIterator> const& entries,
+                              soci::session& session)
+        : mDB(DB), mSession(session)
     {
         mSellerIDs.reserve(entries.size());
         mOfferIDs.reserve(entries.size());
@@ -338,7 +281,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
                           "price = excluded.price, "
                           "flags = excluded.flags, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mSellerIDs));
         st.exchange(soci::use(mOfferIDs));
@@ -352,7 +295,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(mLastModifieds));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("offer");
+            auto timer = mDB.getUpsertTimer("offer", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mOfferIDs.size())
@@ -416,7 +359,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
                           "price = excluded.price, "
                           "flags = excluded.flags, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strSellerIDs));
         st.exchange(soci::use(strOfferIDs));
@@ -430,7 +373,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(strLastModifieds));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("offer");
+            auto timer = mDB.getUpsertTimer("offer", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mOfferIDs.size())
@@ -444,13 +387,15 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<int64_t> mOfferIDs;
 
   public:
     BulkDeleteOffersOperation(Database& DB, LedgerTxnConsistency cons,
-                              std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+                              std::vector<EntryIterator> const& entries,
+                              soci::session& session)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -465,12 +410,12 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
     doSociGenericOperation()
     {
         std::string sql = "DELETE FROM offers WHERE offerid = :id";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mOfferIDs));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("offer");
+            auto timer = mDB.getDeleteTimer("offer", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mOfferIDs.size() &&
@@ -498,12 +443,12 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
                           ") "
                           "DELETE FROM offers WHERE "
                           "offerid IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strOfferIDs));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("offer");
+            auto timer = mDB.getDeleteTimer("offer", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mOfferIDs.size() &&
@@ -516,26 +461,29 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
 };
 
 void
-LedgerTxnRoot::Impl::bulkUpsertOffers(std::vector<EntryIterator> const& entries)
+LedgerTxnRoot::Impl::bulkUpsertOffers(
+    std::vector<EntryIterator> const& entries, soci::session& session)
 {
-    BulkUpsertOffersOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertOffersOperation op(mDatabase, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
-LedgerTxnRoot::Impl::bulkDeleteOffers(std::vector<EntryIterator> const& entries,
-                                      LedgerTxnConsistency cons)
+LedgerTxnRoot::Impl::bulkDeleteOffers(
+    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons,
+    soci::session& session)
 {
-    BulkDeleteOffersOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteOffersOperation op(mDatabase, cons, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropOffers()
 {
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    waitForPendingWrites();
+    clearEntryCache();
+    clearOrderBook();
 
     mDatabase.getSession() << "DROP TABLE IF EXISTS offers;";
     mDatabase.getSession()
@@ -568,6 +516,7 @@ class BulkLoadOffersOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<int64_t> mOfferIDs;
     std::unordered_map<int64_t, AccountID> mSellerIDsByOfferID;
 
@@ -591,7 +540,7 @@ class BulkLoadOffersOperation
         st.exchange(soci::into(lastModified));
         st.define_and_bind();
         {
-            auto timer = mDb.getSelectTimer("offer");
+            auto timer = mDb.getSelectTimer("offer", mSession);
             st.execute(true);
         }
 
@@ -626,8 +575,9 @@ class BulkLoadOffersOperation
 
   public:
     BulkLoadOffersOperation(Database& db,
-                            std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+                            std::unordered_set<LedgerKey> const& keys,
+                            soci::session& session)
+        : mDb(db), mSession(session)
     {
         mOfferIDs.reserve(keys.size());
         for (auto const& k : keys)
@@ -649,7 +599,7 @@ class BulkLoadOffersOperation
             "amount, pricen, priced, flags, lastmodified "
             "FROM offers WHERE offerid IN carray(?, ?, 'int64')";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto sqliteStatement = dynamic_cast<soci::sqlite3_statement_backend*>(
             prep.statement().get_backend());
         auto st = sqliteStatement->stmt_;
@@ -672,7 +622,7 @@ class BulkLoadOffersOperation
             "SELECT sellerid, offerid, sellingasset, buyingasset, "
             "amount, pricen, priced, flags, lastmodified "
             "FROM offers WHERE offerid IN (SELECT * FROM r)";
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strOfferIDs));
         return executeAndFetch(st);
@@ -682,13 +632,13 @@ class BulkLoadOffersOperation
 
 std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadOffers(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadOffersOperation op(mDatabase, keys);
+        BulkLoadOffersOperation op(mDatabase, keys, session);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
@@ -792,8 +742,8 @@ void
 LedgerTxnRoot::Impl::writeOffersIntoSimplifiedOffersTable()
 {
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    clearEntryCache();
+    clearOrderBook();
 
     CLOG(INFO, "Ledger") << "Loading all offers";
     auto const offers = viichain::loadAllOffersForSchemaUpgrade(mDatabase);
@@ -819,7 +769,8 @@ LedgerTxnRoot::Impl::writeOffersIntoSimplifiedOffersTable()
 
     if (!offers.empty())
     {
-        BulkUpsertOffersOperation op(mDatabase, offers);
+        BulkUpsertOffersOperation op(mDatabase, offers,
+                                     mDatabase.getSession());
         mDatabase.doDatabaseTypeSpecificOperation(op);
         CLOG(INFO, "Ledger") << "Wrote " << offers.size() << " offer entries";
     }
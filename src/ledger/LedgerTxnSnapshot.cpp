@@ -0,0 +1,145 @@
+
+#include "ledger/LedgerTxnSnapshot.h"
+
+#include <stdexcept>
+
+namespace viichain
+{
+
+LedgerTxnSnapshot::LedgerTxnSnapshot(AbstractLedgerTxnParent& parent,
+                                     std::vector<LedgerKey> const& footprint)
+    : mHeader(parent.getHeader())
+{
+    mEntries.reserve(footprint.size());
+    for (auto const& key : footprint)
+    {
+        auto entry = parent.getNewestVersion(key);
+        mEntries.emplace(CompactLedgerKey(key),
+                         entry ? std::make_shared<LedgerEntry const>(*entry)
+                               : nullptr);
+    }
+}
+
+void
+LedgerTxnSnapshot::addChild(AbstractLedgerTxn& child)
+{
+    if (mChild)
+    {
+        throw std::runtime_error("LedgerTxnSnapshot has child");
+    }
+    mChild = &child;
+}
+
+void
+LedgerTxnSnapshot::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
+{
+    if (cons != LedgerTxnConsistency::EXACT ||
+        !(mChild->getHeader() == mHeader))
+    {
+        mViolated = true;
+    }
+
+    for (; (bool)iter; ++iter)
+    {
+        auto found = mEntries.find(iter.compactKey());
+        if (found == mEntries.end())
+        {
+            mViolated = true;
+            continue;
+        }
+        found->second = iter.entryExists()
+                            ? std::make_shared<LedgerEntry const>(iter.entry())
+                            : nullptr;
+        mChanged.emplace_back(iter.compactKey());
+    }
+    mChild = nullptr;
+}
+
+std::unordered_map<LedgerKey, LedgerEntry>
+LedgerTxnSnapshot::getAllOffers()
+{
+    mViolated = true;
+    return {};
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxnSnapshot::getBestOffer(Asset const& buying, Asset const& selling,
+                                OfferDescriptor const* worseThan)
+{
+    mViolated = true;
+    return nullptr;
+}
+
+std::unordered_map<LedgerKey, LedgerEntry>
+LedgerTxnSnapshot::getOffersByAccountAndAsset(AccountID const& account,
+                                              Asset const& asset)
+{
+    mViolated = true;
+    return {};
+}
+
+LedgerHeader const&
+LedgerTxnSnapshot::getHeader() const
+{
+    return mHeader;
+}
+
+std::vector<InflationWinner>
+LedgerTxnSnapshot::getInflationWinners(size_t maxWinners, int64_t minBalance)
+{
+    mViolated = true;
+    return {};
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxnSnapshot::getNewestVersion(LedgerKey const& key) const
+{
+    return getNewestVersion(CompactLedgerKey(key));
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxnSnapshot::getNewestVersion(CompactLedgerKey const& key) const
+{
+    auto iter = mEntries.find(key);
+    if (iter == mEntries.end())
+    {
+        mViolated = true;
+        return nullptr;
+    }
+    return iter->second;
+}
+
+void
+LedgerTxnSnapshot::rollbackChild()
+{
+    mChild = nullptr;
+}
+
+bool
+LedgerTxnSnapshot::footprintViolated() const
+{
+    return mViolated;
+}
+
+void
+LedgerTxnSnapshot::commitInto(AbstractLedgerTxn& ltx) const
+{
+    if (mViolated)
+    {
+        throw std::runtime_error("LedgerTxnSnapshot footprint was violated");
+    }
+
+    for (auto const& key : mChanged)
+    {
+        auto const& entry = mEntries.at(key);
+        if (entry)
+        {
+            ltx.createOrUpdateWithoutLoading(*entry);
+        }
+        else if (ltx.getNewestVersion(key))
+        {
+            ltx.erase(key.toLedgerKey());
+        }
+    }
+}
+}
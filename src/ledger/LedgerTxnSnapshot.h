@@ -0,0 +1,71 @@
+#pragma once
+
+
+#include "ledger/CompactLedgerKey.h"
+#include "ledger/LedgerTxn.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace viichain
+{
+
+// A parent for a LedgerTxn that holds copies of a fixed set of ledger
+// entries, its footprint, together with the ledger header. It lets a batch of
+// transactions whose footprints are known in advance be applied on another
+// thread without touching the LedgerTxn it was loaded from.
+//
+// Accessing a key outside the footprint, querying offers or inflation
+// winners, or committing a changed header does not throw, since LedgerTxn
+// must not fail while committing; instead the snapshot is marked as violated
+// and answers as if the ledger were empty. Whoever owns the snapshot must
+// then discard everything applied on top of it.
+class LedgerTxnSnapshot : public AbstractLedgerTxnParent
+{
+    LedgerHeader const mHeader;
+    std::unordered_map<CompactLedgerKey, std::shared_ptr<LedgerEntry const>>
+        mEntries;
+    std::vector<CompactLedgerKey> mChanged;
+    AbstractLedgerTxn* mChild{nullptr};
+    mutable bool mViolated{false};
+
+  public:
+    // Loads the newest version of every key from parent, which must not be
+    // used by anyone else until this constructor returns.
+    LedgerTxnSnapshot(AbstractLedgerTxnParent& parent,
+                      std::vector<LedgerKey> const& footprint);
+
+    void addChild(AbstractLedgerTxn& child) override;
+
+    void commitChild(EntryIterator iter, LedgerTxnConsistency cons) override;
+
+    std::unordered_map<LedgerKey, LedgerEntry> getAllOffers() override;
+
+    std::shared_ptr<LedgerEntry const>
+    getBestOffer(Asset const& buying, Asset const& selling,
+                 OfferDescriptor const* worseThan) override;
+
+    std::unordered_map<LedgerKey, LedgerEntry>
+    getOffersByAccountAndAsset(AccountID const& account,
+                               Asset const& asset) override;
+
+    LedgerHeader const& getHeader() const override;
+
+    std::vector<InflationWinner>
+    getInflationWinners(size_t maxWinners, int64_t minBalance) override;
+
+    std::shared_ptr<LedgerEntry const>
+    getNewestVersion(LedgerKey const& key) const override;
+    std::shared_ptr<LedgerEntry const>
+    getNewestVersion(CompactLedgerKey const& key) const override;
+
+    void rollbackChild() override;
+
+    bool footprintViolated() const;
+
+    // Writes every entry committed into the snapshot to ltx, which must be
+    // the LedgerTxn the snapshot was loaded from, or a descendant that has
+    // not modified the footprint since.
+    void commitInto(AbstractLedgerTxn& ltx) const;
+};
+}
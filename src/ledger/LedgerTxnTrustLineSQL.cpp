@@ -95,6 +95,7 @@ LedgerTxnRoot::Impl::loadTrustLine(LedgerKey const& key) const
 class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<int32_t> mAssetTypes;
     std::vector<std::string> mIssuers;
@@ -109,8 +110,9 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 
   public:
     BulkUpsertTrustLinesOperation(Database& DB,
-                                  std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+                                  std::vector<EntryIterator> const& entries,
+                                  soci::session& session)
+        : mDB(DB), mSession(session)
     {
         mAccountIDs.reserve(entries.size());
         mAssetTypes.reserve(entries.size());
@@ -178,7 +180,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mAssetTypes));
@@ -192,7 +194,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(mSellingLiabilities, mLiabilitiesInds));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("trustline");
+            auto timer = mDB.getUpsertTimer("trustline", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
@@ -256,7 +258,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strAssetTypes));
@@ -270,7 +272,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
         st.exchange(soci::use(strSellingLiabilities));
         st.define_and_bind();
         {
-            auto timer = mDB.getUpsertTimer("trustline");
+            auto timer = mDB.getUpsertTimer("trustline", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
@@ -284,6 +286,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mIssuers;
@@ -291,8 +294,9 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 
   public:
     BulkDeleteTrustLinesOperation(Database& DB, LedgerTxnConsistency cons,
-                                  std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+                                  std::vector<EntryIterator> const& entries,
+                                  soci::session& session)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         mAccountIDs.reserve(entries.size());
         mIssuers.reserve(entries.size());
@@ -316,14 +320,14 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
     {
         std::string sql = "DELETE FROM trustlines WHERE accountid = :id "
                           "AND issuer = :v1 AND assetcode = :v2";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mIssuers));
         st.exchange(soci::use(mAssetCodes));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("trustline");
+            auto timer = mDB.getDeleteTimer("trustline", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size() &&
@@ -355,14 +359,14 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
                           ") "
                           "DELETE FROM trustlines WHERE "
                           "(accountid, issuer, assetcode) IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strIssuers));
         st.exchange(soci::use(strAssetCodes));
         st.define_and_bind();
         {
-            auto timer = mDB.getDeleteTimer("trustline");
+            auto timer = mDB.getDeleteTimer("trustline", mSession);
             st.execute(true);
         }
         if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size() &&
@@ -376,26 +380,27 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertTrustLines(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session)
 {
-    BulkUpsertTrustLinesOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertTrustLinesOperation op(mDatabase, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteTrustLines(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons,
+    soci::session& session)
 {
-    BulkDeleteTrustLinesOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteTrustLinesOperation op(mDatabase, cons, entries, session);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropTrustLines()
 {
     throwIfChild();
-    mEntryCache.clear();
-    mBestOffersCache.clear();
+    waitForPendingWrites();
+    clearEntryCache();
 
     mDatabase.getSession() << "DROP TABLE IF EXISTS trustlines;";
     mDatabase.getSession()
@@ -417,6 +422,7 @@ class BulkLoadTrustLinesOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mIssuers;
     std::vector<std::string> mAssetCodes;
@@ -442,7 +448,7 @@ class BulkLoadTrustLinesOperation
         st.exchange(soci::into(liabilities.selling, sellingLiabilitiesInd));
         st.define_and_bind();
         {
-            auto timer = mDb.getSelectTimer("trust");
+            auto timer = mDb.getSelectTimer("trust", mSession);
             st.execute(true);
         }
 
@@ -490,8 +496,9 @@ class BulkLoadTrustLinesOperation
 
   public:
     BulkLoadTrustLinesOperation(Database& db,
-                                std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+                                std::unordered_set<LedgerKey> const& keys,
+                                soci::session& session)
+        : mDb(db), mSession(session)
     {
         mAccountIDs.reserve(keys.size());
         mIssuers.reserve(keys.size());
@@ -555,7 +562,7 @@ class BulkLoadTrustLinesOperation
             "sellingliabilities "
             "FROM trustlines WHERE (accountid, issuer, assetcode) IN r";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto sqliteStatement = dynamic_cast<soci::sqlite3_statement_backend*>(
             prep.statement().get_backend());
         auto st = sqliteStatement->stmt_;
@@ -589,7 +596,8 @@ class BulkLoadTrustLinesOperation
             "unnest(:v3::TEXT[])) SELECT accountid, assettype, assetcode, "
             "issuer, tlimit, balance, flags, lastmodified, buyingliabilities, "
             "sellingliabilities FROM trustlines "
-            "WHERE (accountid, issuer, assetcode) IN (SELECT * FROM r)");
+            "WHERE (accountid, issuer, assetcode) IN (SELECT * FROM r)",
+            mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strIssuers));
@@ -601,13 +609,13 @@ class BulkLoadTrustLinesOperation
 
 std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadTrustLines(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadTrustLinesOperation op(mDatabase, keys);
+        BulkLoadTrustLinesOperation op(mDatabase, keys, session);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
@@ -0,0 +1,55 @@
+
+#include "ledger/CompactLedgerKey.h"
+#include "ledger/test/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "util/XDROperators.h"
+#include "util/types.h"
+
+using namespace viichain;
+
+TEST_CASE("CompactLedgerKey round trip", "[ledger][compactledgerkey]")
+{
+    std::vector<LedgerKey> keys;
+    for (auto const& le : LedgerTestUtils::generateValidLedgerEntries(200))
+    {
+        keys.emplace_back(LedgerEntryKey(le));
+    }
+
+    for (auto const& key : keys)
+    {
+        CompactLedgerKey compact(key);
+        REQUIRE(compact.type() == key.type());
+        REQUIRE(compact.toLedgerKey() == key);
+        REQUIRE(CompactLedgerKey(compact.toLedgerKey()) == compact);
+        REQUIRE(CompactLedgerKey(compact.toLedgerKey()).hash() ==
+                compact.hash());
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        for (size_t j = 0; j < keys.size(); ++j)
+        {
+            REQUIRE((keys[i] == keys[j]) ==
+                    (CompactLedgerKey(keys[i]) == CompactLedgerKey(keys[j])));
+        }
+    }
+}
+
+TEST_CASE("CompactLedgerKey distinguishes similar keys",
+          "[ledger][compactledgerkey]")
+{
+    auto offer = LedgerTestUtils::generateValidOfferEntry();
+    LedgerKey k1(OFFER);
+    k1.offer().sellerID = offer.sellerID;
+    k1.offer().offerID = 1;
+    LedgerKey k2 = k1;
+    k2.offer().offerID = 256;
+    REQUIRE(CompactLedgerKey(k1) != CompactLedgerKey(k2));
+
+    LedgerKey d1(DATA);
+    d1.data().accountID = offer.sellerID;
+    d1.data().dataName = "a";
+    LedgerKey d2 = d1;
+    d2.data().dataName = "ab";
+    REQUIRE(CompactLedgerKey(d1) != CompactLedgerKey(d2));
+}
@@ -2,11 +2,19 @@
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
 #include "main/Application.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
+#include "transactions/TransactionFrame.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 #include <lib/catch.hpp>
 
 using namespace viichain;
+using namespace viichain::txtest;
 
 TEST_CASE("cannot close ledger with unsupported ledger version", "[ledger]")
 {
@@ -40,3 +48,37 @@ TEST_CASE("cannot close ledger with unsupported ledger version", "[ledger]")
     }
     REQUIRE_THROWS_AS(applyEmptyLedger(), std::runtime_error);
 }
+
+TEST_CASE("transaction history is stored in bulk", "[ledger][txhistory]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(
+        clock, getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
+    auto root = TestAccount::createRoot(*app);
+    auto dest = getAccount("dest").getPublicKey();
+
+    std::vector<TransactionFramePtr> txs;
+    for (int i = 0; i < 150; ++i)
+    {
+        txs.emplace_back(root.tx({payment(dest, 1)}));
+    }
+
+    auto& inserts =
+        app->getMetrics().NewTimer({"database", "insert", "txhistory"});
+    auto& feeInserts =
+        app->getMetrics().NewTimer({"database", "insert", "txfeehistory"});
+    auto before = inserts.count();
+    auto feeBefore = feeInserts.count();
+
+    auto ledgerSeq = app->getLedgerManager().getLastClosedLedgerNum() + 1;
+    auto res = closeLedgerOn(*app, ledgerSeq, 1, 1, 2016, txs);
+    REQUIRE(res.size() == txs.size());
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        REQUIRE(res[i].first.transactionHash == txs[i]->getContentsHash());
+    }
+
+    // SQLite inserts at most 100 rows per statement
+    REQUIRE(inserts.count() - before == 2);
+    REQUIRE(feeInserts.count() - feeBefore == 2);
+}
@@ -1,22 +1,34 @@
 
+#include "database/Database.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
 #include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "main/PersistentState.h"
+#include "medida/meter.h"
+#include "test/AllocationCounter.h"
+#include "test/TestAccount.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 #include "transactions/TransactionUtils.h"
+#include "util/Decoder.h"
 #include "util/Math.h"
 #include "util/XDROperators.h"
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
 #include <queue>
 #include <set>
 #include <xdrpp/autocheck.h>
+#include <xdrpp/marshal.h>
 
 using namespace viichain;
 
@@ -406,7 +418,6 @@ TEST_CASE("LedgerTxn round trip", "[ledgerstate]")
             VirtualClock clock;
             auto cfg = getTestConfig();
             cfg.ENTRY_CACHE_SIZE = 0;
-            cfg.BEST_OFFERS_CACHE_SIZE = 0;
             auto app = createTestApplication(clock, cfg);
             app->start();
 
@@ -821,7 +832,6 @@ testInflationWinners(
         VirtualClock clock;
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
-        cfg.BEST_OFFERS_CACHE_SIZE = 0;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -1394,7 +1404,6 @@ testAllOffers(
         VirtualClock clock;
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
-        cfg.BEST_OFFERS_CACHE_SIZE = 0;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -1643,7 +1652,6 @@ testBestOffer(
         VirtualClock clock;
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
-        cfg.BEST_OFFERS_CACHE_SIZE = 0;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -1808,6 +1816,83 @@ TEST_CASE("LedgerTxn loadBestOffer", "[ledgerstate]")
                            {{{a1, 1}, {selling, buying, Price{1, 1}, 0}}}});
         }
     }
+
+    SECTION("offers modified and erased while crossing")
+    {
+        VirtualClock clock;
+        auto app = createTestApplication(clock, getTestConfig());
+        app->start();
+
+        {
+            LedgerTxn ltx1(app->getLedgerTxnRoot());
+            applyLedgerTxnUpdates(
+                ltx1, {{{a1, 1}, {buying, selling, Price{1, 1}, 1}},
+                       {{a1, 2}, {buying, selling, Price{2, 1}, 1}},
+                       {{a1, 3}, {buying, selling, Price{3, 1}, 1}}});
+            ltx1.commit();
+        }
+
+        LedgerTxn ltx1(app->getLedgerTxnRoot());
+        LedgerTxn ltx2(ltx1);
+        auto crossBest = [&](int64_t expectedID, bool erase) {
+            auto offer = ltx2.loadBestOffer(buying, selling);
+            REQUIRE(offer);
+            auto& oe = offer.current().data.offer();
+            REQUIRE(oe.offerID == expectedID);
+            if (erase)
+            {
+                offer.erase();
+            }
+            else
+            {
+                oe.price = Price{4, 1};
+            }
+        };
+        crossBest(1, false);
+        crossBest(2, true);
+        crossBest(3, true);
+        crossBest(1, true);
+        REQUIRE(!ltx2.loadBestOffer(buying, selling));
+
+        ltx2.commit();
+        REQUIRE(!ltx1.loadBestOffer(buying, selling));
+    }
+
+    SECTION("root order book follows commits")
+    {
+        VirtualClock clock;
+        auto app = createTestApplication(clock, getTestConfig());
+        app->start();
+
+        auto commitUpdates =
+            [&](std::map<std::pair<AccountID, int64_t>,
+                         std::tuple<Asset, Asset, Price, int64_t>> const&
+                    updates) {
+                LedgerTxn ltx(app->getLedgerTxnRoot());
+                applyLedgerTxnUpdates(ltx, updates);
+                ltx.commit();
+            };
+        auto bestOfferID = [&]() -> int64_t {
+            LedgerTxn ltx(app->getLedgerTxnRoot());
+            auto offer = ltx.loadBestOffer(buying, selling);
+            return offer ? offer.current().data.offer().offerID : 0;
+        };
+
+        commitUpdates({{{a1, 1}, {buying, selling, Price{2, 1}, 1}},
+                       {{a1, 2}, {buying, selling, Price{3, 1}, 1}}});
+        REQUIRE(bestOfferID() == 1);
+
+        commitUpdates({{{a2, 3}, {buying, selling, Price{1, 1}, 1}}});
+        REQUIRE(bestOfferID() == 3);
+
+        commitUpdates({{{a2, 3}, {selling, buying, Price{1, 1}, 1}},
+                       {{a1, 1}, {buying, selling, Price{4, 1}, 1}}});
+        REQUIRE(bestOfferID() == 2);
+
+        commitUpdates({{{a1, 2}, {buying, selling, Price{3, 1}, 0}},
+                       {{a1, 1}, {buying, selling, Price{4, 1}, 0}}});
+        REQUIRE(bestOfferID() == 0);
+    }
 }
 
 static void
@@ -1883,7 +1968,6 @@ testOffersByAccountAndAsset(
         VirtualClock clock;
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
-        cfg.BEST_OFFERS_CACHE_SIZE = 0;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -2187,6 +2271,170 @@ TEST_CASE("LedgerTxnRoot prefetch", "[ledgerstate]")
     }
 }
 
+TEST_CASE("LedgerTxnRoot asynchronous prefetch", "[ledgerstate]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    cfg.ENTRY_CACHE_SIZE = 1000;
+    cfg.PREFETCH_BATCH_SIZE = cfg.ENTRY_CACHE_SIZE / 10;
+
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    std::unordered_set<LedgerKey> keys;
+    auto entries = LedgerTestUtils::generateValidLedgerEntries(100);
+    {
+        LedgerTxn ltx(root);
+        for (auto const& e : entries)
+        {
+            ltx.createOrUpdateWithoutLoading(e);
+            keys.emplace(LedgerEntryKey(e));
+        }
+        ltx.commit();
+    }
+
+    auto ledgerSeq = root.getHeader().ledgerSeq;
+    root.prefetchAsync(keys, ledgerSeq + 2);
+
+    // Ledger ledgerSeq + 1 has not been committed yet
+    REQUIRE(root.prefetch({}) == 0);
+
+    {
+        LedgerTxn ltx(root);
+        ltx.loadHeader().current().ledgerSeq = ledgerSeq + 1;
+        ltx.eraseWithoutLoading(LedgerEntryKey(entries[0]));
+        ltx.commit();
+    }
+
+    // The erased entry was committed after the load started
+    REQUIRE(root.prefetch({}) == keys.size() - 1);
+    {
+        // Everything else was loaded on the pool session, so reading it
+        // back must not query the database again.
+        auto& queries = app->getDatabase().getQueryMeter();
+        auto before = queries.count();
+        LedgerTxn ltx(root);
+        for (size_t i = 1; i < entries.size(); ++i)
+        {
+            REQUIRE(ltx.load(LedgerEntryKey(entries[i])));
+        }
+        REQUIRE(queries.count() == before);
+        REQUIRE(!ltx.load(LedgerEntryKey(entries[0])));
+    }
+    REQUIRE(root.getPrefetchHitRate() > 0);
+}
+
+TEST_CASE("LedgerTxnRoot write-behind", "[ledgerstate]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    cfg.EXPERIMENTAL_WRITE_BEHIND = true;
+
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    auto countAll = [&]() {
+        uint64_t count = 0;
+        for (auto let : {ACCOUNT, DATA, TRUSTLINE, OFFER})
+        {
+            count += root.countObjects(let);
+        }
+        return count;
+    };
+    auto initialCount = countAll();
+
+    std::unordered_set<LedgerKey> keys;
+    auto entries = LedgerTestUtils::generateValidLedgerEntries(100);
+    {
+        LedgerTxn ltx(root);
+        for (auto const& e : entries)
+        {
+            ltx.createOrUpdateWithoutLoading(e);
+            keys.emplace(LedgerEntryKey(e));
+        }
+        ltx.commit();
+    }
+
+    auto erased = LedgerEntryKey(entries[0]);
+    keys.erase(erased);
+    {
+        LedgerTxn ltx(root);
+        ltx.eraseWithoutLoading(erased);
+        ltx.commit();
+    }
+
+    // The entries may not be in the database yet
+    {
+        LedgerTxn ltx(root);
+        REQUIRE(!ltx.load(erased));
+        for (auto const& key : keys)
+        {
+            REQUIRE(ltx.load(key));
+        }
+    }
+
+    // countObjects waits for the pending write
+    REQUIRE(countAll() == initialCount + keys.size());
+    REQUIRE(app->getPersistentState()
+                .getState(PersistentState::kWriteBehindChanges)
+                .empty());
+}
+
+TEST_CASE("LedgerTxnRoot write-behind resumes after restart", "[ledgerstate]")
+{
+    auto cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    cfg.EXPERIMENTAL_WRITE_BEHIND = true;
+
+    auto entries = LedgerTestUtils::generateValidLedgerEntries(10);
+    auto countAll = [](LedgerTxnRoot& root) {
+        uint64_t count = 0;
+        for (auto let : {ACCOUNT, DATA, TRUSTLINE, OFFER})
+        {
+            count += root.countObjects(let);
+        }
+        return count;
+    };
+
+    uint64_t initialCount = 0;
+    {
+        VirtualClock clock;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        initialCount = countAll(app->getLedgerTxnRoot());
+
+        // What the close transaction records for a write-behind that did
+        // not finish before the node stopped
+        LedgerEntryChanges changes;
+        for (auto const& e : entries)
+        {
+            changes.emplace_back(LEDGER_ENTRY_UPDATED);
+            changes.back().updated() = e;
+        }
+        app->getPersistentState().setState(
+            PersistentState::kWriteBehindChanges,
+            decoder::encode_b64(xdr::xdr_to_opaque(changes)));
+    }
+
+    VirtualClock clock;
+    auto app = createTestApplication(clock, cfg, false);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    REQUIRE(countAll(root) == initialCount + entries.size());
+    {
+        LedgerTxn ltx(root);
+        for (auto const& e : entries)
+        {
+            REQUIRE(ltx.load(LedgerEntryKey(e)));
+        }
+    }
+    REQUIRE(app->getPersistentState()
+                .getState(PersistentState::kWriteBehindChanges)
+                .empty());
+}
+
 TEST_CASE("Create performance benchmark", "[!hide][createbench]")
 {
     auto runTest = [&](Config::TestDbMode mode, bool loading) {
@@ -2479,7 +2727,6 @@ TEST_CASE("Signers performance benchmark", "[!hide][signersbench]")
         VirtualClock clock;
         Config cfg(getTestConfig(0, mode));
         cfg.ENTRY_CACHE_SIZE = 0;
-        cfg.BEST_OFFERS_CACHE_SIZE = 0;
         Application::pointer app = createTestApplication(clock, cfg);
         app->start();
 
@@ -2643,7 +2890,6 @@ TEST_CASE("Load best offers benchmark", "[!hide][bestoffersbench]")
         VirtualClock clock;
         Config cfg(getTestConfig(0, mode));
         cfg.ENTRY_CACHE_SIZE = 100000;
-        cfg.BEST_OFFERS_CACHE_SIZE = 1000;
         Application::pointer app = createTestApplication(clock, cfg);
 
         CLOG(WARNING, "Ledger")
@@ -2698,3 +2944,61 @@ TEST_CASE("Load best offers benchmark", "[!hide][bestoffersbench]")
         runTest(Config::TESTDB_ON_DISK_SQLITE, 10, 5, 25000);
     }
 }
+
+TEST_CASE("Ledger close allocation benchmark", "[!hide][closeallocbench]")
+{
+    auto runTest = [&](size_t numOps) {
+        VirtualClock clock;
+        Config cfg(getTestConfig());
+        cfg.TESTING_UPGRADE_MAX_TX_SET_SIZE = static_cast<uint32_t>(numOps);
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+
+        auto& lm = app->getLedgerManager();
+        auto root = TestAccount::createRoot(*app);
+        auto balance = lm.getLastMinBalance(0) * 1000;
+        auto dest = root.create("dest", balance);
+
+        // Every source account submits one transaction of MAX_OPS_PER_TX
+        // payments.
+        std::vector<TransactionFramePtr> txs;
+        for (size_t i = 0; i * MAX_OPS_PER_TX < numOps; ++i)
+        {
+            auto source = root.create("source" + std::to_string(i), balance);
+            std::vector<Operation> ops(MAX_OPS_PER_TX,
+                                       txtest::payment(dest, 1));
+            txs.emplace_back(source.tx(ops));
+        }
+
+        auto txSet = std::make_shared<TxSetFrame>(
+            lm.getLastClosedLedgerHeader().hash);
+        for (auto const& tx : txs)
+        {
+            txSet->add(tx);
+        }
+        txSet->sortForHash();
+        REQUIRE(txSet->checkValid(*app));
+
+        VIIValue sv(txSet->getContentsHash(), getTestDate(1, 7, 2019),
+                    emptyUpgradeSteps, VII_VALUE_BASIC);
+        LedgerCloseData ledgerData(lm.getLastClosedLedgerNum() + 1, txSet,
+                                   sv);
+
+        auto allocations = testutil::getAllocationCount();
+        auto start = std::chrono::steady_clock::now();
+        lm.closeLedger(ledgerData);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        allocations = testutil::getAllocationCount() - allocations;
+
+        CLOG(INFO, "Ledger")
+            << "closed ledger of " << numOps << " payments in "
+            << elapsed.count() << "ms, "
+            << static_cast<double>(allocations) / numOps
+            << " allocations per op";
+    };
+
+    runTest(1000);
+    runTest(5000);
+    runTest(10000);
+}
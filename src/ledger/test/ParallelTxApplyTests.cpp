@@ -0,0 +1,177 @@
+
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "transactions/TransactionFrame.h"
+#include "util/format.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+
+using namespace viichain;
+using namespace viichain::txtest;
+
+namespace
+{
+
+// Closes every ledger on two applications, one applying transactions one by
+// one and one applying them in parallel, and checks that both store the same
+// results and meta and end up with the same ledger hash.
+class DifferentialReplay
+{
+    VirtualClock mSerialClock;
+    VirtualClock mParallelClock;
+    Application::pointer mSerial;
+    Application::pointer mParallel;
+
+    static std::vector<std::string>
+    loadColumn(Application& app, std::string const& table,
+               std::string const& column, uint32_t ledgerSeq)
+    {
+        std::vector<std::string> res;
+        std::string value;
+        auto& sess = app.getDatabase().getSession();
+        soci::statement st =
+            (sess.prepare << "SELECT " << column << " FROM " << table
+                          << " WHERE ledgerseq = :lseq ORDER BY txindex ASC",
+             soci::into(value), soci::use(ledgerSeq));
+        st.execute(true);
+        while (st.got_data())
+        {
+            res.emplace_back(value);
+            st.fetch();
+        }
+        return res;
+    }
+
+  public:
+    DifferentialReplay()
+    {
+        Config serialCfg(getTestConfig(0));
+        serialCfg.PARALLEL_TX_APPLY_THREADS = 0;
+        Config parallelCfg(getTestConfig(1));
+        parallelCfg.PARALLEL_TX_APPLY_THREADS = 4;
+        mSerial = createTestApplication(mSerialClock, serialCfg);
+        mParallel = createTestApplication(mParallelClock, parallelCfg);
+    }
+
+    Application&
+    serial()
+    {
+        return *mSerial;
+    }
+
+    int64_t
+    parallelCount(std::string const& name)
+    {
+        return mParallel->getMetrics()
+            .NewCounter({"ledger", "transaction", name})
+            .count();
+    }
+
+    TxSetResultMeta
+    close(std::vector<TransactionFramePtr> const& txs)
+    {
+        std::vector<TransactionFramePtr> parallelTxs;
+        for (auto const& tx : txs)
+        {
+            parallelTxs.emplace_back(TransactionFrame::makeTransactionFromWire(
+                mParallel->getNetworkID(), tx->getEnvelope()));
+        }
+
+        auto ledgerSeq =
+            mSerial->getLedgerManager().getLastClosedLedgerNum() + 1;
+        auto res = closeLedgerOn(*mSerial, ledgerSeq, 1, 1, 2016, txs);
+        closeLedgerOn(*mParallel, ledgerSeq, 1, 1, 2016, parallelTxs);
+
+        for (auto const& column : {"txresult", "txmeta"})
+        {
+            REQUIRE(loadColumn(*mSerial, "txhistory", column, ledgerSeq) ==
+                    loadColumn(*mParallel, "txhistory", column, ledgerSeq));
+        }
+        REQUIRE(loadColumn(*mSerial, "txfeehistory", "txchanges", ledgerSeq) ==
+                loadColumn(*mParallel, "txfeehistory", "txchanges", ledgerSeq));
+        REQUIRE(mSerial->getLedgerManager().getLastClosedLedgerHeader().hash ==
+                mParallel->getLedgerManager().getLastClosedLedgerHeader().hash);
+        return res;
+    }
+};
+}
+
+TEST_CASE("parallel tx apply matches serial apply", "[ledger][parallelapply]")
+{
+    DifferentialReplay replay;
+    auto& app = replay.serial();
+    auto root = TestAccount::createRoot(app);
+    auto amount = app.getLedgerManager().getLastMinBalance(0) * 100;
+
+    std::vector<SecretKey> keys;
+    std::vector<Operation> creates;
+    for (int i = 0; i < 8; ++i)
+    {
+        keys.emplace_back(getAccount(fmt::format("a{}", i)));
+        creates.emplace_back(createAccount(keys.back().getPublicKey(), amount));
+    }
+    replay.close({root.tx(creates)});
+    REQUIRE(replay.parallelCount("parallel-apply") == 0);
+
+    std::vector<TestAccount> accounts;
+    for (auto const& key : keys)
+    {
+        accounts.emplace_back(app, key);
+    }
+
+    SECTION("disjoint payments")
+    {
+        auto res = replay.close(
+            {accounts[0].tx({payment(accounts[1], 100)}),
+             accounts[2].tx({payment(accounts[3], 200)}),
+             accounts[4].tx({payment(accounts[5], 300)}),
+             accounts[6].tx({createAccount(getAccount("b").getPublicKey(),
+                                           amount / 2)})});
+        for (auto const& r : res)
+        {
+            REQUIRE(r.first.result.result.code() == txSUCCESS);
+        }
+        REQUIRE(replay.parallelCount("parallel-apply") == 1);
+    }
+
+    SECTION("conflicting and failing transactions")
+    {
+        auto res = replay.close(
+            {accounts[0].tx({payment(accounts[2], 100)}),
+             accounts[2].tx({payment(accounts[4], 100)}),
+             accounts[4].tx({payment(accounts[0], 100)}),
+             accounts[0].tx({payment(accounts[1], 100)}),
+             accounts[6].tx({payment(getAccount("c").getPublicKey(), 100)}),
+             accounts[7].tx({payment(accounts[7], 100)})});
+        auto failed =
+            std::count_if(res.begin(), res.end(),
+                          [](TxSetResultMeta::value_type const& r) {
+                              return r.first.result.result.code() == txFAILED;
+                          });
+        REQUIRE(failed == 1);
+        REQUIRE(replay.parallelCount("parallel-apply") == 1);
+    }
+
+    SECTION("transactions reaching outside their footprint")
+    {
+        auto usd = makeAsset(keys[1], "USD");
+        replay.close({accounts[0].tx({changeTrust(usd, 1000)}),
+                      accounts[2].tx({payment(accounts[3], 100)})});
+        REQUIRE(replay.parallelCount("parallel-apply") == 0);
+        REQUIRE(replay.parallelCount("parallel-fallback") == 1);
+
+        replay.close({accounts[1].tx({payment(accounts[0], usd, 100)}),
+                      accounts[0].tx({manageOffer(0, usd, makeNativeAsset(),
+                                                  Price{1, 1}, 50)}),
+                      accounts[4].tx({payment(accounts[5], 100)})});
+        REQUIRE(replay.parallelCount("parallel-fallback") == 2);
+    }
+}
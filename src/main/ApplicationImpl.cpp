@@ -128,8 +128,13 @@ ApplicationImpl::initialize(bool createNewDB)
     mBanManager = BanManager::create(*this);
     mStatusManager = std::make_unique<StatusManager>();
     mLedgerTxnRoot = std::make_unique<LedgerTxnRoot>(
-        *mDatabase, mConfig.ENTRY_CACHE_SIZE, mConfig.BEST_OFFERS_CACHE_SIZE,
-        mConfig.PREFETCH_BATCH_SIZE);
+        *mDatabase, mConfig.ENTRY_CACHE_SIZE, mConfig.PREFETCH_BATCH_SIZE,
+        mConfig.EXPERIMENTAL_WRITE_BEHIND && mDatabase->canUsePool(),
+        mConfig.ENTRY_CACHE_EVICTION_POLICY == "TINY_LFU"
+            ? CacheEvictionPolicy::TINY_LFU
+            : CacheEvictionPolicy::RANDOM,
+        mConfig.ENTRY_CACHE_BYTES);
+    PubKeyUtils::setVerifySigCacheSize(mConfig.SIGNATURE_CACHE_SIZE);
 
     BucketListIsConsistentWithDatabase::registerInvariant(*this);
     AccountSubEntriesCountIsValid::registerInvariant(*this);
@@ -604,6 +609,8 @@ ApplicationImpl::syncOwnMetrics()
     mMetrics->NewMeter({"crypto", "verify", "miss"}, "signature").Mark(vmiss);
     mMetrics->NewMeter({"crypto", "verify", "total"}, "signature")
         .Mark(vhit + vmiss);
+    mMetrics->NewCounter({"crypto", "verify", "cache-bytes"})
+        .set_count(PubKeyUtils::getVerifySigCacheBytes());
 
         mMetrics->NewCounter({"process", "memory", "handles"})
         .set_count(mProcessManager->getNumRunningProcesses());
@@ -1,5 +1,7 @@
 
 #include "main/CommandHandler.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "herder/Herder.h"
@@ -20,6 +22,7 @@
 
 #include "medida/reporting/json_reporter.h"
 #include "util/Decoder.h"
+#include "util/Fs.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 #include "xdrpp/printer.h"
@@ -68,6 +71,7 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
     mServer->add404(std::bind(&CommandHandler::fileNotFound, this, _1, _2));
 
     addRoute("bans", &CommandHandler::bans);
+    addRoute("bucketstats", &CommandHandler::bucketStats);
     addRoute("clearmetrics", &CommandHandler::clearMetrics);
     addRoute("connect", &CommandHandler::connect);
     addRoute("dropcursor", &CommandHandler::dropcursor);
@@ -331,6 +335,77 @@ CommandHandler::dropPeer(std::string const& params, std::string& retStr)
     }
 }
 
+static Json::Value
+bucketStatsToJson(Bucket const& b)
+{
+    Json::Value res;
+    res["hash"] = binToHex(b.getHash());
+    res["size"] = static_cast<Json::UInt64>(b.getSize());
+    res["file_size"] = static_cast<Json::UInt64>(
+        b.getFilename().empty() ? 0 : fs::size(b.getFilename()));
+    res["compressed"] = b.isCompressed();
+    if (!b.hasStats())
+    {
+        return res;
+    }
+
+    auto const& stats = b.getStats();
+    res["init"] = static_cast<Json::UInt64>(stats.mInitEntries);
+    res["live"] = static_cast<Json::UInt64>(stats.mLiveEntries);
+    res["dead"] = static_cast<Json::UInt64>(stats.mDeadEntries);
+    res["meta"] = static_cast<Json::UInt64>(stats.mMetaEntries);
+    auto& byType = res["types"];
+    for (auto const& kv : stats.mByType)
+    {
+        auto name = xdr::xdr_traits<LedgerEntryType>::enum_name(kv.first);
+        auto& t = byType[name];
+        t["entries"] = static_cast<Json::UInt64>(kv.second.mEntries);
+        t["bytes"] = static_cast<Json::UInt64>(kv.second.mBytes);
+    }
+    if (stats.mMinKey && stats.mMaxKey)
+    {
+        res["min_key"] =
+            decoder::encode_b64(xdr::xdr_to_opaque(*stats.mMinKey));
+        res["max_key"] =
+            decoder::encode_b64(xdr::xdr_to_opaque(*stats.mMaxKey));
+    }
+    return res;
+}
+
+void
+CommandHandler::bucketStats(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+    uint32_t first = 0;
+    uint32_t last = BucketList::kNumLevels - 1;
+    uint32_t level;
+    if (maybeParseParam(retMap, "level", level))
+    {
+        if (level > last)
+        {
+            throw std::invalid_argument("level out of range");
+        }
+        first = last = level;
+    }
+
+    Json::Value root;
+    auto& bm = mApp.getBucketManager();
+    auto& bl = bm.getBucketList();
+    for (uint32_t i = first; i <= last; ++i)
+    {
+        auto curr = bl.getLevel(i).getCurr();
+        auto snap = bl.getLevel(i).getSnap();
+        bm.loadBucketStats(curr);
+        bm.loadBucketStats(snap);
+        auto& node = root["levels"][i - first];
+        node["level"] = i;
+        node["curr"] = bucketStatsToJson(*curr);
+        node["snap"] = bucketStatsToJson(*snap);
+    }
+    retStr = root.toStyledString();
+}
+
 void
 CommandHandler::bans(std::string const& params, std::string& retStr)
 {
@@ -832,6 +907,9 @@ CommandHandler::testTx(std::string const& params, std::string& retStr)
         case TransactionQueue::AddResult::ADD_STATUS_TRY_AGAIN_LATER:
             root["status"] = "try_again_later";
             break;
+        case TransactionQueue::AddResult::ADD_STATUS_QUEUE_FULL:
+            root["status"] = "queue_full";
+            break;
         default:
             assert(false);
         }
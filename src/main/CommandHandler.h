@@ -29,6 +29,7 @@ class CommandHandler
     void fileNotFound(std::string const& params, std::string& retStr);
 
     void bans(std::string const& params, std::string& retStr);
+    void bucketStats(std::string const& params, std::string& retStr);
     void checkdb(std::string const& params, std::string& retStr);
     void connect(std::string const& params, std::string& retStr);
     void dropcursor(std::string const& params, std::string& retStr);
@@ -80,6 +80,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 0;
     ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING = false;
     ARTIFICIALLY_REDUCE_MERGE_COUNTS_FOR_TESTING = false;
+    ARTIFICIALLY_INTERRUPT_MERGES_FOR_TESTING = 0;
     ALLOW_LOCALHOST_FOR_TESTING = false;
     USE_CONFIG_FOR_GENESIS = false;
     FAILURE_SAFETY = -1;
@@ -116,8 +117,26 @@ Config::Config() : NODE_SEED(SecretKey::random())
     DATABASE = SecretValue{"sqlite3://:memory:"};
 
     ENTRY_CACHE_SIZE = 100000;
-    BEST_OFFERS_CACHE_SIZE = 64;
+    ENTRY_CACHE_EVICTION_POLICY = "RANDOM";
+    ENTRY_CACHE_BYTES = 0;
     PREFETCH_BATCH_SIZE = 1000;
+    SIGNATURE_CACHE_SIZE = 0xffff;
+    TRANSACTION_QUEUE_MAX_OPS = 100000;
+    TRANSACTION_QUEUE_MAX_BYTES = 64 * 1024 * 1024;
+    PARALLEL_TX_APPLY_THREADS = 0;
+    EXPERIMENTAL_WRITE_BEHIND = false;
+
+    EXPERIMENTAL_BUCKETLIST_DB = false;
+    BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT = 14;
+    BUCKETLIST_DB_INDEX_CUTOFF = 20;
+    BUCKET_BLOOM_FILTER_BITS_PER_KEY = 0;
+    BUCKET_STATS = false;
+    BUCKET_MERGE_THREADS = 1;
+    BUCKET_MERGE_MIN_PARTITION_SIZE = 64 * 1024 * 1024;
+    BUCKET_MERGE_CHECKPOINT_INTERVAL = 0;
+    COMPRESS_BUCKET_FILES = false;
+    MMAP_BUCKET_FILES = false;
+    DURABLE_BUCKET_WRITES = false;
 }
 
 namespace
@@ -850,14 +869,103 @@ Config::processConfig(std::shared_ptr<cpptoml::table> t)
             {
                 ENTRY_CACHE_SIZE = readInt<uint32_t>(item);
             }
+            else if (item.first == "ENTRY_CACHE_BYTES")
+            {
+                ENTRY_CACHE_BYTES = readInt<int64_t>(item, 0);
+            }
+            else if (item.first == "ENTRY_CACHE_EVICTION_POLICY")
+            {
+                ENTRY_CACHE_EVICTION_POLICY = readString(item);
+                if (ENTRY_CACHE_EVICTION_POLICY != "RANDOM" &&
+                    ENTRY_CACHE_EVICTION_POLICY != "TINY_LFU")
+                {
+                    throw std::invalid_argument(
+                        fmt::format("Unknown ENTRY_CACHE_EVICTION_POLICY {}",
+                                    ENTRY_CACHE_EVICTION_POLICY));
+                }
+            }
             else if (item.first == "BEST_OFFERS_CACHE_SIZE")
             {
-                BEST_OFFERS_CACHE_SIZE = readInt<uint32_t>(item);
+                LOG(WARNING) << "BEST_OFFERS_CACHE_SIZE is no longer used, "
+                                "offers are kept in memory";
             }
             else if (item.first == "PREFETCH_BATCH_SIZE")
             {
                 PREFETCH_BATCH_SIZE = readInt<uint32_t>(item);
             }
+            else if (item.first == "SIGNATURE_CACHE_SIZE")
+            {
+                SIGNATURE_CACHE_SIZE = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "TRANSACTION_QUEUE_MAX_OPS")
+            {
+                TRANSACTION_QUEUE_MAX_OPS = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "TRANSACTION_QUEUE_MAX_BYTES")
+            {
+                TRANSACTION_QUEUE_MAX_BYTES = readInt<int64_t>(item, 1);
+            }
+            else if (item.first == "PARALLEL_TX_APPLY_THREADS")
+            {
+                PARALLEL_TX_APPLY_THREADS = readInt<uint32_t>(item, 0, 256);
+            }
+            else if (item.first == "EXPERIMENTAL_WRITE_BEHIND")
+            {
+                EXPERIMENTAL_WRITE_BEHIND = readBool(item);
+            }
+            else if (item.first == "EXPERIMENTAL_BUCKETLIST_DB")
+            {
+                EXPERIMENTAL_BUCKETLIST_DB = readBool(item);
+            }
+            else if (item.first == "BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT")
+            {
+                BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT =
+                    readInt<uint32_t>(item, 8, 32);
+            }
+            else if (item.first == "BUCKETLIST_DB_INDEX_CUTOFF")
+            {
+                BUCKETLIST_DB_INDEX_CUTOFF = readInt<uint32_t>(item);
+            }
+            else if (item.first == "BUCKET_BLOOM_FILTER_BITS_PER_KEY")
+            {
+                BUCKET_BLOOM_FILTER_BITS_PER_KEY =
+                    readInt<uint32_t>(item, 0, 64);
+            }
+            else if (item.first == "BUCKET_STATS")
+            {
+                BUCKET_STATS = readBool(item);
+            }
+            else if (item.first == "BUCKET_MERGE_THREADS")
+            {
+                BUCKET_MERGE_THREADS = readInt<uint32_t>(item, 1, 64);
+            }
+            else if (item.first == "BUCKET_MERGE_MIN_PARTITION_SIZE")
+            {
+                BUCKET_MERGE_MIN_PARTITION_SIZE = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "BUCKET_MERGE_CHECKPOINT_INTERVAL")
+            {
+                BUCKET_MERGE_CHECKPOINT_INTERVAL = readInt<uint32_t>(item);
+            }
+            else if (item.first == "COMPRESS_BUCKET_FILES")
+            {
+                COMPRESS_BUCKET_FILES = readBool(item);
+#ifndef USE_ZSTD
+                if (COMPRESS_BUCKET_FILES)
+                {
+                    throw std::invalid_argument(
+                        "COMPRESS_BUCKET_FILES needs vii-core built with zstd");
+                }
+#endif
+            }
+            else if (item.first == "MMAP_BUCKET_FILES")
+            {
+                MMAP_BUCKET_FILES = readBool(item);
+            }
+            else if (item.first == "DURABLE_BUCKET_WRITES")
+            {
+                DURABLE_BUCKET_WRITES = readBool(item);
+            }
             else if (item.first == "MAXIMUM_LEDGER_CLOSETIME_DRIFT")
             {
                 MAXIMUM_LEDGER_CLOSETIME_DRIFT = readInt<int64_t>(item, 0);
@@ -125,6 +125,9 @@ class Config : public std::enable_shared_from_this<Config>
 
                     bool ARTIFICIALLY_REDUCE_MERGE_COUNTS_FOR_TESTING;
 
+    // Makes checkpointed merges fail after this many checkpoints.
+    uint32_t ARTIFICIALLY_INTERRUPT_MERGES_FOR_TESTING;
+
             bool ALLOW_LOCALHOST_FOR_TESTING;
 
             bool USE_CONFIG_FOR_GENESIS;
@@ -199,10 +202,79 @@ class Config : public std::enable_shared_from_this<Config>
     std::vector<std::string> REPORT_METRICS;
 
                             size_t ENTRY_CACHE_SIZE;
-    size_t BEST_OFFERS_CACHE_SIZE;
+
+    // Which entries the ledger entry cache evicts when it is full: RANDOM or
+    // TINY_LFU, which resists scans over entries that are used only once.
+    std::string ENTRY_CACHE_EVICTION_POLICY;
+
+    // Also limit the ledger entry cache to entries of this many bytes in
+    // total, measured by their XDR size. 0 only limits their number.
+    size_t ENTRY_CACHE_BYTES;
 
                     size_t PREFETCH_BATCH_SIZE;
 
+    // Number of signature verification results kept in memory, shared by
+    // all applications in the process.
+    size_t SIGNATURE_CACHE_SIZE;
+
+    // Limits on the operations and on the XDR bytes of the transactions
+    // waiting in the transaction queue. Once either is reached, new
+    // transactions push out the account chains with the lowest fees, or are
+    // turned away if their own fee is not higher.
+    size_t TRANSACTION_QUEUE_MAX_OPS;
+    size_t TRANSACTION_QUEUE_MAX_BYTES;
+
+    // Apply the transactions of a ledger on up to this many threads, one
+    // group of non-conflicting transactions per thread. 0 or 1 applies them
+    // one by one.
+    uint32_t PARALLEL_TX_APPLY_THREADS;
+
+    // Write the ledger entries changed by a ledger close to the database on
+    // a background thread while the next ledger is being agreed on. Has no
+    // effect with an in-memory database.
+    bool EXPERIMENTAL_WRITE_BEHIND;
+
+    // Build a key index alongside every bucket so ledger entries can be
+    // looked up directly from the BucketList. Buckets larger than
+    // BUCKETLIST_DB_INDEX_CUTOFF megabytes are indexed per page of
+    // 2^BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT bytes instead of per key.
+    bool EXPERIMENTAL_BUCKETLIST_DB;
+    uint32_t BUCKETLIST_DB_INDEX_PAGE_SIZE_EXPONENT;
+    uint32_t BUCKETLIST_DB_INDEX_CUTOFF;
+
+    // Bits per key of the bloom filter kept beside each bucket; 0 disables
+    // the filters.
+    uint32_t BUCKET_BLOOM_FILTER_BITS_PER_KEY;
+
+    // Keep entry counts and sizes beside each bucket for the bucketstats
+    // command. Buckets written without them, such as downloaded ones, are
+    // scanned when the command first asks for them.
+    bool BUCKET_STATS;
+
+    // Number of threads a single bucket merge may use. Merges whose inputs
+    // total less than BUCKET_MERGE_MIN_PARTITION_SIZE bytes per thread use
+    // fewer threads. Only merges of indexed buckets, as kept with
+    // EXPERIMENTAL_BUCKETLIST_DB, are split.
+    uint32_t BUCKET_MERGE_THREADS;
+    uint32_t BUCKET_MERGE_MIN_PARTITION_SIZE;
+
+    // Checkpoint sequential merges after every this many bytes of output so
+    // that a restarted node resumes them; 0 disables checkpoints. Merges of
+    // inputs smaller than one interval are not checkpointed.
+    uint32_t BUCKET_MERGE_CHECKPOINT_INTERVAL;
+
+    // Write new buckets as independently compressed blocks. Bucket hashes
+    // still cover the uncompressed stream, and published buckets are
+    // decompressed first. Needs vii-core built with zstd.
+    bool COMPRESS_BUCKET_FILES;
+
+    // Read buckets through read-only memory mappings of their files.
+    bool MMAP_BUCKET_FILES;
+
+    // Sync each new bucket file to disk before renaming it into the bucket
+    // directory, and sync the directory after the rename.
+    bool DURABLE_BUCKET_WRITES;
+
     Config();
 
     void load(std::string const& filename);
@@ -14,7 +14,7 @@ using namespace std;
 std::string PersistentState::mapping[kLastEntry] = {
     "lastclosedledger", "historyarchivestate", "forcescponnextlaunch",
     "lastscpdata",      "databaseschema",      "networkpassphrase",
-    "ledgerupgrades"};
+    "ledgerupgrades",   "writebehindchanges"};
 
 std::string PersistentState::kSQLCreateStatement =
     "CREATE TABLE IF NOT EXISTS storestate ("
@@ -21,11 +21,14 @@ class PersistentState
         kDatabaseSchema,
         kNetworkPassphrase,
         kLedgerUpgrades,
+        kWriteBehindChanges,
         kLastEntry,
     };
 
     static void dropAll(Database& db);
 
+    static std::string getStoreStateName(Entry n, uint32 subscript = 0);
+
     std::string getState(Entry stateName);
     void setState(Entry stateName, std::string const& value);
 
@@ -38,7 +41,6 @@ class PersistentState
 
     Application& mApp;
 
-    std::string getStoreStateName(Entry n, uint32 subscript = 0);
     void updateDb(std::string const& entry, std::string const& value);
     std::string getFromDb(std::string const& entry);
 };
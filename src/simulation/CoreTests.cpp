@@ -462,6 +462,47 @@ TEST_CASE("Accounts vs latency", "[scalability][!hide]")
              txtime.GetSnapshot().get99thPercentile()});
 }
 
+TEST_CASE("Transaction rate vs tx set build time", "[scalability][!hide]")
+{
+    ScaleReporter r({"txrate", "txsets", "buildmin", "buildmax", "build50",
+                     "build95", "build99"});
+
+    VirtualClock clock;
+    auto appPtr = newLoadTestApp(clock);
+    auto& app = *appPtr;
+
+    auto& lg = app.getLoadGenerator();
+    auto& build = app.getMetrics().NewTimer({"herder", "txset", "build"});
+    auto& complete =
+        app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+    uint32_t numAccounts = 100000;
+
+    auto& io = clock.getIOContext();
+    asio::io_context::work mainWork(io);
+    auto runLoad = [&](bool isCreate, uint32_t nTxs, uint32_t txRate) {
+        auto runs = complete.count();
+        lg.generateLoad(isCreate, numAccounts, 0, nTxs, txRate, 100);
+        while (!io.stopped() && complete.count() == runs)
+        {
+            clock.crank();
+        }
+    };
+
+    runLoad(true, 0, 10);
+
+    // Above 2000 transactions per second, they come in faster than ledgers of
+    // 10000 operations take them out, so the queue keeps growing.
+    for (uint32_t txRate : {500, 1000, 2000, 4000, 8000})
+    {
+        build.Clear();
+        runLoad(false, 20 * txRate, txRate);
+        r.write({(double)txRate, (double)build.count(), build.min(),
+                 build.max(), build.GetSnapshot().getMedian(),
+                 build.GetSnapshot().get95thPercentile(),
+                 build.GetSnapshot().get99thPercentile()});
+    }
+}
+
 static void
 netTopologyTest(std::string const& name,
                 std::function<Simulation::pointer(int numNodes)> mkSim)
@@ -0,0 +1,58 @@
+
+#include "test/AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+std::atomic<uint64_t> gAllocationCount{0};
+}
+
+void*
+operator new(std::size_t size)
+{
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+    {
+        size = 1;
+    }
+    while (true)
+    {
+        if (void* p = std::malloc(size))
+        {
+            return p;
+        }
+        auto handler = std::get_new_handler();
+        if (!handler)
+        {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void
+operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace viichain
+{
+namespace testutil
+{
+uint64_t
+getAllocationCount()
+{
+    return gAllocationCount.load(std::memory_order_relaxed);
+}
+}
+}
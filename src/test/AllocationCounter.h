@@ -0,0 +1,14 @@
+#pragma once
+
+
+#include <cstdint>
+
+namespace viichain
+{
+namespace testutil
+{
+// Number of calls to the global operator new so far. Test builds replace
+// operator new to count them, from every thread.
+uint64_t getAllocationCount();
+}
+}
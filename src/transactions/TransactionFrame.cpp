@@ -4,6 +4,7 @@
 #include "OperationFrame.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "crypto/SignerKey.h"
 #include "database/Database.h"
 #include "database/DatabaseUtils.h"
@@ -16,6 +17,7 @@
 #include "main/Application.h"
 #include "transactions/SignatureChecker.h"
 #include "transactions/SignatureUtils.h"
+#include "transactions/TransactionHistoryBatch.h"
 #include "transactions/TransactionUtils.h"
 #include "util/Algoritm.h"
 #include "util/Decoder.h"
@@ -170,6 +172,67 @@ TransactionFrame::checkSignatureNoAccount(SignatureChecker& signatureChecker,
     return signatureChecker.checkSignature(accountID, signers, 0);
 }
 
+std::set<AccountID>
+TransactionFrame::getSourceAccountIDs() const
+{
+    std::set<AccountID> accounts{getSourceID()};
+    for (auto const& op : mOperations)
+    {
+        accounts.insert(op->getSourceID());
+    }
+    return accounts;
+}
+
+void
+TransactionFrame::addSignatureChecks(
+    std::set<PublicKey> const& keys,
+    std::vector<PubKeyUtils::SignatureCheck>& checks)
+{
+    for (auto const& sig : mEnvelope.signatures)
+    {
+        for (auto const& key : keys)
+        {
+            if (SignatureUtils::doesHintMatch(key.ed25519(), sig.hint))
+            {
+                checks.push_back({key, sig.signature, getContentsHash()});
+            }
+        }
+    }
+}
+
+void
+TransactionFrame::addSignatureChecks(
+    AbstractLedgerTxn& ltx, std::vector<PubKeyUtils::SignatureCheck>& checks)
+{
+    std::set<PublicKey> keys;
+    for (auto const& accountID : getSourceAccountIDs())
+    {
+        keys.insert(accountID);
+        auto account = ltx.loadWithoutRecord(accountKey(accountID));
+        if (!account)
+        {
+            continue;
+        }
+        for (auto const& signer : account.current().data.account().signers)
+        {
+            if (signer.key.type() == SIGNER_KEY_TYPE_ED25519)
+            {
+                keys.insert(KeyUtils::convertKey<PublicKey>(signer.key));
+            }
+        }
+    }
+    addSignatureChecks(keys, checks);
+}
+
+void
+TransactionFrame::addMasterKeySignatureChecks(
+    std::vector<PubKeyUtils::SignatureCheck>& checks)
+{
+    auto accounts = getSourceAccountIDs();
+    addSignatureChecks(std::set<PublicKey>(accounts.begin(), accounts.end()),
+                       checks);
+}
+
 LedgerTxnEntry
 TransactionFrame::loadSourceAccount(AbstractLedgerTxn& ltx,
                                     LedgerTxnHeader const& header)
@@ -225,6 +288,14 @@ TransactionFrame::resetResults(LedgerHeader const& header, int64_t baseFee)
     getResult().result.results().resize(
         (uint32_t)mEnvelope.tx.operations.size());
 
+    makeOperations();
+
+            getResult().feeCharged = getFee(header, baseFee);
+}
+
+void
+TransactionFrame::makeOperations()
+{
     mOperations.clear();
 
         for (size_t i = 0; i < mEnvelope.tx.operations.size(); i++)
@@ -233,8 +304,13 @@ TransactionFrame::resetResults(LedgerHeader const& header, int64_t baseFee)
             OperationFrame::makeHelper(mEnvelope.tx.operations[i],
                                        getResult().result.results()[i], *this));
     }
+}
 
-            getResult().feeCharged = getFee(header, baseFee);
+void
+TransactionFrame::restoreResult(TransactionResult const& result)
+{
+    mResult = result;
+    makeOperations();
 }
 
 bool
@@ -614,7 +690,7 @@ TransactionFrame::toVIIMessage() const
 }
 
 void
-TransactionFrame::storeTransaction(Database& db, uint32_t ledgerSeq,
+TransactionFrame::storeTransaction(TransactionHistoryBatch& batch,
                                    TransactionMeta& tm, int txindex,
                                    TransactionResultSet& resultSet) const
 {
@@ -636,32 +712,12 @@ TransactionFrame::storeTransaction(Database& db, uint32_t ledgerSeq,
 
     string txIDString(binToHex(getContentsHash()));
 
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txhistory "
-        "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
-        "(:id,  :seq,      :txindex, :txb,   :txres,   :meta)");
-
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txBody));
-    st.exchange(soci::use(txResult));
-    st.exchange(soci::use(meta));
-    st.define_and_bind();
-    {
-        auto timer = db.getInsertTimer("txhistory");
-        st.execute(true);
-    }
-
-    if (st.get_affected_rows() != 1)
-    {
-        throw std::runtime_error("Could not update data in SQL");
-    }
+    batch.addTransaction(std::move(txIDString), txindex, std::move(txBody),
+                         std::move(txResult), std::move(meta));
 }
 
 void
-TransactionFrame::storeTransactionFee(Database& db, uint32_t ledgerSeq,
+TransactionFrame::storeTransactionFee(TransactionHistoryBatch& batch,
                                       LedgerEntryChanges const& changes,
                                       int txindex) const
 {
@@ -672,26 +728,8 @@ TransactionFrame::storeTransactionFee(Database& db, uint32_t ledgerSeq,
 
     string txIDString(binToHex(getContentsHash()));
 
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txfeehistory "
-        "( txid, ledgerseq, txindex,  txchanges) VALUES "
-        "(:id,  :seq,      :txindex, :txchanges)");
-
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txChanges64));
-    st.define_and_bind();
-    {
-        auto timer = db.getInsertTimer("txfeehistory");
-        st.execute(true);
-    }
-
-    if (st.get_affected_rows() != 1)
-    {
-        throw std::runtime_error("Could not update data in SQL");
-    }
+    batch.addTransactionFee(std::move(txIDString), txindex,
+                            std::move(txChanges64));
 }
 
 static void
@@ -23,9 +23,15 @@ class LedgerTxnEntry;
 class LedgerTxnHeader;
 class SecretKey;
 class SignatureChecker;
+class TransactionHistoryBatch;
 class XDROutputFileStream;
 class SHA256;
 
+namespace PubKeyUtils
+{
+struct SignatureCheck;
+}
+
 class TransactionFrame;
 using TransactionFramePtr = std::shared_ptr<TransactionFrame>;
 
@@ -54,6 +60,11 @@ class TransactionFrame
                                       kFullyValid
     };
 
+    std::set<AccountID> getSourceAccountIDs() const;
+
+    void addSignatureChecks(std::set<PublicKey> const& keys,
+                            std::vector<PubKeyUtils::SignatureCheck>& checks);
+
     bool commonValidPreSeqNum(AbstractLedgerTxn& ltx, bool forApply);
 
     ValidationType commonValid(SignatureChecker& signatureChecker,
@@ -61,6 +72,7 @@ class TransactionFrame
                                SequenceNumber current, bool applying);
 
     void resetResults(LedgerHeader const& header, int64_t baseFee);
+    void makeOperations();
 
     void removeUsedOneTimeSignerKeys(SignatureChecker& signatureChecker,
                                      AbstractLedgerTxn& ltx);
@@ -153,6 +165,19 @@ class TransactionFrame
     bool checkSignatureNoAccount(SignatureChecker& signatureChecker,
                                  AccountID const& accountID);
 
+    // Appends a check for each pair of a signature and an ed25519 signer of
+    // the source accounts of the transaction or its operations whose hint
+    // matches it, so that they can be verified in one batch ahead of
+    // checkValid.
+    void addSignatureChecks(AbstractLedgerTxn& ltx,
+                            std::vector<PubKeyUtils::SignatureCheck>& checks);
+
+    // Like addSignatureChecks, but only tries the master keys of the source
+    // accounts. It does not read the ledger, so the checks can be verified
+    // away from the main thread.
+    void addMasterKeySignatureChecks(
+        std::vector<PubKeyUtils::SignatureCheck>& checks);
+
     bool checkValid(AbstractLedgerTxn& ltxOuter, SequenceNumber current);
 
         void processFeeSeqNum(AbstractLedgerTxn& ltx, int64_t baseFee);
@@ -162,16 +187,23 @@ class TransactionFrame
 
         bool apply(Application& app, AbstractLedgerTxn& ltx);
 
+    // Puts back a result saved after processFeeSeqNum, undoing an apply
+    // whose effects were discarded so that the transaction can be applied
+    // again.
+    void restoreResult(TransactionResult const& result);
+
     VIIMessage toVIIMessage() const;
 
     LedgerTxnEntry loadAccount(AbstractLedgerTxn& ltx,
                                LedgerTxnHeader const& header,
                                AccountID const& accountID);
 
-        void storeTransaction(Database& db, uint32_t ledgerSeq, TransactionMeta& tm,
+    // Appends the rows for txhistory and txfeehistory to batch, which writes
+    // them once the whole transaction set has been applied.
+    void storeTransaction(TransactionHistoryBatch& batch, TransactionMeta& tm,
                           int txindex, TransactionResultSet& resultSet) const;
 
-        void storeTransactionFee(Database& db, uint32_t ledgerSeq,
+    void storeTransactionFee(TransactionHistoryBatch& batch,
                              LedgerEntryChanges const& changes,
                              int txindex) const;
 
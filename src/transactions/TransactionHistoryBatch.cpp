@@ -0,0 +1,211 @@
+
+#include "transactions/TransactionHistoryBatch.h"
+#include "database/Database.h"
+#include "database/DatabaseUtils.h"
+#include "util/format.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace viichain
+{
+
+namespace
+{
+// Keeps the number of parameters of a multi-row insert under the 999 that
+// SQLite allows by default.
+size_t const SQLITE_ROWS_PER_INSERT = 100;
+
+// Inserts rows made of a txid, the ledger sequence, a txindex and a list of
+// text columns into one of the transaction history tables.
+class BulkInsertHistoryOperation : public DatabaseTypeSpecificOperation<void>
+{
+    Database& mDB;
+    std::string const mTable;
+    std::vector<std::string> const mColumns;
+    uint32_t mLedgerSeq;
+    std::vector<std::string> mTxIDs;
+    std::vector<int32_t> mTxIndexes;
+    std::vector<std::vector<std::string>> mValues;
+
+    std::string
+    insertInto() const
+    {
+        std::string sql =
+            "INSERT INTO " + mTable + " ( txid, ledgerseq, txindex";
+        for (auto const& column : mColumns)
+        {
+            sql += ", " + column;
+        }
+        return sql + " ) ";
+    }
+
+    void
+    execute(soci::statement& st, size_t rows)
+    {
+        st.define_and_bind();
+        {
+            auto timer = mDB.getInsertTimer(mTable);
+            st.execute(true);
+        }
+        if (static_cast<size_t>(st.get_affected_rows()) != rows)
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
+  public:
+    BulkInsertHistoryOperation(Database& db, std::string table,
+                               std::vector<std::string> columns,
+                               uint32_t ledgerSeq,
+                               std::vector<std::string>&& txIDs,
+                               std::vector<int32_t>&& txIndexes,
+                               std::vector<std::vector<std::string>>&& values)
+        : mDB(db)
+        , mTable(std::move(table))
+        , mColumns(std::move(columns))
+        , mLedgerSeq(ledgerSeq)
+        , mTxIDs(std::move(txIDs))
+        , mTxIndexes(std::move(txIndexes))
+        , mValues(std::move(values))
+    {
+        assert(mValues.size() == mColumns.size());
+    }
+
+    void
+    doSqliteSpecificOperation(soci::sqlite3_session_backend* sq) override
+    {
+        for (size_t begin = 0; begin < mTxIDs.size();
+             begin += SQLITE_ROWS_PER_INSERT)
+        {
+            auto end = std::min(mTxIDs.size(), begin + SQLITE_ROWS_PER_INSERT);
+            std::string sql = insertInto() + "VALUES ";
+            for (size_t row = 0; row < end - begin; ++row)
+            {
+                sql += fmt::format("{0}(:id{1}, :seq{1}, :idx{1}",
+                                   row == 0 ? "" : ", ", row);
+                for (size_t col = 0; col < mColumns.size(); ++col)
+                {
+                    sql += fmt::format(", :v{}_{}", col, row);
+                }
+                sql += ")";
+            }
+
+            auto prep = mDB.getPreparedStatement(sql);
+            soci::statement& st = prep.statement();
+            for (size_t i = begin; i < end; ++i)
+            {
+                st.exchange(soci::use(mTxIDs[i]));
+                st.exchange(soci::use(mLedgerSeq));
+                st.exchange(soci::use(mTxIndexes[i]));
+                for (auto& values : mValues)
+                {
+                    st.exchange(soci::use(values[i]));
+                }
+            }
+            execute(st, end - begin);
+        }
+    }
+
+#ifdef USE_POSTGRES
+    void
+    doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
+    {
+        PGconn* conn = pg->conn_;
+        std::string strTxIDs, strTxIndexes;
+        std::vector<std::string> strValues(mValues.size());
+        marshalToPGArray(conn, strTxIDs, mTxIDs);
+        marshalToPGArray(conn, strTxIndexes, mTxIndexes);
+        for (size_t col = 0; col < mValues.size(); ++col)
+        {
+            marshalToPGArray(conn, strValues[col], mValues[col]);
+        }
+
+        std::string sql = "WITH r AS (SELECT "
+                          "unnest(:ids::TEXT[]), "
+                          ":seq::INT, "
+                          "unnest(:idx::INT[])";
+        for (size_t col = 0; col < mColumns.size(); ++col)
+        {
+            sql += fmt::format(", unnest(:v{}::TEXT[])", col);
+        }
+        sql += ") " + insertInto() + "SELECT * FROM r";
+
+        auto prep = mDB.getPreparedStatement(sql);
+        soci::statement& st = prep.statement();
+        st.exchange(soci::use(strTxIDs));
+        st.exchange(soci::use(mLedgerSeq));
+        st.exchange(soci::use(strTxIndexes));
+        for (auto& values : strValues)
+        {
+            st.exchange(soci::use(values));
+        }
+        execute(st, mTxIDs.size());
+    }
+#endif
+};
+}
+
+TransactionHistoryBatch::TransactionHistoryBatch(uint32_t ledgerSeq)
+    : mLedgerSeq(ledgerSeq)
+{
+}
+
+void
+TransactionHistoryBatch::addTransaction(std::string txID, int32_t txIndex,
+                                        std::string txBody,
+                                        std::string txResult,
+                                        std::string txMeta)
+{
+    mTxIDs.emplace_back(std::move(txID));
+    mTxIndexes.emplace_back(txIndex);
+    mTxBodies.emplace_back(std::move(txBody));
+    mTxResults.emplace_back(std::move(txResult));
+    mTxMetas.emplace_back(std::move(txMeta));
+}
+
+void
+TransactionHistoryBatch::addTransactionFee(std::string txID, int32_t txIndex,
+                                           std::string txChanges)
+{
+    mFeeTxIDs.emplace_back(std::move(txID));
+    mFeeTxIndexes.emplace_back(txIndex);
+    mFeeTxChanges.emplace_back(std::move(txChanges));
+}
+
+void
+TransactionHistoryBatch::flush(Database& db)
+{
+    if (!mFeeTxIDs.empty())
+    {
+        std::vector<std::vector<std::string>> values;
+        values.emplace_back(std::move(mFeeTxChanges));
+        BulkInsertHistoryOperation op(db, "txfeehistory", {"txchanges"},
+                                      mLedgerSeq, std::move(mFeeTxIDs),
+                                      std::move(mFeeTxIndexes),
+                                      std::move(values));
+        db.doDatabaseTypeSpecificOperation(op);
+    }
+
+    if (!mTxIDs.empty())
+    {
+        std::vector<std::vector<std::string>> values;
+        values.emplace_back(std::move(mTxBodies));
+        values.emplace_back(std::move(mTxResults));
+        values.emplace_back(std::move(mTxMetas));
+        BulkInsertHistoryOperation op(
+            db, "txhistory", {"txbody", "txresult", "txmeta"}, mLedgerSeq,
+            std::move(mTxIDs), std::move(mTxIndexes), std::move(values));
+        db.doDatabaseTypeSpecificOperation(op);
+    }
+
+    mTxIDs.clear();
+    mTxIndexes.clear();
+    mTxBodies.clear();
+    mTxResults.clear();
+    mTxMetas.clear();
+    mFeeTxIDs.clear();
+    mFeeTxIndexes.clear();
+    mFeeTxChanges.clear();
+}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace viichain
+{
+
+class Database;
+
+// Collects the txhistory and txfeehistory rows of the ledger being closed so
+// that they are written with a few bulk inserts once every transaction has
+// been applied, rather than with one insert per transaction.
+class TransactionHistoryBatch : public NonMovableOrCopyable
+{
+    uint32_t const mLedgerSeq;
+
+    std::vector<std::string> mTxIDs;
+    std::vector<int32_t> mTxIndexes;
+    std::vector<std::string> mTxBodies;
+    std::vector<std::string> mTxResults;
+    std::vector<std::string> mTxMetas;
+
+    std::vector<std::string> mFeeTxIDs;
+    std::vector<int32_t> mFeeTxIndexes;
+    std::vector<std::string> mFeeTxChanges;
+
+  public:
+    explicit TransactionHistoryBatch(uint32_t ledgerSeq);
+
+    void addTransaction(std::string txID, int32_t txIndex, std::string txBody,
+                        std::string txResult, std::string txMeta);
+
+    void addTransactionFee(std::string txID, int32_t txIndex,
+                           std::string txChanges);
+
+    // Inserts every row added since the last flush and clears the batch.
+    void flush(Database& db);
+};
+}
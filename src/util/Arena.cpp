@@ -0,0 +1,57 @@
+
+#include "util/Arena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace viichain
+{
+
+constexpr size_t Arena::kMinChunkSize;
+constexpr size_t Arena::kMaxChunkSize;
+
+void*
+Arena::allocate(size_t size, size_t alignment)
+{
+    assert(alignment != 0 && alignment <= alignof(std::max_align_t));
+
+    auto pad = (alignment - reinterpret_cast<uintptr_t>(mCur) % alignment) %
+               alignment;
+    if (!mCur || pad + size > mAvailable)
+    {
+        // Oversized requests get a chunk of their own so that the rest of
+        // the current chunk stays usable.
+        if (size > mNextChunkSize / 2)
+        {
+            mChunks.emplace_back(new char[size]);
+            mBytesAllocated += size;
+            return mChunks.back().get();
+        }
+
+        mChunks.emplace_back(new char[mNextChunkSize]);
+        mCur = mChunks.back().get();
+        mAvailable = mNextChunkSize;
+        mNextChunkSize = std::min(mNextChunkSize * 2, kMaxChunkSize);
+        pad = 0;
+    }
+
+    void* res = mCur + pad;
+    mCur += pad + size;
+    mAvailable -= pad + size;
+    mBytesAllocated += size;
+    return res;
+}
+
+size_t
+Arena::bytesAllocated() const
+{
+    return mBytesAllocated;
+}
+
+size_t
+Arena::numChunks() const
+{
+    return mChunks.size();
+}
+}
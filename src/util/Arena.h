@@ -0,0 +1,81 @@
+#pragma once
+
+
+#include "util/NonCopyable.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace viichain
+{
+
+// A bump allocator for objects that die together. Memory is handed out from
+// chunks of growing size and is only returned when the arena is destroyed.
+class Arena : public NonMovableOrCopyable
+{
+    std::vector<std::unique_ptr<char[]>> mChunks;
+    char* mCur{nullptr};
+    size_t mAvailable{0};
+    size_t mNextChunkSize{kMinChunkSize};
+    size_t mBytesAllocated{0};
+
+  public:
+    static constexpr size_t kMinChunkSize = 4 * 1024;
+    static constexpr size_t kMaxChunkSize = 1024 * 1024;
+
+    void* allocate(size_t size, size_t alignment);
+
+    // Bytes handed out so far, not counting padding or unused chunk tails.
+    size_t bytesAllocated() const;
+    size_t numChunks() const;
+};
+
+// Allocates from an arena and never frees. Every copy of the allocator,
+// including the ones std::allocate_shared keeps in its control blocks, holds
+// a reference to the arena, so the arena lives as long as any object in it.
+template <typename T> class ArenaAllocator
+{
+    template <typename U> friend class ArenaAllocator;
+
+    std::shared_ptr<Arena> mArena;
+
+  public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(std::shared_ptr<Arena> arena)
+        : mArena(std::move(arena))
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const& other) : mArena(other.mArena)
+    {
+    }
+
+    T*
+    allocate(size_t n)
+    {
+        return static_cast<T*>(mArena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void
+    deallocate(T*, size_t)
+    {
+    }
+
+    template <typename U>
+    bool
+    operator==(ArenaAllocator<U> const& other) const
+    {
+        return mArena == other.mArena;
+    }
+
+    template <typename U>
+    bool
+    operator!=(ArenaAllocator<U> const& other) const
+    {
+        return mArena != other.mArena;
+    }
+};
+}
@@ -0,0 +1,304 @@
+
+#include "util/BlockCompressedFile.h"
+#include "util/FileSystemException.h"
+#include "util/Fs.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace viichain
+{
+
+namespace
+{
+char const kMagic[8] = {'V', 'I', 'I', 'B', 'Z', 'S', 'T', '1'};
+size_t const kTrailerSize = 4 * 8 + sizeof(kMagic);
+int const kCompressionLevel = 3;
+
+void
+putUint64(char* p, uint64_t v)
+{
+    for (int i = 7; i >= 0; --i)
+    {
+        p[i] = static_cast<char>(v & 0xff);
+        v >>= 8;
+    }
+}
+
+uint64_t
+getUint64(char const* p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        v = (v << 8) | static_cast<unsigned char>(p[i]);
+    }
+    return v;
+}
+
+int
+seekFile(std::FILE* file, uint64_t pos, int whence)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(pos), whence);
+#else
+    return fseeko(file, static_cast<off_t>(pos), whence);
+#endif
+}
+
+void
+readExactly(std::FILE* file, uint64_t pos, char* out, size_t n)
+{
+    if (seekFile(file, pos, SEEK_SET) != 0 ||
+        std::fread(out, 1, n, file) != n)
+    {
+        throw FileSystemException("malformed compressed bucket file");
+    }
+}
+
+struct FileCloser
+{
+    void
+    operator()(std::FILE* f) const
+    {
+        std::fclose(f);
+    }
+};
+
+std::unique_ptr<std::FILE, FileCloser>
+openFile(std::string const& filename, char const* mode)
+{
+    std::unique_ptr<std::FILE, FileCloser> f(
+        std::fopen(filename.c_str(), mode));
+    if (!f)
+    {
+        throw FileSystemException("failed to open file: " + filename +
+                                  ", reason: " + std::to_string(errno));
+    }
+    return f;
+}
+
+#ifndef USE_ZSTD
+[[noreturn]] void
+throwNoZstd()
+{
+    throw FileSystemException(
+        "compressed bucket files need vii-core built with zstd");
+}
+#endif
+}
+
+bool
+BlockCompressedReader::isCompressed(std::FILE* file)
+{
+    char magic[sizeof(kMagic)];
+    return seekFile(file, 0, SEEK_SET) == 0 &&
+           std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+           std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool
+BlockCompressedReader::isCompressed(std::string const& filename)
+{
+    return isCompressed(openFile(filename, "rb").get());
+}
+
+size_t
+BlockCompressedReader::contentSize(std::string const& filename)
+{
+    auto f = openFile(filename, "rb");
+    if (!isCompressed(f.get()))
+    {
+        return fs::size(filename);
+    }
+    return BlockCompressedReader(f.get()).size();
+}
+
+void
+BlockCompressedReader::decompressFile(std::string const& from,
+                                      std::string const& to)
+{
+    auto in = openFile(from, "rb");
+    auto out = openFile(to, "wb");
+    BlockCompressedReader reader(in.get());
+    std::vector<char> block(reader.blockSize());
+    for (size_t i = 0; i + 1 < reader.mOffsets.size(); ++i)
+    {
+        auto n = reader.readBlock(i, block.data());
+        if (std::fwrite(block.data(), 1, n, out.get()) != n)
+        {
+            throw FileSystemException("failed to write file: " + to);
+        }
+    }
+    if (std::fclose(out.release()) != 0)
+    {
+        throw FileSystemException("failed to close file: " + to);
+    }
+}
+
+BlockCompressedReader::BlockCompressedReader(std::FILE* file) : mFile(file)
+{
+    if (seekFile(mFile, 0, SEEK_END) != 0)
+    {
+        throw FileSystemException("failed to seek compressed bucket file");
+    }
+#ifdef _WIN32
+    uint64_t fileSize = static_cast<uint64_t>(_ftelli64(mFile));
+#else
+    uint64_t fileSize = static_cast<uint64_t>(ftello(mFile));
+#endif
+    if (fileSize < sizeof(kMagic) + kTrailerSize)
+    {
+        throw FileSystemException("malformed compressed bucket file");
+    }
+
+    char trailer[kTrailerSize];
+    readExactly(mFile, fileSize - kTrailerSize, trailer, kTrailerSize);
+    mBlockSize = getUint64(trailer);
+    mSize = getUint64(trailer + 8);
+    uint64_t nBlocks = getUint64(trailer + 16);
+    uint64_t indexOffset = getUint64(trailer + 24);
+    if (std::memcmp(trailer + 32, kMagic, sizeof(kMagic)) != 0 ||
+        mBlockSize == 0 || mBlockSize > (1 << 30) ||
+        nBlocks != (mSize + mBlockSize - 1) / mBlockSize ||
+        indexOffset + nBlocks * 8 + kTrailerSize != fileSize)
+    {
+        throw FileSystemException("malformed compressed bucket file");
+    }
+
+    std::vector<char> index(nBlocks * 8);
+    readExactly(mFile, indexOffset, index.data(), index.size());
+    mOffsets.reserve(nBlocks + 1);
+    for (uint64_t i = 0; i < nBlocks; ++i)
+    {
+        mOffsets.emplace_back(getUint64(index.data() + i * 8));
+    }
+    mOffsets.emplace_back(indexOffset);
+    for (size_t i = 0; i + 1 < mOffsets.size(); ++i)
+    {
+        if (mOffsets[i] > mOffsets[i + 1])
+        {
+            throw FileSystemException("malformed compressed bucket file");
+        }
+    }
+}
+
+size_t
+BlockCompressedReader::size() const
+{
+    return mSize;
+}
+
+size_t
+BlockCompressedReader::blockSize() const
+{
+    return mBlockSize;
+}
+
+size_t
+BlockCompressedReader::readBlock(size_t i, char* out)
+{
+    if (i + 1 >= mOffsets.size())
+    {
+        throw FileSystemException("compressed block out of range");
+    }
+    mFrame.resize(mOffsets[i + 1] - mOffsets[i]);
+    readExactly(mFile, mOffsets[i], mFrame.data(), mFrame.size());
+    size_t expected = std::min<uint64_t>(mBlockSize, mSize - i * mBlockSize);
+#ifdef USE_ZSTD
+    auto n = ZSTD_decompress(out, mBlockSize, mFrame.data(), mFrame.size());
+    if (ZSTD_isError(n) || n != expected)
+    {
+        throw FileSystemException("malformed compressed bucket block");
+    }
+    return n;
+#else
+    (void)out;
+    (void)expected;
+    throwNoZstd();
+#endif
+}
+
+BlockCompressedWriter::BlockCompressedWriter(std::FILE* file) : mFile(file)
+{
+#ifndef USE_ZSTD
+    throwNoZstd();
+#endif
+    mBlock.reserve(BlockCompressedReader::kBlockSize);
+    writeFile(kMagic, sizeof(kMagic));
+}
+
+void
+BlockCompressedWriter::writeFile(char const* data, size_t n)
+{
+    if (std::fwrite(data, 1, n, mFile) != n)
+    {
+        throw FileSystemException("failed to write compressed bucket file");
+    }
+    mFileOffset += n;
+}
+
+void
+BlockCompressedWriter::compressBlock()
+{
+#ifdef USE_ZSTD
+    mFrame.resize(ZSTD_compressBound(mBlock.size()));
+    auto n = ZSTD_compress(mFrame.data(), mFrame.size(), mBlock.data(),
+                           mBlock.size(), kCompressionLevel);
+    if (ZSTD_isError(n))
+    {
+        throw FileSystemException(
+            std::string("failed to compress bucket block: ") +
+            ZSTD_getErrorName(n));
+    }
+    mOffsets.emplace_back(mFileOffset);
+    writeFile(mFrame.data(), n);
+    mBlock.clear();
+#endif
+}
+
+void
+BlockCompressedWriter::write(char const* data, size_t n)
+{
+    while (n > 0)
+    {
+        auto k = std::min(n, BlockCompressedReader::kBlockSize - mBlock.size());
+        mBlock.insert(mBlock.end(), data, data + k);
+        data += k;
+        n -= k;
+        mSize += k;
+        if (mBlock.size() == BlockCompressedReader::kBlockSize)
+        {
+            compressBlock();
+        }
+    }
+}
+
+void
+BlockCompressedWriter::finish()
+{
+    if (!mBlock.empty())
+    {
+        compressBlock();
+    }
+    uint64_t indexOffset = mFileOffset;
+    std::vector<char> tail(mOffsets.size() * 8 + kTrailerSize);
+    for (size_t i = 0; i < mOffsets.size(); ++i)
+    {
+        putUint64(tail.data() + i * 8, mOffsets[i]);
+    }
+    char* trailer = tail.data() + mOffsets.size() * 8;
+    putUint64(trailer, BlockCompressedReader::kBlockSize);
+    putUint64(trailer + 8, mSize);
+    putUint64(trailer + 16, mOffsets.size());
+    putUint64(trailer + 24, indexOffset);
+    std::memcpy(trailer + 32, kMagic, sizeof(kMagic));
+    writeFile(tail.data(), tail.size());
+}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace viichain
+{
+
+// A byte stream stored as independently zstd-compressed blocks of
+// kBlockSize bytes, so that readers can seek to any offset of the
+// uncompressed stream by decompressing one block. The file starts with a
+// magic number whose first byte has its high bit clear, which tells it apart
+// from a raw XDR record stream. After the blocks come the file offsets of
+// the blocks and a trailer with the block size, stream size and block count.
+//
+// Both classes throw FileSystemException when vii-core is built without
+// zstd.
+class BlockCompressedReader : public NonMovableOrCopyable
+{
+    std::FILE* mFile;
+    uint64_t mBlockSize{0};
+    uint64_t mSize{0};
+    std::vector<uint64_t> mOffsets;
+    std::vector<char> mFrame;
+
+  public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    // The file position is left at an unspecified offset.
+    static bool isCompressed(std::FILE* file);
+    static bool isCompressed(std::string const& filename);
+
+    // Size of the uncompressed stream in filename, compressed or not.
+    static size_t contentSize(std::string const& filename);
+
+    // Writes the uncompressed stream of from to the file to.
+    static void decompressFile(std::string const& from, std::string const& to);
+
+    // Reads the block index of file, which stays owned by the caller.
+    explicit BlockCompressedReader(std::FILE* file);
+
+    size_t size() const;
+    size_t blockSize() const;
+
+    // Decompresses block i into out, which must have room for blockSize()
+    // bytes, and returns its length.
+    size_t readBlock(size_t i, char* out);
+};
+
+class BlockCompressedWriter : public NonMovableOrCopyable
+{
+    std::FILE* mFile;
+    std::vector<char> mBlock;
+    std::vector<char> mFrame;
+    std::vector<uint64_t> mOffsets;
+    uint64_t mFileOffset{0};
+    uint64_t mSize{0};
+
+    void writeFile(char const* data, size_t n);
+    void compressBlock();
+
+  public:
+    // Writes the magic number to file, which stays owned by the caller.
+    explicit BlockCompressedWriter(std::FILE* file);
+
+    void write(char const* data, size_t n);
+
+    // Writes the last partial block, the block offsets and the trailer.
+    void finish();
+};
+}
@@ -0,0 +1,80 @@
+
+#include "util/FrequencySketch.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace viichain
+{
+
+constexpr size_t FrequencySketch::kRows;
+
+FrequencySketch::FrequencySketch(size_t expectedKeys)
+{
+    if (expectedKeys == 0)
+    {
+        return;
+    }
+    size_t width = 16;
+    while (width < expectedKeys)
+    {
+        width <<= 1;
+    }
+    mCounters.resize(kRows * width);
+    mMask = width - 1;
+    mResetThreshold = 10 * width;
+}
+
+size_t
+FrequencySketch::index(size_t row, size_t hash) const
+{
+    // Remixes the hash with a different odd constant for each row, as
+    // std::hash is the identity for integers.
+    static uint64_t const seeds[kRows] = {
+        0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL,
+        0xd6e8feb86659fd93ULL};
+    uint64_t h = (static_cast<uint64_t>(hash) + row) * seeds[row];
+    h ^= h >> 31;
+    return row * (mMask + 1) + (static_cast<size_t>(h) & mMask);
+}
+
+void
+FrequencySketch::add(size_t hash)
+{
+    if (mCounters.empty())
+    {
+        return;
+    }
+    for (size_t row = 0; row < kRows; ++row)
+    {
+        auto& counter = mCounters[index(row, hash)];
+        if (counter < std::numeric_limits<uint8_t>::max())
+        {
+            ++counter;
+        }
+    }
+    if (++mAdditions >= mResetThreshold)
+    {
+        for (auto& counter : mCounters)
+        {
+            counter >>= 1;
+        }
+        mAdditions = 0;
+    }
+}
+
+uint8_t
+FrequencySketch::estimate(size_t hash) const
+{
+    if (mCounters.empty())
+    {
+        return 0;
+    }
+    uint8_t res = std::numeric_limits<uint8_t>::max();
+    for (size_t row = 0; row < kRows; ++row)
+    {
+        res = std::min(res, mCounters[index(row, hash)]);
+    }
+    return res;
+}
+}
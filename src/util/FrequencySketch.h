@@ -0,0 +1,35 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace viichain
+{
+
+// Estimates how often keys were seen recently, given their hashes, in a
+// count-min sketch of four rows of saturating 8-bit counters. Estimates can
+// only be too high, by the counts of colliding keys. Once the sketch has
+// recorded ten times as many keys as it has columns, every counter is halved
+// so that old accesses fade away.
+class FrequencySketch
+{
+    static constexpr size_t kRows = 4;
+
+    std::vector<uint8_t> mCounters;
+    size_t mMask{0};
+    size_t mAdditions{0};
+    size_t mResetThreshold{0};
+
+    size_t index(size_t row, size_t hash) const;
+
+  public:
+    // The sketch keeps about expectedKeys keys apart. 0 makes a sketch that
+    // records nothing and estimates 0 for every key.
+    explicit FrequencySketch(size_t expectedKeys);
+
+    void add(size_t hash);
+    uint8_t estimate(size_t hash) const;
+};
+}
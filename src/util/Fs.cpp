@@ -141,6 +141,30 @@ findfiles(std::string const& p,
     return res;
 }
 
+void
+syncFile(std::string const& path)
+{
+    HANDLE h = CreateFile(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        throw FileSystemException("unable to open file to sync: " + path);
+    }
+    BOOL ok = FlushFileBuffers(h);
+    CloseHandle(h);
+    if (!ok)
+    {
+        throw FileSystemException("unable to sync file: " + path);
+    }
+}
+
+void
+syncDirectory(std::string const& path)
+{
+    // NTFS makes renames durable with its journal; directories can't be
+    // flushed through FlushFileBuffers.
+}
+
 #else
 #include <cerrno>
 #include <fcntl.h>
@@ -294,6 +318,42 @@ findfiles(std::string const& path,
     }
 }
 
+static void
+syncPath(std::string const& path, bool dataOnly)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        throw FileSystemException("unable to open path to sync: " + path +
+                                  " (" + strerror(errno) + ")");
+    }
+#ifdef __APPLE__
+    (void)dataOnly;
+    int r = fsync(fd);
+#else
+    int r = dataOnly ? fdatasync(fd) : fsync(fd);
+#endif
+    int err = errno;
+    close(fd);
+    if (r != 0)
+    {
+        throw FileSystemException("unable to sync path: " + path + " (" +
+                                  strerror(err) + ")");
+    }
+}
+
+void
+syncFile(std::string const& path)
+{
+    syncPath(path, true);
+}
+
+void
+syncDirectory(std::string const& path)
+{
+    syncPath(path, false);
+}
+
 #endif
 
 PathSplitter::PathSplitter(std::string path) : mPath{std::move(path)}, mPos{0}
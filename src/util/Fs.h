@@ -26,6 +26,13 @@ std::vector<std::string>
 findfiles(std::string const& path,
           std::function<bool(std::string const& name)> predicate);
 
+// Flushes a file's contents to stable storage.
+void syncFile(std::string const& path);
+
+// Flushes a directory's entries, such as files renamed into it, to stable
+// storage.
+void syncDirectory(std::string const& path);
+
 size_t size(std::ifstream& ifs);
 
 size_t size(std::string const& path);
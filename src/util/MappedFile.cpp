@@ -0,0 +1,95 @@
+
+#include "util/MappedFile.h"
+#include "util/FileSystemException.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace viichain
+{
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string const& filename)
+{
+    throw FileSystemException("memory-mapped files are not supported: " +
+                              filename);
+}
+
+MappedFile::~MappedFile()
+{
+}
+
+#else
+
+namespace
+{
+std::string
+mapErrorMessage(std::string const& filename)
+{
+    std::string msg("failed to map file: ");
+    msg += filename;
+    msg += ", reason: ";
+    msg += std::to_string(errno);
+    return msg;
+}
+}
+
+MappedFile::MappedFile(std::string const& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw FileSystemException(mapErrorMessage(filename));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        auto msg = mapErrorMessage(filename);
+        ::close(fd);
+        throw FileSystemException(msg);
+    }
+    mSize = static_cast<size_t>(st.st_size);
+
+    if (mSize > 0)
+    {
+        void* p = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            auto msg = mapErrorMessage(filename);
+            ::close(fd);
+            throw FileSystemException(msg);
+        }
+        mData = static_cast<char const*>(p);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+    {
+        munmap(const_cast<char*>(mData), mSize);
+    }
+}
+
+#endif
+
+char const*
+MappedFile::data() const
+{
+    return mData;
+}
+
+size_t
+MappedFile::size() const
+{
+    return mSize;
+}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+
+#include "util/NonCopyable.h"
+
+#include <cstddef>
+#include <string>
+
+namespace viichain
+{
+
+// Read-only memory mapping of a whole file. The mapping stays valid after
+// the file is unlinked, until the MappedFile is destroyed.
+class MappedFile : public NonMovableOrCopyable
+{
+    char const* mData{nullptr};
+    size_t mSize{0};
+
+  public:
+    // Throws FileSystemException if the file can't be mapped, including on
+    // platforms without mmap support.
+    explicit MappedFile(std::string const& filename);
+    ~MappedFile();
+
+    char const* data() const;
+    size_t size() const;
+};
+}
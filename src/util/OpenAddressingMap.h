@@ -0,0 +1,397 @@
+#pragma once
+
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace viichain
+{
+
+// A hash map that stores its elements inline in one array and resolves
+// collisions by linear probing. Each slot keeps the hash of its key, so
+// growing the table never rehashes a key and probes compare hashes before
+// keys. Erasing shifts later elements of the probe sequence back instead of
+// leaving tombstones.
+//
+// Unlike std::unordered_map, any insertion or erasure invalidates all
+// iterators and references, keys and values must be default constructible,
+// and erase(iterator) returns nothing.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class OpenAddressingMap
+{
+  public:
+    typedef std::pair<K, V> value_type;
+
+  private:
+    // The top bit marks a slot as used, so a stored hash is never 0.
+    static constexpr size_t kUsed = size_t(1)
+                                    << (std::numeric_limits<size_t>::digits - 1);
+
+    struct Slot
+    {
+        size_t mHash{0};
+        value_type mValue;
+    };
+
+    std::vector<Slot> mSlots;
+    size_t mSize{0};
+    Hash mHasher;
+
+    size_t
+    hashOf(K const& key) const
+    {
+        return mHasher(key) | kUsed;
+    }
+
+    size_t
+    mask() const
+    {
+        return mSlots.size() - 1;
+    }
+
+    // Index of the slot holding key, or of the empty slot where it belongs.
+    size_t
+    probe(K const& key, size_t hash) const
+    {
+        auto i = hash & mask();
+        while (mSlots[i].mHash != 0 &&
+               !(mSlots[i].mHash == hash && mSlots[i].mValue.first == key))
+        {
+            i = (i + 1) & mask();
+        }
+        return i;
+    }
+
+    void
+    rehash(size_t capacity)
+    {
+        std::vector<Slot> old(capacity);
+        old.swap(mSlots);
+        for (auto& slot : old)
+        {
+            if (slot.mHash != 0)
+            {
+                auto i = slot.mHash & mask();
+                while (mSlots[i].mHash != 0)
+                {
+                    i = (i + 1) & mask();
+                }
+                mSlots[i] = std::move(slot);
+            }
+        }
+    }
+
+    // Keeps the load factor at or below 3/4.
+    void
+    growFor(size_t n)
+    {
+        size_t capacity = mSlots.empty() ? 8 : mSlots.size();
+        while (n * 4 > capacity * 3)
+        {
+            capacity *= 2;
+        }
+        if (capacity != mSlots.size())
+        {
+            rehash(capacity);
+        }
+    }
+
+    void
+    eraseSlot(size_t i)
+    {
+        auto j = i;
+        while (true)
+        {
+            j = (j + 1) & mask();
+            if (mSlots[j].mHash == 0)
+            {
+                break;
+            }
+            // Move slot j back into the hole at i unless its home slot lies
+            // cyclically in (i, j].
+            auto home = mSlots[j].mHash & mask();
+            bool homeBetween = i <= j ? (i < home && home <= j)
+                                      : (i < home || home <= j);
+            if (!homeBetween)
+            {
+                mSlots[i] = std::move(mSlots[j]);
+                i = j;
+            }
+        }
+        mSlots[i] = Slot();
+        --mSize;
+    }
+
+    template <typename SlotPtr, typename Value> class IteratorBase
+    {
+        friend class OpenAddressingMap;
+        template <typename, typename> friend class IteratorBase;
+        SlotPtr mSlot;
+        SlotPtr mEnd;
+
+        void
+        skipUnused()
+        {
+            while (mSlot != mEnd && mSlot->mHash == 0)
+            {
+                ++mSlot;
+            }
+        }
+
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Value value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Value* pointer;
+        typedef Value& reference;
+
+        IteratorBase() : mSlot(nullptr), mEnd(nullptr)
+        {
+        }
+
+        IteratorBase(SlotPtr slot, SlotPtr end) : mSlot(slot), mEnd(end)
+        {
+            skipUnused();
+        }
+
+        template <typename OtherPtr, typename OtherValue>
+        IteratorBase(IteratorBase<OtherPtr, OtherValue> const& other)
+            : mSlot(other.mSlot), mEnd(other.mEnd)
+        {
+        }
+
+        reference operator*() const
+        {
+            return mSlot->mValue;
+        }
+
+        pointer operator->() const
+        {
+            return &mSlot->mValue;
+        }
+
+        IteratorBase& operator++()
+        {
+            ++mSlot;
+            skipUnused();
+            return *this;
+        }
+
+        IteratorBase operator++(int)
+        {
+            auto res = *this;
+            ++*this;
+            return res;
+        }
+
+        template <typename OtherPtr, typename OtherValue>
+        bool
+        operator==(IteratorBase<OtherPtr, OtherValue> const& other) const
+        {
+            return mSlot == other.mSlot;
+        }
+
+        template <typename OtherPtr, typename OtherValue>
+        bool
+        operator!=(IteratorBase<OtherPtr, OtherValue> const& other) const
+        {
+            return mSlot != other.mSlot;
+        }
+    };
+
+  public:
+    typedef IteratorBase<Slot*, value_type> iterator;
+    typedef IteratorBase<Slot const*, value_type const> const_iterator;
+
+    OpenAddressingMap() = default;
+
+    explicit OpenAddressingMap(size_t n)
+    {
+        reserve(n);
+    }
+
+    iterator
+    begin()
+    {
+        return iterator(mSlots.data(), mSlots.data() + mSlots.size());
+    }
+
+    iterator
+    end()
+    {
+        auto e = mSlots.data() + mSlots.size();
+        return iterator(e, e);
+    }
+
+    const_iterator
+    begin() const
+    {
+        return const_iterator(mSlots.data(), mSlots.data() + mSlots.size());
+    }
+
+    const_iterator
+    end() const
+    {
+        auto e = mSlots.data() + mSlots.size();
+        return const_iterator(e, e);
+    }
+
+    const_iterator
+    cbegin() const
+    {
+        return begin();
+    }
+
+    const_iterator
+    cend() const
+    {
+        return end();
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+
+    bool
+    empty() const
+    {
+        return mSize == 0;
+    }
+
+    void
+    reserve(size_t n)
+    {
+        growFor(n);
+    }
+
+    void
+    clear()
+    {
+        if (mSize != 0)
+        {
+            for (auto& slot : mSlots)
+            {
+                slot = Slot();
+            }
+            mSize = 0;
+        }
+    }
+
+    void
+    swap(OpenAddressingMap& other)
+    {
+        mSlots.swap(other.mSlots);
+        std::swap(mSize, other.mSize);
+        std::swap(mHasher, other.mHasher);
+    }
+
+    iterator
+    find(K const& key)
+    {
+        if (mSize == 0)
+        {
+            return end();
+        }
+        auto i = probe(key, hashOf(key));
+        return mSlots[i].mHash == 0
+                   ? end()
+                   : iterator(mSlots.data() + i,
+                              mSlots.data() + mSlots.size());
+    }
+
+    const_iterator
+    find(K const& key) const
+    {
+        if (mSize == 0)
+        {
+            return end();
+        }
+        auto i = probe(key, hashOf(key));
+        return mSlots[i].mHash == 0
+                   ? end()
+                   : const_iterator(mSlots.data() + i,
+                                    mSlots.data() + mSlots.size());
+    }
+
+    size_t
+    count(K const& key) const
+    {
+        return find(key) == end() ? 0 : 1;
+    }
+
+    V&
+    at(K const& key)
+    {
+        auto iter = find(key);
+        if (iter == end())
+        {
+            throw std::out_of_range("OpenAddressingMap::at");
+        }
+        return iter->second;
+    }
+
+    V const&
+    at(K const& key) const
+    {
+        auto iter = find(key);
+        if (iter == end())
+        {
+            throw std::out_of_range("OpenAddressingMap::at");
+        }
+        return iter->second;
+    }
+
+    template <typename KArg, typename VArg>
+    std::pair<iterator, bool>
+    emplace(KArg&& key, VArg&& value)
+    {
+        growFor(mSize + 1);
+        auto hash = hashOf(key);
+        auto i = probe(key, hash);
+        bool inserted = mSlots[i].mHash == 0;
+        if (inserted)
+        {
+            mSlots[i].mHash = hash;
+            mSlots[i].mValue.first = std::forward<KArg>(key);
+            mSlots[i].mValue.second = std::forward<VArg>(value);
+            ++mSize;
+        }
+        return {iterator(mSlots.data() + i, mSlots.data() + mSlots.size()),
+                inserted};
+    }
+
+    V& operator[](K const& key)
+    {
+        return emplace(key, V()).first->second;
+    }
+
+    size_t
+    erase(K const& key)
+    {
+        if (mSize == 0)
+        {
+            return 0;
+        }
+        auto i = probe(key, hashOf(key));
+        if (mSlots[i].mHash == 0)
+        {
+            return 0;
+        }
+        eraseSlot(i);
+        return 1;
+    }
+
+    void
+    erase(const_iterator iter)
+    {
+        eraseSlot(static_cast<size_t>(iter.mSlot - mSlots.data()));
+    }
+};
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "util/FrequencySketch.h"
 #include "util/Math.h"
 #include "util/NonCopyable.h"
 
@@ -9,6 +10,17 @@
 namespace viichain
 {
 
+enum class CacheEvictionPolicy
+{
+    // Evicts the least recently used of two random entries.
+    RANDOM,
+    // Counts how often keys are used in a FrequencySketch, evicts the least
+    // frequently used of a few random entries, and only admits a new key if
+    // it has been used at least as often as the entry it would replace, so
+    // that a scan over keys used once does not push out hot entries.
+    TINY_LFU
+};
+
 template <typename K, typename V>
 class RandomEvictionCache : public NonMovableOrCopyable
 {
@@ -20,15 +32,24 @@ class RandomEvictionCache : public NonMovableOrCopyable
         uint64_t mInserts{0};
         uint64_t mUpdates{0};
         uint64_t mEvicts{0};
+        // New keys that TINY_LFU did not admit or that exceed maxBytes.
+        uint64_t mRejects{0};
     };
 
   private:
         size_t mMaxSize;
+    // 0 if only the number of entries is limited.
+    size_t const mMaxBytes;
+    size_t mBytes{0};
+    CacheEvictionPolicy const mPolicy;
+    FrequencySketch mSketch;
+    static constexpr size_t kTinyLfuSamples = 5;
 
             uint64_t mGeneration{0};
     struct CacheValue
     {
         uint64_t mLastAccess;
+        size_t mBytes;
         V mValue;
     };
 
@@ -47,18 +68,105 @@ class RandomEvictionCache : public NonMovableOrCopyable
         {
             return;
         }
-        MapValueType*& vp1 = mValuePtrs.at(rand_uniform<size_t>(0, sz - 1));
-        MapValueType*& vp2 = mValuePtrs.at(rand_uniform<size_t>(0, sz - 1));
-        MapValueType*& victim =
-            (vp1->second.mLastAccess < vp2->second.mLastAccess ? vp1 : vp2);
-        mValueMap.erase(victim->first);
-        std::swap(victim, mValuePtrs.back());
-        mValuePtrs.pop_back();
+        if (mPolicy == CacheEvictionPolicy::TINY_LFU)
+        {
+            removeAt(sampleLeastFrequent(sz));
+            ++mCounters.mEvicts;
+            return;
+        }
+        size_t i1 = rand_uniform<size_t>(0, sz - 1);
+        size_t i2 = rand_uniform<size_t>(0, sz - 1);
+        removeAt(mValuePtrs[i1]->second.mLastAccess <
+                         mValuePtrs[i2]->second.mLastAccess
+                     ? i1
+                     : i2);
         ++mCounters.mEvicts;
     }
 
+    // Removes the entry at index i of mValuePtrs, moving the last one there.
+    void
+    removeAt(size_t i)
+    {
+        MapValueType*& vp = mValuePtrs[i];
+        mBytes -= vp->second.mBytes;
+        mValueMap.erase(vp->first);
+        std::swap(vp, mValuePtrs.back());
+        mValuePtrs.pop_back();
+    }
+
+    bool
+    overBudget() const
+    {
+        return mValuePtrs.size() > mMaxSize ||
+               (mMaxBytes != 0 && mBytes > mMaxBytes);
+    }
+
+    size_t
+    hashKey(K const& k) const
+    {
+        return mValueMap.hash_function()(k);
+    }
+
+    // Index of the least frequently used, then least recently used, of a few
+    // random entries among the first n of mValuePtrs.
+    size_t
+    sampleLeastFrequent(size_t n) const
+    {
+        size_t victim = rand_uniform<size_t>(0, n - 1);
+        auto victimFreq = mSketch.estimate(hashKey(mValuePtrs[victim]->first));
+        for (size_t i = 1; i < kTinyLfuSamples; ++i)
+        {
+            size_t candidate = rand_uniform<size_t>(0, n - 1);
+            auto const& value = *mValuePtrs[candidate];
+            auto freq = mSketch.estimate(hashKey(value.first));
+            if (freq < victimFreq ||
+                (freq == victimFreq &&
+                 value.second.mLastAccess <
+                     mValuePtrs[victim]->second.mLastAccess))
+            {
+                victim = candidate;
+                victimFreq = freq;
+            }
+        }
+        return victim;
+    }
+
+    // Called with the newest entry at the back of mValuePtrs. Evicts the
+    // least frequently used of a few other random entries, or the newest
+    // entry if it is used less often than that one. Returns whether the
+    // newest entry was kept, in which case it is still at the back.
+    bool
+    evictOrReject()
+    {
+        size_t newest = mValuePtrs.size() - 1;
+        if (newest > 0)
+        {
+            size_t victim = sampleLeastFrequent(newest);
+            if (mSketch.estimate(hashKey(mValuePtrs[newest]->first)) >=
+                mSketch.estimate(hashKey(mValuePtrs[victim]->first)))
+            {
+                removeAt(victim);
+                std::swap(mValuePtrs[victim], mValuePtrs.back());
+                ++mCounters.mEvicts;
+                return true;
+            }
+        }
+        removeAt(newest);
+        ++mCounters.mRejects;
+        return false;
+    }
+
   public:
-    explicit RandomEvictionCache(size_t maxSize) : mMaxSize(maxSize)
+    // Holds at most maxSize entries and, unless maxBytes is 0, entries of at
+    // most maxBytes in total, as sized by the callers of put.
+    explicit RandomEvictionCache(
+        size_t maxSize,
+        CacheEvictionPolicy policy = CacheEvictionPolicy::RANDOM,
+        size_t maxBytes = 0)
+        : mMaxSize(maxSize)
+        , mMaxBytes(maxBytes)
+        , mPolicy(policy)
+        , mSketch(policy == CacheEvictionPolicy::TINY_LFU ? maxSize : 0)
     {
         mValueMap.reserve(maxSize + 1);
         mValuePtrs.reserve(maxSize + 1);
@@ -76,34 +184,82 @@ class RandomEvictionCache : public NonMovableOrCopyable
         return mValueMap.size();
     }
 
+    size_t
+    maxBytes() const
+    {
+        return mMaxBytes;
+    }
+
+    // Total of the sizes given to put for the entries in the cache.
+    size_t
+    bytes() const
+    {
+        return mBytes;
+    }
+
+    CacheEvictionPolicy
+    policy() const
+    {
+        return mPolicy;
+    }
+
     Counters const&
     getCounters() const
     {
         return mCounters;
     }
 
-                void
-    put(K const& k, V const& v)
+    // Caches v, of size bytes, under k. Returns false if k is not cached
+    // afterwards, because the policy did not admit it or it was evicted to
+    // stay within maxBytes.
+    bool
+    put(K const& k, V const& v, size_t bytes = 0)
     {
+        if (mMaxBytes != 0 && bytes > mMaxBytes &&
+            mValueMap.find(k) == mValueMap.end())
+        {
+            ++mCounters.mRejects;
+            return false;
+        }
         ++mGeneration;
-        CacheValue newValue{mGeneration, v};
+        mSketch.add(hashKey(k));
+        CacheValue newValue{mGeneration, bytes, v};
         auto pair = mValueMap.insert(std::make_pair(k, newValue));
         if (pair.second)
         {
                                                             MapValueType& inserted = *pair.first;
             mValuePtrs.push_back(&inserted);
+            mBytes += bytes;
             ++mCounters.mInserts;
-                        if (mValuePtrs.size() > mMaxSize)
+            if (mPolicy == CacheEvictionPolicy::TINY_LFU)
             {
-                evictOne();
+                while (overBudget())
+                {
+                    if (!evictOrReject())
+                    {
+                        return false;
+                    }
+                }
+                return true;
             }
         }
         else
         {
                         CacheValue& existing = pair.first->second;
+            mBytes = mBytes - existing.mBytes + bytes;
             existing = newValue;
             ++mCounters.mUpdates;
         }
+
+        if (!overBudget())
+        {
+            return true;
+        }
+        do
+        {
+            evictOne();
+        } while (overBudget());
+        return mValueMap.find(k) != mValueMap.end();
     }
 
         bool
@@ -122,6 +278,7 @@ class RandomEvictionCache : public NonMovableOrCopyable
     {
         mValuePtrs.clear();
         mValueMap.clear();
+        mBytes = 0;
     }
 
             void
@@ -132,9 +289,7 @@ class RandomEvictionCache : public NonMovableOrCopyable
             MapValueType*& vp = mValuePtrs.at(i);
             while (mValuePtrs.size() != i && f(vp->second.mValue))
             {
-                                                                                                mValueMap.erase(vp->first);
-                std::swap(vp, mValuePtrs.back());
-                mValuePtrs.pop_back();
+                removeAt(i);
             }
         }
     }
@@ -147,6 +302,7 @@ class RandomEvictionCache : public NonMovableOrCopyable
         {
             auto& cacheVal = it->second;
             ++mCounters.mHits;
+            mSketch.add(hashKey(k));
             cacheVal.mLastAccess = ++mGeneration;
             return cacheVal.mValue;
         }
@@ -156,4 +312,7 @@ class RandomEvictionCache : public NonMovableOrCopyable
         }
     }
 };
+
+template <typename K, typename V>
+constexpr size_t RandomEvictionCache<K, V>::kTinyLfuSamples;
 }
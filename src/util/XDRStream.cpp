@@ -0,0 +1,463 @@
+
+#include "util/XDRStream.h"
+#include "util/Fs.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace viichain
+{
+
+namespace
+{
+char*
+alignBlock(std::vector<char>& storage, size_t blockSize)
+{
+    auto align = XDRBufferedInputFileStream::kBlockAlignment;
+    storage.resize(blockSize + align);
+    auto addr = reinterpret_cast<uintptr_t>(storage.data());
+    return storage.data() + ((align - addr % align) % align);
+}
+
+int
+seekFile(std::FILE* file, size_t pos)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(pos), SEEK_SET);
+#else
+    return fseeko(file, static_cast<off_t>(pos), SEEK_SET);
+#endif
+}
+
+int
+truncateFile(std::FILE* file, size_t size)
+{
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), static_cast<__int64>(size));
+#else
+    return ftruncate(fileno(file), static_cast<off_t>(size));
+#endif
+}
+
+std::string
+errnoMessage(std::string msg)
+{
+    msg += ", reason: ";
+    msg += std::to_string(errno);
+    return msg;
+}
+}
+
+XDRBufferedInputFileStream::XDRBufferedInputFileStream(unsigned int sizeLimit,
+                                                       size_t blockSize)
+    : mBlockSize(blockSize), mSizeLimit(sizeLimit)
+{
+    assert(blockSize >= 4);
+}
+
+XDRBufferedInputFileStream::~XDRBufferedInputFileStream()
+{
+    close();
+}
+
+void
+XDRBufferedInputFileStream::open(std::string const& filename, bool sequential)
+{
+    if (mFile)
+    {
+        throw FileSystemException("XDR file already open: " + filename);
+    }
+    mFile = std::fopen(filename.c_str(), "rb");
+    if (!mFile)
+    {
+        auto msg = errnoMessage("failed to open XDR file: " + filename);
+        CLOG(ERROR, "Fs") << msg;
+        throw FileSystemException(msg);
+    }
+    std::setvbuf(mFile, nullptr, _IONBF, 0);
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (sequential)
+    {
+        posix_fadvise(fileno(mFile), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#else
+    (void)sequential;
+#endif
+
+    size_t capacity = mBlockSize;
+    mSize = fs::size(filename);
+    try
+    {
+        if (BlockCompressedReader::isCompressed(mFile))
+        {
+            mCompressed = std::make_unique<BlockCompressedReader>(mFile);
+            mSize = mCompressed->size();
+            // A block is only decompressed when the buffer holds less than
+            // mBlockSize bytes, so this always leaves room for it.
+            capacity += mCompressed->blockSize();
+        }
+        else if (seekFile(mFile, 0) != 0)
+        {
+            throw FileSystemException(
+                errnoMessage("failed to seek XDR file: " + filename));
+        }
+    }
+    catch (...)
+    {
+        close();
+        throw;
+    }
+
+    if (mCapacity < capacity)
+    {
+        mBuffer = alignBlock(mStorage, capacity);
+        mCapacity = capacity;
+    }
+    mBlock = mBuffer;
+    mBlockOffset = 0;
+    mCur = 0;
+    mEnd = 0;
+    mGood = true;
+}
+
+void
+XDRBufferedInputFileStream::open(std::shared_ptr<MappedFile const> mapping)
+{
+    if (mFile || mMapping)
+    {
+        throw FileSystemException("XDR file already open");
+    }
+    mMapping = mapping;
+    mBlock = mMapping->data();
+    mSize = mMapping->size();
+    mBlockOffset = 0;
+    mCur = 0;
+    mEnd = mSize;
+    mGood = true;
+}
+
+void
+XDRBufferedInputFileStream::close()
+{
+    if (mFile)
+    {
+        std::fclose(mFile);
+        mFile = nullptr;
+    }
+    mCompressed.reset();
+    mMapping.reset();
+    mBlock = nullptr;
+    mBlockOffset = 0;
+    mCur = 0;
+    mEnd = 0;
+    mGood = false;
+}
+
+bool
+XDRBufferedInputFileStream::fill(size_t n)
+{
+    if (mEnd - mCur >= n)
+    {
+        return true;
+    }
+    if (!mFile)
+    {
+        return false;
+    }
+    assert(n <= mBlockSize);
+    if (mCur > 0)
+    {
+        std::memmove(mBuffer, mBuffer + mCur, mEnd - mCur);
+        mBlockOffset += mCur;
+        mEnd -= mCur;
+        mCur = 0;
+    }
+    while (mEnd < n)
+    {
+        if (mCompressed)
+        {
+            if (mBlockOffset + mEnd >= mSize)
+            {
+                return false;
+            }
+            appendBlock();
+            continue;
+        }
+        auto got = std::fread(mBuffer + mEnd, 1, mBlockSize - mEnd, mFile);
+        if (got == 0)
+        {
+            if (std::ferror(mFile))
+            {
+                throw FileSystemException(
+                    errnoMessage("failed to read XDR file"));
+            }
+            return false;
+        }
+        mEnd += got;
+    }
+    return true;
+}
+
+// Decompresses the block that starts at the end of the buffered data, which
+// is always block aligned in compressed mode, and appends it to the buffer.
+void
+XDRBufferedInputFileStream::appendBlock()
+{
+    auto bs = mCompressed->blockSize();
+    assert((mBlockOffset + mEnd) % bs == 0);
+    assert(mEnd + bs <= mCapacity);
+    mEnd += mCompressed->readBlock((mBlockOffset + mEnd) / bs, mBuffer + mEnd);
+}
+
+bool
+XDRBufferedInputFileStream::readSize(uint32_t& sz)
+{
+    if (!fill(4))
+    {
+        mGood = false;
+        return false;
+    }
+    auto b = reinterpret_cast<unsigned char const*>(mBlock + mCur);
+    sz = (static_cast<uint32_t>(b[0] & 0x7f) << 24) |
+         (static_cast<uint32_t>(b[1]) << 16) |
+         (static_cast<uint32_t>(b[2]) << 8) | static_cast<uint32_t>(b[3]);
+    mCur += 4;
+    return true;
+}
+
+char const*
+XDRBufferedInputFileStream::readRecord(uint32_t sz)
+{
+    if (sz <= mBlockSize || !mFile || mEnd - mCur >= sz)
+    {
+        if (!fill(sz))
+        {
+            mGood = false;
+            throw xdr::xdr_runtime_error("malformed XDR file");
+        }
+        char const* data = mBlock + mCur;
+        mCur += sz;
+        return data;
+    }
+
+    // Records larger than a block are read around the buffer.
+    size_t have = mEnd - mCur;
+    mRecordBuf.resize(sz);
+    std::memcpy(mRecordBuf.data(), mBlock + mCur, have);
+    mBlockOffset += mEnd;
+    mCur = 0;
+    mEnd = 0;
+    if (mCompressed)
+    {
+        while (have < sz)
+        {
+            mBlockOffset += mEnd;
+            mEnd = 0;
+            if (mBlockOffset >= mSize)
+            {
+                mGood = false;
+                throw xdr::xdr_runtime_error("malformed XDR file");
+            }
+            appendBlock();
+            mCur = std::min(mEnd, sz - have);
+            std::memcpy(mRecordBuf.data() + have, mBuffer, mCur);
+            have += mCur;
+        }
+        return mRecordBuf.data();
+    }
+    auto got = std::fread(mRecordBuf.data() + have, 1, sz - have, mFile);
+    mBlockOffset += got;
+    if (have + got < sz)
+    {
+        mGood = false;
+        throw xdr::xdr_runtime_error("malformed XDR file");
+    }
+    return mRecordBuf.data();
+}
+
+void
+XDRBufferedInputFileStream::seek(size_t pos)
+{
+    mGood = mFile != nullptr || mMapping != nullptr;
+    if (pos >= mBlockOffset && pos <= mBlockOffset + mEnd)
+    {
+        mCur = pos - mBlockOffset;
+        return;
+    }
+    if (mCompressed)
+    {
+        // Restart the buffer at the block holding pos.
+        auto bs = mCompressed->blockSize();
+        mBlockOffset = pos < mSize ? pos - pos % bs : pos;
+        mEnd = 0;
+        if (pos < mSize)
+        {
+            appendBlock();
+        }
+        mCur = pos - mBlockOffset;
+        return;
+    }
+    if (!mFile || seekFile(mFile, pos) != 0)
+    {
+        throw FileSystemException(errnoMessage("failed to seek XDR file"));
+    }
+    mBlockOffset = pos;
+    mCur = 0;
+    mEnd = 0;
+}
+
+bool
+XDRBufferedInputFileStream::skipOne()
+{
+    uint32_t sz;
+    if (!readSize(sz))
+    {
+        return false;
+    }
+    if (pos() + sz > mSize)
+    {
+        throw xdr::xdr_runtime_error("malformed XDR file");
+    }
+    seek(pos() + sz);
+    return true;
+}
+
+XDRBufferedOutputFileStream::XDRBufferedOutputFileStream(size_t blockSize)
+    : mBlockSize(blockSize)
+{
+    assert(blockSize >= 4);
+}
+
+XDRBufferedOutputFileStream::~XDRBufferedOutputFileStream()
+{
+    if (mFile)
+    {
+        try
+        {
+            flush();
+        }
+        catch (FileSystemException&)
+        {
+        }
+        std::fclose(mFile);
+    }
+}
+
+void
+XDRBufferedOutputFileStream::open(std::string const& filename, bool compress)
+{
+    if (mFile)
+    {
+        throw FileSystemException("XDR file already open: " + filename);
+    }
+    mFile = std::fopen(filename.c_str(), "wb");
+    if (!mFile)
+    {
+        auto msg = errnoMessage("failed to open XDR file: " + filename);
+        CLOG(FATAL, "Fs") << msg;
+        throw FileSystemException(msg);
+    }
+    std::setvbuf(mFile, nullptr, _IONBF, 0);
+    if (compress)
+    {
+        try
+        {
+            mCompressor = std::make_unique<BlockCompressedWriter>(mFile);
+        }
+        catch (...)
+        {
+            std::fclose(mFile);
+            mFile = nullptr;
+            throw;
+        }
+    }
+    if (!mBlock)
+    {
+        mBlock = alignBlock(mStorage, mBlockSize);
+    }
+    mEnd = 0;
+}
+
+void
+XDRBufferedOutputFileStream::openAt(std::string const& filename, size_t offset)
+{
+    if (mFile)
+    {
+        throw FileSystemException("XDR file already open: " + filename);
+    }
+    mFile = std::fopen(filename.c_str(), "r+b");
+    if (!mFile)
+    {
+        auto msg = errnoMessage("failed to open XDR file: " + filename);
+        CLOG(ERROR, "Fs") << msg;
+        throw FileSystemException(msg);
+    }
+    std::setvbuf(mFile, nullptr, _IONBF, 0);
+    if (truncateFile(mFile, offset) != 0 || seekFile(mFile, offset) != 0)
+    {
+        auto msg = errnoMessage("failed to truncate XDR file: " + filename);
+        std::fclose(mFile);
+        mFile = nullptr;
+        throw FileSystemException(msg);
+    }
+    if (!mBlock)
+    {
+        mBlock = alignBlock(mStorage, mBlockSize);
+    }
+    mEnd = 0;
+}
+
+void
+XDRBufferedOutputFileStream::writeBytes(char const* data, size_t n)
+{
+    if (mCompressor)
+    {
+        mCompressor->write(data, n);
+        return;
+    }
+    if (std::fwrite(data, 1, n, mFile) != n)
+    {
+        throw FileSystemException(errnoMessage("failed to write XDR file"));
+    }
+}
+
+void
+XDRBufferedOutputFileStream::flush()
+{
+    if (mFile && mEnd > 0)
+    {
+        writeBytes(mBlock, mEnd);
+        mEnd = 0;
+    }
+}
+
+void
+XDRBufferedOutputFileStream::close()
+{
+    if (!mFile)
+    {
+        throw FileSystemException(errnoMessage("failed to close XDR file"));
+    }
+    flush();
+    if (mCompressor)
+    {
+        mCompressor->finish();
+        mCompressor.reset();
+    }
+    auto res = std::fclose(mFile);
+    mFile = nullptr;
+    if (res != 0)
+    {
+        throw FileSystemException(errnoMessage("failed to close XDR file"));
+    }
+}
+}
@@ -3,12 +3,16 @@
 
 #include "crypto/ByteSlice.h"
 #include "crypto/SHA.h"
+#include "util/BlockCompressedFile.h"
 #include "util/FileSystemException.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
 #include "xdrpp/marshal.h"
 
+#include <cstdio>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -22,6 +26,26 @@ class XDRInputFileStream
     size_t mSizeLimit;
     size_t mSize;
 
+    bool
+    readSize(uint32_t& sz)
+    {
+        char szBuf[4];
+        if (!mIn.read(szBuf, 4))
+        {
+            return false;
+        }
+
+        sz = 0;
+        sz |= static_cast<uint8_t>(szBuf[0] & '\x7f');
+        sz <<= 8;
+        sz |= static_cast<uint8_t>(szBuf[1]);
+        sz <<= 8;
+        sz |= static_cast<uint8_t>(szBuf[2]);
+        sz <<= 8;
+        sz |= static_cast<uint8_t>(szBuf[3]);
+        return true;
+    }
+
   public:
     XDRInputFileStream(unsigned int sizeLimit = 0) : mSizeLimit{sizeLimit}
     {
@@ -69,25 +93,40 @@ class XDRInputFileStream
         return mIn.tellg();
     }
 
+    void
+    seek(size_t pos)
+    {
+        mIn.clear();
+        mIn.seekg(pos);
+    }
+
+    // Skips over the next record without decoding it.
+    bool
+    skipOne()
+    {
+        uint32_t sz;
+        if (!readSize(sz))
+        {
+            return false;
+        }
+        if (pos() + sz > mSize)
+        {
+            throw xdr::xdr_runtime_error("malformed XDR file");
+        }
+        mIn.seekg(sz, std::ios_base::cur);
+        return true;
+    }
+
     template <typename T>
     bool
     readOne(T& out)
     {
-        char szBuf[4];
-        if (!mIn.read(szBuf, 4))
+        uint32_t sz;
+        if (!readSize(sz))
         {
             return false;
         }
 
-                        uint32_t sz = 0;
-        sz |= static_cast<uint8_t>(szBuf[0] & '\x7f');
-        sz <<= 8;
-        sz |= static_cast<uint8_t>(szBuf[1]);
-        sz <<= 8;
-        sz |= static_cast<uint8_t>(szBuf[2]);
-        sz <<= 8;
-        sz |= static_cast<uint8_t>(szBuf[3]);
-
         if (mSizeLimit != 0 && sz > mSizeLimit)
         {
             return false;
@@ -188,4 +227,186 @@ class XDROutputFileStream
         }
     }
 };
+
+// Reads XDR records through a large aligned block buffer that it refills
+// itself. A record that lies within the buffered block is decoded in place,
+// with no per-record calls into the C library. When opened on a MappedFile
+// the whole mapping serves as the block, so records are decoded straight
+// from the mapped pages. Files written in the block-compressed format are
+// detected on open and read through their decompressed blocks.
+class XDRBufferedInputFileStream
+{
+    std::FILE* mFile{nullptr};
+    std::shared_ptr<MappedFile const> mMapping;
+    std::unique_ptr<BlockCompressedReader> mCompressed;
+    std::vector<char> mStorage;
+    char* mBuffer{nullptr};
+    size_t mCapacity{0};
+    char const* mBlock{nullptr};
+    size_t mBlockSize;
+    size_t mBlockOffset{0};
+    size_t mCur{0};
+    size_t mEnd{0};
+    size_t mSize{0};
+    size_t mSizeLimit;
+    bool mGood{false};
+    std::vector<char> mRecordBuf;
+
+    bool fill(size_t n);
+    void appendBlock();
+    bool readSize(uint32_t& sz);
+    char const* readRecord(uint32_t sz);
+
+  public:
+    static constexpr size_t kDefaultBlockSize = 1024 * 1024;
+    static constexpr size_t kBlockAlignment = 4096;
+
+    explicit XDRBufferedInputFileStream(
+        unsigned int sizeLimit = 0, size_t blockSize = kDefaultBlockSize);
+    ~XDRBufferedInputFileStream();
+
+    XDRBufferedInputFileStream(XDRBufferedInputFileStream const&) = delete;
+    XDRBufferedInputFileStream&
+    operator=(XDRBufferedInputFileStream const&) = delete;
+
+    // With sequential set, the kernel is advised that the file will be read
+    // front to back, where the platform supports posix_fadvise.
+    void open(std::string const& filename, bool sequential = false);
+    void open(std::shared_ptr<MappedFile const> mapping);
+    void close();
+
+    operator bool() const
+    {
+        return mGood;
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+
+    size_t
+    pos() const
+    {
+        return mBlockOffset + mCur;
+    }
+
+    void seek(size_t pos);
+
+    // Skips over the next record without decoding it.
+    bool skipOne();
+
+    template <typename T>
+    bool
+    readOne(T& out)
+    {
+        uint32_t sz;
+        if (!readSize(sz))
+        {
+            return false;
+        }
+        if (mSizeLimit != 0 && sz > mSizeLimit)
+        {
+            return false;
+        }
+        char const* data = readRecord(sz);
+        xdr::xdr_get g(data, data + sz);
+        xdr::xdr_argpack_archive(g, out);
+        return true;
+    }
+};
+
+// Writes XDR records by encoding them directly into a large aligned block
+// buffer, which is written out whenever it fills up.
+class XDRBufferedOutputFileStream
+{
+    std::FILE* mFile{nullptr};
+    std::unique_ptr<BlockCompressedWriter> mCompressor;
+    std::vector<char> mStorage;
+    char* mBlock{nullptr};
+    size_t mBlockSize;
+    size_t mEnd{0};
+    std::vector<char> mRecordBuf;
+
+    void writeBytes(char const* data, size_t n);
+
+  public:
+    explicit XDRBufferedOutputFileStream(
+        size_t blockSize = XDRBufferedInputFileStream::kDefaultBlockSize);
+    ~XDRBufferedOutputFileStream();
+
+    XDRBufferedOutputFileStream(XDRBufferedOutputFileStream const&) = delete;
+    XDRBufferedOutputFileStream&
+    operator=(XDRBufferedOutputFileStream const&) = delete;
+
+    // With compress set, the file is written in the block-compressed format.
+    void open(std::string const& filename, bool compress = false);
+
+    // Opens an existing uncompressed file, truncated to offset, to append to
+    // it.
+    void openAt(std::string const& filename, size_t offset);
+
+    void flush();
+    void close();
+
+    operator bool() const
+    {
+        return mFile != nullptr;
+    }
+
+    template <typename T>
+    void
+    writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
+    {
+        if (!mFile)
+        {
+            throw FileSystemException("XDR file is not open for writing");
+        }
+        uint32_t sz = (uint32_t)xdr::xdr_size(t);
+        assert(sz < 0x80000000);
+        size_t total = size_t{sz} + 4;
+
+        if (mEnd + total > mBlockSize)
+        {
+            flush();
+        }
+        char* buf;
+        if (total <= mBlockSize)
+        {
+            buf = mBlock + mEnd;
+        }
+        else
+        {
+            mRecordBuf.resize(total);
+            buf = mRecordBuf.data();
+        }
+
+        buf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        buf[1] = static_cast<char>((sz >> 16) & 0xFF);
+        buf[2] = static_cast<char>((sz >> 8) & 0xFF);
+        buf[3] = static_cast<char>(sz & 0xFF);
+
+        xdr::xdr_put p(buf + 4, buf + total);
+        xdr_argpack_archive(p, t);
+
+        if (total <= mBlockSize)
+        {
+            mEnd += total;
+        }
+        else
+        {
+            writeBytes(buf, total);
+        }
+
+        if (hasher)
+        {
+            hasher->add(ByteSlice(buf, total));
+        }
+        if (bytesPut)
+        {
+            *bytesPut += total;
+        }
+    }
+};
 }
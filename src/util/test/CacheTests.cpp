@@ -96,6 +96,80 @@ TEST_CASE("cachetable does not thrash", "[randomevictioncachethrash][!hide]")
     REQUIRE(ctrs.mEvicts < 11);
 }
 
+TEST_CASE("tiny-lfu cache keeps hot keys through a scan",
+          "[randomevictioncache]")
+{
+    // Half of the cache is used by hot keys, read in turn between inserts
+    // of keys that are used once.
+    auto hotMisses = [](CacheEvictionPolicy policy) {
+        RandomEvictionCache<int, int> cache(100, policy);
+        int hotKeys = 50;
+        int misses = 0;
+        for (int i = 0; i < 10000; ++i)
+        {
+            cache.put(hotKeys + i, i);
+            int hot = i % hotKeys;
+            if (cache.exists(hot))
+            {
+                REQUIRE(cache.get(hot) == hot);
+            }
+            else
+            {
+                cache.put(hot, hot);
+                if (i >= 1000)
+                {
+                    ++misses;
+                }
+            }
+        }
+        if (policy == CacheEvictionPolicy::TINY_LFU)
+        {
+            REQUIRE(cache.getCounters().mRejects > 0);
+        }
+        REQUIRE(cache.size() == 100);
+        return misses;
+    };
+
+    auto lfuMisses = hotMisses(CacheEvictionPolicy::TINY_LFU);
+    auto randomMisses = hotMisses(CacheEvictionPolicy::RANDOM);
+    REQUIRE(lfuMisses < 100);
+    REQUIRE(lfuMisses * 10 < randomMisses);
+}
+
+TEST_CASE("cache stays within its byte budget", "[randomevictioncache]")
+{
+    for (auto policy :
+         {CacheEvictionPolicy::RANDOM, CacheEvictionPolicy::TINY_LFU})
+    {
+        RandomEvictionCache<int, int> cache(1000, policy, 100);
+        auto const& ctrs = cache.getCounters();
+        for (int i = 0; i < 10; ++i)
+        {
+            REQUIRE(cache.put(i, i, 10));
+        }
+        REQUIRE(cache.size() == 10);
+        REQUIRE(cache.bytes() == 100);
+        REQUIRE(ctrs.mEvicts == 0);
+
+        // Growing an entry evicts others, or the entry itself.
+        cache.put(0, 0, 40);
+        REQUIRE(cache.bytes() <= 100);
+        REQUIRE(ctrs.mEvicts >= 1);
+
+        cache.put(10, 10, 30);
+        REQUIRE(cache.bytes() <= 100);
+        REQUIRE(cache.size() < 10);
+
+        auto size = cache.size();
+        REQUIRE(!cache.put(11, 11, 101));
+        REQUIRE(!cache.exists(11, false));
+        REQUIRE(cache.size() == size);
+
+        cache.erase_if([](int) { return true; });
+        REQUIRE(cache.bytes() == 0);
+    }
+}
+
 using RandCache = RandomEvictionCache<int, int>;
 using LruCache = cache::lru_cache<int, int>;
 
@@ -0,0 +1,106 @@
+#include "lib/catch.hpp"
+#include "util/Arena.h"
+#include "util/Math.h"
+#include "util/OpenAddressingMap.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace viichain;
+
+namespace
+{
+// Sends every key to one of a few home slots so that probe sequences
+// overlap and wrap around the table.
+struct CollidingHash
+{
+    size_t
+    operator()(int key) const
+    {
+        return static_cast<size_t>(key % 5);
+    }
+};
+
+template <typename Hash>
+void
+checkAgainstUnorderedMap()
+{
+    OpenAddressingMap<int, std::shared_ptr<int>, Hash> map;
+    std::unordered_map<int, std::shared_ptr<int>> expected;
+
+    std::uniform_int_distribution<int> keys(0, 300);
+    std::uniform_int_distribution<int> ops(0, 3);
+    for (int i = 0; i < 20000; ++i)
+    {
+        auto key = keys(gRandomEngine);
+        auto value = std::make_shared<int>(i);
+        switch (ops(gRandomEngine))
+        {
+        case 0:
+            REQUIRE(map.emplace(key, value).second ==
+                    expected.emplace(key, value).second);
+            break;
+        case 1:
+            map[key] = value;
+            expected[key] = value;
+            break;
+        case 2:
+            REQUIRE(map.erase(key) == expected.erase(key));
+            break;
+        default:
+        {
+            auto iter = map.find(key);
+            REQUIRE((iter != map.end()) == (expected.count(key) == 1));
+            if (iter != map.end())
+            {
+                REQUIRE(iter->second == expected.at(key));
+                map.erase(iter);
+                expected.erase(key);
+            }
+        }
+        }
+        REQUIRE(map.size() == expected.size());
+    }
+
+    size_t n = 0;
+    for (auto const& kv : map)
+    {
+        REQUIRE(expected.at(kv.first) == kv.second);
+        ++n;
+    }
+    REQUIRE(n == expected.size());
+}
+}
+
+TEST_CASE("open addressing map matches unordered_map", "[openaddressingmap]")
+{
+    SECTION("std::hash")
+    {
+        checkAgainstUnorderedMap<std::hash<int>>();
+    }
+    SECTION("colliding hash")
+    {
+        checkAgainstUnorderedMap<CollidingHash>();
+    }
+}
+
+TEST_CASE("arena outlives its allocations", "[openaddressingmap][arena]")
+{
+    auto arena = std::make_shared<Arena>();
+    std::weak_ptr<Arena> weak = arena;
+
+    std::vector<std::shared_ptr<std::string>> strings;
+    for (int i = 0; i < 1000; ++i)
+    {
+        strings.emplace_back(std::allocate_shared<std::string>(
+            ArenaAllocator<std::string>(arena), std::to_string(i)));
+    }
+    REQUIRE(arena->bytesAllocated() >= 1000 * sizeof(std::string));
+
+    arena.reset();
+    REQUIRE(!weak.expired());
+    REQUIRE(*strings[999] == "999");
+    strings.clear();
+    REQUIRE(weak.expired());
+}
@@ -2,10 +2,31 @@
 #include "bucket/Bucket.h"
 #include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
+#include "util/Logging.h"
+#include "util/TmpDir.h"
 #include "util/XDRStream.h"
 
+#include <chrono>
+
 using namespace viichain;
 
+namespace
+{
+std::vector<BucketEntry>
+generateBucketEntries(size_t n)
+{
+    auto ledgerEntries = LedgerTestUtils::generateValidLedgerEntries(n);
+    return Bucket::convertToBucketEntry(false, {}, ledgerEntries, {});
+}
+
+double
+megabytesPerSecond(size_t bytes, std::chrono::steady_clock::duration d)
+{
+    auto secs = std::chrono::duration<double>(d).count();
+    return secs > 0 ? (bytes / (1024.0 * 1024.0)) / secs : 0;
+}
+}
+
 TEST_CASE("XDROutputFileStream fail modes", "[xdrstream]")
 {
     XDROutputFileStream out;
@@ -33,3 +54,120 @@ TEST_CASE("XDROutputFileStream fail modes", "[xdrstream]")
         REQUIRE_THROWS_AS(out.close(), std::runtime_error);
     }
 }
+
+TEST_CASE("XDR buffered streams round trip", "[xdrstream]")
+{
+    TmpDir dir("xdrstream");
+    auto filename = dir.getName() + "/entries.xdr";
+    auto entries = generateBucketEntries(1000);
+
+    // A small block size forces records across block boundaries.
+    for (size_t blockSize :
+         {size_t(64), XDRBufferedInputFileStream::kDefaultBlockSize})
+    {
+        std::vector<size_t> offsets;
+        size_t bytes = 0;
+        auto hasher = SHA256::create();
+        {
+            XDRBufferedOutputFileStream out(blockSize);
+            out.open(filename);
+            for (auto const& e : entries)
+            {
+                offsets.emplace_back(bytes);
+                out.writeOne(e, hasher.get(), &bytes);
+            }
+            out.close();
+        }
+        REQUIRE(fs::size(filename) == bytes);
+
+        XDRInputFileStream plain;
+        plain.open(filename);
+        XDRBufferedInputFileStream in(0, blockSize);
+        in.open(filename, true);
+        BucketEntry be;
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            REQUIRE(in.pos() == offsets[i]);
+            REQUIRE(in.readOne(be));
+            REQUIRE(be == entries[i]);
+            REQUIRE(plain.readOne(be));
+            REQUIRE(be == entries[i]);
+        }
+        REQUIRE(!in.readOne(be));
+        REQUIRE(!in);
+
+        in.seek(offsets[500]);
+        REQUIRE(in.readOne(be));
+        REQUIRE(be == entries[500]);
+        in.seek(offsets[10]);
+        REQUIRE(in.skipOne());
+        REQUIRE(in.readOne(be));
+        REQUIRE(be == entries[11]);
+    }
+
+    XDRBufferedInputFileStream mapped;
+    mapped.open(std::make_shared<MappedFile>(filename));
+    BucketEntry be;
+    for (auto const& e : entries)
+    {
+        REQUIRE(mapped.readOne(be));
+        REQUIRE(be == e);
+    }
+    REQUIRE(!mapped.readOne(be));
+    mapped.seek(0);
+    REQUIRE(mapped.readOne(be));
+    REQUIRE(be == entries[0]);
+}
+
+TEST_CASE("XDR stream throughput", "[xdrstream][bench][!hide]")
+{
+    TmpDir dir("xdrstream");
+    auto filename = dir.getName() + "/entries.xdr";
+    auto entries = generateBucketEntries(10000);
+    size_t const rounds = 50;
+
+    auto timeWrite = [&](auto& out) {
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        out.open(filename);
+        for (size_t r = 0; r < rounds; ++r)
+        {
+            for (auto const& e : entries)
+            {
+                out.writeOne(e, nullptr, &bytes);
+            }
+        }
+        out.close();
+        return megabytesPerSecond(bytes,
+                                  std::chrono::steady_clock::now() - start);
+    };
+    auto timeRead = [&](auto& in) {
+        size_t n = 0;
+        BucketEntry be;
+        auto start = std::chrono::steady_clock::now();
+        while (in.readOne(be))
+        {
+            ++n;
+        }
+        REQUIRE(n == entries.size() * rounds);
+        return megabytesPerSecond(fs::size(filename),
+                                  std::chrono::steady_clock::now() - start);
+    };
+
+    XDROutputFileStream plainOut;
+    auto plainWrite = timeWrite(plainOut);
+    XDRBufferedOutputFileStream bufferedOut;
+    auto bufferedWrite = timeWrite(bufferedOut);
+
+    XDRInputFileStream plainIn;
+    plainIn.open(filename);
+    auto plainRead = timeRead(plainIn);
+    XDRBufferedInputFileStream bufferedIn;
+    bufferedIn.open(filename, true);
+    auto bufferedRead = timeRead(bufferedIn);
+
+    LOG(INFO) << "XDR write MB/s: stream " << plainWrite << ", buffered "
+              << bufferedWrite;
+    LOG(INFO) << "XDR read MB/s: stream " << plainRead << ", buffered "
+              << bufferedRead;
+}